@@ -0,0 +1,70 @@
+// kinebench [inifile] [samples] [json]
+//
+// Round-trip accuracy and throughput of every Kines type, see
+// kines/kineBench.h. The geometry comes from the [KINS] section of
+// inifile and the joint positions are drawn inside its [JOINT_n]
+// limits, without an inifile the default geometry and +-500 / +-180.
+// The results are also written to json, kinebench.json by default,
+// so they can be compared from build to build.
+#include "kines/kineBench.h"
+#include "emcParas.h"
+#include "emcIniFile.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+static void loadLimits(const char *filename, KinesBench::Options &opt)
+{
+    EmcIniFile iniFile;
+    bool opened = filename && iniFile.Open(filename);
+
+    for (int joint = 0; joint < EMCMOT_MAX_JOINTS; joint++) {
+        double minLimit = joint < 3 ? -500.0 : -180.0;
+        double maxLimit = joint < 3 ? 500.0 : 180.0;
+        if (opened) {
+            char jointString[16];
+            double lo = minLimit, hi = maxLimit;
+            snprintf(jointString, sizeof(jointString), "JOINT_%d", joint);
+            iniFile.Find(&lo, "MIN_LIMIT", jointString);
+            iniFile.Find(&hi, "MAX_LIMIT", jointString);
+            if (hi > lo) {
+                minLimit = lo;
+                maxLimit = hi;
+            }
+        }
+        opt.minLimit[joint] = minLimit;
+        opt.maxLimit[joint] = maxLimit;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *inifile = argc > 1 ? argv[1] : nullptr;
+    const char *json = argc > 3 ? argv[3] : "kinebench.json";
+    KinesBench::Options opt;
+
+    if (argc > 2)
+        opt.samples = atoi(argv[2]);
+    if (opt.samples <= 0) {
+        std::cerr << "usage: kinebench [inifile] [samples] [json]" << std::endl;
+        return 2;
+    }
+    if (inifile && 0 != EMCParas::iniKins(inifile)) {
+        std::cerr << "kinebench: can't load [KINS] from " << inifile << std::endl;
+        return 1;
+    }
+    loadLimits(inifile, opt);
+
+    std::vector<KinesBench::Result> results = KinesBench::Run(opt);
+    std::cout << KinesBench::ToText(results);
+
+    std::ofstream ofs(json);
+    ofs << KinesBench::ToJson(opt, results);
+    if (!ofs) {
+        std::cerr << "kinebench: can't write " << json << std::endl;
+        return 1;
+    }
+    std::cout << "Saved " << json << std::endl;
+    return 0;
+}
@@ -0,0 +1,79 @@
+// pathbench [inifile] [segments] [threads]
+//
+// Time of PathCheck::Run on a synthetic program, for every Kines type.
+// The program is a spiral of short lines with every third segment an
+// arc, C turning 0.01 degree per segment and an M6 between two tools
+// every 10000 segments. The limits are wide open so every segment is
+// checked. The geometry comes from the [KINS] section of inifile,
+// without one the default geometry.
+#include "kines/kinePathCheck.h"
+#include "emcParas.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static PathCheck::Program spiral(int segments)
+{
+    PathCheck::Program program{};
+    program.tools = {{1, 50.0}, {2, 80.0}};
+
+    for (int i = 0; i < segments; i++) {
+        PathCheck::Segment seg{};
+        seg.end.tran.x = 50.0 * std::sin(i * 0.001);
+        seg.end.tran.y = 50.0 * std::cos(i * 0.001);
+        seg.end.c = i * 0.01;
+        seg.line = i;
+        seg.arc = -1;
+        seg.tool = (i / 10000) % 2 + 1;
+        if (i % 3 == 0) {
+            seg.arc = (int)program.arcs.size();
+            program.arcs.push_back({{0.0, 0.0, 0.0}, {0.0, 0.0, -1.0}, 0});
+        }
+        program.segments.push_back(seg);
+    }
+
+    return program;
+}
+
+int main(int argc, char **argv)
+{
+    const char *inifile = argc > 1 ? argv[1] : nullptr;
+    int segments = argc > 2 ? atoi(argv[2]) : 1000000;
+    PathCheck::Options opt;
+
+    if (argc > 3)
+        opt.threads = atoi(argv[3]);
+    if (segments <= 0 || opt.threads < 0) {
+        std::cerr << "usage: pathbench [inifile] [segments] [threads]" << std::endl;
+        return 2;
+    }
+    if (inifile && 0 != EMCParas::iniKins(inifile)) {
+        std::cerr << "pathbench: can't load [KINS] from " << inifile << std::endl;
+        return 1;
+    }
+
+    PathCheck::Program program = spiral(segments);
+    PathCheck::Limits limits;
+    limits.joints = EMCMOT_MAX_JOINTS;
+    for (int joint = 0; joint < limits.joints; joint++) {
+        limits.jointMin[joint] = -1e9;
+        limits.jointMax[joint] = 1e9;
+    }
+
+    const struct {
+        int type;
+        const char *name;
+    } types[] = {
+        {Kines::kKineTypeIDENTITY, "IDENTITY"},
+        {Kines::kKineTypeFiveAxis, "FIVEAXIS"},
+        {Kines::kKineTypeXYZABTRT, "XYZABTRT"},
+        {Kines::kKineTypeXYZACTRT, "XYZACTRT"},
+    };
+    for (const auto &t : types) {
+        Kines::GetInstance().SetKineType(t.type);
+        PathCheck::Report report = PathCheck::Run(program, limits, opt);
+        std::cout << t.name << " " << PathCheck::ToText(report) << std::endl;
+    }
+
+    return 0;
+}
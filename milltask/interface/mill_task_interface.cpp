@@ -5,7 +5,15 @@
 #include <stdexcept>
 #include "emcLog.h"
 #include "cmdtask.h"
+#include "telemtask.h"
 #include "motionTask.h"
+#include "emcParas.h"
+#include "emcTrace.h"
+#include "motionStatus.h"
+
+static_assert(IMillTaskInterface::kStatusChgAxis == MOT_STATUS_CHG_AXIS &&
+              IMillTaskInterface::kStatusChgMotion == MOT_STATUS_CHG_MOTION,
+              "status change bits differ from motionStatus.h");
 
 // Concrete implementation of the interface
 class MillTaskImplementation : public IMillTaskInterface {
@@ -15,17 +23,26 @@ public:
         millTask_ = new MillTask(emcfile);
         motTask_ = new MotTask;
         cmdTask_ = new CmdTask;
+        telemTask_ = new TelemTask;
     }
 
     ~MillTaskImplementation() override {
-        // Cleanup code
+        // Producers first: the console feeds the mill and motion
+        // lanes, the mill feeds the motion lanes. TelemTask reads the
+        // ring ~MotTask closes, so it has to be gone before that
+        delete cmdTask_;
+        delete millTask_;
+        delete telemTask_;
+        delete motTask_;
     }
 
     void initialize() override {
-        // Initialization logic
+        // Initialization logic, called on the GUI thread
+        EMCTrace::ThreadName("GUI");
         millTask_->doWork();
         motTask_->doWork();
         cmdTask_->doWork();
+        telemTask_->doWork();
     }
 
     void processData(const char* input, char* output, int size) override {
@@ -58,14 +75,29 @@ public:
         return 0;
     }
 
+    int checkfile(const char *filename, std::string &res, std::string &err) override {
+        return millTask_->check_file(filename, res, err);
+    }
+
     int getlog(std::string &log, int &level) override {
         return EMCLog::GetLog(log, level);
     }
 
+    int getlog(std::string &log, int &level, long long &timeNs) override {
+        int64_t ns = 0;
+        int res = EMCLog::GetLog(log, level, ns);
+        timeNs = ns;
+        return res;
+    }
+
     void setCmd(std::string &cmd) override {
         cmdTask_->SetCmd(cmd);
     }
 
+    int runScript(const char *filename, const char *resultfile, std::string &err) override {
+        return cmdTask_->RunScript(filename, resultfile ? resultfile : "", err);
+    }
+
     ToolPath getCarteCmdPos() override {
         return MotionTask::getCarteCmdPos();
     }
@@ -118,6 +150,10 @@ public:
         return MotionTask::isJogging();
     }
 
+    unsigned int getStatusChanges(unsigned int &gen) override {
+        return MotionTask::getStatusChanges(gen);
+    }
+
 
     int getKineType(void) override {
         return 0;
@@ -127,10 +163,27 @@ public:
 
     }
 
+    int loadKinsGeometry(const char *inifile, bool reload, std::string &err) override {
+        if (0 != EMCParas::iniKins(inifile, reload)) {
+            err = std::string("load kinematics geometry failed: ") + inifile;
+            return -1;
+        }
+        return 0;
+    }
+
+    void traceBegin(const char *name) override {
+        EMCTrace::Begin(name);
+    }
+
+    void traceEnd(const char *name) override {
+        EMCTrace::End(name);
+    }
+
 private:
     MillTask *millTask_;
     MotTask *motTask_;
     CmdTask *cmdTask_;
+    TelemTask *telemTask_;
 };
 
 // Factory function
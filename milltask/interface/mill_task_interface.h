@@ -42,10 +42,23 @@ public:
     // generator motion profile for configured tool machine,
     // this will send task to milltask, and milltask will let mottask do fastest simulation
     virtual int simulate(const char *filename, std::string &res, std::string &err) = 0;
+    // check every move of the file against the joint and axis soft limits
+    // along the whole path, not only at the end points. Runs on the
+    // calling thread like loadfile. res is the report, first violation
+    // with its line and segment parameter. Returns 6 on a violation
+    virtual int checkfile(const char *filename, std::string &res, std::string &err) = 0;
     //level 0: message 1: warning 2:error 3:cmdline echo
     virtual int getlog(std::string &log, int &level) = 0;
+    // same, with the time the line was logged, ns since the epoch
+    virtual int getlog(std::string &log, int &level, long long &timeNs) = 0;
     //do some command have been reigisted
     virtual void setCmd(std::string &cmd) = 0;
+    // run a file of console commands with waits on the motion status
+    // (see CmdTask::RunScript) on the command thread. The file is
+    // checked first, err has the line of a mistake and nothing runs.
+    // resultfile, if given, gets a binary record per step. SCRIPT on
+    // the console shows the progress and the summary
+    virtual int runScript(const char *filename, const char *resultfile, std::string &err) = 0;
 
     virtual ToolPath getCarteCmdPos() = 0;
     virtual void active_g_codes(int active_gcodes[ACTIVE_G_CODES]) = 0;
@@ -61,10 +74,25 @@ public:
     virtual void getStateTag(state_tag_t &state_tag) = 0;
     virtual void runInfo(double &curVel, double &reqVel) = 0;
     virtual int isJoggingActive() = 0;
+    // status groups that changed after gen, gen is moved to the latest
+    // change. Bit j joint j (flags, homing, limits), bit 16 axis limits,
+    // bit 17 motion state and flags. Start with gen 0 to get them all
+    static constexpr unsigned int kStatusChgAxis = 1u << 16;
+    static constexpr unsigned int kStatusChgMotion = 1u << 17;
+    virtual unsigned int getStatusChanges(unsigned int &gen) = 0;
 
     //kinematicssetting
     virtual int getKineType(void) = 0;
     virtual void setKineType(int type) = 0;
+    // load [KINS] geometry from inifile and make it active,
+    // an already loaded file is only reselected unless reload
+    virtual int loadKinsGeometry(const char *inifile, bool reload, std::string &err) = 0;
+
+    // a slice of the calling thread in the trace TRACE START records
+    // (see EMCTrace), for the GUI timers. name must stay valid until
+    // TRACE STOP, use a literal. Nothing is kept while not tracing
+    virtual void traceBegin(const char *name) = 0;
+    virtual void traceEnd(const char *name) = 0;
 
     // Factory function
     static IMillTaskInterface* create(const char* emcfile = nullptr);
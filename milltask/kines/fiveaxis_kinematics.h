@@ -170,7 +170,9 @@ public:
 
     // ---------- Forward kinematics ----------
     // 输入：X/Y/Z + 两个角；输出：刀尖位置 & 刀轴方向（世界）
-    void forwardKinematics(const JointValues& q, Vec3& tip_pos_world, Vec3& tool_dir_world) const {
+    // extra_tool_length：当前刀具长度，叠加到 cfg.tool_length，换刀无需重新 configure
+    void forwardKinematics(const JointValues& q, Vec3& tip_pos_world, Vec3& tool_dir_world,
+                           double extra_tool_length = 0.0) const {
         // 1) 物理角（考虑旋向）
         const double th1 = cfg.sign_axis1 * q.angle1_deg;
         const double th2 = cfg.sign_axis2 * q.angle2_deg;
@@ -192,7 +194,7 @@ public:
         Vec3 swing_global = mul(R, swing_local0);
         t = t + swing_global;
         // tool length along local -Z of tool frame: 先经 R 旋转
-        Vec3 ttool_local0 {0,0,-cfg.tool_length};
+        Vec3 ttool_local0 {0,0,-(cfg.tool_length + extra_tool_length)};
         Vec3 ttool_global = mul(R, ttool_local0);
         t = t + ttool_global;
 
@@ -210,7 +212,8 @@ public:
     // 已知转角（控制角）与目标刀尖坐标，直接求 X/Y/Z
     void inverseLinearOnly(const Vec3& target_tip_world,
                            const Angles& ang,
-                           Vec3& xyz_out) const
+                           Vec3& xyz_out,
+                           double extra_tool_length = 0.0) const
     {
         // 1) 物理角
         const double th1 = cfg.sign_axis1 * ang.angle1_deg;
@@ -226,7 +229,7 @@ public:
         Vec3 t = cfg.primary_center_world;
         t = t + mul(R1, t12_local0);
         t = t + mul(R, swing_local0);
-        t = t + mul(R, Vec3{0,0,-cfg.tool_length});
+        t = t + mul(R, Vec3{0,0,-(cfg.tool_length + extra_tool_length)});
 
         // 4) XYZ = target - t_fixed
         xyz_out = target_tip_world - t;
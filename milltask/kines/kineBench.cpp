@@ -0,0 +1,174 @@
+#include "kineBench.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+using BenchClock = std::chrono::steady_clock;
+
+struct KineCase {
+    int type;
+    const char *name;
+    int joints;     // joints written by the inverse kinematics
+};
+
+const KineCase kKineCases[] = {
+    {Kines::kKineTypeIDENTITY, "IDENTITY", 5},
+    {Kines::kKineTypeFiveAxis, "FIVEAXIS", 9},
+    {Kines::kKineTypeXYZABTRT, "XYZABTRT", 5},
+    {Kines::kKineTypeXYZACTRT, "XYZACTRT", 9},
+};
+
+double nsPerCall(BenchClock::duration d, int calls)
+{
+    return std::chrono::duration<double, std::nano>(d).count() / calls;
+}
+
+// Cost of one pair of clock reads, removed from individually timed calls
+double timerOverheadNs(int samples)
+{
+    BenchClock::duration total{0};
+    for (int i = 0; i < samples; i++) {
+        auto t0 = BenchClock::now();
+        auto t1 = BenchClock::now();
+        total += t1 - t0;
+    }
+    return nsPerCall(total, samples);
+}
+
+}
+
+std::vector<KinesBench::Result> KinesBench::Run(const Options &opt)
+{
+    std::vector<Result> results;
+    if (opt.samples <= 0)
+        return results;
+
+    const int n = opt.samples;
+    const int stride = EMCMOT_MAX_JOINTS;
+
+    Kines kines;
+    kines.LoadGeometry(Kines::GetInstance().GetGeometryName(),
+                       Kines::GetInstance().GetGeometry());
+
+    // Same joint set for every type so the numbers compare
+    std::mt19937 rng(opt.seed);
+    std::vector<double> joints((size_t)n * stride);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < stride; j++) {
+            std::uniform_real_distribution<double> dist(opt.minLimit[j], opt.maxLimit[j]);
+            joints[(size_t)i * stride + j] = dist(rng);
+        }
+    }
+
+    std::vector<EmcPose> poses(n);
+    std::vector<double> back((size_t)n * stride, 0.0);
+    KINEMATICS_FORWARD_FLAGS fflags = 0;
+    KINEMATICS_INVERSE_FLAGS iflags = 0;
+    const double timerNs = timerOverheadNs(n);
+
+    for (const KineCase &kc : kKineCases) {
+        Result r{};
+        r.kineType = kc.type;
+        r.name = kc.name;
+        kines.SetKineType(kc.type);
+        std::fill(back.begin(), back.end(), 0.0);
+
+        // batch: back to back calls over the whole set
+        auto t0 = BenchClock::now();
+        for (int i = 0; i < n; i++)
+            kines.KinematicsForward(&joints[(size_t)i * stride], &poses[i], &fflags, &iflags);
+        auto t1 = BenchClock::now();
+        for (int i = 0; i < n; i++)
+            kines.KinematicsInverse(&poses[i], &back[(size_t)i * stride], &iflags, &fflags);
+        auto t2 = BenchClock::now();
+        r.forwardNs = nsPerCall(t1 - t0, n);
+        r.inverseNs = nsPerCall(t2 - t1, n);
+
+        // single: one call per servo cycle is what motion does, time each
+        BenchClock::duration fwd{0}, inv{0};
+        for (int i = 0; i < n; i++) {
+            EmcPose pose;
+            double j[EMCMOT_MAX_JOINTS];
+            auto s0 = BenchClock::now();
+            kines.KinematicsForward(&joints[(size_t)i * stride], &pose, &fflags, &iflags);
+            auto s1 = BenchClock::now();
+            kines.KinematicsInverse(&pose, j, &iflags, &fflags);
+            auto s2 = BenchClock::now();
+            fwd += s1 - s0;
+            inv += s2 - s1;
+        }
+        r.forwardSingleNs = std::max(0.0, nsPerCall(fwd, n) - timerNs);
+        r.inverseSingleNs = std::max(0.0, nsPerCall(inv, n) - timerNs);
+
+        // round-trip error of the batch results
+        double sum = 0.0;
+        r.worstJoint = -1;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < kc.joints; j++) {
+                double e = std::fabs(joints[(size_t)i * stride + j] - back[(size_t)i * stride + j]);
+                if (!std::isfinite(e) || e > r.maxError) {
+                    r.maxError = std::isfinite(e) ? e : INFINITY;
+                    r.worstJoint = j;
+                }
+                sum += e * e;
+            }
+        }
+        r.rmsError = std::sqrt(sum / ((double)n * kc.joints));
+
+        results.push_back(r);
+    }
+
+    return results;
+}
+
+std::string KinesBench::ToJson(const Options &opt, const std::vector<Result> &results)
+{
+    std::stringstream ss;
+    ss << std::setprecision(9);
+
+    ss << "{\n";
+    ss << "  \"samples\": " << opt.samples << ",\n";
+    ss << "  \"seed\": " << opt.seed << ",\n";
+    ss << "  \"geometry\": \"" << Kines::GetInstance().GetGeometryName() << "\",\n";
+    ss << "  \"kinematics\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        ss << "    {\"type\": " << r.kineType
+           << ", \"name\": \"" << r.name << "\""
+           << ", \"max_error\": " << (std::isfinite(r.maxError) ? r.maxError : -1.0)
+           << ", \"rms_error\": " << (std::isfinite(r.rmsError) ? r.rmsError : -1.0)
+           << ", \"worst_joint\": " << r.worstJoint
+           << ", \"forward_ns\": " << r.forwardNs
+           << ", \"inverse_ns\": " << r.inverseNs
+           << ", \"forward_single_ns\": " << r.forwardSingleNs
+           << ", \"inverse_single_ns\": " << r.inverseSingleNs
+           << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    ss << "  ]\n";
+    ss << "}\n";
+
+    return ss.str();
+}
+
+std::string KinesBench::ToText(const std::vector<Result> &results)
+{
+    std::stringstream ss;
+    ss << std::fixed;
+
+    for (const Result &r : results) {
+        ss << std::setw(9) << std::left << r.name << std::right
+           << " err max " << std::scientific << std::setprecision(3) << r.maxError
+           << " rms " << r.rmsError
+           << std::fixed << std::setprecision(1)
+           << " fwd " << r.forwardNs << "/" << r.forwardSingleNs << "ns"
+           << " inv " << r.inverseNs << "/" << r.inverseSingleNs << "ns"
+           << std::endl;
+    }
+
+    return ss.str();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "kineIf.h"
+#include "emcmotcfg.h"
+#include <string>
+#include <vector>
+
+// Round-trip accuracy and throughput check for every Kines type.
+// Runs on a private Kines instance with a copy of the active geometry,
+// so it can be started while the motion thread is using the kinematics.
+class KinesBench {
+public:
+    struct Options {
+        int samples = 10000;
+        unsigned int seed = 1;
+        // joint limits the random joint positions are drawn from
+        std::array<double, EMCMOT_MAX_JOINTS> minLimit{};
+        std::array<double, EMCMOT_MAX_JOINTS> maxLimit{};
+    };
+
+    struct Result {
+        int kineType;
+        std::string name;
+        double maxError;          // max |j - inv(fwd(j))| over the joints the type maps
+        double rmsError;
+        int worstJoint;
+        double forwardNs;         // back to back calls, ns per call
+        double inverseNs;
+        double forwardSingleNs;   // individually timed calls, timer cost removed
+        double inverseSingleNs;
+    };
+
+    static std::vector<Result> Run(const Options &opt);
+    static std::string ToJson(const Options &opt, const std::vector<Result> &results);
+    static std::string ToText(const std::vector<Result> &results);
+
+    KinesBench() = delete;
+};
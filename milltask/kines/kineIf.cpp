@@ -1,45 +1,40 @@
 #include "kineIf.h"
+#include "kineVolComp.h"
 #include "switchkins.h"
 #include "emcmotcfg.h"
 #include <iostream>
 #include <math.h>
+#include <stdio.h>
 
 using namespace fiveaxis;
-Kines::Kines()
-{
-    // 1) 配置（示例：一台混合型 AC，主轴摆头）
-    cfg_.mtype = MachineType::TABLE_SPINDLE_TILTING;
-    cfg_.axis1 = RotaryAxis::A;            // 第一轴 A
-    cfg_.axis2 = RotaryAxis::B;            // 第二轴 C
-    cfg_.sign_axis1 = +1;                  // 控制角与物理角同号
-    cfg_.sign_axis2 = +1;
-    cfg_.axis1_dir_world = {1,0,0};        // A 沿 X
-    cfg_.axis2_dir_world = {0,0,1};        // C 沿 Z
-    cfg_.primary_center_world = {455,0,650};
-    cfg_.secondary_offset_world = {-455,250,-850};
-    cfg_.spindle_swing_world   = {0,-250,200}; // 摆头偏置（头架）
-    cfg_.tool_dir = 'Z';
-    cfg_.tool_axis_sign = +1;
-    cfg_.tool_length = 0.0;
-
-    solver_.configure(cfg_);
-
-    // 2) 正解
-    JointValues q;
-    q.X = 100; q.Y = -50; q.Z = 300;
-    q.angle1_deg = 20; q.angle2_deg = -35;
 
-    fiveaxis::Vec3 pos, dir;
-    solver_.forwardKinematics(q, pos, dir);
-    std::printf("FK: P=(%.3f, %.3f, %.3f), n=(%.6f, %.6f, %.6f)\n",
-                pos.x,pos.y,pos.z, dir.x,dir.y,dir.z);
+fiveaxis::Config Kines::DefaultFiveAxisConfig()
+{
+    fiveaxis::Config cfg;
+
+    // 配置（示例：一台混合型 AC，主轴摆头）
+    cfg.mtype = MachineType::TABLE_SPINDLE_TILTING;
+    cfg.axis1 = RotaryAxis::A;            // 第一轴 A
+    cfg.axis2 = RotaryAxis::B;            // 第二轴 C
+    cfg.sign_axis1 = +1;                  // 控制角与物理角同号
+    cfg.sign_axis2 = +1;
+    cfg.axis1_dir_world = {1,0,0};        // A 沿 X
+    cfg.axis2_dir_world = {0,0,1};        // C 沿 Z
+    cfg.primary_center_world = {455,0,650};
+    cfg.secondary_offset_world = {-455,250,-850};
+    cfg.spindle_swing_world   = {0,-250,200}; // 摆头偏置（头架）
+    cfg.tool_dir = 'Z';
+    cfg.tool_axis_sign = +1;
+    cfg.tool_length = 0.0;
+
+    return cfg;
+}
 
-    // 3) 线性逆解（角度已知）
-    fiveaxis::Angles ang{q.angle1_deg, q.angle2_deg};
-    fiveaxis::Vec3 xyz;
-    solver_.inverseLinearOnly(pos, ang, xyz);
-    std::printf("IK-linear: (X,Y,Z)=(%.3f, %.3f, %.3f)\n", xyz.x,xyz.y,xyz.z);
+const Kines::ToolEntry Kines::kNoTool{0, 0.0};
 
+Kines::Kines()
+{
+    LoadGeometry("default", Geometry());
 }
 
 Kines &Kines::GetInstance()
@@ -69,6 +64,214 @@ void Kines::reset()
     kinType_ = kKineTypeIDENTITY;
 }
 
+void Kines::SetToolTable(const std::map<int, double> &lengths)
+{
+    auto table = std::make_unique<ToolTable>();
+    for (const auto &tool : lengths)
+        table->emplace(tool.first, ToolEntry{tool.first, tool.second});
+
+    std::lock_guard<std::mutex> lock(modelMutex_);
+    const ToolTable *published = table.get();
+    toolTables_.push_back(std::move(table));
+    toolTable_.store(published, std::memory_order_release);
+
+    // Keep the tool in the spindle, now with its new length,
+    // unless a tool change raced us
+    const ToolEntry *active = activeTool_.load(std::memory_order_acquire);
+    if (active != &kNoTool) {
+        auto it = published->find(active->toolno);
+        const ToolEntry *entry = it != published->end() ? &it->second : &kNoTool;
+        activeTool_.compare_exchange_strong(active, entry, std::memory_order_acq_rel);
+    }
+}
+
+int Kines::ChangeTool(int toolno)
+{
+    if (toolno <= 0) {
+        activeTool_.store(&kNoTool, std::memory_order_release);
+        return 0;
+    }
+
+    const ToolTable *table = toolTable_.load(std::memory_order_acquire);
+    if (!table)
+        return -1;
+
+    auto it = table->find(toolno);
+    if (it == table->end())
+        return -1;
+
+    activeTool_.store(&it->second, std::memory_order_release);
+    return 0;
+}
+
+int Kines::GetActiveTool()
+{
+    return activeTool_.load(std::memory_order_acquire)->toolno;
+}
+
+double Kines::GetActiveToolLength()
+{
+    return activeTool_.load(std::memory_order_acquire)->length;
+}
+
+bool Kines::AppliesToolLength()
+{
+    return kinType_ == kKineTypeFiveAxis ||
+           kinType_ == kKineTypeXYZABTRT ||
+           kinType_ == kKineTypeXYZACTRT;
+}
+
+std::unique_ptr<Kines::Model> Kines::BuildModel(const std::string &name,
+                                                const Geometry &geo)
+{
+    auto model = std::make_unique<Model>();
+
+    model->name = name;
+    model->geo = geo;
+    model->solver.configure(geo.fiveaxis);
+
+    model->abtrt_pre_x = geo.x_rot_point;
+    model->abtrt_pre_y = geo.y_rot_point;
+    model->abtrt_pre_z = geo.z_rot_point + geo.tool_offset_z;
+
+    model->actrt_dz = geo.z_offset + geo.tool_offset;
+
+    return model;
+}
+
+int Kines::LoadGeometry(const std::string &name, const Geometry &geo)
+{
+    if (name.empty())
+        return -1;
+
+    std::unique_ptr<Model> model = BuildModel(name, geo);
+
+    std::lock_guard<std::mutex> lock(modelMutex_);
+    auto it = models_.find(name);
+    if (it != models_.end()) {
+        // The motion thread may still be using the old one
+        retiredModels_.push_back(std::move(it->second));
+        it->second = std::move(model);
+    }
+    else {
+        it = models_.emplace(name, std::move(model)).first;
+    }
+    model_.store(it->second.get(), std::memory_order_release);
+
+    return 0;
+}
+
+int Kines::SelectGeometry(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(modelMutex_);
+    auto it = models_.find(name);
+    if (it == models_.end())
+        return -1;
+
+    model_.store(it->second.get(), std::memory_order_release);
+    return 0;
+}
+
+std::string Kines::GetGeometryName()
+{
+    return model_.load(std::memory_order_acquire)->name;
+}
+
+Kines::Geometry Kines::GetGeometry()
+{
+    return model_.load(std::memory_order_acquire)->geo;
+}
+
+namespace {
+
+struct Fnv {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    template<typename T>
+    void add(const T &v) {
+        const unsigned char *c = reinterpret_cast<const unsigned char *>(&v);
+        for (size_t i = 0; i < sizeof(v); i++) {
+            h ^= c[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    void add(const fiveaxis::Vec3 &v) {
+        add(v.x);
+        add(v.y);
+        add(v.z);
+    }
+};
+
+}
+
+// field by field, the structs have padding
+uint64_t Kines::GeometryDigest()
+{
+    const Model *m = model_.load(std::memory_order_acquire);
+    const Geometry &g = m->geo;
+    const fiveaxis::Config &c = g.fiveaxis;
+    Fnv f;
+
+    f.add(kinType_);
+    f.add(g.tool_offset_z);
+    f.add(g.tool_offset);
+    f.add(g.x_offset);
+    f.add(g.y_offset);
+    f.add(g.z_offset);
+    f.add(g.x_rot_point);
+    f.add(g.y_rot_point);
+    f.add(g.z_rot_point);
+    f.add((int)c.mtype);
+    f.add((int)c.axis1);
+    f.add((int)c.axis2);
+    f.add(c.sign_axis1);
+    f.add(c.sign_axis2);
+    f.add(c.axis1_dir_world);
+    f.add(c.axis2_dir_world);
+    f.add(c.primary_center_world);
+    f.add(c.secondary_offset_world);
+    f.add(c.spindle_swing_world);
+    f.add(c.tool_dir);
+    f.add(c.tool_axis_sign);
+    f.add(c.tool_length);
+    f.add(GetActiveToolLength());
+    return f.h;
+}
+
+std::string Kines::showGeometry()
+{
+    const Model *m = model_.load(std::memory_order_acquire);
+    const ToolEntry *tool = activeTool_.load(std::memory_order_acquire);
+    char buf[640];
+
+    snprintf(buf, sizeof(buf),
+             "Geometry %s\n"
+             "ToolOffsetZ %.4f\nToolOffset %.4f\n"
+             "Offset %.4f %.4f %.4f\n"
+             "RotPoint %.4f %.4f %.4f\n"
+             "FiveAxisType %d\n"
+             "PrimaryCenter %.4f %.4f %.4f\n"
+             "SecondaryOffset %.4f %.4f %.4f\n"
+             "SpindleSwing %.4f %.4f %.4f\n"
+             "Tool %d Length %.4f",
+             m->name.c_str(),
+             m->geo.tool_offset_z, m->geo.tool_offset,
+             m->geo.x_offset, m->geo.y_offset, m->geo.z_offset,
+             m->geo.x_rot_point, m->geo.y_rot_point, m->geo.z_rot_point,
+             (int)m->geo.fiveaxis.mtype,
+             m->geo.fiveaxis.primary_center_world.x,
+             m->geo.fiveaxis.primary_center_world.y,
+             m->geo.fiveaxis.primary_center_world.z,
+             m->geo.fiveaxis.secondary_offset_world.x,
+             m->geo.fiveaxis.secondary_offset_world.y,
+             m->geo.fiveaxis.secondary_offset_world.z,
+             m->geo.fiveaxis.spindle_swing_world.x,
+             m->geo.fiveaxis.spindle_swing_world.y,
+             m->geo.fiveaxis.spindle_swing_world.z,
+             tool->toolno, tool->length);
+
+    return buf;
+}
+
 int
 Kines::KinematicsForward(const double *joint, EmcPose *pos,
                          const KINEMATICS_FORWARD_FLAGS *fflags,
@@ -87,7 +290,7 @@ Kines::KinematicsForward(const double *joint, EmcPose *pos,
     case kKineTypeXYZACTRT:
         ForwardXYZACTRT(joint, pos, fflags, iflags);
         break;
-    defualt:
+    default:
         ForwardIdentity(joint, pos, fflags, iflags);
         break;
     }
@@ -111,7 +314,8 @@ Kines::KinematicsInverse(const EmcPose *pos, double *joint,
         break;
     case kKineTypeXYZACTRT:
         InverseXYZACTRT(pos, joint, iflags, fflags);
-    defualt:
+        break;
+    default:
         InverseIDentity(pos, joint, iflags, fflags);
         break;
     }
@@ -166,14 +370,12 @@ Kines::ForwardXYZABTRT(const double *j, EmcPose *pos,
 {
     (void)fflags;
     (void)iflags;
-    double t_x = x_rot_point_;
-    double t_y = y_rot_point_;
-    double t_z = z_rot_point_;
+    const Model *m = model_.load(std::memory_order_acquire);
+    const double tool_length = activeTool_.load(std::memory_order_acquire)->length;
 
-    double t_x1 = x_offset_;
-    double t_y1 = y_offset_;
-    double t_z1 = z_offset_;
-    double tool_length = tool_offset_z_;
+    double t_x1 = m->geo.x_offset;
+    double t_y1 = m->geo.y_offset;
+    double t_z1 = m->geo.z_offset;
 
     double det_x = 0.0, det_y = 0.0, det_z = 0.0;
 
@@ -189,13 +391,10 @@ Kines::ForwardXYZABTRT(const double *j, EmcPose *pos,
    double y = j[1];
    double z = j[2];
 
-   // T_TS2Tool(0,0,-L)
-   z -= tool_length;
-
-   // T_B2RB(-t_x,-t_y,-t_z) : 等价 x-=t_x, y-=t_y, z-=t_z
-   x -= t_x;
-   y -= t_y;
-   z -= t_z;
+   // T_TS2Tool(0,0,-L) * T_B2RB(-t_x,-t_y,-t_z) : 等价 x-=t_x, y-=t_y, z-=t_z+L
+   x -= m->abtrt_pre_x;
+   y -= m->abtrt_pre_y;
+   z -= m->abtrt_pre_z + tool_length;
 
     // R_B (绕Y： [cb*x + sb*z, y, -sb*x + cb*z])
     {
@@ -256,14 +455,12 @@ Kines::InverseXYZABTRT(const EmcPose * pos,
 {
     (void)iflags;
     (void)fflags;
-    double t_x = x_rot_point_;
-    double t_y = y_rot_point_;
-    double t_z = z_rot_point_;
+    const Model *m = model_.load(std::memory_order_acquire);
+    const double tool_length = activeTool_.load(std::memory_order_acquire)->length;
 
-    double t_x1 = x_offset_;
-    double t_y1 = y_offset_;
-    double t_z1 = z_offset_;
-    double tool_length = tool_offset_z_;
+    double t_x1 = m->geo.x_offset;
+    double t_y1 = m->geo.y_offset;
+    double t_z1 = m->geo.z_offset;
 
     double det_x = 0.0, det_y = 0.0, det_z = 0.0;
 
@@ -300,13 +497,10 @@ Kines::InverseXYZABTRT(const EmcPose * pos,
         x = x1; y = y1; z = z1;
     }
 
-    // T_B2RB^{-1} (+t)
-    x += t_x;
-    y += t_y;
-    z += t_z;
-
-    // T_TS2Tool^{-1} (0,0,+L)
-    z += tool_length;
+    // T_B2RB^{-1} (+t) * T_TS2Tool^{-1} (0,0,+L)
+    x += m->abtrt_pre_x;
+    y += m->abtrt_pre_y;
+    z += m->abtrt_pre_z + tool_length;
 
 
     // + (t_x, t_y, t_z) , + (0,0,tool_length), -pos
@@ -324,17 +518,15 @@ int Kines::ForwardXYZACTRT(const double *j, EmcPose *pos, const KINEMATICS_FORWA
 {
     (void)fflags;
     (void)iflags;
-    double x_rot_point = x_rot_point_;
-    double y_rot_point = y_rot_point_;
-    double z_rot_point = z_rot_point;
-    double          dt = tool_offset_;
-    double          dy = y_offset_;
-    double          dz = z_offset_;
+    const Model *m = model_.load(std::memory_order_acquire);
+    double x_rot_point = m->geo.x_rot_point;
+    double y_rot_point = m->geo.y_rot_point;
+    double z_rot_point = m->geo.z_rot_point;
+    double          dy = m->geo.y_offset;
+    double          dz = m->actrt_dz + activeTool_.load(std::memory_order_acquire)->length;
     double       a_rad = j[3]*TO_RAD;
     double       c_rad = j[5]*TO_RAD;
 
-    dz = dz + dt;
-
     pos->tran.x = + cos(c_rad)              * (j[0]      - x_rot_point)
                  + sin(c_rad) * cos(a_rad) * (j[1] - dy - y_rot_point)
                  + sin(c_rad) * sin(a_rad) * (j[2] - dz - z_rot_point)
@@ -369,19 +561,17 @@ int Kines::InverseXYZACTRT(const EmcPose *pos, double *j, const KINEMATICS_INVER
 {
     (void)iflags;
     (void)fflags;
-    double x_rot_point = x_rot_point_;
-    double y_rot_point = y_rot_point_;
-    double z_rot_point = z_rot_point_;
-    double         dy  = y_offset_;
-    double         dz  = z_offset_;
-    double         dt  = tool_offset_;
+    const Model *m = model_.load(std::memory_order_acquire);
+    double x_rot_point = m->geo.x_rot_point;
+    double y_rot_point = m->geo.y_rot_point;
+    double z_rot_point = m->geo.z_rot_point;
+    double         dy  = m->geo.y_offset;
+    double         dz  = m->actrt_dz + activeTool_.load(std::memory_order_acquire)->length;
     double      a_rad  = pos->a*TO_RAD;
     double      c_rad  = pos->c*TO_RAD;
 
     EmcPose P; // computed position
 
-    dz = dz + dt;
-
     P.tran.x   = + cos(c_rad)              * (pos->tran.x - x_rot_point)
                 - sin(c_rad)              * (pos->tran.y - y_rot_point)
                 + x_rot_point;
@@ -412,6 +602,16 @@ int Kines::InverseXYZACTRT(const EmcPose *pos, double *j, const KINEMATICS_INVER
     P.v = pos->v;
     P.w = pos->w;
 
+    j[0] = P.tran.x;
+    j[1] = P.tran.y;
+    j[2] = P.tran.z;
+    j[3] = P.a;
+    j[4] = P.b;
+    j[5] = P.c;
+    j[6] = P.u;
+    j[7] = P.v;
+    j[8] = P.w;
+
     return 0;
 }
 
@@ -429,11 +629,12 @@ int Kines::ForwardFiveAxis(const double *j, EmcPose *pos, const KINEMATICS_FORWA
 
     fiveaxis::Vec3 toolPos, dir;
 
-    solver_.forwardKinematics(q, toolPos, dir);
+    model_.load(std::memory_order_acquire)->solver.forwardKinematics(q, toolPos, dir,
+        activeTool_.load(std::memory_order_acquire)->length);
 
-    pos->tran.x = q.X;
-    pos->tran.y = q.Y;
-    pos->tran.z = q.Z;
+    pos->tran.x = toolPos.x;
+    pos->tran.y = toolPos.y;
+    pos->tran.z = toolPos.z;
     pos->a = j[3];
     pos->b = j[4];
     pos->c = j[5];
@@ -458,7 +659,8 @@ int Kines::InverseFiveAxis(const EmcPose *pos, double *j, const KINEMATICS_INVER
 
     fiveaxis::Angles ang{pos->a, pos->b};
     fiveaxis::Vec3 xyz;
-    solver_.inverseLinearOnly(toolPos, ang, xyz);
+    model_.load(std::memory_order_acquire)->solver.inverseLinearOnly(toolPos, ang, xyz,
+        activeTool_.load(std::memory_order_acquire)->length);
 
     j[0] = xyz.x;
     j[1] = xyz.y;
@@ -483,6 +685,13 @@ int kinematicsForward(const double *joint,
                       const KINEMATICS_FORWARD_FLAGS * fflags,
                       KINEMATICS_INVERSE_FLAGS * iflags)
 {
+    // commanded joints include the volumetric compensation
+    double nominal[EMCMOT_MAX_JOINTS];
+    if (VolComp::GetInstance().IsActive()) {
+        VolComp::GetInstance().Remove(joint, nominal);
+        joint = nominal;
+    }
+
     Kines::GetInstance().KinematicsForward(joint,
                                            pos,
                                            fflags,
@@ -499,6 +708,7 @@ int kinematicsInverse(const EmcPose * pos,
                                            joint,
                                            iflags,
                                            fflags);
+    VolComp::GetInstance().Apply(joint);
     return 0;
 }
 
@@ -524,7 +734,7 @@ int kinematicsSwitch(int new_switchkins_type)
     case Kines::kKineTypeXYZACTRT:
         Kines::GetInstance().SetKineType(Kines::kKineTypeXYZACTRT);
         break;
-    defaul:
+    default:
         Kines::GetInstance().SetKineType(Kines::kKineTypeIDENTITY);
         break;
     }
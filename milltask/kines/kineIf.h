@@ -4,6 +4,12 @@
 #include "fiveaxis_kinematics.h"
 #include <string>
 #include <array>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class Kines {
 public:
@@ -16,6 +22,23 @@ public:
         kKineTypeNum,
     };
 
+    // Machine geometry, read from [KINS] of the INI file.
+    // The defaults are the values this simulator used to hard code.
+    struct Geometry {
+        double tool_offset_z = 255.0;
+        double tool_offset = 255.0;
+        double x_offset = 150.0;
+        double y_offset = 0.0;
+        double z_offset = 0.0;
+        double x_rot_point = -150.0;
+        double y_rot_point = 0.0;
+        double z_rot_point = -150.0;
+
+        fiveaxis::Config fiveaxis = DefaultFiveAxisConfig();
+    };
+
+    static fiveaxis::Config DefaultFiveAxisConfig();
+
     Kines();
     Kines(const Kines&) = delete;
     Kines& operator=(const Kines&) = delete;
@@ -79,23 +102,67 @@ public:
 
     std::array<double, 3> GetTad();
 
-
+    // Build the cached model for a geometry and make it active.
+    // A model is built once per name, selecting it again later
+    // only swaps a pointer, so the motion thread never waits.
+    int LoadGeometry(const std::string &name, const Geometry &geo);
+    int SelectGeometry(const std::string &name);
+    std::string GetGeometryName();
+    Geometry GetGeometry();
+    std::string showGeometry();
+    // FNV-1a of the kinematics type, the active geometry and tool
+    // length, equal when the kinematics compute the same
+    uint64_t GeometryDigest();
+
+    // Tool lengths come from an immutable snapshot of the tool table.
+    // SetToolTable publishes a new snapshot, ChangeTool (M6) only swaps
+    // the active entry pointer. The active length is added to the tool
+    // offset of the geometry by every kinematics type but IDENTITY, for
+    // those canon leaves the Z of G43 out so it is not counted twice.
+    void SetToolTable(const std::map<int, double> &lengths);
+    int ChangeTool(int toolno);
+    int GetActiveTool();
+    double GetActiveToolLength();
+    bool AppliesToolLength();
 
 private:
+    // Geometry precompiled into the constants the kinematics use
+    struct Model {
+        std::string name;
+        Geometry geo;
+        fiveaxis::Solver solver;
+
+        // XYZABTRT: tool length and rotary point folded together
+        double abtrt_pre_x, abtrt_pre_y, abtrt_pre_z;
+        // XYZACTRT: z offset including the tool offset
+        double actrt_dz;
+    };
+
+    static std::unique_ptr<Model> BuildModel(const std::string &name,
+                                             const Geometry &geo);
+
+    // Read by the motion thread on every kinematics call, written
+    // when a geometry is selected. Models are never freed while
+    // the process runs, so a reader can not see a dangling model.
+    std::atomic<const Model *> model_{nullptr};
+
+    struct ToolEntry {
+        int toolno;
+        double length;
+    };
+    using ToolTable = std::map<int, ToolEntry>;
+    static const ToolEntry kNoTool;
 
+    // Snapshots are kept for the life of the process, like models
+    std::atomic<const ToolTable *> toolTable_{nullptr};
+    std::atomic<const ToolEntry *> activeTool_{&kNoTool};
+    std::vector<std::unique_ptr<ToolTable>> toolTables_;
 
-    fiveaxis::Config cfg_;
-    fiveaxis::Solver solver_;
+    std::mutex modelMutex_;
+    std::map<std::string, std::unique_ptr<Model>> models_;
+    std::vector<std::unique_ptr<Model>> retiredModels_;
 
     int kinType_ = kKineTypeIDENTITY;
-    double tool_offset_z_ = 255.0;
-    double tool_offset_ = 255.0;
-    double x_offset_ = 150.0;
-    double y_offset_ = 0.0;
-    double z_offset_ = 0.0;
-    double x_rot_point_ = -150.0;
-    double y_rot_point_ = 0.0;
-    double z_rot_point_ = -150.0;
 
 //    double tool_length_ = 100.0;
 //    double tx_ = 0.0, ty_ = 0.0, tz_ = -50.0;
@@ -0,0 +1,302 @@
+/********************************************************************
+* Description: kineInterp.cpp
+*   All-joint spline interpolator, see kineInterp.h
+*
+*   Cubic mode reproduces cubic.c: the segment runs between the
+*   B-spline way points of x1 and x2 with central difference
+*   velocities, so the output is smoothed and lags the planner
+*   points slightly.
+*
+*   Quintic mode passes through x1 and x2 exactly. Velocity and
+*   acceleration at each knot come from the neighbouring points only,
+*   so both are shared by the two segments meeting there and the
+*   commanded acceleration stays continuous across segments.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "kineInterp.h"
+#include "rtapi_math.h"
+
+#define SEGMENT_TIME_SET 0x01
+#define INTERPOLATION_RATE_SET 0x02
+#define ALL_SET (SEGMENT_TIME_SET | INTERPOLATION_RATE_SET)
+
+JOINT_INTERP_STRUCT jointInterp;
+
+static void updateIncrement(JOINT_INTERP_STRUCT * ji)
+{
+    if (ji->configured == ALL_SET) {
+        ji->interpolationIncrement =
+            ji->segmentTime / ji->interpolationRate;
+    }
+}
+
+/*
+   Fit every joint from the current four point history.
+   All loops run over plain arrays with no aliasing between input and
+   output, so they vectorize.
+*/
+static void fitCubic(JOINT_INTERP_STRUCT * ji)
+{
+    const int n = ji->numJoints;
+    const double T = ji->segmentTime;
+    const double invT = 1.0 / T;
+    const double invT2 = invT * invT;
+    const double * __restrict x0 = ji->x0;
+    const double * __restrict x1 = ji->x1;
+    const double * __restrict x2 = ji->x2;
+    const double * __restrict x3 = ji->x3;
+    double * __restrict c0 = ji->c0;
+    double * __restrict c1 = ji->c1;
+    double * __restrict c2 = ji->c2;
+    double * __restrict c3 = ji->c3;
+    double * __restrict c4 = ji->c4;
+    double * __restrict c5 = ji->c5;
+
+    for (int i = 0; i < n; i++) {
+        double wp0 = (x0[i] + 4.0 * x1[i] + x2[i]) / 6.0;
+        double wp1 = (x1[i] + 4.0 * x2[i] + x3[i]) / 6.0;
+        double vp0 = (x2[i] - x0[i]) * 0.5 * invT;
+        double vp1 = (x3[i] - x1[i]) * 0.5 * invT;
+        double b = 3.0 * (wp1 - wp0) * invT2 - (2.0 * vp0 + vp1) * invT;
+
+        c0[i] = wp0;
+        c1[i] = vp0;
+        c2[i] = b;
+        c3[i] = (vp1 - vp0) * invT2 / 3.0 - 2.0 * b * invT / 3.0;
+        c4[i] = 0.0;
+        c5[i] = 0.0;
+    }
+}
+
+static void fitQuintic(JOINT_INTERP_STRUCT * ji)
+{
+    const int n = ji->numJoints;
+    const double T = ji->segmentTime;
+    const double invT = 1.0 / T;
+    const double invT2 = invT * invT;
+    const double invT3 = invT2 * invT;
+    const double * __restrict x0 = ji->x0;
+    const double * __restrict x1 = ji->x1;
+    const double * __restrict x2 = ji->x2;
+    const double * __restrict x3 = ji->x3;
+    double * __restrict c0 = ji->c0;
+    double * __restrict c1 = ji->c1;
+    double * __restrict c2 = ji->c2;
+    double * __restrict c3 = ji->c3;
+    double * __restrict c4 = ji->c4;
+    double * __restrict c5 = ji->c5;
+
+    for (int i = 0; i < n; i++) {
+        double v0 = (x2[i] - x0[i]) * 0.5 * invT;
+        double v1 = (x3[i] - x1[i]) * 0.5 * invT;
+        double a0 = (x0[i] - 2.0 * x1[i] + x2[i]) * invT2;
+        double a1 = (x1[i] - 2.0 * x2[i] + x3[i]) * invT2;
+        /* residuals left after the known c0..c2 terms at t = T */
+        double h = x2[i] - x1[i] - v0 * T - 0.5 * a0 * T * T;
+        double dv = (v1 - v0 - a0 * T) * T;
+        double da = (a1 - a0) * T * T;
+
+        c0[i] = x1[i];
+        c1[i] = v0;
+        c2[i] = 0.5 * a0;
+        c3[i] = (10.0 * h - 4.0 * dv + 0.5 * da) * invT3;
+        c4[i] = (-15.0 * h + 7.0 * dv - da) * invT3 * invT;
+        c5[i] = (6.0 * h - 3.0 * dv + 0.5 * da) * invT3 * invT2;
+    }
+}
+
+int jointInterpInit(JOINT_INTERP_STRUCT * ji, int numJoints)
+{
+    if (0 == ji || numJoints < 0 || numJoints > EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+
+    ji->configured = 0;
+    ji->mode = JOINT_INTERP_CUBIC;
+    ji->requestedMode = JOINT_INTERP_CUBIC;
+    ji->numJoints = numJoints;
+    ji->segmentTime = 0.0;
+    ji->interpolationRate = 0;
+    ji->interpolationIncrement = 0.0;
+    jointInterpDrain(ji);
+
+    return 0;
+}
+
+int jointInterpSetSegmentTime(JOINT_INTERP_STRUCT * ji, double time)
+{
+    if (0 == ji || time <= 0.0) {
+        return -1;
+    }
+
+    ji->segmentTime = time;
+    ji->configured |= SEGMENT_TIME_SET;
+    updateIncrement(ji);
+
+    return 0;
+}
+
+int jointInterpSetInterpolationRate(JOINT_INTERP_STRUCT * ji, int rate)
+{
+    if (0 == ji || rate <= 0) {
+        return -1;
+    }
+
+    ji->interpolationRate = rate;
+    ji->configured |= INTERPOLATION_RATE_SET;
+    updateIncrement(ji);
+
+    return 0;
+}
+
+/*
+  The mode is latched and only applied when the interpolator is drained,
+  which happens on every enable and coord/teleop transition. Switching
+  in the middle of a stream would jump between the smoothed cubic path
+  and the exact quintic one.
+*/
+int jointInterpSetMode(JOINT_INTERP_STRUCT * ji, int mode)
+{
+    if (0 == ji ||
+        (mode != JOINT_INTERP_CUBIC && mode != JOINT_INTERP_QUINTIC)) {
+        return -1;
+    }
+
+    ji->requestedMode = mode;
+
+    return 0;
+}
+
+int jointInterpGetMode(JOINT_INTERP_STRUCT * ji)
+{
+    if (0 == ji) {
+        return -1;
+    }
+
+    return ji->mode;
+}
+
+/*
+  Add one point per joint to the end of the interpolator, same rules
+  as cubicAddPoint(): only when the interpolator needs a point, and the
+  first point fills all four history slots.
+*/
+int jointInterpAddPoints(JOINT_INTERP_STRUCT * ji, const double *points)
+{
+    if (0 == ji || 0 == points || !(ji->configured == ALL_SET)) {
+        return -1;
+    }
+
+    if (!ji->needNextPoint) {
+        return -1;
+    }
+
+    const int n = ji->numJoints;
+    if (!ji->filled) {
+        for (int i = 0; i < n; i++) {
+            ji->x0[i] = ji->x1[i] = ji->x2[i] = ji->x3[i] = points[i];
+        }
+        ji->filled = 1;
+    } else {
+        for (int i = 0; i < n; i++) {
+            ji->x0[i] = ji->x1[i];
+            ji->x1[i] = ji->x2[i];
+            ji->x2[i] = ji->x3[i];
+            ji->x3[i] = points[i];
+        }
+    }
+
+    if (ji->mode == JOINT_INTERP_QUINTIC) {
+        fitQuintic(ji);
+    } else {
+        fitCubic(ji);
+    }
+    ji->interpolationTime = 0.0;
+    ji->needNextPoint = 0;
+
+    return 0;
+}
+
+/*
+  Evaluate all joints at the current interpolation time and advance it.
+  Any of x, v, a, j may be null. Evaluation is always the quintic form,
+  cubic mode just leaves c4 and c5 at zero.
+*/
+int jointInterpInterpolate(JOINT_INTERP_STRUCT * ji, double *x,
+    double *v, double *a, double *j)
+{
+    if (0 == ji || !(ji->configured == ALL_SET)) {
+        return -1;
+    }
+
+    if (ji->needNextPoint) {
+        /* queue ran out-- fill right with last point */
+        jointInterpAddPoints(ji, ji->x3);
+    }
+
+    const int n = ji->numJoints;
+    const double t = ji->interpolationTime;
+    const double * __restrict c0 = ji->c0;
+    const double * __restrict c1 = ji->c1;
+    const double * __restrict c2 = ji->c2;
+    const double * __restrict c3 = ji->c3;
+    const double * __restrict c4 = ji->c4;
+    const double * __restrict c5 = ji->c5;
+
+    if (x != 0) {
+        for (int i = 0; i < n; i++) {
+            x[i] = c0[i] + t * (c1[i] + t * (c2[i] + t * (c3[i] +
+                t * (c4[i] + t * c5[i]))));
+        }
+    }
+    if (v != 0) {
+        for (int i = 0; i < n; i++) {
+            v[i] = c1[i] + t * (2.0 * c2[i] + t * (3.0 * c3[i] +
+                t * (4.0 * c4[i] + t * 5.0 * c5[i])));
+        }
+    }
+    if (a != 0) {
+        for (int i = 0; i < n; i++) {
+            a[i] = 2.0 * c2[i] + t * (6.0 * c3[i] +
+                t * (12.0 * c4[i] + t * 20.0 * c5[i]));
+        }
+    }
+    if (j != 0) {
+        for (int i = 0; i < n; i++) {
+            j[i] = 6.0 * c3[i] + t * (24.0 * c4[i] + t * 60.0 * c5[i]);
+        }
+    }
+
+    ji->interpolationTime += ji->interpolationIncrement;
+
+    /* check to see if the next point is at (close to) the segment end */
+    if (fabs(ji->segmentTime - ji->interpolationTime)
+        < 0.5 * ji->interpolationIncrement) {
+        /* just computed last point-- flag that we need a new one */
+        ji->needNextPoint = 1;
+    }
+
+    return 0;
+}
+
+int jointInterpNeedNextPoint(JOINT_INTERP_STRUCT * ji)
+{
+    return ji->needNextPoint;
+}
+
+int jointInterpDrain(JOINT_INTERP_STRUCT * ji)
+{
+    for (int i = 0; i < EMCMOT_MAX_JOINTS; i++) {
+        ji->x0[i] = ji->x1[i] = ji->x2[i] = ji->x3[i] = 0.0;
+        ji->c0[i] = ji->c1[i] = ji->c2[i] = 0.0;
+        ji->c3[i] = ji->c4[i] = ji->c5[i] = 0.0;
+    }
+    ji->mode = ji->requestedMode;
+    ji->interpolationTime = 0.0;
+    ji->filled = 0;
+    ji->needNextPoint = 1;
+
+    return 0;
+}
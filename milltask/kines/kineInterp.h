@@ -0,0 +1,70 @@
+/********************************************************************
+* Description: kineInterp.h
+*   All-joint spline interpolator between the trajectory planner and
+*   the servo loop.
+*
+*   Replaces one CUBIC_STRUCT per joint by a single structure that
+*   keeps every quantity as a per-joint array (structure of arrays),
+*   so the add-point and interpolate loops walk contiguous memory
+*   and can be vectorized by the compiler.
+*
+*   Two fitting modes are supported:
+*     JOINT_INTERP_CUBIC    same B-spline smoothing as cubic.c
+*     JOINT_INTERP_QUINTIC  quintic through the planner points, with
+*                           velocity and acceleration at the knots
+*                           taken from central differences
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef KINE_INTERP_H
+#define KINE_INTERP_H
+
+#include "emcmotcfg.h"		/* EMCMOT_MAX_JOINTS */
+
+#define JOINT_INTERP_CUBIC   0
+#define JOINT_INTERP_QUINTIC 1
+
+typedef struct {
+    int configured;
+    int mode;			/* mode used for fitting */
+    int requestedMode;		/* applied on the next drain */
+    int numJoints;
+    double segmentTime;
+    int interpolationRate;
+    double interpolationIncrement;
+    double interpolationTime;
+    int needNextPoint;
+    int filled;
+
+    /* four point history, oldest first */
+    alignas(64) double x0[EMCMOT_MAX_JOINTS];
+    alignas(64) double x1[EMCMOT_MAX_JOINTS];
+    alignas(64) double x2[EMCMOT_MAX_JOINTS];
+    alignas(64) double x3[EMCMOT_MAX_JOINTS];
+
+    /* p(t) = c0 + c1 t + c2 t^2 + c3 t^3 + c4 t^4 + c5 t^5,
+       c4 and c5 are zero in cubic mode */
+    alignas(64) double c0[EMCMOT_MAX_JOINTS];
+    alignas(64) double c1[EMCMOT_MAX_JOINTS];
+    alignas(64) double c2[EMCMOT_MAX_JOINTS];
+    alignas(64) double c3[EMCMOT_MAX_JOINTS];
+    alignas(64) double c4[EMCMOT_MAX_JOINTS];
+    alignas(64) double c5[EMCMOT_MAX_JOINTS];
+} JOINT_INTERP_STRUCT;
+
+/* the joint interpolator used by the motion controller */
+extern JOINT_INTERP_STRUCT jointInterp;
+
+extern int jointInterpInit(JOINT_INTERP_STRUCT * ji, int numJoints);
+extern int jointInterpSetSegmentTime(JOINT_INTERP_STRUCT * ji, double time);
+extern int jointInterpSetInterpolationRate(JOINT_INTERP_STRUCT * ji, int rate);
+extern int jointInterpSetMode(JOINT_INTERP_STRUCT * ji, int mode);
+extern int jointInterpGetMode(JOINT_INTERP_STRUCT * ji);
+extern int jointInterpAddPoints(JOINT_INTERP_STRUCT * ji, const double *points);
+extern int jointInterpInterpolate(JOINT_INTERP_STRUCT * ji, double *x,
+    double *v, double *a, double *j);
+extern int jointInterpNeedNextPoint(JOINT_INTERP_STRUCT * ji);
+extern int jointInterpDrain(JOINT_INTERP_STRUCT * ji);
+
+#endif /* KINE_INTERP_H */
@@ -0,0 +1,411 @@
+#include "kinePathCheck.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+constexpr size_t kChunk = 1024;        // segments a worker takes at once
+constexpr int kMaxSamples = 100000;    // first samples of one segment
+const char kAxisLetters[] = "XYZABCUVW";
+
+double dot(const PmCartesian &a, const PmCartesian &b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+PmCartesian cross(const PmCartesian &a, const PmCartesian &b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+PmCartesian sub(const PmCartesian &a, const PmCartesian &b)
+{
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+PmCartesian scale(const PmCartesian &a, double s)
+{
+    return {a.x * s, a.y * s, a.z * s};
+}
+
+void axes(const EmcPose &p, double *v)
+{
+    v[0] = p.tran.x; v[1] = p.tran.y; v[2] = p.tran.z;
+    v[3] = p.a; v[4] = p.b; v[5] = p.c;
+    v[6] = p.u; v[7] = p.v; v[8] = p.w;
+}
+
+double lerp(double a, double b, double t)
+{
+    return a + (b - a) * t;
+}
+
+// One segment prepared for evaluation at a parameter t in [0, 1].
+// Arcs follow the motion planner: the angle runs counter clockwise
+// about the normal, plus full turns, radius and height along the
+// normal change linearly (spiral and helix).
+struct SegGeom {
+    EmcPose s, e;
+    bool arc;
+    bool nonlinear;     // joint path may leave the chord between samples
+    PmCartesian c, n, u, v;
+    double r0, r1, angle, h0, h1;
+
+    void setup(const EmcPose &start, const PathCheck::Segment &seg,
+               const PathCheck::Arc *a)
+    {
+        s = start;
+        e = seg.end;
+        arc = a != nullptr;
+        // with fixed rotaries every kinematics here is a rigid transform
+        // of XYZ, so a straight move is straight in joint space and its
+        // end points bound it
+        nonlinear = arc || s.a != e.a || s.b != e.b || s.c != e.c;
+        if (!arc)
+            return;
+
+        c = a->center;
+        double nl = std::sqrt(dot(a->normal, a->normal));
+        n = nl > 0.0 ? scale(a->normal, 1.0 / nl) : PmCartesian{0.0, 0.0, 1.0};
+
+        PmCartesian ds = sub(s.tran, c), de = sub(e.tran, c);
+        h0 = dot(ds, n);
+        h1 = dot(de, n);
+        PmCartesian rs = sub(ds, scale(n, h0)), re = sub(de, scale(n, h1));
+        r0 = std::sqrt(dot(rs, rs));
+        r1 = std::sqrt(dot(re, re));
+        u = r0 > 0.0 ? scale(rs, 1.0 / r0) : PmCartesian{1.0, 0.0, 0.0};
+        v = cross(n, u);
+
+        angle = std::atan2(dot(cross(rs, re), n), dot(rs, re));
+        if (angle <= 0.0)
+            angle += 2.0 * M_PI;
+        if (a->turn > 0)
+            angle += 2.0 * M_PI * a->turn;
+    }
+
+    EmcPose eval(double t) const
+    {
+        EmcPose p;
+        if (arc) {
+            double r = lerp(r0, r1, t), h = lerp(h0, h1, t);
+            double ca = std::cos(angle * t), sa = std::sin(angle * t);
+            p.tran.x = c.x + r * (ca * u.x + sa * v.x) + h * n.x;
+            p.tran.y = c.y + r * (ca * u.y + sa * v.y) + h * n.y;
+            p.tran.z = c.z + r * (ca * u.z + sa * v.z) + h * n.z;
+        }
+        else {
+            p.tran.x = lerp(s.tran.x, e.tran.x, t);
+            p.tran.y = lerp(s.tran.y, e.tran.y, t);
+            p.tran.z = lerp(s.tran.z, e.tran.z, t);
+        }
+        p.a = lerp(s.a, e.a, t);
+        p.b = lerp(s.b, e.b, t);
+        p.c = lerp(s.c, e.c, t);
+        p.u = lerp(s.u, e.u, t);
+        p.v = lerp(s.v, e.v, t);
+        p.w = lerp(s.w, e.w, t);
+        return p;
+    }
+
+    // First sampling from the curvature: arc chord error within the
+    // tolerance, rotary axes in fixed angle steps. Whatever is left
+    // between the samples is found by splitting spans.
+    int samples(const PathCheck::Options &opt) const
+    {
+        double n = 1.0;
+        if (arc) {
+            double r = std::max(r0, r1);
+            double step = r > opt.chordTol ? 2.0 * std::acos(1.0 - opt.chordTol / r) : M_PI / 2;
+            n = std::max(n, std::ceil(angle / std::min(step, M_PI / 2)));
+        }
+        double rot = std::max({std::fabs(e.a - s.a), std::fabs(e.b - s.b), std::fabs(e.c - s.c)});
+        if (opt.rotaryStep > 0.0)
+            n = std::max(n, std::ceil(rot / opt.rotaryStep));
+        return (int)std::min(n, (double)kMaxSamples);
+    }
+};
+
+class Worker {
+public:
+    Worker(const PathCheck::Limits &limits, const PathCheck::Options &opt,
+           int kineType, const std::string &geoName, const Kines::Geometry &geo,
+           const std::map<int, double> &tools)
+        : limits_(limits), opt_(opt)
+    {
+        kines_.LoadGeometry(geoName, geo);
+        kines_.SetKineType(kineType);
+        kines_.SetToolTable(tools);
+    }
+
+    // M6 only swaps the active entry, cheap enough per segment. A tool
+    // missing from the table has no length, like an empty spindle
+    void setTool(int tool)
+    {
+        if (tool == tool_)
+            return;
+        if (0 != kines_.ChangeTool(tool))
+            kines_.ChangeTool(0);
+        tool_ = tool;
+    }
+
+    // true and v filled (param, limit) for the first violation
+    bool checkSegment(const SegGeom &g, PathCheck::Violation &v)
+    {
+        const int n = g.samples(opt_);
+        const int stride = EMCMOT_MAX_JOINTS;
+
+        // batch: all first samples through the inverse kinematics at once
+        poses_.resize(n + 1);
+        joints_.assign((size_t)(n + 1) * stride, 0.0);
+        ok_.resize(n + 1);
+        for (int k = 0; k <= n; k++)
+            poses_[k] = g.eval((double)k / n);
+        for (int k = 0; k <= n; k++)
+            ok_[k] = solve(poses_[k], &joints_[(size_t)k * stride]);
+        samples_ += n + 1;
+
+        if (outside(poses_[0], &joints_[0], ok_[0], v)) {
+            v.param = 0.0;
+            return true;
+        }
+        for (int k = 1; k <= n; k++) {
+            Span a{(double)(k - 1) / n, &poses_[k - 1], &joints_[(size_t)(k - 1) * stride]};
+            Span b{(double)k / n, &poses_[k], &joints_[(size_t)k * stride]};
+            if (scan(g, a, b, ok_[k], 0, v))
+                return true;
+        }
+
+        return false;
+    }
+
+    size_t samples() const { return samples_; }
+
+private:
+    struct Span {
+        double t;
+        const EmcPose *pose;
+        const double *joint;
+    };
+
+    bool solve(const EmcPose &p, double *j)
+    {
+        KINEMATICS_INVERSE_FLAGS iflags = 0;
+        KINEMATICS_FORWARD_FLAGS fflags = 0;
+        return 0 == kines_.KinematicsInverse(&p, j, &iflags, &fflags);
+    }
+
+    bool outside(const EmcPose &p, const double *j, bool ok, PathCheck::Violation &v) const
+    {
+        if (!ok) {
+            v.isJoint = true;
+            v.index = -1;
+            v.value = v.limit = 0.0;
+            return true;
+        }
+
+        double a[9];
+        axes(p, a);
+        for (int i = 0; i < 9; i++) {
+            if (!(limits_.axisMask & (1u << i)))
+                continue;
+            if (a[i] < limits_.axisMin[i] || a[i] > limits_.axisMax[i]) {
+                v.isJoint = false;
+                v.index = i;
+                v.value = a[i];
+                v.limit = a[i] < limits_.axisMin[i] ? limits_.axisMin[i] : limits_.axisMax[i];
+                return true;
+            }
+        }
+        for (int i = 0; i < limits_.joints; i++) {
+            if (j[i] < limits_.jointMin[i] || j[i] > limits_.jointMax[i]) {
+                v.isJoint = true;
+                v.index = i;
+                v.value = j[i];
+                v.limit = j[i] < limits_.jointMin[i] ? limits_.jointMin[i] : limits_.jointMax[i];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a is inside, b was solved with result bOk. Returns the first
+    // violation in (a.t, b.t], splitting the span while the joint
+    // path between a and b is not close to the straight chord.
+    bool scan(const SegGeom &g, const Span &a, const Span &b, bool bOk,
+              int depth, PathCheck::Violation &v)
+    {
+        if (outside(*b.pose, b.joint, bOk, v)) {
+            bisect(g, a.t, b.t, v);
+            return true;
+        }
+        if (!g.nonlinear || depth >= opt_.maxDepth)
+            return false;
+
+        double tm = 0.5 * (a.t + b.t);
+        EmcPose pm = g.eval(tm);
+        double jm[EMCMOT_MAX_JOINTS] = {0};
+        bool mOk = solve(pm, jm);
+        samples_++;
+        if (outside(pm, jm, mOk, v)) {
+            bisect(g, a.t, tm, v);
+            return true;
+        }
+
+        double dev = 0.0;
+        for (int i = 0; i < limits_.joints; i++)
+            dev = std::max(dev, std::fabs(jm[i] - 0.5 * (a.joint[i] + b.joint[i])));
+        double pa[9], pb[9], pmv[9];
+        axes(*a.pose, pa);
+        axes(*b.pose, pb);
+        axes(pm, pmv);
+        for (int i = 0; i < 9; i++)
+            dev = std::max(dev, std::fabs(pmv[i] - 0.5 * (pa[i] + pb[i])));
+        if (dev <= opt_.jointTol)
+            return false;
+
+        Span m{tm, &pm, jm};
+        return scan(g, a, m, true, depth + 1, v) ||
+               scan(g, m, b, true, depth + 1, v);
+    }
+
+    // lo inside, hi outside with v describing it: narrow down to the
+    // first parameter outside
+    void bisect(const SegGeom &g, double lo, double hi, PathCheck::Violation &v)
+    {
+        double j[EMCMOT_MAX_JOINTS];
+        PathCheck::Violation t;
+        while (hi - lo > opt_.paramTol) {
+            double mid = 0.5 * (lo + hi);
+            EmcPose p = g.eval(mid);
+            std::fill(j, j + EMCMOT_MAX_JOINTS, 0.0);
+            bool ok = solve(p, j);
+            samples_++;
+            if (outside(p, j, ok, t)) {
+                hi = mid;
+                v = t;
+            }
+            else {
+                lo = mid;
+            }
+        }
+        v.param = hi;
+    }
+
+    Kines kines_;
+    const PathCheck::Limits &limits_;
+    const PathCheck::Options &opt_;
+    std::vector<EmcPose> poses_;
+    std::vector<double> joints_;
+    std::vector<char> ok_;
+    size_t samples_ = 0;
+    int tool_ = 0;
+};
+
+}
+
+PathCheck::Report PathCheck::Run(const Program &program, const Limits &limits,
+                                 const Options &opt)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    Report report;
+    const size_t nseg = program.segments.size();
+    report.segments = nseg;
+
+    const size_t chunks = (nseg + kChunk - 1) / kChunk;
+    int threads = opt.threads > 0 ? opt.threads : (int)std::thread::hardware_concurrency();
+    threads = (int)std::max<size_t>(1, std::min<size_t>(std::max(threads, 1), chunks));
+    report.threads = threads;
+
+    Kines &active = Kines::GetInstance();
+    const int kineType = active.GetKineType();
+    const std::string geoName = active.GetGeometryName();
+    const Kines::Geometry geo = active.GetGeometry();
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> firstBad{std::numeric_limits<size_t>::max()};
+    std::vector<Violation> found(threads);
+    std::vector<size_t> samples(threads, 0);
+
+    auto work = [&](int w) {
+        Worker worker(limits, opt, kineType, geoName, geo, program.tools);
+        SegGeom g;
+        for (;;) {
+            size_t begin = next.fetch_add(1) * kChunk;
+            if (begin >= nseg || begin > firstBad.load(std::memory_order_relaxed))
+                break;
+            size_t end = std::min(nseg, begin + kChunk);
+            for (size_t i = begin; i < end; i++) {
+                const Segment &seg = program.segments[i];
+                const EmcPose &start = i ? program.segments[i - 1].end : program.start;
+                g.setup(start, seg, seg.arc >= 0 ? &program.arcs[seg.arc] : nullptr);
+                worker.setTool(seg.tool);
+
+                Violation v;
+                if (!worker.checkSegment(g, v))
+                    continue;
+                v.found = true;
+                v.segment = i;
+                v.line = seg.line;
+                if (!found[w].found || i < found[w].segment)
+                    found[w] = v;
+                size_t cur = firstBad.load();
+                while (i < cur && !firstBad.compare_exchange_weak(cur, i)) {
+                }
+                break;
+            }
+        }
+        samples[w] = worker.samples();
+    };
+
+    if (threads == 1) {
+        work(0);
+    }
+    else {
+        std::vector<std::thread> pool;
+        for (int w = 0; w < threads; w++)
+            pool.emplace_back(work, w);
+        for (auto &t : pool)
+            t.join();
+    }
+
+    for (int w = 0; w < threads; w++) {
+        report.samples += samples[w];
+        if (found[w].found && (!report.first.found || found[w].segment < report.first.segment))
+            report.first = found[w];
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return report;
+}
+
+std::string PathCheck::ToText(const Report &report)
+{
+    std::stringstream ss;
+    const Violation &v = report.first;
+
+    if (!v.found) {
+        ss << "PathCheck ok";
+    }
+    else {
+        ss << "PathCheck line " << v.line << " segment " << v.segment
+           << std::fixed << std::setprecision(6) << " at " << v.param << " ";
+        if (v.isJoint && v.index < 0)
+            ss << "fails kinematicsInverse";
+        else if (v.isJoint)
+            ss << "joint " << v.index << " " << v.value << " exceeds " << v.limit;
+        else
+            ss << "axis " << kAxisLetters[v.index] << " " << v.value << " exceeds " << v.limit;
+    }
+    ss << std::endl << std::defaultfloat
+       << "Segments " << report.segments << " samples " << report.samples
+       << " threads " << report.threads << " time " << report.seconds << "s";
+
+    return ss.str();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "kineIf.h"
+#include "emcmotcfg.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Offline soft limit check of a whole program.
+// The motion controller only checks the end point of every move, so an
+// arc bulging past a limit or a rotary move whose joints leave the
+// envelope in the middle is not caught. PathCheck samples every segment,
+// runs the inverse kinematics on the samples and checks joint and axis
+// limits along the swept path.
+//
+// Segments are split into chunks that are checked in parallel, each
+// worker with its own Kines instance holding a copy of the active
+// geometry, kinematics type and the program's tool table. Every segment
+// is checked with the tool the program has in the spindle there.
+class PathCheck {
+public:
+    struct Arc {
+        PmCartesian center;
+        PmCartesian normal;
+        int turn;
+    };
+
+    // A segment starts where the previous one ends
+    struct Segment {
+        EmcPose end;
+        int line;       // program line, reported with a violation
+        int arc;        // index into Program::arcs, -1 for a line
+        int tool;       // tool in the spindle, 0 none
+    };
+
+    struct Program {
+        EmcPose start;
+        std::vector<Segment> segments;
+        std::vector<Arc> arcs;
+        std::map<int, double> tools;    // tool lengths by tool number
+    };
+
+    struct Limits {
+        int joints = 0;
+        double jointMin[EMCMOT_MAX_JOINTS];
+        double jointMax[EMCMOT_MAX_JOINTS];
+        unsigned int axisMask = 0;  // bit 0 X .. bit 8 W
+        double axisMin[9];
+        double axisMax[9];
+    };
+
+    struct Options {
+        double chordTol = 0.001;    // arc chord error of the first sampling
+        double jointTol = 0.001;    // joint path error before a span is split
+        double paramTol = 1e-9;     // resolution of the violation parameter
+        double rotaryStep = 1.0;    // rotary degrees per first sample
+        int maxDepth = 16;          // span splits per first sample
+        int threads = 0;            // 0 uses every hardware thread
+    };
+
+    struct Violation {
+        bool found = false;
+        size_t segment = 0;
+        int line = 0;
+        double param = 0.0;         // 0 segment start .. 1 segment end
+        bool isJoint = false;       // joint or axis limit
+        int index = 0;              // joint number or axis 0..8
+        double value = 0.0;
+        double limit = 0.0;
+    };
+
+    struct Report {
+        Violation first;
+        size_t segments = 0;
+        size_t samples = 0;
+        int threads = 0;
+        double seconds = 0.0;
+    };
+
+    static Report Run(const Program &program, const Limits &limits,
+                      const Options &opt);
+    static std::string ToText(const Report &report);
+
+    PathCheck() = delete;
+};
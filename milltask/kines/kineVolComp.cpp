@@ -0,0 +1,287 @@
+#include "kineVolComp.h"
+#include "emcmotcfg.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+struct VolCompFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n[3];
+    double origin[3];
+    double spacing[3];
+    double squareness[3];
+    double rotary[3];
+};
+
+// Remove() inverts Apply() by fixed point iteration. The errors are
+// small against the grid spacing, so it converges in a few steps
+constexpr int kRemoveIterations = 3;
+
+}
+
+VolComp &VolComp::GetInstance()
+{
+    static VolComp _instance;
+    return _instance;
+}
+
+int VolComp::Load(const std::string &filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return -1;
+
+    // field by field, the struct has padding the file does not
+    VolCompFileHeader hdr;
+    ifs.read(hdr.magic, sizeof(hdr.magic));
+    ifs.read(reinterpret_cast<char *>(&hdr.version), sizeof(hdr.version));
+    ifs.read(reinterpret_cast<char *>(hdr.n), sizeof(hdr.n));
+    ifs.read(reinterpret_cast<char *>(hdr.origin), sizeof(hdr.origin));
+    ifs.read(reinterpret_cast<char *>(hdr.spacing), sizeof(hdr.spacing));
+    ifs.read(reinterpret_cast<char *>(hdr.squareness), sizeof(hdr.squareness));
+    ifs.read(reinterpret_cast<char *>(hdr.rotary), sizeof(hdr.rotary));
+    if (!ifs || std::memcmp(hdr.magic, "VCMP", 4) != 0 || hdr.version != 1)
+        return -1;
+
+    auto map = std::make_unique<Map>();
+    map->file = filename;
+    for (int k = 0; k < 3; k++) {
+        if (hdr.n[k] < 2 || hdr.n[k] > 4096 || !(hdr.spacing[k] > 0.0))
+            return -1;
+        map->n[k] = (int)hdr.n[k];
+        map->cells[k] = map->n[k] - 1;
+        map->bricks[k] = (map->cells[k] + kBrickCells - 1) / kBrickCells;
+        map->origin[k] = hdr.origin[k];
+        map->invSpacing[k] = 1.0 / hdr.spacing[k];
+        map->squareness[k] = hdr.squareness[k];
+        map->rotary[k] = hdr.rotary[k];
+    }
+
+    const size_t count = (size_t)map->n[0] * map->n[1] * map->n[2];
+    std::vector<float> raw(count * 3);
+    ifs.read(reinterpret_cast<char *>(raw.data()), raw.size() * sizeof(float));
+    if (!ifs)
+        return -1;
+
+    // the file as read, a recording keeps it to tell maps apart
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto fnv = [&h](const void *p, size_t n) {
+        const unsigned char *c = static_cast<const unsigned char *>(p);
+        for (size_t i = 0; i < n; i++) {
+            h ^= c[i];
+            h *= 0x100000001b3ULL;
+        }
+    };
+    fnv(hdr.n, sizeof(hdr.n));
+    fnv(hdr.origin, sizeof(hdr.origin));
+    fnv(hdr.spacing, sizeof(hdr.spacing));
+    fnv(hdr.squareness, sizeof(hdr.squareness));
+    fnv(hdr.rotary, sizeof(hdr.rotary));
+    fnv(raw.data(), raw.size() * sizeof(float));
+    map->digest = h;
+
+    // Re-layout into overlapping bricks, nodes past the grid end repeat
+    // the last node so every brick is complete
+    const int bnodes = kBrick * kBrick * kBrick;
+    map->nodes.resize((size_t)map->bricks[0] * map->bricks[1] * map->bricks[2] * bnodes);
+    for (int bz = 0; bz < map->bricks[2]; bz++)
+    for (int by = 0; by < map->bricks[1]; by++)
+    for (int bx = 0; bx < map->bricks[0]; bx++) {
+        Node *brick = &map->nodes[(((size_t)bz * map->bricks[1] + by) * map->bricks[0] + bx) * bnodes];
+        for (int lz = 0; lz < kBrick; lz++)
+        for (int ly = 0; ly < kBrick; ly++)
+        for (int lx = 0; lx < kBrick; lx++) {
+            int x = std::min(bx * kBrickCells + lx, map->n[0] - 1);
+            int y = std::min(by * kBrickCells + ly, map->n[1] - 1);
+            int z = std::min(bz * kBrickCells + lz, map->n[2] - 1);
+            const float *src = &raw[(((size_t)z * map->n[1] + y) * map->n[0] + x) * 3];
+            Node &node = brick[(lz * kBrick + ly) * kBrick + lx];
+            node.d[0] = src[0];
+            node.d[1] = src[1];
+            node.d[2] = src[2];
+            node.d[3] = 0.0f;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mapMutex_);
+    const Map *published = map.get();
+    maps_.push_back(std::move(map));
+    map_.store(published, std::memory_order_release);
+
+    return 0;
+}
+
+void VolComp::Unload()
+{
+    map_.store(nullptr, std::memory_order_release);
+}
+
+void VolComp::Bind(const std::string &geometry)
+{
+    std::lock_guard<std::mutex> lock(mapMutex_);
+    geometries_[geometry] = map_.load(std::memory_order_acquire);
+}
+
+int VolComp::Select(const std::string &geometry)
+{
+    std::lock_guard<std::mutex> lock(mapMutex_);
+    auto it = geometries_.find(geometry);
+    if (it == geometries_.end())
+        return -1;
+    map_.store(it->second, std::memory_order_release);
+    return 0;
+}
+
+void VolComp::SetEnable(bool enable)
+{
+    enable_.store(enable, std::memory_order_release);
+}
+
+bool VolComp::IsActive()
+{
+    return enable_.load(std::memory_order_acquire) &&
+           map_.load(std::memory_order_acquire) != nullptr;
+}
+
+uint64_t VolComp::Digest()
+{
+    const Map *map = map_.load(std::memory_order_acquire);
+    if (!map || !enable_.load(std::memory_order_acquire))
+        return 0;
+    return map->digest;
+}
+
+std::string VolComp::showVolComp()
+{
+    const Map *map = map_.load(std::memory_order_acquire);
+    std::stringstream ss;
+
+    if (!map) {
+        ss << "VolComp none";
+        return ss.str();
+    }
+
+    ss << "VolComp " << map->file << (enable_.load() ? " enabled" : " disabled") << std::endl;
+    ss << "Nodes " << map->n[0] << " " << map->n[1] << " " << map->n[2] << std::endl;
+    ss << "Origin " << map->origin[0] << " " << map->origin[1] << " " << map->origin[2] << std::endl;
+    ss << "Spacing " << 1.0 / map->invSpacing[0] << " " << 1.0 / map->invSpacing[1]
+       << " " << 1.0 / map->invSpacing[2] << std::endl;
+    ss << "Squareness " << map->squareness[0] << " " << map->squareness[1]
+       << " " << map->squareness[2] << std::endl;
+    ss << "Rotary " << map->rotary[0] << " " << map->rotary[1] << " " << map->rotary[2];
+
+    return ss.str();
+}
+
+// Trilinear interpolation of the grid at p plus squareness terms.
+// Outside the grid the edge values are held.
+void VolComp::lookup(const Map *map, const double *p, double *d) const
+{
+    int cell[3], local[3], brick[3];
+    double f[3];
+
+    for (int k = 0; k < 3; k++) {
+        double u = (p[k] - map->origin[k]) * map->invSpacing[k];
+        u = std::clamp(u, 0.0, (double)map->cells[k]);
+        cell[k] = std::min((int)u, map->cells[k] - 1);
+        f[k] = u - cell[k];
+        brick[k] = cell[k] / kBrickCells;
+        local[k] = cell[k] - brick[k] * kBrickCells;
+    }
+
+    const Node *b = &map->nodes[(((size_t)brick[2] * map->bricks[1] + brick[1]) * map->bricks[0] + brick[0])
+                                * (kBrick * kBrick * kBrick)];
+    const Node *c = b + (local[2] * kBrick + local[1]) * kBrick + local[0];
+    const int sy = kBrick, sz = kBrick * kBrick;
+
+    const double fx = f[0], fy = f[1], fz = f[2];
+    for (int k = 0; k < 3; k++) {
+        double c00 = c[0].d[k]       + fx * (c[1].d[k]       - c[0].d[k]);
+        double c10 = c[sy].d[k]      + fx * (c[sy + 1].d[k]  - c[sy].d[k]);
+        double c01 = c[sz].d[k]      + fx * (c[sz + 1].d[k]  - c[sz].d[k]);
+        double c11 = c[sz + sy].d[k] + fx * (c[sz + sy + 1].d[k] - c[sz + sy].d[k]);
+        double c0 = c00 + fy * (c10 - c00);
+        double c1 = c01 + fy * (c11 - c01);
+        d[k] = c0 + fz * (c1 - c0);
+    }
+
+    d[0] += map->squareness[0] * p[1] + map->squareness[1] * p[2];
+    d[1] += map->squareness[2] * p[2];
+}
+
+void VolComp::Apply(double *joint)
+{
+    if (!enable_.load(std::memory_order_relaxed))
+        return;
+    const Map *map = map_.load(std::memory_order_acquire);
+    if (!map)
+        return;
+
+    double d[3];
+    lookup(map, joint, d);
+    joint[0] += d[0];
+    joint[1] += d[1];
+    joint[2] += d[2];
+    joint[3] += map->rotary[0];
+    joint[4] += map->rotary[1];
+    joint[5] += map->rotary[2];
+}
+
+void VolComp::Remove(const double *joint, double *out)
+{
+    std::copy(joint, joint + EMCMOT_MAX_JOINTS, out);
+
+    if (!enable_.load(std::memory_order_relaxed))
+        return;
+    const Map *map = map_.load(std::memory_order_acquire);
+    if (!map)
+        return;
+
+    double d[3];
+    for (int i = 0; i < kRemoveIterations; i++) {
+        lookup(map, out, d);
+        out[0] = joint[0] - d[0];
+        out[1] = joint[1] - d[1];
+        out[2] = joint[2] - d[2];
+    }
+    out[3] = joint[3] - map->rotary[0];
+    out[4] = joint[4] - map->rotary[1];
+    out[5] = joint[5] - map->rotary[2];
+}
+
+double VolComp::Bench(int samples)
+{
+    const Map *map = map_.load(std::memory_order_acquire);
+    if (!map || samples <= 0)
+        return -1.0;
+
+    // points are drawn before the clock starts, only the lookups count
+    std::mt19937 rng(1);
+    std::vector<double> points((size_t)samples * 3);
+    for (int k = 0; k < 3; k++) {
+        std::uniform_real_distribution<double> dist(
+            map->origin[k], map->origin[k] + map->cells[k] / map->invSpacing[k]);
+        for (int i = 0; i < samples; i++)
+            points[(size_t)i * 3 + k] = dist(rng);
+    }
+
+    double d[3], sum = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < samples; i++) {
+        lookup(map, &points[(size_t)i * 3], d);
+        sum += d[0];
+    }
+    auto end = std::chrono::steady_clock::now();
+    volatile double sink = sum;
+    (void)sink;
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / samples;
+}
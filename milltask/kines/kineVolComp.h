@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Volumetric error compensation.
+//
+// A regular XYZ grid of measured errors (machine coordinates of joints
+// 0..2) is applied to the joint positions after the inverse kinematics
+// and removed again before the forward kinematics, with trilinear
+// interpolation between grid nodes. Global squareness terms and fixed
+// offsets of the rotary joints 3..5 are applied on top.
+//
+// Binary file layout, little endian, no padding:
+//
+//   char     magic[4]      "VCMP"
+//   uint32   version       1
+//   uint32   nx, ny, nz    grid nodes per axis, each >= 2
+//   double   origin[3]     position of node (0,0,0)
+//   double   spacing[3]    node distance per axis, > 0
+//   double   squareness[3] xy, xz, yz in rad:
+//                          dx += xy*y + xz*z, dy += yz*z
+//   double   rotary[3]     offsets added to joints 3, 4, 5
+//   float    error[nz][ny][nx][3]  dx, dy, dz per node, x fastest
+//
+// In memory the nodes are stored in 4x4x4 bricks that overlap by one
+// node, so the 8 corners of any cell are inside one 1 KiB brick.
+class VolComp {
+public:
+    static VolComp& GetInstance();
+
+    VolComp(const VolComp&) = delete;
+    VolComp& operator=(const VolComp&) = delete;
+
+    int Load(const std::string &filename);
+    void Unload();
+    // Keeps the current map, or none, as the one of a kinematics
+    // geometry, Select() publishes it again when the geometry is
+    // reselected from the cache
+    void Bind(const std::string &geometry);
+    int Select(const std::string &geometry);
+    // steps the joints by the error, switch with the machine at rest
+    void SetEnable(bool enable);
+    bool IsActive();
+    std::string showVolComp();
+    // ns per Apply() over random points of the grid, -1 without a map
+    double Bench(int samples);
+    // FNV-1a of the active map file, 0 while compensation is off
+    uint64_t Digest();
+
+    // joints are full EMCMOT_MAX_JOINTS arrays
+    void Apply(double *joint);                     // nominal -> commanded
+    void Remove(const double *joint, double *out); // commanded -> nominal
+
+private:
+    VolComp() = default;
+
+    static constexpr int kBrick = 4;               // nodes per brick edge
+    static constexpr int kBrickCells = kBrick - 1; // cells per brick edge
+
+    struct alignas(16) Node {
+        float d[4];  // dx, dy, dz, unused
+    };
+
+    struct Map {
+        std::string file;
+        uint64_t digest;
+        int n[3];
+        int cells[3];
+        int bricks[3];
+        double origin[3];
+        double invSpacing[3];
+        double squareness[3];
+        double rotary[3];
+        std::vector<Node> nodes;   // brick after brick, 64 nodes each
+    };
+
+    void lookup(const Map *map, const double *p, double *d) const;
+
+    std::atomic<const Map *> map_{nullptr};
+    std::atomic<bool> enable_{true};
+
+    std::mutex mapMutex_;
+    std::vector<std::unique_ptr<Map>> maps_;   // never freed, see Kines models
+    std::map<std::string, const Map *> geometries_;
+};
@@ -21,6 +21,13 @@
 #include "rtapi_math.h"
 #include "homing.h"
 #include "axis.h"
+#include "kines/kineInterp.h"
+#include "motionServo.h"
+#include "motionSpindle.h"
+#include "motionProfile.h"
+#include "motionComp.h"
+#include "motionJerkTp.h"
+#include "motionStatus.h"
 #include "hal.h"
 
 // Mark strings for translation, but defer translation to userspace
@@ -1094,10 +1101,16 @@ static int init_comm_buffers(void)
     joint->ferror = 0.0;
     joint->ferror_limit = joint->min_ferror;
     joint->ferror_high_mark = 0.0;
+    }
 
     /* init internal info */
-    cubicInit(&(joint->cubic));
-    }
+    jointInterpInit(&jointInterp, NO_OF_KINS_JOINTS);
+    servoModelInit(&servoModel, num_joints);
+    spindleModelInit(&spindleModel, num_spindles);
+    motProfInit();
+    motCompInit();
+    jerkTpInit();
+    motStatusInit();
 
     emcmotStatus->tail = 0;
 
@@ -1192,20 +1205,31 @@ static int init_threads(void)
     return 0;
 }
 
+/* set the servo and traj periods before rtapi_app_main_motion(),
+   they take the place of the servo_period_nsec and traj_period_nsec
+   module parameters */
+void emcmotSetPeriods(long servo_nsec, long traj_nsec)
+{
+    if (servo_nsec > 0) {
+    servo_period_nsec = servo_nsec;
+    }
+    traj_period_nsec = traj_nsec > servo_nsec ? traj_nsec : 0;
+}
+
+/* nsec is the servo period the controller is called with, the traj
+   period keeps its configured multiple of it */
 void emcmotSetCycleTime(unsigned long nsec )
 {
-    int servo_mult;
-    servo_mult = traj_period_nsec / nsec;
-    if(servo_mult < 0) servo_mult = 1;
-    setTrajCycleTime(nsec * 1e-9);
-    setServoCycleTime(nsec * servo_mult * 1e-9);
+    long servo_mult;
+    servo_mult = (traj_period_nsec + (long)nsec / 2) / (long)nsec;
+    if(servo_mult < 1) servo_mult = 1;
+    setServoCycleTime(nsec * 1e-9);
+    setTrajCycleTime(nsec * servo_mult * 1e-9);
 }
 
 /* call this when setting the trajectory cycle time */
 static int setTrajCycleTime(double secs)
 {
-    static int t;
-
     rtapi_print_msg(RTAPI_MSG_INFO,
     "MOTION: setting Traj cycle time to %ld nsecs\n", (long) (secs * 1e9));
 
@@ -1226,11 +1250,10 @@ static int setTrajCycleTime(double secs)
     /* set traj planner */
     tpSetCycleTime(&emcmotInternal->coord_tp, secs);
 
-    /* set the free planners, cubic interpolation rate and segment time */
-    for (t = 0; t < ALL_JOINTS; t++) {
-    cubicSetInterpolationRate(&(joints[t].cubic),
+    /* one interpolator segment per planner cycle */
+    jointInterpSetInterpolationRate(&jointInterp,
         emcmotConfig->interpolationRate);
-    }
+    jointInterpSetSegmentTime(&jointInterp, secs);
 
     /* copy into status out */
     emcmotConfig->trajCycleTime = secs;
@@ -1241,8 +1264,6 @@ static int setTrajCycleTime(double secs)
 /* call this when setting the servo cycle time */
 static int setServoCycleTime(double secs)
 {
-    static int t;
-
     rtapi_print_msg(RTAPI_MSG_INFO,
     "MOTION: setting Servo cycle time to %ld nsecs\n", (long) (secs * 1e9));
 
@@ -1257,12 +1278,13 @@ static int setServoCycleTime(double secs)
     emcmotConfig->interpolationRate =
     (int) (emcmotConfig->trajCycleTime / secs + 0.5);
 
-    /* set the cubic interpolation rate and PID cycle time */
-    for (t = 0; t < ALL_JOINTS; t++) {
-    cubicSetInterpolationRate(&(joints[t].cubic),
+    /* set the joint interpolation rate, the segment time is the
+       traj period and is set with it */
+    jointInterpSetInterpolationRate(&jointInterp,
         emcmotConfig->interpolationRate);
-    cubicSetSegmentTime(&(joints[t].cubic), secs);
-    }
+    servoModelSetPeriod(&servoModel, secs);
+    spindleModelSetPeriod(&spindleModel, secs);
+    motProfSetPeriod(secs);
 
     /* copy into status out */
     emcmotConfig->servoCycleTime = secs;
@@ -4,6 +4,7 @@
 #include "rtapi.h"
 #include "rtapi_math.h"
 #include "simple_tp.h"
+#include "motionJerkTp.h"
 
 typedef struct {
     double pos_cmd;                 /* commanded axis position */
@@ -82,6 +83,7 @@ void axis_initialize_external_offsets(void)
         axis_array[n].ext_offset_tp.pos_cmd  = 0;
         axis_array[n].ext_offset_tp.curr_pos = 0;
         axis_array[n].ext_offset_tp.curr_vel = 0;
+        jerkTpReset(JERK_TP_EOFFSET(n));
     }
 }
 
@@ -353,6 +355,7 @@ bool axis_jog_abort(int axis_num, bool immediate)
     axis->wheel_ajog_active = 0;
     if (immediate) {
         axis->teleop_tp.curr_vel = 0.0;
+        jerkTpReset(JERK_TP_AXIS(axis_num));
     }
     return aborted;
 }
@@ -599,7 +602,7 @@ int axis_update_coord_with_bound(double *pcmd_p[], double servo_period)
         axis = &axis_array[n];
         save_pos_cmd[n]     = *pcmd_p[n];
         save_offset_cmd[n]  = axis->ext_offset_tp.pos_cmd;
-        simple_tp_update(&(axis->ext_offset_tp), servo_period);
+        jerkTpUpdate(&(axis->ext_offset_tp), JERK_TP_EOFFSET(n), servo_period);
     }
     axis_apply_ext_offsets_to_carte_pos(+1, pcmd_p); // add external offsets
 
@@ -624,6 +627,7 @@ int axis_update_coord_with_bound(double *pcmd_p[], double servo_period)
                 axis->ext_offset_tp.pos_cmd = save_offset_cmd[n];
             }
             axis->ext_offset_tp.curr_vel = 0;
+            jerkTpReset(JERK_TP_EOFFSET(n));
             ans++;
             continue;
         }
@@ -635,6 +639,7 @@ int axis_update_coord_with_bound(double *pcmd_p[], double servo_period)
                 axis->ext_offset_tp.pos_cmd = save_offset_cmd[n];
             }
             axis->ext_offset_tp.curr_vel = 0;
+            jerkTpReset(JERK_TP_EOFFSET(n));
             ans++;
         }
     }
@@ -642,16 +647,16 @@ int axis_update_coord_with_bound(double *pcmd_p[], double servo_period)
     return 0;
 }
 
-static int update_teleop_with_check(int axis_num, simple_tp_t *the_tp, double servo_period)
+static int update_teleop_with_check(int axis_num, simple_tp_t *the_tp, int lane, double servo_period)
 {
-    // 'the_tp' is the planner to update
+    // 'the_tp' is the planner to update, 'lane' its jerk limited lane
     // the tests herein apply to the sum of the offsets for both
     // planners (teleop_tp and ext_offset_tp)
     double save_curr_pos;
     emcmot_axis_t *axis = &axis_array[axis_num];
 
     save_curr_pos = the_tp->curr_pos;
-    simple_tp_update(the_tp, servo_period);
+    jerkTpUpdate(the_tp, lane, servo_period);
 
     //workaround: axis letters not in [TRAJ]COORDINATES
     //            have min_pos_limit == max_pos_lim == 0
@@ -663,6 +668,7 @@ static int update_teleop_with_check(int axis_num, simple_tp_t *the_tp, double se
         // positive error, restore save_curr_pos
         the_tp->curr_pos = save_curr_pos;
         the_tp->curr_vel = 0;
+        jerkTpReset(lane);
         return 1;
     }
     if  ( (axis->ext_offset_tp.curr_pos + axis->teleop_tp.curr_pos)
@@ -670,6 +676,7 @@ static int update_teleop_with_check(int axis_num, simple_tp_t *the_tp, double se
         // negative error, restore save_curr_pos
         the_tp->curr_pos = save_curr_pos;
         the_tp->curr_vel = 0;
+        jerkTpReset(lane);
         return 1;
     }
     return 0;
@@ -687,7 +694,7 @@ int axis_calc_motion(double servo_period)
         if (axis->teleop_tp.max_vel > axis->vel_limit) {
             axis->teleop_tp.max_vel = axis->vel_limit;
         }
-        if (update_teleop_with_check(axis_num, &(axis->teleop_tp), servo_period)) {
+        if (update_teleop_with_check(axis_num, &(axis->teleop_tp), JERK_TP_AXIS(axis_num), servo_period)) {
             violated_teleop_limit = 1;
         } else {
             axis->teleop_vel_cmd = axis->teleop_tp.curr_vel;
@@ -700,7 +707,7 @@ int axis_calc_motion(double servo_period)
         }
 
         if (axis->ext_offset_tp.enable) {
-            if (update_teleop_with_check(axis_num, &(axis->ext_offset_tp), servo_period)) {
+            if (update_teleop_with_check(axis_num, &(axis->ext_offset_tp), JERK_TP_EOFFSET(axis_num), servo_period)) {
                 violated_teleop_limit = 1;
             }
         }
@@ -69,6 +69,7 @@
 #include "axis.h"
 
 #include "tp_debug.h"
+#include "emcMetrics.h"
 
 #define ABS(x) (((x) < 0) ? -(x) : (x))
 
@@ -79,6 +80,17 @@ extern int motion_num_spindles;
 
 static int rehomeAll;
 
+/* segments the planner accepted, sharded counters, see emcMetrics.h */
+enum { SEGMENT_LINE, SEGMENT_CIRCLE, SEGMENT_RIGID_TAP, SEGMENT_TYPES };
+static EMCMetrics::Counter *segmentsAdded[SEGMENT_TYPES] = {
+    &EMCMetrics::GetCounter("cncsim_segments_added_total{type=\"line\"}",
+                            "segments added to the planner"),
+    &EMCMetrics::GetCounter("cncsim_segments_added_total{type=\"circle\"}",
+                            "segments added to the planner"),
+    &EMCMetrics::GetCounter("cncsim_segments_added_total{type=\"rigid_tap\"}",
+                            "segments added to the planner"),
+};
+
 /* limits_ok() returns 1 if none of the hard limits are set,
    0 if any are set. Called on a linear and circular move. */
 STATIC int limits_ok(void)
@@ -1036,6 +1048,9 @@ void emcmotCommandHandler_locked(void *arg, long servo_period)
                     issue_atspeed,
                     emcmotCommand->turn,
                     emcmotCommand->tag);
+        if (res_addline == 0) {
+            segmentsAdded[SEGMENT_LINE]->Add();
+        }
         //KLUDGE ignore zero length line
         if (res_addline < 0) {
             reportError(_("can't add linear move at line %d, error code %d"),
@@ -1094,6 +1109,9 @@ void emcmotCommandHandler_locked(void *arg, long servo_period)
                             emcmotCommand->vel, emcmotCommand->ini_maxvel,
                             emcmotCommand->acc, emcmotStatus->enables_new,
                 issue_atspeed, emcmotCommand->tag);
+        if (res_addcircle == 0) {
+            segmentsAdded[SEGMENT_CIRCLE]->Add();
+        }
         if (res_addcircle < 0) {
             reportError(_("can't add circular move at line %d, error code %d"),
                     emcmotCommand->id, res_addcircle);
@@ -1497,6 +1515,9 @@ void emcmotCommandHandler_locked(void *arg, long servo_period)
                                     emcmotStatus->enables_new,
                                     emcmotCommand->scale,
                                     emcmotCommand->tag);
+        if (res_addtap == 0) {
+            segmentsAdded[SEGMENT_RIGID_TAP]->Add();
+        }
         if (res_addtap < 0) {
             emcmotStatus->atspeed_next_feed = 0; /* rigid tap always waits for spindle to be at-speed */
             reportError(_("can't add rigid tap move at line %d, error code %d"),
@@ -1911,12 +1932,9 @@ void emcmotCommandHandler_locked(void *arg, long servo_period)
 
 
 void emcmotCommandHandler(void *arg, long servo_period) {
-    if (rtapi_mutex_try(&emcmotStruct->command_mutex) != 0) {
-        // Failed to take the mutex, because it is held by Task.
-        // This means Task is in the process of updating the command.
-        // Give up for now, and try again on the next invocation.
-        return;
-    }
+    // Commands reach the motion thread only through the EMCChannel
+    // lanes and are copied into emcmotCommand by that same thread,
+    // nothing else writes it, so there is no command_mutex to take
+    // and no cycle is skipped.
     emcmotCommandHandler_locked(arg, servo_period);
-    rtapi_mutex_give(&emcmotStruct->command_mutex);
 }
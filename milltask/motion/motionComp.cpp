@@ -0,0 +1,330 @@
+/********************************************************************
+* Description: motionComp.cpp
+*   Compensation tables, see motionComp.h
+*
+*   A replaced table is retired with the cycle count of the motion
+*   thread at that moment. Any cycle that could still have loaded it
+*   was running then, so once the count has moved on the table is
+*   unused and the next load or unload frees it.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionComp.h"
+#include "motionJerkTp.h"
+#include "rtapi.h"
+#include "rtapi_math.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct TABLE_NODE {
+    MOT_COMP_TABLE table;
+    unsigned long retiredAt;	/* cycles when it was replaced */
+    struct TABLE_NODE *next;
+} TABLE_NODE;
+
+/* under loadMutex: the published node per joint, replaced ones */
+static std::mutex loadMutex;
+static TABLE_NODE *current[EMCMOT_MAX_JOINTS];
+static TABLE_NODE *retired;
+
+static std::atomic<const MOT_COMP_TABLE *> tables[EMCMOT_MAX_JOINTS];
+static std::atomic<int> entries[EMCMOT_MAX_JOINTS];
+/* motion cycles done, bumped by motCompCycleDone() */
+static std::atomic<unsigned long> cycles;
+
+/* motion thread state */
+typedef struct {
+    const MOT_COMP_TABLE *table;	/* table seg belongs to */
+    int seg;
+} JOINT_STATE;
+
+static JOINT_STATE state[EMCMOT_MAX_JOINTS];
+
+typedef struct {
+    std::atomic<unsigned long> lookups;
+    std::atomic<unsigned long> neighbour;
+    std::atomic<unsigned long> searches;
+} JOINT_STATS;
+
+static JOINT_STATS stats[EMCMOT_MAX_JOINTS];
+
+#define FNV_BASIS 0xcbf29ce484222325ULL
+
+static unsigned long long fnv(unsigned long long h, const void *p, size_t n)
+{
+    const unsigned char *c = (const unsigned char *)p;
+    for (size_t i = 0; i < n; i++) {
+        h ^= c[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static inline void count(std::atomic<unsigned long> *c)
+{
+    c->store(c->load(std::memory_order_relaxed) + 1,
+             std::memory_order_relaxed);
+}
+
+static void freeNode(TABLE_NODE * node)
+{
+    delete[] node->table.nominal;
+    delete[] node->table.seg;
+    delete node;
+}
+
+/* under loadMutex. Unpublish the table of joint, t may be 0, and free
+   the retired tables no cycle can be using any more */
+static void publish(int joint, TABLE_NODE * node)
+{
+    tables[joint].store(node ? &node->table : 0, std::memory_order_seq_cst);
+    entries[joint].store(node ? node->table.entries : 0,
+                         std::memory_order_relaxed);
+    unsigned long now = cycles.load(std::memory_order_seq_cst);
+
+    if (current[joint]) {
+        current[joint]->retiredAt = now;
+        current[joint]->next = retired;
+        retired = current[joint];
+    }
+    current[joint] = node;
+
+    TABLE_NODE **link = &retired;
+    while (*link) {
+        TABLE_NODE *old = *link;
+        if (old->retiredAt != now) {
+            *link = old->next;
+            freeNode(old);
+        } else {
+            link = &old->next;
+        }
+    }
+}
+
+int motCompLoad(int joint, const char *file, int type)
+{
+    FILE *fp;
+    char buffer[256];
+    double nom, fwd, rev;
+    std::vector<double> points;
+    int line = 0;
+
+    if (joint < 0 || joint >= EMCMOT_MAX_JOINTS || 0 == file) {
+        return -1;
+    }
+    if (NULL == (fp = fopen(file, "r"))) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "can't open compensation file %s\n", file);
+        return -1;
+    }
+    while (NULL != fgets(buffer, sizeof(buffer), fp)) {
+        const char *p = buffer + strspn(buffer, " \t");
+        line++;
+        if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#') {
+            continue;
+        }
+        if (3 != sscanf(p, "%lf %lf %lf", &nom, &fwd, &rev)) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "%s:%d: expected three numbers\n",
+                            file, line);
+            fclose(fp);
+            return -1;
+        }
+        if (!points.empty() && nom <= points[points.size() - 3]) {
+            rtapi_print_msg(RTAPI_MSG_ERR,
+                            "%s:%d: compensation values must increase\n",
+                            file, line);
+            fclose(fp);
+            return -1;
+        }
+        if (points.size() / 3 >= MOT_COMP_MAX_ENTRIES) {
+            rtapi_print_msg(RTAPI_MSG_ERR, "%s: more than %d points\n",
+                            file, MOT_COMP_MAX_ENTRIES);
+            fclose(fp);
+            return -1;
+        }
+        if (type == 0) {
+            /* convert to diffs, see usrmotLoadComp() */
+            fwd = nom - fwd;
+            rev = nom - rev;
+        }
+        points.push_back(nom);
+        points.push_back(fwd);
+        points.push_back(rev);
+    }
+    fclose(fp);
+
+    int n = (int)(points.size() / 3);
+    if (n == 0) {
+        rtapi_print_msg(RTAPI_MSG_ERR, "%s: no compensation points\n", file);
+        return -1;
+    }
+
+    TABLE_NODE *node = new TABLE_NODE;
+    MOT_COMP_TABLE *t = &node->table;
+    t->entries = n;
+    t->digest = fnv(FNV_BASIS, points.data(), points.size() * sizeof(double));
+    t->nominal = new double[n + 3];
+    t->seg = new MOT_COMP_SEG[n + 1];
+
+    /* segment 0 is below the first point and segment n above the
+       last, both hold the trims of their end with no slope */
+    t->nominal[0] = -DBL_MAX;
+    t->nominal[n + 1] = DBL_MAX;
+    t->nominal[n + 2] = DBL_MAX;
+    t->seg[0].fwd_trim = points[1];
+    t->seg[0].rev_trim = points[2];
+    t->seg[0].fwd_slope = 0.0;
+    t->seg[0].rev_slope = 0.0;
+    for (int i = 0; i < n; i++) {
+        MOT_COMP_SEG *s = &t->seg[i + 1];
+        t->nominal[i + 1] = points[3 * i];
+        s->fwd_trim = points[3 * i + 1];
+        s->rev_trim = points[3 * i + 2];
+        if (i + 1 < n) {
+            double span = points[3 * i + 3] - points[3 * i];
+            s->fwd_slope = (points[3 * i + 4] - s->fwd_trim) / span;
+            s->rev_slope = (points[3 * i + 5] - s->rev_trim) / span;
+        } else {
+            s->fwd_slope = 0.0;
+            s->rev_slope = 0.0;
+        }
+    }
+
+    node->next = 0;
+    std::lock_guard<std::mutex> lock(loadMutex);
+    publish(joint, node);
+
+    return n;
+}
+
+void motCompUnload(int joint)
+{
+    if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(loadMutex);
+    publish(joint, 0);
+}
+
+int motCompSetJerk(int joint, double jerk)
+{
+    if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+    return jerkTpSetJerk(JERK_TP_COMP(joint), jerk);
+}
+
+void motCompGetStats(int joint, MOT_COMP_STATS * st)
+{
+    memset(st, 0, sizeof(*st));
+    if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return;
+    }
+    /* not the table itself, it may be freed under our feet */
+    st->entries = entries[joint].load(std::memory_order_relaxed);
+    st->jerk = jerkTpGetJerk(JERK_TP_COMP(joint));
+    st->lookups = stats[joint].lookups.load(std::memory_order_relaxed);
+    st->neighbour = stats[joint].neighbour.load(std::memory_order_relaxed);
+    st->searches = stats[joint].searches.load(std::memory_order_relaxed);
+}
+
+void motCompClearStats(void)
+{
+    for (int j = 0; j < EMCMOT_MAX_JOINTS; j++) {
+        stats[j].lookups.store(0, std::memory_order_relaxed);
+        stats[j].neighbour.store(0, std::memory_order_relaxed);
+        stats[j].searches.store(0, std::memory_order_relaxed);
+    }
+}
+
+void motCompInit(void)
+{
+    for (int j = 0; j < EMCMOT_MAX_JOINTS; j++) {
+        state[j].table = 0;
+        state[j].seg = 0;
+    }
+}
+
+unsigned long long motCompDigest(void)
+{
+    unsigned long long h = FNV_BASIS;
+
+    for (int j = 0; j < EMCMOT_MAX_JOINTS; j++) {
+        const MOT_COMP_TABLE *t = tables[j].load(std::memory_order_acquire);
+        unsigned long long d = t ? t->digest : 0;
+        double jerk = jerkTpGetJerk(JERK_TP_COMP(j));
+        h = fnv(h, &d, sizeof(d));
+        h = fnv(h, &jerk, sizeof(jerk));
+    }
+    return h;
+}
+
+void motCompCycleDone(void)
+{
+    cycles.fetch_add(1, std::memory_order_seq_cst);
+}
+
+/* segment holding pos, starting from the one used last cycle */
+static inline int findSeg(const MOT_COMP_TABLE * t, int i, double pos,
+    JOINT_STATS * js)
+{
+    const double *nom = t->nominal;
+
+    if (pos >= nom[i]) {
+        if (pos < nom[i + 1]) {
+            return i;
+        }
+        if (pos < nom[i + 2]) {
+            count(&js->neighbour);
+            return i + 1;
+        }
+    } else if (i > 0 && pos >= nom[i - 1]) {
+        count(&js->neighbour);
+        return i - 1;
+    }
+
+    /* jumped, last nominal <= pos, the compare becomes a cmov */
+    count(&js->searches);
+    const double *base = nom;
+    size_t len = t->entries + 2;
+    while (len > 1) {
+        size_t half = len / 2;
+        base = base[half] <= pos ? base + half : base;
+        len -= half;
+    }
+    i = (int)(base - nom);
+    return i > t->entries ? t->entries : i;
+}
+
+int motCompCorrection(int joint, double pos, double vel, double *corr)
+{
+    const MOT_COMP_TABLE *t = tables[joint].load(std::memory_order_acquire);
+    JOINT_STATE *s = &state[joint];
+    JOINT_STATS *js = &stats[joint];
+
+    if (0 == t) {
+        return 0;
+    }
+    /* a new table may sit where a freed one was, keep seg in range */
+    if (t != s->table || s->seg > t->entries) {
+        s->table = t;
+        s->seg = 0;
+    }
+    count(&js->lookups);
+    s->seg = findSeg(t, s->seg, pos, js);
+
+    const MOT_COMP_SEG *seg = &t->seg[s->seg];
+    double dpos = pos - t->nominal[s->seg];
+    if (vel > 0.0) {
+        /* moving "up". apply forward screw comp */
+        *corr = seg->fwd_trim + seg->fwd_slope * dpos;
+    } else if (vel < 0.0) {
+        /* moving "down". apply reverse screw comp */
+        *corr = seg->rev_trim + seg->rev_slope * dpos;
+    }
+    return 1;
+}
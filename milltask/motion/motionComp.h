@@ -0,0 +1,81 @@
+/********************************************************************
+* Description: motionComp.h
+*   Leadscrew compensation tables of any resolution, for laser
+*   calibration maps with thousands of points.
+*
+*   A table lives outside the joint struct, so it is not bound by
+*   EMCMOT_COMP_SIZE. The nominal positions have their own array with
+*   -DBL_MAX and DBL_MAX at the ends, segment i runs from nominal[i]
+*   to nominal[i+1] and holds the trims at nominal[i] and the slopes
+*   to the next point, the same numbers EMCMOT_SET_JOINT_COMP keeps.
+*   Every joint remembers the segment used the cycle before. The
+*   lookup checks it and its neighbours and only after a jump does a
+*   binary search, so the cost per cycle does not grow with the table.
+*
+*   With [JOINT_n]COMP_JERK > 0 the correction is ramped with bounded
+*   jerk by the JERK_TP_COMP lane of motionJerkTp, inside the velocity
+*   and acceleration limits compute_screw_comp() uses for its
+*   trapezoidal ramp.
+*
+*   Tables are built by the loading thread and published with a
+*   single pointer store, the motion thread switches to them on its
+*   next cycle. A replaced table is freed by a later load or unload
+*   once the motion thread has finished a cycle since.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_COMP_H
+#define MOTION_COMP_H
+
+#include "emcmotcfg.h"		/* EMCMOT_MAX_JOINTS */
+
+#define MOT_COMP_MAX_ENTRIES 100000
+
+typedef struct {
+    double fwd_trim;
+    double fwd_slope;
+    double rev_trim;
+    double rev_slope;
+} MOT_COMP_SEG;
+
+typedef struct {
+    int entries;		/* measured points */
+    double *nominal;		/* entries + 3, sentinels at both ends */
+    MOT_COMP_SEG *seg;		/* entries + 1 */
+    unsigned long long digest;	/* FNV-1a of the points */
+} MOT_COMP_TABLE;
+
+typedef struct {
+    int entries;		/* 0 without a table */
+    double jerk;		/* 0 is the trapezoidal ramp */
+    unsigned long lookups;
+    unsigned long neighbour;	/* found next to the cached segment */
+    unsigned long searches;	/* binary searches */
+} MOT_COMP_STATS;
+
+/* any thread. The file holds one point per line, like
+   usrmotLoadComp(): nominal forward reverse for type 0, nominal
+   fwd_trim rev_trim otherwise. Blank lines and lines starting with #
+   are skipped. Returns the number of points, -1 on error */
+extern int motCompLoad(int joint, const char *file, int type);
+extern void motCompUnload(int joint);
+/* COMP_JERK, jerkTpSetJerk() of the JERK_TP_COMP lane */
+extern int motCompSetJerk(int joint, double jerk);
+extern void motCompGetStats(int joint, MOT_COMP_STATS * stats);
+extern void motCompClearStats(void);
+
+/* motion thread only */
+extern void motCompInit(void);
+/* 0 when the joint has no table. Otherwise sets *corr from the
+   forward or reverse trim for the direction of vel, and leaves it
+   alone when vel is 0 */
+extern int motCompCorrection(int joint, double pos, double vel,
+    double *corr);
+/* once per servo cycle, after the last motCompCorrection() */
+extern void motCompCycleDone(void);
+/* FNV-1a of every joint's table and COMP_JERK, the same for tables
+   that correct the same */
+extern unsigned long long motCompDigest(void);
+
+#endif
@@ -33,6 +33,12 @@
 #include "homing.h"
 #include "axis.h"
 #include "kinematics.h"  //for kinematicsSwitchable()
+#include "kines/kineInterp.h"
+#include "motionProfile.h"
+#include "motionComp.h"
+#include "motionJerkTp.h"
+#include "motionStatus.h"
+#include "motionTelemetry.h"
 
 // Mark strings for translation, but defer translation to userspace
 #define _(s) (s)
@@ -246,13 +252,17 @@ void emcmotController(void *arg, long period)
     emcmotStatus->head++;
     /* here begins the core of the controller */
 
+    motProfBegin();
     read_homing_in_pins(ALL_JOINTS);
     handle_kinematicsSwitch();
     process_inputs();
+    motProfMark(MOT_PROF_INPUTS);
     do_forward_kins();
+    motProfMark(MOT_PROF_FORWARD_KINS);
     process_probe_inputs();
     check_for_faults();
     set_operating_mode();
+    motProfMark(MOT_PROF_FAULTS);
     if (!*emcmot_hal_data->jog_inhibit) {
         handle_jjogwheels();
     }
@@ -263,13 +273,19 @@ void emcmotController(void *arg, long period)
         && do_homing()) {
         switch_to_teleop_mode();
     }
+    motProfMark(MOT_PROF_JOG_HOME);
 
     get_pos_cmds(period);
+    motProfMark(MOT_PROF_POS_CMDS);
     compute_screw_comp();
+    motCompCycleDone();
+    motProfMark(MOT_PROF_SCREW_COMP);
     *(emcmot_hal_data->eoffset_active) = axis_plan_external_offsets(servo_period, GET_MOTION_ENABLE_FLAG(), get_allhomed());
     output_to_hal();
     write_homing_out_pins(ALL_JOINTS);
+    motProfMark(MOT_PROF_OUTPUT);
     update_status();
+    motProfEnd();
     /* here ends the core of the controller */
     emcmotStatus->heartbeat++;
     /* set tail to head, to indicate work complete */
@@ -563,6 +579,7 @@ static void joint_jog_abort_all(bool immediate)
         joint->wheel_jjog_active = 0;
         if (immediate) {
           joint->free_tp.curr_vel = 0.0;
+          jerkTpReset(JERK_TP_JOINT(jNum));
         }
     }
 }
@@ -866,14 +883,15 @@ static void set_operating_mode(void)
     if (!emcmotInternal->enabling && GET_MOTION_ENABLE_FLAG()) {
     /* clear out the motion emcmotInternal->coord_tp and interpolators */
     tpClear(&emcmotInternal->coord_tp);
+    /* drain coord mode interpolators */
+    jointInterpDrain(&jointInterp);
     for (joint_num = 0; joint_num < ALL_JOINTS; joint_num++) {
         /* point to joint data */
         joint = &joints[joint_num];
         /* disable free mode planner */
         joint->free_tp.enable = 0;
         joint->free_tp.curr_vel = 0.0;
-        /* drain coord mode interpolators */
-        cubicDrain(&(joint->cubic));
+        jerkTpReset(JERK_TP_JOINT(joint_num));
         if (GET_JOINT_ACTIVE_FLAG(joint)) {
         SET_JOINT_INPOS_FLAG(joint, 1);
         SET_JOINT_ENABLE_FLAG(joint, 0);
@@ -927,16 +945,16 @@ static void set_operating_mode(void)
 
         /* update coordinated emcmotInternal->coord_tp position */
         tpSetPos(&emcmotInternal->coord_tp, &emcmotStatus->carte_pos_cmd);
-        /* drain the cubics so they'll synch up */
+        /* drain the interpolators so they'll synch up */
+        if (coord_cubic_active && *(emcmot_hal_data->eoffset_active)) {
+            //skip
+        } else {
+            jointInterpDrain(&jointInterp);
+        }
         for (joint_num = 0; joint_num < EMCMOT_MAX_JOINTS; joint_num++) {
         if (joint_num < NO_OF_KINS_JOINTS) {
         /* point to joint data */
             joint = &joints[joint_num];
-            if (coord_cubic_active && *(emcmot_hal_data->eoffset_active)) {
-                //skip
-            } else {
-                cubicDrain(&(joint->cubic));
-            }
             positions[joint_num] = joint->coarse_pos;
         } else {
             positions[joint_num] = 0;
@@ -979,12 +997,8 @@ static void set_operating_mode(void)
                 axis_apply_ext_offsets_to_carte_pos(-1, pcmd_p);
 
         tpSetPos(&emcmotInternal->coord_tp, &emcmotStatus->carte_pos_cmd);
-        /* drain the cubics so they'll synch up */
-        for (joint_num = 0; joint_num < NO_OF_KINS_JOINTS; joint_num++) {
-            /* point to joint data */
-            joint = &joints[joint_num];
-            cubicDrain(&(joint->cubic));
-        }
+        /* drain the interpolators so they'll synch up */
+        jointInterpDrain(&jointInterp);
         /* clear the override limits flags */
         emcmotInternal->overriding = 0;
         emcmotStatus->overrideLimitMask = 0;
@@ -1178,6 +1192,9 @@ static void get_pos_cmds(long period)
     int joint_num, result;
     emcmot_joint_t *joint;
     double positions[EMCMOT_MAX_JOINTS];
+    double interp_pos[EMCMOT_MAX_JOINTS];
+    double interp_vel[EMCMOT_MAX_JOINTS];
+    double interp_acc[EMCMOT_MAX_JOINTS];
     double vel_lim;
 
     /* used in teleop mode to compute the max accell requested */
@@ -1248,14 +1265,15 @@ static void get_pos_cmds(long period)
             } else {
                 joint->free_tp.max_acc = joint->acc_limit;
             }
-            simple_tp_update(&(joint->free_tp), servo_period );
+            jerkTpUpdate(&(joint->free_tp), JERK_TP_JOINT(joint_num), servo_period);
             /* copy free TP output to pos_cmd and coarse_pos */
             joint->pos_cmd = joint->free_tp.curr_pos;
             joint->vel_cmd = joint->free_tp.curr_vel;
             //no acceleration output form simple_tp, but the pin will
             //still show the acceleration from the interpolation.
             //it's delayed, but that's ok during jogging or homing.
-            joint->acc_cmd = 0.0;
+            //with [JOINT_n]MAX_JERK the jerk limited lane has it.
+            joint->acc_cmd = jerkTpGetAcc(JERK_TP_JOINT(joint_num));
             joint->coarse_pos = joint->free_tp.curr_pos;
             /* update joint status flag and overall status flag */
             if ( joint->free_tp.active ) {
@@ -1328,9 +1346,9 @@ static void get_pos_cmds(long period)
     case EMCMOT_MOTION_COORD:
         axis_jog_abort_all(1);
 
-    /* check joint 0 to see if the interpolators are empty */
+    /* check to see if the joint interpolator is empty */
     coord_cubic_active = 1;
-    while (cubicNeedNextPoint(&(joints[0].cubic))) {
+    while (jointInterpNeedNextPoint(&jointInterp)) {
         /* they're empty, pull next point(s) off Cartesian planner */
         /* run coordinated trajectory planning cycle */
 
@@ -1349,6 +1367,7 @@ static void get_pos_cmds(long period)
         &iflags, &fflags);
         if(result == 0)
         {
+        int finite = 1;
         /* copy to joint structures and spline them up */
         for (joint_num = 0; joint_num < NO_OF_KINS_JOINTS; joint_num++) {
             if(!isfinite(positions[joint_num]))
@@ -1357,16 +1376,21 @@ static void get_pos_cmds(long period)
                            joint_num);
                        SET_MOTION_ERROR_FLAG(1);
                        emcmotInternal->enabling = 0;
+                       finite = 0;
                        break;
             }
             /* point to joint struct */
             joint = &joints[joint_num];
             joint->coarse_pos = positions[joint_num];
-            /* spline joints up-- note that we may be adding points
-               that fail soft limits, but we'll abort at the end of
-               this cycle so it doesn't really matter */
-            cubicAddPoint(&(joint->cubic), joint->coarse_pos);
         }
+        /* nothing of a bad point goes into the interpolator, it holds
+           the last good one until the abort at the end of this cycle */
+        if (!finite)
+            break;
+        /* spline joints up-- note that we may be adding points
+           that fail soft limits, but we'll abort at the end of
+           this cycle so it doesn't really matter */
+        jointInterpAddPoints(&jointInterp, positions);
         }
         else
         {
@@ -1379,12 +1403,14 @@ static void get_pos_cmds(long period)
         /* END OF OUTPUT KINS */
     } // while
     /* there is data in the interpolators */
-    /* run interpolation */
+    /* run interpolation for all joints at once */
+    jointInterpInterpolate(&jointInterp, interp_pos, interp_vel, interp_acc, 0);
     for (joint_num = 0; joint_num < NO_OF_KINS_JOINTS; joint_num++) {
         /* point to joint struct */
         joint = &joints[joint_num];
-        /* interpolate to get new position and velocity */
-        joint->pos_cmd = cubicInterpolate(&(joint->cubic), 0, &(joint->vel_cmd), &(joint->acc_cmd), 0);
+        joint->pos_cmd = interp_pos[joint_num];
+        joint->vel_cmd = interp_vel[joint_num];
+        joint->acc_cmd = interp_acc[joint_num];
     }
     /* report motion status */
     SET_MOTION_INPOS_FLAG(0);
@@ -1417,6 +1443,7 @@ static void get_pos_cmds(long period)
     /* copy to joint structures and spline them up */
     if(result == 0)
     {
+        int finite = 1;
         for (joint_num = 0; joint_num < NO_OF_KINS_JOINTS; joint_num++) {
         if(!isfinite(positions[joint_num]))
         {
@@ -1424,17 +1451,27 @@ static void get_pos_cmds(long period)
                  joint_num);
            SET_MOTION_ERROR_FLAG(1);
            emcmotInternal->enabling = 0;
+           finite = 0;
            break;
         }
         /* point to joint struct */
         joint = &joints[joint_num];
         joint->coarse_pos = positions[joint_num];
+        }
+        /* the joints keep their last commands until the abort */
+        if (!finite)
+            break;
         /* spline joints up-- note that we may be adding points
                that fail soft limits, but we'll abort at the end of
                this cycle so it doesn't really matter */
-        cubicAddPoint(&(joint->cubic), joint->coarse_pos);
+        jointInterpAddPoints(&jointInterp, positions);
         /* interpolate to get new position and velocity */
-        joint->pos_cmd = cubicInterpolate(&(joint->cubic), 0, &(joint->vel_cmd), &(joint->acc_cmd), 0);
+        jointInterpInterpolate(&jointInterp, interp_pos, interp_vel, interp_acc, 0);
+        for (joint_num = 0; joint_num < NO_OF_KINS_JOINTS; joint_num++) {
+        joint = &joints[joint_num];
+        joint->pos_cmd = interp_pos[joint_num];
+        joint->vel_cmd = interp_vel[joint_num];
+        joint->acc_cmd = interp_acc[joint_num];
         }
     }
     else
@@ -1674,7 +1711,10 @@ static void compute_screw_comp(void)
     }
     /* point to compensation data */
     comp = &(joint->comp);
-    if ( comp->entries > 0 ) {
+    if (motCompCorrection(joint_num, joint->pos_cmd, joint->vel_cmd,
+                          &joint->backlash_corr)) {
+        /* high resolution table from COMP_FILE, see motionComp.h */
+    } else if ( comp->entries > 0 ) {
         /* there is data in the comp table, use it */
         /* first make sure we're in the right spot in the table */
         while ( joint->pos_cmd < comp->entry->nominal ) {
@@ -1750,6 +1790,12 @@ static void compute_screw_comp(void)
      */
         v_max = 0.5 * joint->vel_limit * emcmotStatus->net_feed_scale;
         a_max = 0.5 * joint->acc_limit;
+        if (jerkTpRamp(JERK_TP_COMP(joint_num), joint->backlash_corr,
+                       v_max, a_max, servo_period, &joint->backlash_filt,
+                       &joint->backlash_vel)) {
+            /* COMP_JERK set, jerk limited instead */
+            continue;
+        }
         v = joint->backlash_vel;
         if (joint->backlash_corr >= joint->backlash_filt) {
             s_to_go = joint->backlash_corr - joint->backlash_filt; /* abs val */
@@ -2069,9 +2115,13 @@ static void output_to_hal(void)
 static void update_status(void)
 {
     int joint_num, axis_num, dio, aio, misc_error;
+    int homing, homed;
+    double max_limit, min_limit;
     emcmot_joint_t *joint;
     emcmot_joint_status_t *joint_status;
     emcmot_axis_status_t *axis_status;
+    static int status_force = 1;
+    unsigned int changed = 0;
 #ifdef WATCH_FLAGS
     static int old_joint_flags[8];
     static int old_motion_flag;
@@ -2092,20 +2142,36 @@ static void update_status(void)
         old_joint_flags[joint_num] = joint->flag;
     }
 #endif
-    joint_status->flag = joint->flag;
-    joint_status->homing = get_homing(joint_num);
-    joint_status->homed  = get_homed(joint_num);
     joint_status->pos_cmd = joint->pos_cmd;
     joint_status->pos_fb = joint->pos_fb;
     joint_status->vel_cmd = joint->vel_cmd;
     joint_status->acc_cmd = joint->acc_cmd;
     joint_status->ferror = joint->ferror;
-    joint_status->ferror_high_mark = joint->ferror_high_mark;
-    joint_status->backlash = joint->backlash;
-    joint_status->max_pos_limit = joint->max_pos_limit;
-    joint_status->min_pos_limit = joint->min_pos_limit;
-    joint_status->min_ferror = joint->min_ferror;
-    joint_status->max_ferror = joint->max_ferror;
+    /* the rest rarely changes, only write it when it does so the
+       status lines readers poll stay clean */
+    homing = get_homing(joint_num);
+    homed = get_homed(joint_num);
+    if (status_force
+        || joint_status->flag != joint->flag
+        || joint_status->homing != homing
+        || joint_status->homed != homed
+        || joint_status->ferror_high_mark != joint->ferror_high_mark
+        || joint_status->backlash != joint->backlash
+        || joint_status->max_pos_limit != joint->max_pos_limit
+        || joint_status->min_pos_limit != joint->min_pos_limit
+        || joint_status->min_ferror != joint->min_ferror
+        || joint_status->max_ferror != joint->max_ferror) {
+        joint_status->flag = joint->flag;
+        joint_status->homing = homing;
+        joint_status->homed  = homed;
+        joint_status->ferror_high_mark = joint->ferror_high_mark;
+        joint_status->backlash = joint->backlash;
+        joint_status->max_pos_limit = joint->max_pos_limit;
+        joint_status->min_pos_limit = joint->min_pos_limit;
+        joint_status->min_ferror = joint->min_ferror;
+        joint_status->max_ferror = joint->max_ferror;
+        changed |= MOT_STATUS_CHG_JOINT(joint_num);
+    }
     }
     if (get_allhomed()) {
         *emcmot_hal_data->is_all_homed = 1;
@@ -2119,8 +2185,15 @@ static void update_status(void)
         axis_status = &(emcmotStatus->axis_status[axis_num]);
 
         axis_status->teleop_vel_cmd = axis_get_teleop_vel_cmd(axis_num);
-        axis_status->max_pos_limit = axis_get_max_pos_limit(axis_num);
-        axis_status->min_pos_limit = axis_get_min_pos_limit(axis_num);
+        max_limit = axis_get_max_pos_limit(axis_num);
+        min_limit = axis_get_min_pos_limit(axis_num);
+        if (status_force
+            || axis_status->max_pos_limit != max_limit
+            || axis_status->min_pos_limit != min_limit) {
+            axis_status->max_pos_limit = max_limit;
+            axis_status->min_pos_limit = min_limit;
+            changed |= MOT_STATUS_CHG_AXIS;
+        }
     }
     emcmotStatus->eoffset_pose.tran.x = axis_get_ext_offset_curr_pos(0);
     emcmotStatus->eoffset_pose.tran.y = axis_get_ext_offset_curr_pos(1);
@@ -2180,6 +2253,10 @@ static void update_status(void)
     old_motion_flag = emcmotStatus->motionFlag;
     }
 #endif
+
+    motStatusPublish(emcmotStatus, ALL_JOINTS, changed);
+    motTelemPublish(emcmotStatus, ALL_JOINTS, emcmotConfig->numSpindles);
+    status_force = 0;
 }
 
 struct emcmot_status_t *GetEMCMotStatus(void)
@@ -2209,6 +2286,27 @@ void BlkForward(const double * joints,
     kinematicsForward(joints, pos, &fflags, &iflags);
 }
 
+/* The kinematics changed under the joints (a tool change swaps the tool
+   length): carte_pos_cmd is taken again from the commanded joints and
+   the coordinated planner restarted there, like handle_kinematicsSwitch()
+   does, so the next inverse gives the same joints and nothing moves.
+   Motion thread only, between controller cycles */
+void SyncCartePosCmd(void)
+{
+    int joint_num;
+    double joint_pos[EMCMOT_MAX_JOINTS] = {0,};
+    KINEMATICS_FORWARD_FLAGS tmpFFlags = fflags;
+    KINEMATICS_INVERSE_FLAGS tmpIFlags = iflags;
+
+    for (joint_num = 0; joint_num < emcmotConfig->numJoints; joint_num++) {
+        joint_pos[joint_num] = joints[joint_num].pos_cmd;
+    }
+    kinematicsForward(joint_pos, &emcmotStatus->carte_pos_cmd,
+                      &tmpFFlags, &tmpIFlags);
+    axis_apply_ext_offsets_to_carte_pos(-1, pcmd_p);
+    tpSetPos(&emcmotInternal->coord_tp, &emcmotStatus->carte_pos_cmd);
+}
+
 
 //EXPORT_SYMBOL(GetEMCMotStatus);
 //EXPORT_SYMBOL(GetEMCMotConfig);
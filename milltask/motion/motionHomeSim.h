@@ -0,0 +1,64 @@
+/********************************************************************
+* Description: motionHomeSim.h
+*   Simulated homing, [EMCMOT]HOME_SIM in the ini file.
+*
+*   OFF      home switch and index come from the HAL pins, nothing
+*            drives them in the simulator
+*   STEP     the home switch is simulated at motor position HOME_OFFSET,
+*            closed on the side SEARCH_VEL moves towards, and the index
+*            arrives as soon as it is armed. The state machine runs
+*            every servo cycle, like on a machine
+*   WARP     as STEP, but the search, latch, backoff and final moves
+*            skip the servo cycles they would spend at constant
+*            velocity before the switch edge or the deceleration, and
+*            the HOME_DELAY pauses are dropped.
+*            The jump is a whole number of cycles, so the joints end
+*            up where STEP leaves them, to rounding
+*   VIRTUAL  no motion at all. A joint is set homed at its current
+*            position and put at HOME: without an absolute encoder
+*            that position then reads HOME, with one the joint is
+*            relocated there, servo model included. homeSimHomeAll()
+*            does the same for every joint not homed yet, in
+*            HOME_SEQUENCE order, and is used when a simulation
+*            starts
+*
+*   WARP moves the commanded position in steps, which only the ideal
+*   servo follows. Joints with SERVO_MODEL = PID are never jumped, they
+*   home as in STEP with the HOME_DELAY pauses dropped.
+*
+*   The mode may be set from any thread, the motion thread picks it up
+*   when no joint is homing.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_HOME_SIM_H
+#define MOTION_HOME_SIM_H
+
+#define HOME_SIM_OFF     0
+#define HOME_SIM_STEP    1
+#define HOME_SIM_WARP    2
+#define HOME_SIM_VIRTUAL 3
+
+typedef struct {
+    unsigned long cycles;	/* servo cycles spent homing */
+    unsigned long warps;	/* constant velocity phases jumped */
+    unsigned long warpedCycles;	/* servo cycles skipped by them */
+    unsigned long virtualHomes;	/* joints set homed without moving */
+} HOME_SIM_STATS;
+
+extern int homeSimSetMode(int mode);
+extern int homeSimGetMode(void);
+extern const char *homeSimModeName(int mode);
+extern int homeSimModeFromName(const char *name);
+
+/* motion thread only. Sets every active joint taking part in home all
+   that is not homed yet homed, sequence by sequence, homed joints are
+   left alone. Returns the number of joints homed or -1 while a homing
+   sequence is running */
+extern int homeSimHomeAll(void);
+
+extern void homeSimGetStats(HOME_SIM_STATS * stats);
+extern void homeSimClearStats(void);
+
+#endif
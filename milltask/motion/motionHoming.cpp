@@ -16,6 +16,11 @@
 #include "motion.h"
 #include "homing.h"
 #include "hal.h"
+#include "motionHomeSim.h"
+#include "motionJerkTp.h"
+#include "motionServo.h"
+#include <atomic>
+#include <strings.h>
 
 static double servo_freq;
 static emcmot_joint_t  * joints;
@@ -201,6 +206,135 @@ static bool home_do_moving_checks(int jno)
     return 0;
 } // home_do_moving_checks()
 
+/***********************************************************************
+*                         SIMULATED HOMING                             *
+************************************************************************/
+
+static std::atomic<int> home_sim_request; /* set by homeSimSetMode() */
+static int home_sim = HOME_SIM_OFF;       /* latched while not homing */
+
+static std::atomic<unsigned long> home_sim_cycles;
+static std::atomic<unsigned long> home_sim_warps;
+static std::atomic<unsigned long> home_sim_warped_cycles;
+static std::atomic<unsigned long> home_sim_virtual_homes;
+
+static inline void home_sim_count(std::atomic<unsigned long> *c,
+                                  unsigned long n)
+{
+    c->store(c->load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+}
+
+static bool home_sim_switch(void)
+{
+    return home_sim == HOME_SIM_STEP || home_sim == HOME_SIM_WARP;
+}
+
+/* pause between homing moves, in servo periods */
+static double home_delay_cycles(void)
+{
+    return home_sim == HOME_SIM_WARP ? 0.0 : HOME_DELAY * servo_freq;
+}
+
+/* the simulated switch sits at motor position home_offset and is
+   closed on the side the search moves towards */
+static bool home_sim_read_switch(int jno)
+{
+    double pos = joints[jno].motor_pos_fb;
+
+    if (H[jno].home_search_vel > 0.0) {
+        return pos >= H[jno].home_offset;
+    }
+    if (H[jno].home_search_vel < 0.0) {
+        return pos <= H[jno].home_offset;
+    }
+    return 0;
+}
+
+/* 'home_sim_warp()' is called from the states that wait while
+   free_tp moves the joint, for the switch edge or for the end of the
+   final move.  Once the move cruises it is jumped over the whole
+   servo periods left before the edge, or before the planner would
+   start to decelerate, keeping the last one so the edge is still
+   found by stepping.  The jump is a step of the command, only an
+   ideal servo follows it exactly, a joint with the PID model is
+   stepped like HOME_SIM_STEP. */
+static void home_sim_warp(int jno, bool to_switch)
+{
+    emcmot_joint_t *joint = &joints[jno];
+    simple_tp_t *tp = &joint->free_tp;
+    double dir, step, dist, room;
+    long n;
+
+    if (home_sim != HOME_SIM_WARP || !tp->active
+        || fabs(tp->curr_vel) < tp->max_vel
+        || servoModel.model[jno] != SERVO_MODEL_IDEAL) {
+        return;
+    }
+    dir = tp->curr_vel > 0.0 ? 1.0 : -1.0;
+    step = tp->max_vel / servo_freq;
+    room = (tp->pos_cmd - tp->curr_pos
+            - jerkTpStopDist(tp, JERK_TP_JOINT(jno))) * dir - step;
+    dist = room;
+    if (to_switch) {
+        dist = (H[jno].home_offset - joint->motor_pos_fb) * dir;
+    }
+    if (room < dist) {
+        dist = room;
+    }
+    n = (long)(dist / step) - 1;
+    if (n < 1) {
+        return;
+    }
+    tp->curr_pos += n * step * dir;
+    home_sim_count(&home_sim_warps, 1);
+    home_sim_count(&home_sim_warped_cycles, n);
+}
+
+/* set the joint homed where it stands, as a home with both search
+   and latch velocity zero would, then put it at HOME, where the final
+   move would have left it.  Without an absolute encoder it reads HOME
+   already, with one the joint and the simulated servo are relocated */
+static void home_sim_set_home(int jno)
+{
+    emcmot_joint_t *joint = &joints[jno];
+    double offset, delta;
+
+    joint->free_tp.enable = 0;
+    if (H[jno].home_flags & HOME_ABSOLUTE_ENCODER) {
+        offset = H[jno].home_offset;
+    } else {
+        offset = H[jno].home - joint->pos_fb;
+    }
+    /* this moves the internal position but does not affect the
+       motor position */
+    joint->pos_cmd += offset;
+    joint->pos_fb += offset;
+    joint->free_tp.curr_pos += offset;
+    joint->motor_offset -= offset;
+    if (!(H[jno].home_flags & HOME_ABSOLUTE_ENCODER)) {
+        joint->free_tp.curr_pos = H[jno].home;
+    } else {
+        delta = H[jno].home - joint->pos_fb;
+        joint->pos_cmd += delta;
+        joint->pos_fb += delta;
+        joint->motor_pos_cmd += delta;
+        joint->motor_pos_fb += delta;
+        joint->free_tp.curr_pos = H[jno].home;
+        servoModelShift(&servoModel, jno, delta);
+    }
+    joint->free_tp.pos_cmd = H[jno].home;
+    joint->free_tp.curr_vel = 0.0;
+    jerkTpReset(JERK_TP_JOINT(jno));
+    H[jno].homing = 0;
+    H[jno].homed = 1;
+    H[jno].home_state = HOME_IDLE;
+    H[jno].index_enable = 0;
+    H[jno].pause_timer = 0;
+    H[jno].joint_in_sequence = 0;
+    home_sim_count(&home_sim_virtual_homes, 1);
+}
+
 #define ABORT_CHECK(joint_num) do { \
     if (home_do_moving_checks(joint_num)) { \
         H[joint_num].home_state = HOME_ABORT; \
@@ -535,10 +669,18 @@ static void base_read_homing_in_pins(int njoints)
 {
     int jno;
     one_joint_home_data_t *addr;
+    if (!homing_active) {
+        home_sim = home_sim_request.load(std::memory_order_relaxed);
+    }
     for (jno = 0; jno < njoints; jno++) {
         addr = &(joint_home_data->jhd[jno]);
         H[jno].home_sw      = *(addr->home_sw);      // IN
         H[jno].index_enable = *(addr->index_enable); // IO
+        if (home_sim_switch()) {
+            H[jno].home_sw = home_sim_read_switch(jno);
+            /* the index arrives as soon as it is armed */
+            H[jno].index_enable = 0;
+        }
     }
 }
 
@@ -779,6 +921,11 @@ static int base_1joint_state_machine(int joint_num)
             joint->free_tp.enable = 0;    /* stop any existing motion */
             sync_reset();                 /* stop any interrupted/canceled sync */
             H[joint_num].pause_timer = 0; /* reset delay counter */
+            if (home_sim == HOME_SIM_VIRTUAL) {
+                /* no motion, homed where it stands */
+                home_sim_set_home(joint_num);
+                break;
+            }
             /* figure out exactly what homing sequence is needed */
             if (H[joint_num].home_flags & HOME_ABSOLUTE_ENCODER) {
                 H[joint_num].home_flags &= ~HOME_IS_SHARED; // shared not applicable
@@ -847,7 +994,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -873,6 +1020,7 @@ static int base_1joint_state_machine(int joint_num)
                 immediate_state = 1;
                 break;
             }
+            home_sim_warp(joint_num, 1);
             ABORT_CHECK(joint_num);
             break;
 
@@ -888,7 +1036,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -921,6 +1069,7 @@ static int base_1joint_state_machine(int joint_num)
                 immediate_state = 1;
                 break;
             }
+            home_sim_warp(joint_num, 1);
             ABORT_CHECK(joint_num);
             break;
 
@@ -969,7 +1118,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -1004,6 +1153,7 @@ static int base_1joint_state_machine(int joint_num)
                 immediate_state = 1;
                 break;
             }
+            home_sim_warp(joint_num, 1);
             ABORT_CHECK(joint_num);
             break;
 
@@ -1018,7 +1168,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -1060,6 +1210,7 @@ static int base_1joint_state_machine(int joint_num)
                     break;
                 }
             }
+            home_sim_warp(joint_num, 1);
             ABORT_CHECK(joint_num);
             break;
 
@@ -1074,7 +1225,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -1117,6 +1268,7 @@ static int base_1joint_state_machine(int joint_num)
                     break;
                 }
             }
+            home_sim_warp(joint_num, 1);
             ABORT_CHECK(joint_num);
             break;
 
@@ -1164,7 +1316,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
                 break;
@@ -1236,8 +1388,10 @@ static int base_1joint_state_machine(int joint_num)
             joint->pos_cmd = joint->pos_fb;
             joint->free_tp.curr_pos = joint->pos_fb;
 
-            if (H[joint_num].home_flags & HOME_INDEX_NO_ENCODER_RESET) {
-               /* Special case: encoder does not reset on index pulse.
+            if (   (H[joint_num].home_flags & HOME_INDEX_NO_ENCODER_RESET)
+                || home_sim_switch()) {
+               /* Special case: encoder does not reset on index pulse,
+                  nor does the simulated one.
                   This moves the internal position but does not affect
                   the motor position */
                offset = H[joint_num].home_offset - joint->pos_fb;
@@ -1264,7 +1418,7 @@ static int base_1joint_state_machine(int joint_num)
                 break;
             }
             /* has delay timed out? */
-            if (H[joint_num].pause_timer < (HOME_DELAY * servo_freq)) {
+            if (H[joint_num].pause_timer < home_delay_cycles()) {
                 /* no, update timer and wait some more */
                 H[joint_num].pause_timer++;
             }
@@ -1304,6 +1458,7 @@ static int base_1joint_state_machine(int joint_num)
                 break; // not all joints at *this* state, wait for them
             }
 
+            home_sim_warp(joint_num, 0);
             /* have we arrived (and stopped) at home? */
             if (!joint->free_tp.active) {
                 /* yes, stop motion */
@@ -1395,6 +1550,7 @@ static bool base_do_homing(void)
     }
     if ( homing_flag > 0 ) { /* one or more joint is homing */
         homing_active = 1;
+        home_sim_count(&home_sim_cycles, 1);
     } else { /* is a homing sequence in progress? */
         if (sequence_state == HOME_SEQUENCE_IDLE) {
             /* no, single joint only, we're done */
@@ -1482,3 +1638,88 @@ void update_joint_homing_params(int    jno,
 void write_homing_out_pins(int njoints) {base_write_homing_out_pins(njoints); }
 
 #endif // }
+
+/***********************************************************************
+*                   SIMULATED HOMING, see motionHomeSim.h              *
+************************************************************************/
+
+static const char *home_sim_names[] = { "OFF", "STEP", "WARP", "VIRTUAL" };
+
+int homeSimSetMode(int mode)
+{
+    if (mode < HOME_SIM_OFF || mode > HOME_SIM_VIRTUAL) {
+        return -1;
+    }
+    home_sim_request.store(mode, std::memory_order_relaxed);
+    return 0;
+}
+
+int homeSimGetMode(void)
+{
+    return home_sim_request.load(std::memory_order_relaxed);
+}
+
+const char *homeSimModeName(int mode)
+{
+    if (mode < HOME_SIM_OFF || mode > HOME_SIM_VIRTUAL) {
+        return "?";
+    }
+    return home_sim_names[mode];
+}
+
+int homeSimModeFromName(const char *name)
+{
+    for (int mode = HOME_SIM_OFF; mode <= HOME_SIM_VIRTUAL; mode++) {
+        if (!strcasecmp(name, home_sim_names[mode])) {
+            return mode;
+        }
+    }
+    return -1;
+}
+
+int homeSimHomeAll(void)
+{
+    int seq, jno, seen, homed = 0;
+
+    if (homing_active) {
+        return -1;
+    }
+    /* same order as do_homing_sequence(): ascending ABS(home_sequence),
+       joints sharing one are done together, stop at the first gap */
+    for (seq = 0; seq <= all_joints; seq++) {
+        seen = 0;
+        for (jno = 0; jno < all_joints; jno++) {
+            if (!GET_JOINT_ACTIVE_FLAG(&joints[jno]))     { continue; }
+            if (H[jno].home_sequence > 100)               { continue; }
+            if (ABS(H[jno].home_sequence) != seq)         { continue; }
+            seen++;
+            /* a homed joint keeps its offset, homing it again where it
+               stands would shift its machine coordinates */
+            if (H[jno].homed) {
+                continue;
+            }
+            home_sim_set_home(jno);
+            homed++;
+        }
+        if (!seen && seq > 0) {
+            break;
+        }
+    }
+    return homed;
+}
+
+void homeSimGetStats(HOME_SIM_STATS * stats)
+{
+    stats->cycles = home_sim_cycles.load(std::memory_order_relaxed);
+    stats->warps = home_sim_warps.load(std::memory_order_relaxed);
+    stats->warpedCycles = home_sim_warped_cycles.load(std::memory_order_relaxed);
+    stats->virtualHomes = home_sim_virtual_homes.load(std::memory_order_relaxed);
+}
+
+void homeSimClearStats(void)
+{
+    home_sim_cycles.store(0, std::memory_order_relaxed);
+    home_sim_warps.store(0, std::memory_order_relaxed);
+    home_sim_warped_cycles.store(0, std::memory_order_relaxed);
+    home_sim_virtual_homes.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,281 @@
+/********************************************************************
+* Description: motionJerkTp.cpp
+*   Jerk limited simple planner, see motionJerkTp.h
+*
+*   The braking profile from velocity v and acceleration a takes any
+*   acceleration away at full jerk, ramps the deceleration up to the
+*   limit (or as far as the velocity allows), holds it and ramps it
+*   back to 0. Each piece has constant jerk and is integrated exactly,
+*   the acceleration of the next period is found by bisection.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionJerkTp.h"
+#include "rtapi_math.h"
+#include <atomic>
+
+#define JERK_TP_BISECT 30
+
+static std::atomic<double> jerks[JERK_TP_LANES];
+
+/* motion thread state. reset is set when somebody else changed
+   curr_vel, the acceleration is no longer known then */
+typedef struct {
+    double acc;
+    int reset;
+} LANE_STATE;
+
+static LANE_STATE lanes[JERK_TP_LANES];
+
+/* integrate t seconds at jerk j */
+static inline void brakeSeg(double *d, double *v, double *a, double j, double t)
+{
+    *d += *v * t + 0.5 * *a * t * t + j * t * t * t / 6.0;
+    *v += *a * t + 0.5 * j * t * t;
+    *a += j * t;
+}
+
+/* distance and time to come to rest from velocity v >= 0 and
+   acceleration a, braking at jerk jm and deceleration up to am */
+static void brake(double v, double a, double am, double jm, double *d,
+    double *t)
+{
+    double a0, vfull, ap, hold = 0.0, t1;
+
+    *d = 0.0;
+    *t = 0.0;
+    if (a > 0.0) {
+        /* take the acceleration away first */
+        t1 = a / jm;
+        brakeSeg(d, &v, &a, -jm, t1);
+        *t += t1;
+        a = 0.0;
+    }
+    if (v <= 0.0) {
+        return;
+    }
+    /* ramp the deceleration up to ap, hold it, ramp it back to 0 */
+    a0 = -a;
+    vfull = (2.0 * am * am - a0 * a0) / (2.0 * jm);
+    if (v >= vfull) {
+        ap = am;
+        hold = (v - vfull) / am;
+    } else {
+        ap = sqrt(0.5 * (2.0 * jm * v + a0 * a0));
+        if (ap < a0) {
+            ap = a0;
+        }
+    }
+    t1 = (ap - a0) / jm;
+    brakeSeg(d, &v, &a, -jm, t1);
+    brakeSeg(d, &v, &a, 0.0, hold);
+    brakeSeg(d, &v, &a, jm, ap / jm);
+    *t += t1 + hold + ap / jm;
+}
+
+/* signed, in the direction of travel */
+static void brakeSigned(double vel, double acc, double amax, double jmax,
+    double *d, double *t)
+{
+    double dir = vel > 0.0 || (vel == 0.0 && acc > 0.0) ? 1.0 : -1.0;
+
+    *d = 0.0;
+    *t = 0.0;
+    if (amax <= 0.0 || (vel == 0.0 && acc == 0.0)) {
+        return;
+    }
+    if (jmax <= 0.0) {
+        /* simple_tp, constant deceleration */
+        *d = 0.5 * vel * vel / amax * dir;
+        *t = fabs(vel) / amax;
+        return;
+    }
+    brake(vel * dir, acc * dir, amax, jmax, d, t);
+    *d *= dir;
+}
+
+/* can the step to acceleration a1 be taken, r to go */
+static bool stepFits(double r, double v, double a, double a1, double vmax,
+    double amax, double jm, double dt)
+{
+    double v1 = v + 0.5 * (a + a1) * dt;
+    double dx = v * dt + (2.0 * a + a1) * dt * dt / 6.0;
+    double d, t;
+
+    /* taking a1 away in whole periods adds half a step to the velocity.
+       The bound holds for a deceleration too, a lane above a lowered
+       vmax brakes down to it at full jerk */
+    if (v1 + a1 * fabs(a1) / (2.0 * jm) + 0.5 * a1 * dt > vmax) {
+        return 0;
+    }
+    if (v1 > 0.0 || a1 > 0.0) {
+        brake(v1, a1, amax, jm, &d, &t);
+    } else {
+        d = 0.0;
+    }
+    /* half a step of margin keeps the discrete stop short of the target */
+    return d + 0.5 * fabs(a1) * dt * dt <= r - dx;
+}
+
+int jerkTpStep(double target, double vmax, double amax, double jmax,
+    double period, double *pos, double *vel, double *acc)
+{
+    double dir, r, v, a, dj, lo, hi, a1, v1, dx;
+
+    /* work in the direction of the target */
+    dir = target >= *pos ? 1.0 : -1.0;
+    r = (target - *pos) * dir;
+    v = *vel * dir;
+    a = *acc * dir;
+    dj = jmax * period;
+
+    if (r <= dj * period * period && fabs(v) <= dj * period && fabs(a) <= dj) {
+        /* within one jerk step of rest at the target */
+        *pos = target;
+        *vel = 0.0;
+        *acc = 0.0;
+        return 0;
+    }
+
+    lo = fmax(a - dj, -amax);
+    hi = fmin(a + dj, amax);
+    if (stepFits(r, v, a, hi, vmax, amax, jmax, period)) {
+        a1 = hi;
+    } else if (!stepFits(r, v, a, lo, vmax, amax, jmax, period)) {
+        a1 = lo;
+    } else {
+        for (int i = 0; i < JERK_TP_BISECT; i++) {
+            double mid = 0.5 * (lo + hi);
+            if (stepFits(r, v, a, mid, vmax, amax, jmax, period)) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        a1 = lo;
+    }
+
+    v1 = v + 0.5 * (a + a1) * period;
+    dx = v * period + (2.0 * a + a1) * period * period / 6.0;
+    if (a1 >= 0.0 && a <= dj && v1 >= vmax - dj * period && v1 <= vmax) {
+        /* within one jerk step of cruising, settle there so the
+           velocity reads max_vel like it does with simple_tp */
+        v1 = vmax;
+        a1 = 0.0;
+    } else if (a1 <= 0.0 && a >= -dj && v1 <= vmax + dj * period && v1 >= vmax) {
+        /* the same coming down to a lowered vmax */
+        v1 = vmax;
+        a1 = 0.0;
+    }
+    *pos += dx * dir;
+    *vel = v1 * dir;
+    *acc = a1 * dir;
+    return 1;
+}
+
+int jerkTpSetJerk(int lane, double jerk)
+{
+    if (lane < 0 || lane >= JERK_TP_LANES || jerk < 0.0) {
+        return -1;
+    }
+    jerks[lane].store(jerk, std::memory_order_relaxed);
+    return 0;
+}
+
+double jerkTpGetJerk(int lane)
+{
+    if (lane < 0 || lane >= JERK_TP_LANES) {
+        return 0.0;
+    }
+    return jerks[lane].load(std::memory_order_relaxed);
+}
+
+void jerkTpInit(void)
+{
+    for (int n = 0; n < JERK_TP_LANES; n++) {
+        lanes[n].acc = 0.0;
+        lanes[n].reset = 0;
+    }
+}
+
+void jerkTpReset(int lane)
+{
+    lanes[lane].reset = 1;
+}
+
+/* acceleration of the lane, 0 after a reset */
+static inline double laneAcc(const LANE_STATE * l)
+{
+    return l->reset ? 0.0 : l->acc;
+}
+
+void jerkTpUpdate(simple_tp_t * tp, int lane, double period)
+{
+    double jm = jerks[lane].load(std::memory_order_relaxed);
+    LANE_STATE *l = &lanes[lane];
+    double target, d, t;
+
+    if (jm <= 0.0 || tp->max_acc <= 0.0) {
+        l->acc = 0.0;
+        l->reset = 0;
+        simple_tp_update(tp, period);
+        return;
+    }
+
+    l->acc = laneAcc(l);
+    l->reset = 0;
+    if (tp->enable) {
+        target = tp->pos_cmd;
+    } else {
+        /* stop as soon as possible */
+        brakeSigned(tp->curr_vel, l->acc, tp->max_acc, jm, &d, &t);
+        target = tp->curr_pos + d;
+    }
+    tp->active = jerkTpStep(target, tp->max_vel, tp->max_acc, jm, period,
+                            &tp->curr_pos, &tp->curr_vel, &l->acc);
+    if (!tp->enable) {
+        /* avoid movement when next enabled */
+        tp->pos_cmd = tp->curr_pos;
+    }
+}
+
+int jerkTpRamp(int lane, double target, double vmax, double amax,
+    double period, double *pos, double *vel)
+{
+    double jm = jerks[lane].load(std::memory_order_relaxed);
+    LANE_STATE *l = &lanes[lane];
+
+    if (jm <= 0.0) {
+        l->acc = 0.0;
+        l->reset = 0;
+        return 0;
+    }
+    l->acc = laneAcc(l);
+    l->reset = 0;
+    jerkTpStep(target, vmax, amax, jm, period, pos, vel, &l->acc);
+    return 1;
+}
+
+double jerkTpStopDist(const simple_tp_t * tp, int lane)
+{
+    double d, t;
+
+    brakeSigned(tp->curr_vel, laneAcc(&lanes[lane]), tp->max_acc,
+                jerks[lane].load(std::memory_order_relaxed), &d, &t);
+    return d;
+}
+
+double jerkTpTimeToStop(const simple_tp_t * tp, int lane)
+{
+    double d, t;
+
+    brakeSigned(tp->curr_vel, laneAcc(&lanes[lane]), tp->max_acc,
+                jerks[lane].load(std::memory_order_relaxed), &d, &t);
+    return t;
+}
+
+double jerkTpGetAcc(int lane)
+{
+    return lanes[lane].acc;
+}
@@ -0,0 +1,64 @@
+/********************************************************************
+* Description: motionJerkTp.h
+*   Jerk limited point to point generator, and the lanes that put it
+*   behind the simple planners: joint free_tp (jogs and homing moves),
+*   axis teleop_tp (teleop jogs) and axis ext_offset_tp (external
+*   offsets), and the backlash / screw comp ramp of every joint
+*   (COMP_JERK), which has no simple_tp of its own.
+*
+*   Every period the generator takes the largest acceleration within
+*   one jerk step of the present one from which it can still come to
+*   rest at the target by braking at full jerk, inside the velocity
+*   and acceleration limits. The braking distance and time are worked
+*   out in closed form, so the decision costs the same at any speed,
+*   and the same numbers answer the stop distance and time queries.
+*
+*   A lane with jerk 0 keeps the acceleration limited simple_tp, that
+*   is the default for [JOINT_n]MAX_JERK and [AXIS_n]MAX_JERK.
+*
+*   simple_tp_t has no room for the acceleration, the lane keeps it.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_JERK_TP_H
+#define MOTION_JERK_TP_H
+
+#include "emcmotcfg.h"		/* EMCMOT_MAX_JOINTS, EMCMOT_MAX_AXIS */
+#include "simple_tp.h"
+
+#define JERK_TP_JOINT(j)	(j)
+#define JERK_TP_AXIS(a)		(EMCMOT_MAX_JOINTS + (a))
+#define JERK_TP_EOFFSET(a)	(EMCMOT_MAX_JOINTS + EMCMOT_MAX_AXIS + (a))
+#define JERK_TP_COMP(j)		(EMCMOT_MAX_JOINTS + 2 * EMCMOT_MAX_AXIS + (j))
+#define JERK_TP_LANES		(2 * EMCMOT_MAX_JOINTS + 2 * EMCMOT_MAX_AXIS)
+
+/* one period from *pos, *vel, *acc towards target. Returns 1 while
+   moving, 0 once at rest on the target */
+extern int jerkTpStep(double target, double vmax, double amax, double jmax,
+    double period, double *pos, double *vel, double *acc);
+
+/* any thread, jerk 0 is the acceleration limited simple_tp */
+extern int jerkTpSetJerk(int lane, double jerk);
+extern double jerkTpGetJerk(int lane);
+
+/* motion thread only */
+extern void jerkTpInit(void);
+/* simple_tp_update() of lane. The planner follows pos_cmd while
+   enabled and stops as fast as the limits allow when disabled */
+extern void jerkTpUpdate(simple_tp_t * tp, int lane, double period);
+/* a lane without a simple_tp: 0 when its jerk is 0, otherwise moves
+   *pos one period towards target, *vel is its rate of change */
+extern int jerkTpRamp(int lane, double target, double vmax, double amax,
+    double period, double *pos, double *vel);
+/* after curr_vel of the lane was set outside the planner, the next
+   update starts from zero acceleration */
+extern void jerkTpReset(int lane);
+/* signed distance to come to rest if disabled now, for the continuous
+   profile. The planner stops within it */
+extern double jerkTpStopDist(const simple_tp_t * tp, int lane);
+/* time to come to rest if disabled now, from the same braking profile */
+extern double jerkTpTimeToStop(const simple_tp_t * tp, int lane);
+extern double jerkTpGetAcc(int lane);
+
+#endif
@@ -0,0 +1,143 @@
+/********************************************************************
+* Description: motionProfile.cpp
+*   Controller cycle profiler, see motionProfile.h
+*
+*   A reset is only requested here and carried out by the motion
+*   thread at the start of its next cycle, so the histograms always
+*   have a single writer.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionProfile.h"
+#include <cstdio>
+
+MOT_PROF_STRUCT motProf;
+
+static const char *stageName[MOT_PROF_STAGES] = {
+    "inputs", "forward_kins", "faults", "jog_home", "pos_cmds",
+    "screw_comp", "output", "status", "cycle"
+};
+
+void motProfClear(void)
+{
+    const auto r = std::memory_order_relaxed;
+
+    for (int s = 0; s < MOT_PROF_STAGES; s++) {
+        MOT_PROF_HIST *h = &motProf.hist[s];
+        h->count.store(0, r);
+        h->sum.store(0, r);
+        h->max.store(0, r);
+        h->maxCycle.store(0, r);
+        for (int b = 0; b < MOT_PROF_BUCKETS; b++)
+            h->bucket[b].store(0, r);
+    }
+}
+
+void motProfInit(void)
+{
+    motProfClear();
+    motProf.cycle = 0;
+    motProf.initTicks = motProfTicks();
+    motProf.initTime = std::chrono::steady_clock::now();
+    motProf.period.store(0.001);
+    motProf.resetRequest.store(false);
+    motProf.enable.store(true);
+}
+
+void motProfSetPeriod(double period)
+{
+    if (period > 0.0)
+        motProf.period.store(period, std::memory_order_relaxed);
+}
+
+void motProfSetEnable(bool enable)
+{
+    motProf.enable.store(enable, std::memory_order_relaxed);
+}
+
+void motProfReset(void)
+{
+    motProf.resetRequest.store(true, std::memory_order_relaxed);
+}
+
+/* lowest value that falls into bucket b */
+static uint64_t bucketValue(int b)
+{
+    if (b < MOT_PROF_SUB_BUCKETS)
+        return b;
+    int e = b / MOT_PROF_SUB_BUCKETS + MOT_PROF_SUB_BITS - 1;
+    uint64_t sub = b % MOT_PROF_SUB_BUCKETS;
+    return (1ull << e) | (sub << (e - MOT_PROF_SUB_BITS));
+}
+
+double motProfNsPerTick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ticks = motProfTicks() - motProf.initTicks;
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - motProf.initTime).count();
+    return ticks > 0 ? ns / ticks : 0.0;
+#else
+    return 1.0;
+#endif
+}
+
+/* values of the fractions q[] in ticks, from one pass over the buckets */
+static void percentiles(const uint32_t *bucket, uint64_t count,
+    const double *q, uint64_t *v, int nq)
+{
+    uint64_t seen = 0;
+    int k = 0;
+
+    for (int b = 0; b < MOT_PROF_BUCKETS && k < nq; b++) {
+        seen += bucket[b];
+        while (k < nq && seen > 0 && seen >= q[k] * count)
+            v[k++] = bucketValue(b);
+    }
+    while (k < nq)
+        v[k++] = 0;
+}
+
+std::string motProfReport(void)
+{
+    const auto r = std::memory_order_relaxed;
+    const double q[3] = { 0.5, 0.99, 0.999 };
+    const double us = motProfNsPerTick() * 1e-3;
+    const double budget = motProf.period.load(r) * 1e6;
+    uint32_t bucket[MOT_PROF_BUCKETS];
+    char line[160];
+    std::string out;
+
+    snprintf(line, sizeof(line), "%-13s %10s %8s %8s %8s %8s %8s %7s %10s\n",
+             "stage", "count", "mean", "p50", "p99", "p99.9", "max",
+             "budget", "max@cycle");
+    out += line;
+
+    for (int s = 0; s < MOT_PROF_STAGES; s++) {
+        const MOT_PROF_HIST *h = &motProf.hist[s];
+        uint64_t count = 0;
+        for (int b = 0; b < MOT_PROF_BUCKETS; b++) {
+            bucket[b] = h->bucket[b].load(r);
+            count += bucket[b];
+        }
+        uint64_t v[3];
+        percentiles(bucket, count, q, v, 3);
+        double mean = count ? (double)h->sum.load(r) / count * us : 0.0;
+        double max = h->max.load(r) * us;
+
+        snprintf(line, sizeof(line),
+                 "%-13s %10llu %8.2f %8.2f %8.2f %8.2f %8.2f %6.1f%% %10llu\n",
+                 stageName[s], (unsigned long long)count, mean,
+                 v[0] * us, v[1] * us, v[2] * us, max,
+                 budget > 0.0 ? 100.0 * mean / budget : 0.0,
+                 (unsigned long long)h->maxCycle.load(r));
+        out += line;
+    }
+
+    snprintf(line, sizeof(line), "times in us, budget %.1f us per cycle, %s\n",
+             budget, motProf.enable.load(r) ? "enabled" : "disabled");
+    out += line;
+
+    return out;
+}
@@ -0,0 +1,139 @@
+/********************************************************************
+* Description: motionProfile.h
+*   Per-stage timing of emcmotController().
+*
+*   Every stage of the controller is timed with the CPU time stamp
+*   counter and recorded into a log-linear (HDR style) histogram:
+*   values below 16 ticks get their own bucket, above that each power
+*   of two is split into 16 buckets, so any value is known to within
+*   about 6% over the whole range of a 64 bit counter.
+*
+*   Only the motion thread writes. Counters are relaxed atomics
+*   updated with plain load/store, readers (MOTPROF) see a slightly
+*   torn but never undefined picture. Ticks are converted to time at
+*   report time from the counter rate measured since init.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum MOT_PROF_STAGE {
+    MOT_PROF_INPUTS,		/* homing in pins, kins switch, process_inputs */
+    MOT_PROF_FORWARD_KINS,	/* do_forward_kins */
+    MOT_PROF_FAULTS,		/* probe inputs, check_for_faults, operating mode */
+    MOT_PROF_JOG_HOME,		/* jog wheels, do_homing */
+    MOT_PROF_POS_CMDS,		/* get_pos_cmds, planner and interpolation */
+    MOT_PROF_SCREW_COMP,	/* compute_screw_comp */
+    MOT_PROF_OUTPUT,		/* external offsets, output_to_hal, homing out pins */
+    MOT_PROF_STATUS,		/* update_status */
+    MOT_PROF_CYCLE,		/* whole controller cycle */
+    MOT_PROF_STAGES
+};
+
+#define MOT_PROF_SUB_BITS 4
+#define MOT_PROF_SUB_BUCKETS (1 << MOT_PROF_SUB_BITS)
+#define MOT_PROF_BUCKETS (64 * MOT_PROF_SUB_BUCKETS)
+
+typedef struct {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> maxCycle;	/* cycle number of the worst case */
+    std::atomic<uint32_t> bucket[MOT_PROF_BUCKETS];
+} MOT_PROF_HIST;
+
+typedef struct {
+    std::atomic<bool> enable;
+    std::atomic<bool> resetRequest;
+    uint64_t cycle;
+    uint64_t start;			/* cycle start, ticks */
+    uint64_t last;			/* previous mark, ticks */
+    uint64_t initTicks;			/* for the tick rate */
+    std::atomic<double> period;		/* servo period, seconds */
+    std::chrono::steady_clock::time_point initTime;
+    MOT_PROF_HIST hist[MOT_PROF_STAGES];
+} MOT_PROF_STRUCT;
+
+extern MOT_PROF_STRUCT motProf;
+
+static inline uint64_t motProfTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static inline int motProfBucket(uint64_t v)
+{
+    if (v < MOT_PROF_SUB_BUCKETS)
+        return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    int sub = (int)(v >> (e - MOT_PROF_SUB_BITS)) & (MOT_PROF_SUB_BUCKETS - 1);
+    return (e - MOT_PROF_SUB_BITS + 1) * MOT_PROF_SUB_BUCKETS + sub;
+}
+
+static inline void motProfRecord(MOT_PROF_HIST * h, uint64_t v, uint64_t cycle)
+{
+    const auto r = std::memory_order_relaxed;
+    std::atomic<uint32_t> &b = h->bucket[motProfBucket(v)];
+    b.store(b.load(r) + 1, r);
+    h->count.store(h->count.load(r) + 1, r);
+    h->sum.store(h->sum.load(r) + v, r);
+    if (v > h->max.load(r)) {
+        h->max.store(v, r);
+        h->maxCycle.store(cycle, r);
+    }
+}
+
+extern void motProfInit(void);
+extern void motProfClear(void);
+extern void motProfSetPeriod(double period);
+
+static inline void motProfBegin(void)
+{
+    if (motProf.resetRequest.load(std::memory_order_relaxed)) {
+        motProfClear();
+        motProf.resetRequest.store(false, std::memory_order_relaxed);
+    }
+    motProf.cycle++;
+    motProf.start = motProf.last = motProfTicks();
+}
+
+/* close the stage that started at the previous mark */
+static inline void motProfMark(int stage)
+{
+    if (!motProf.enable.load(std::memory_order_relaxed))
+        return;
+    uint64_t now = motProfTicks();
+    motProfRecord(&motProf.hist[stage], now - motProf.last, motProf.cycle);
+    motProf.last = now;
+}
+
+static inline void motProfEnd(void)
+{
+    motProfMark(MOT_PROF_STATUS);
+    if (motProf.enable.load(std::memory_order_relaxed))
+        motProfRecord(&motProf.hist[MOT_PROF_CYCLE], motProf.last - motProf.start, motProf.cycle);
+}
+
+/* reader side, any thread */
+extern void motProfSetEnable(bool enable);
+extern void motProfReset(void);
+extern std::string motProfReport(void);
+/* length of a tick, measured against the steady clock since init */
+extern double motProfNsPerTick(void);
+
+#endif
@@ -0,0 +1,227 @@
+/********************************************************************
+* Description: motionServo.cpp
+*   Simulated joint servo loop, see motionServo.h
+*
+*   Joints that are disabled or ideal follow the command exactly and
+*   keep their controller state reset, so enabling a drive starts
+*   from zero following error and an empty integrator.
+*
+*   The integrator is frozen while the output is saturated
+*   (conditional integration), otherwise a long saturated move winds
+*   it up and the joint overshoots badly at the end.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionServo.h"
+#include "rtapi_math.h"
+
+SERVO_MODEL_STRUCT servoModel;
+
+void servoModelDefaultParams(SERVO_PARAMS * params)
+{
+    params->model = SERVO_MODEL_IDEAL;
+    params->p = 0.0;
+    params->i = 0.0;
+    params->d = 0.0;
+    params->ff0 = 0.0;
+    params->ff1 = 0.0;
+    params->ff2 = 0.0;
+    params->maxOutput = 0.0;
+    params->inertia = 1.0;
+    params->damping = 0.0;
+}
+
+int servoModelInit(SERVO_MODEL_STRUCT * sm, int numJoints)
+{
+    SERVO_PARAMS params;
+
+    if (0 == sm || numJoints < 0 || numJoints > EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+
+    sm->numJoints = numJoints;
+    sm->substeps = SERVO_DEFAULT_SUBSTEPS;
+    sm->period = 0.001;
+
+    servoModelDefaultParams(&params);
+    for (int i = 0; i < EMCMOT_MAX_JOINTS; i++) {
+        servoModelSetParams(sm, i, &params);
+        sm->prevCmd[i] = 0.0;
+        sm->prevVelCmd[i] = 0.0;
+        sm->pos[i] = 0.0;
+        sm->vel[i] = 0.0;
+        sm->integ[i] = 0.0;
+        sm->output[i] = 0.0;
+        sm->ferror[i] = 0.0;
+    }
+    servoModelClearStats(sm);
+
+    return 0;
+}
+
+int servoModelSetPeriod(SERVO_MODEL_STRUCT * sm, double period)
+{
+    if (0 == sm || period <= 0.0) {
+        return -1;
+    }
+
+    sm->period = period;
+
+    return 0;
+}
+
+int servoModelSetSubsteps(SERVO_MODEL_STRUCT * sm, int substeps)
+{
+    if (0 == sm || substeps < 1) {
+        return -1;
+    }
+
+    sm->substeps = substeps;
+
+    return 0;
+}
+
+int servoModelSetParams(SERVO_MODEL_STRUCT * sm, int joint,
+    const SERVO_PARAMS * params)
+{
+    if (0 == sm || 0 == params || joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+    if ((params->model != SERVO_MODEL_IDEAL &&
+         params->model != SERVO_MODEL_PID) ||
+        params->inertia <= 0.0 || params->maxOutput < 0.0) {
+        return -1;
+    }
+
+    sm->model[joint] = params->model;
+    sm->p[joint] = params->p;
+    sm->i[joint] = params->i;
+    sm->d[joint] = params->d;
+    sm->ff0[joint] = params->ff0;
+    sm->ff1[joint] = params->ff1;
+    sm->ff2[joint] = params->ff2;
+    sm->maxOutput[joint] = params->maxOutput;
+    sm->invInertia[joint] = 1.0 / params->inertia;
+    sm->damping[joint] = params->damping;
+
+    return 0;
+}
+
+int servoModelGetParams(SERVO_MODEL_STRUCT * sm, int joint,
+    SERVO_PARAMS * params)
+{
+    if (0 == sm || 0 == params || joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+
+    params->model = sm->model[joint];
+    params->p = sm->p[joint];
+    params->i = sm->i[joint];
+    params->d = sm->d[joint];
+    params->ff0 = sm->ff0[joint];
+    params->ff1 = sm->ff1[joint];
+    params->ff2 = sm->ff2[joint];
+    params->maxOutput = sm->maxOutput[joint];
+    params->inertia = 1.0 / sm->invInertia[joint];
+    params->damping = sm->damping[joint];
+
+    return 0;
+}
+
+/*
+  Move one joint of the plant by delta together with its last command,
+  so a command that jumps by the same delta is followed without a
+  transient. Used where the simulation relocates a joint.
+*/
+int servoModelShift(SERVO_MODEL_STRUCT * sm, int joint, double delta)
+{
+    if (0 == sm || joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
+        return -1;
+    }
+
+    sm->pos[joint] += delta;
+    sm->prevCmd[joint] += delta;
+
+    return 0;
+}
+
+int servoModelClearStats(SERVO_MODEL_STRUCT * sm)
+{
+    if (0 == sm) {
+        return -1;
+    }
+
+    for (int i = 0; i < EMCMOT_MAX_JOINTS; i++) {
+        sm->maxFerror[i] = 0.0;
+        sm->saturated[i] = 0;
+        sm->satCycles[i] = 0;
+    }
+
+    return 0;
+}
+
+int servoModelUpdate(SERVO_MODEL_STRUCT * sm, const double *cmd,
+    const unsigned char *enable, double *fb)
+{
+    if (0 == sm || 0 == cmd || 0 == enable || 0 == fb) {
+        return -1;
+    }
+
+    const int n = sm->numJoints;
+    const double dt = sm->period;
+    const double invDt = 1.0 / dt;
+    const double h = dt / sm->substeps;
+    double active[EMCMOT_MAX_JOINTS];
+
+    double * __restrict pos = sm->pos;
+    double * __restrict vel = sm->vel;
+    double * __restrict integ = sm->integ;
+    double * __restrict out = sm->output;
+    double * __restrict prevCmd = sm->prevCmd;
+    double * __restrict prevVelCmd = sm->prevVelCmd;
+
+    /* controller, sampled once per period */
+    for (int i = 0; i < n; i++) {
+        double vcmd = (cmd[i] - prevCmd[i]) * invDt;
+        double acmd = (vcmd - prevVelCmd[i]) * invDt;
+        int on = enable[i] && sm->model[i] == SERVO_MODEL_PID;
+
+        double e = cmd[i] - pos[i];
+        double in = integ[i] + e * dt;
+        double u = sm->p[i] * e + sm->i[i] * in + sm->d[i] * (vcmd - vel[i]) +
+            sm->ff0[i] * cmd[i] + sm->ff1[i] * vcmd + sm->ff2[i] * acmd;
+        double lim = sm->maxOutput[i] > 0.0 ? sm->maxOutput[i] : HUGE_VAL;
+        double uc = u > lim ? lim : (u < -lim ? -lim : u);
+        int sat = on && uc != u;
+
+        out[i] = on ? uc : 0.0;
+        integ[i] = on ? (sat ? integ[i] : in) : 0.0;
+        pos[i] = on ? pos[i] : cmd[i];
+        vel[i] = on ? vel[i] : vcmd;
+        sm->saturated[i] = sat;
+        sm->satCycles[i] += sat;
+        active[i] = on ? 1.0 : 0.0;
+
+        prevCmd[i] = cmd[i];
+        prevVelCmd[i] = vcmd;
+    }
+
+    /* plant, output held over the period */
+    for (int s = 0; s < sm->substeps; s++) {
+        for (int i = 0; i < n; i++) {
+            double a = (out[i] - sm->damping[i] * vel[i]) * sm->invInertia[i];
+            vel[i] += active[i] * a * h;
+            pos[i] += active[i] * vel[i] * h;
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        double e = cmd[i] - pos[i];
+        sm->ferror[i] = e;
+        sm->maxFerror[i] = fmax(sm->maxFerror[i], fabs(e));
+        fb[i] = pos[i];
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/********************************************************************
+* Description: motionServo.h
+*   Simulated joint servo loop, stands in for the drive, motor and
+*   mechanics behind motor_pos_cmd / motor_pos_fb.
+*
+*   Each joint is either ideal (feedback equals command, the old
+*   behaviour) or a PID position loop with feedforward driving a
+*   second order plant:
+*
+*     u = P*e + I*int(e) + D*(vcmd - v) + FF0*cmd + FF1*vcmd + FF2*acmd
+*     u limited to +-MAX_OUTPUT
+*     INERTIA * a = u - DAMPING * v
+*
+*   The controller is sampled once per servo period and its output
+*   held, the plant is integrated with semi-implicit Euler in fixed
+*   substeps. All state is kept as per-joint arrays so the update
+*   loops run over contiguous memory and vectorize.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_SERVO_H
+#define MOTION_SERVO_H
+
+#include "emcmotcfg.h"		/* EMCMOT_MAX_JOINTS */
+
+#define SERVO_MODEL_IDEAL 0
+#define SERVO_MODEL_PID   1
+
+#define SERVO_DEFAULT_SUBSTEPS 4
+
+/* per joint parameters, [JOINT_n] in the ini file */
+typedef struct {
+    int model;			/* SERVO_MODEL_IDEAL or SERVO_MODEL_PID */
+    double p;			/* output per unit of following error */
+    double i;			/* output per unit*s of following error */
+    double d;			/* output per unit/s of velocity error */
+    double ff0;			/* output per unit of command */
+    double ff1;			/* output per unit/s of command */
+    double ff2;			/* output per unit/s^2 of command */
+    double maxOutput;		/* torque/current limit, 0 is unlimited */
+    double inertia;		/* output per unit/s^2, > 0 */
+    double damping;		/* viscous friction, output per unit/s */
+} SERVO_PARAMS;
+
+typedef struct {
+    int numJoints;
+    int substeps;
+    double period;		/* servo period in seconds */
+
+    /* parameters, one array per field */
+    int model[EMCMOT_MAX_JOINTS];
+    double p[EMCMOT_MAX_JOINTS];
+    double i[EMCMOT_MAX_JOINTS];
+    double d[EMCMOT_MAX_JOINTS];
+    double ff0[EMCMOT_MAX_JOINTS];
+    double ff1[EMCMOT_MAX_JOINTS];
+    double ff2[EMCMOT_MAX_JOINTS];
+    double maxOutput[EMCMOT_MAX_JOINTS];
+    double invInertia[EMCMOT_MAX_JOINTS];
+    double damping[EMCMOT_MAX_JOINTS];
+
+    /* state */
+    double prevCmd[EMCMOT_MAX_JOINTS];
+    double prevVelCmd[EMCMOT_MAX_JOINTS];
+    double pos[EMCMOT_MAX_JOINTS];
+    double vel[EMCMOT_MAX_JOINTS];
+    double integ[EMCMOT_MAX_JOINTS];
+    double output[EMCMOT_MAX_JOINTS];
+    double ferror[EMCMOT_MAX_JOINTS];		/* cmd - pos after the update */
+    double maxFerror[EMCMOT_MAX_JOINTS];	/* largest |ferror| seen */
+    unsigned char saturated[EMCMOT_MAX_JOINTS];	/* output hit the limit */
+    unsigned long satCycles[EMCMOT_MAX_JOINTS];	/* cycles spent saturated */
+} SERVO_MODEL_STRUCT;
+
+extern SERVO_MODEL_STRUCT servoModel;
+
+extern int servoModelInit(SERVO_MODEL_STRUCT * sm, int numJoints);
+extern int servoModelSetPeriod(SERVO_MODEL_STRUCT * sm, double period);
+extern int servoModelSetSubsteps(SERVO_MODEL_STRUCT * sm, int substeps);
+extern int servoModelSetParams(SERVO_MODEL_STRUCT * sm, int joint,
+    const SERVO_PARAMS * params);
+extern int servoModelGetParams(SERVO_MODEL_STRUCT * sm, int joint,
+    SERVO_PARAMS * params);
+extern void servoModelDefaultParams(SERVO_PARAMS * params);
+
+/* one servo period, cmd and enable in, fb out, all numJoints long */
+extern int servoModelUpdate(SERVO_MODEL_STRUCT * sm, const double *cmd,
+    const unsigned char *enable, double *fb);
+
+/* relocate a joint of the plant, see motionServo.cpp */
+extern int servoModelShift(SERVO_MODEL_STRUCT * sm, int joint, double delta);
+
+extern int servoModelClearStats(SERVO_MODEL_STRUCT * sm);
+
+#endif
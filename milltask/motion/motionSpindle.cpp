@@ -0,0 +1,164 @@
+/********************************************************************
+* Description: motionSpindle.cpp
+*   Simulated spindle drive and encoder, see motionSpindle.h
+*
+*   The index is the encoder's whole revolution mark. While
+*   index-enable is set the revolution counter is watched for a
+*   crossing, in either direction, and the position is rebased on it
+*   so revs reads the distance travelled past the index.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionSpindle.h"
+#include "rtapi_math.h"
+
+SPINDLE_MODEL_STRUCT spindleModel;
+
+void spindleModelDefaultParams(SPINDLE_PARAMS * params)
+{
+    params->model = SPINDLE_MODEL_IDEAL;
+    params->accel = 100.0;
+    params->droop = 0.0;
+    params->load = 0.0;
+    params->atSpeedTol = 0.02;
+    params->atSpeedMin = 0.1;
+    params->encoderCounts = 0;
+}
+
+int spindleModelInit(SPINDLE_MODEL_STRUCT * sm, int numSpindles)
+{
+    SPINDLE_PARAMS params;
+
+    if (0 == sm || numSpindles < 0 || numSpindles > EMCMOT_MAX_SPINDLES) {
+        return -1;
+    }
+
+    sm->numSpindles = numSpindles;
+    sm->period = 0.001;
+
+    spindleModelDefaultParams(&params);
+    for (int i = 0; i < EMCMOT_MAX_SPINDLES; i++) {
+        spindleModelSetParams(sm, i, &params);
+        sm->speed[i] = 0.0;
+        sm->pos[i] = 0.0;
+        sm->atSpeed[i] = 1;
+    }
+    spindleModelClearStats(sm);
+
+    return 0;
+}
+
+int spindleModelSetPeriod(SPINDLE_MODEL_STRUCT * sm, double period)
+{
+    if (0 == sm || period <= 0.0) {
+        return -1;
+    }
+
+    sm->period = period;
+
+    return 0;
+}
+
+int spindleModelSetParams(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    const SPINDLE_PARAMS * params)
+{
+    if (0 == sm || 0 == params || spindle < 0 || spindle >= EMCMOT_MAX_SPINDLES) {
+        return -1;
+    }
+    if ((params->model != SPINDLE_MODEL_IDEAL &&
+         params->model != SPINDLE_MODEL_DYNAMIC) ||
+        params->accel <= 0.0 ||
+        params->droop < 0.0 || params->droop > 1.0 ||
+        params->load < 0.0 || params->load > 1.0 ||
+        params->atSpeedTol < 0.0 || params->atSpeedMin < 0.0 ||
+        params->encoderCounts < 0) {
+        return -1;
+    }
+
+    sm->params[spindle] = *params;
+
+    return 0;
+}
+
+int spindleModelGetParams(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    SPINDLE_PARAMS * params)
+{
+    if (0 == sm || 0 == params || spindle < 0 || spindle >= EMCMOT_MAX_SPINDLES) {
+        return -1;
+    }
+
+    *params = sm->params[spindle];
+
+    return 0;
+}
+
+int spindleModelClearStats(SPINDLE_MODEL_STRUCT * sm)
+{
+    if (0 == sm) {
+        return -1;
+    }
+
+    for (int i = 0; i < EMCMOT_MAX_SPINDLES; i++) {
+        sm->atSpeedWait[i] = 0.0;
+        sm->indexCount[i] = 0;
+    }
+
+    return 0;
+}
+
+int spindleModelUpdate(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    double cmd, int on, int feeding, int *indexEnable,
+    double *revs, double *speedIn, int *atSpeed)
+{
+    if (0 == sm || spindle < 0 || spindle >= sm->numSpindles ||
+        0 == indexEnable || 0 == revs || 0 == speedIn || 0 == atSpeed) {
+        return -1;
+    }
+
+    const SPINDLE_PARAMS *p = &sm->params[spindle];
+    const double dt = sm->period;
+    double target = on ? cmd : 0.0;
+    double prev = sm->speed[spindle];
+    double speed = prev;
+
+    if (p->model == SPINDLE_MODEL_IDEAL) {
+        speed = target;
+        sm->atSpeed[spindle] = 1;
+    } else {
+        double dv = p->accel * dt;
+        target *= 1.0 - p->droop * (feeding ? p->load : 0.0);
+        if (speed < target - dv) {
+            speed += dv;
+        } else if (speed > target + dv) {
+            speed -= dv;
+        } else {
+            speed = target;
+        }
+        double band = fmax(p->atSpeedTol * fabs(cmd), p->atSpeedMin);
+        sm->atSpeed[spindle] = fabs(speed - (on ? cmd : 0.0)) <= band;
+    }
+    sm->speed[spindle] = speed;
+
+    /* encoder, trapezoidal position over the period */
+    double before = sm->pos[spindle];
+    double after = before + 0.5 * (prev + speed) * dt;
+    if (*indexEnable && floor(before) != floor(after)) {
+        /* index at the whole revolution crossed */
+        after -= speed > 0.0 ? floor(after) : ceil(after);
+        *indexEnable = 0;
+        sm->indexCount[spindle]++;
+    }
+    sm->pos[spindle] = after;
+
+    if (on && !sm->atSpeed[spindle]) {
+        sm->atSpeedWait[spindle] += dt;
+    }
+
+    *revs = p->encoderCounts > 0 ?
+        floor(after * p->encoderCounts) / p->encoderCounts : after;
+    *speedIn = speed;
+    *atSpeed = sm->atSpeed[spindle];
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/********************************************************************
+* Description: motionSpindle.h
+*   Simulated spindle drive and encoder, stands in for the hardware
+*   behind spindle.N.speed-out / speed-in / revs / at-speed /
+*   index-enable.
+*
+*   A spindle is either ideal (speed feedback equals the command and
+*   it is always at speed) or dynamic:
+*
+*     target = cmd * (1 - DROOP * load)
+*     speed moves towards target at no more than ACCEL
+*     at speed while |speed - cmd| <= max(AT_SPEED_TOL * |cmd|, AT_SPEED_MIN)
+*
+*   In both modes the encoder integrates the speed into revs,
+*   quantized to ENCODER_COUNTS per revolution, and when motion sets
+*   index-enable the next whole revolution resets revs to zero and
+*   clears index-enable, like a real encoder with an index pulse. That
+*   is what spindle synchronised moves and rigid tapping wait for.
+*
+*   Speeds are in revolutions per second, like spindle.N.speed-in.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_SPINDLE_H
+#define MOTION_SPINDLE_H
+
+#include "emcmotcfg.h"		/* EMCMOT_MAX_SPINDLES */
+
+#define SPINDLE_MODEL_IDEAL   0
+#define SPINDLE_MODEL_DYNAMIC 1
+
+/* per spindle parameters, [SPINDLE_n] in the ini file */
+typedef struct {
+    int model;			/* SPINDLE_MODEL_IDEAL or _DYNAMIC */
+    double accel;		/* rps/s, > 0 */
+    double droop;		/* speed lost at full load, 0..1 */
+    double load;		/* load while feeding, 0..1 */
+    double atSpeedTol;		/* fraction of the commanded speed */
+    double atSpeedMin;		/* rps, band used at low speed */
+    int encoderCounts;		/* counts per rev, 0 is continuous */
+} SPINDLE_PARAMS;
+
+typedef struct {
+    int numSpindles;
+    double period;		/* servo period in seconds */
+    SPINDLE_PARAMS params[EMCMOT_MAX_SPINDLES];
+
+    /* state */
+    double speed[EMCMOT_MAX_SPINDLES];		/* rps */
+    double pos[EMCMOT_MAX_SPINDLES];		/* revs since the last index */
+    int atSpeed[EMCMOT_MAX_SPINDLES];
+
+    /* statistics */
+    double atSpeedWait[EMCMOT_MAX_SPINDLES];	/* s on and not at speed */
+    unsigned long indexCount[EMCMOT_MAX_SPINDLES];
+} SPINDLE_MODEL_STRUCT;
+
+extern SPINDLE_MODEL_STRUCT spindleModel;
+
+extern int spindleModelInit(SPINDLE_MODEL_STRUCT * sm, int numSpindles);
+extern int spindleModelSetPeriod(SPINDLE_MODEL_STRUCT * sm, double period);
+extern int spindleModelSetParams(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    const SPINDLE_PARAMS * params);
+extern int spindleModelGetParams(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    SPINDLE_PARAMS * params);
+extern void spindleModelDefaultParams(SPINDLE_PARAMS * params);
+
+/* one servo period of one spindle. cmd is the commanded speed in rps,
+   feeding says the load applies. indexEnable is the HAL IO pin, it is
+   cleared on the index. revs, speedIn and atSpeed are the feedback */
+extern int spindleModelUpdate(SPINDLE_MODEL_STRUCT * sm, int spindle,
+    double cmd, int on, int feeding, int *indexEnable,
+    double *revs, double *speedIn, int *atSpeed);
+
+extern int spindleModelClearStats(SPINDLE_MODEL_STRUCT * sm);
+
+#endif
@@ -0,0 +1,200 @@
+/********************************************************************
+* Description: motionStatus.cpp
+*   Seqlock status snapshots, see motionStatus.h
+*
+*   The sequence counter is odd while a block is written. A reader
+*   copies the block between two loads of the counter and keeps the
+*   copy only if both loads saw the same even value.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionStatus.h"
+#include <string.h>
+
+typedef struct {
+    alignas(64) std::atomic<unsigned int> seq;
+    MOT_STATUS_FAST data;
+} FAST_BUF;
+
+static FAST_BUF fastBuf[2];
+static std::atomic<int> fastCurrent;
+
+alignas(64) static std::atomic<unsigned int> slowSeq;
+static MOT_STATUS_SLOW slowBuf;
+/* writer side copy, the published block is only touched on a change */
+static MOT_STATUS_SLOW slowWork;
+
+#define READ_RETRIES 1000
+
+static inline void writeBegin(std::atomic<unsigned int> *seq)
+{
+    seq->store(seq->load(std::memory_order_relaxed) + 1,
+               std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static inline void writeEnd(std::atomic<unsigned int> *seq)
+{
+    seq->store(seq->load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+}
+
+static int readBlock(std::atomic<unsigned int> *seq, void *dst,
+    const void *src, size_t size)
+{
+    for (int i = 0; i < READ_RETRIES; i++) {
+        unsigned int s1 = seq->load(std::memory_order_acquire);
+        if (s1 & 1)
+            continue;
+        memcpy(dst, src, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq->load(std::memory_order_relaxed) == s1)
+            return 0;
+    }
+    return -1;
+}
+
+void motStatusInit(void)
+{
+    memset(&slowWork, 0, sizeof(slowWork));
+    writeBegin(&slowSeq);
+    slowBuf = slowWork;
+    writeEnd(&slowSeq);
+    fastCurrent.store(0, std::memory_order_release);
+}
+
+static void copyFast(MOT_STATUS_FAST * f, const emcmot_status_t * st,
+    int numJoints)
+{
+    f->heartbeat = st->heartbeat;
+    f->numJoints = numJoints;
+    f->motion_state = st->motion_state;
+    f->motionFlag = st->motionFlag;
+    f->on_soft_limit = st->on_soft_limit;
+    f->jogging_active = st->jogging_active;
+    f->carte_pos_cmd_ok = st->carte_pos_cmd_ok;
+    f->carte_pos_fb_ok = st->carte_pos_fb_ok;
+    f->rapid_scale = st->rapid_scale;
+    f->feed_scale = st->feed_scale;
+    f->current_vel = st->current_vel;
+    f->requested_vel = st->requested_vel;
+    f->distance_to_go = st->distance_to_go;
+    f->carte_pos_cmd = st->carte_pos_cmd;
+    f->carte_pos_fb = st->carte_pos_fb;
+    f->tag = st->tag;
+    f->id = st->id;
+    f->depth = st->depth;
+    f->activeDepth = st->activeDepth;
+    f->tcqlen = st->tcqlen;
+    f->queueFull = st->queueFull;
+
+    for (int j = 0; j < numJoints; j++) {
+        const emcmot_joint_status_t *js = &st->joint_status[j];
+        f->pos_cmd[j] = js->pos_cmd;
+        f->pos_fb[j] = js->pos_fb;
+        f->vel_cmd[j] = js->vel_cmd;
+        f->acc_cmd[j] = js->acc_cmd;
+        f->ferror[j] = js->ferror;
+    }
+}
+
+static void copySlow(MOT_STATUS_SLOW * s, const emcmot_status_t * st,
+    int numJoints, unsigned int changed)
+{
+    for (int j = 0; j < numJoints; j++) {
+        if (!(changed & MOT_STATUS_CHG_JOINT(j)))
+            continue;
+        const emcmot_joint_status_t *js = &st->joint_status[j];
+        s->flag[j] = js->flag;
+        s->homing[j] = js->homing;
+        s->homed[j] = js->homed;
+        s->ferror_high_mark[j] = js->ferror_high_mark;
+        s->backlash[j] = js->backlash;
+        s->min_pos_limit[j] = js->min_pos_limit;
+        s->max_pos_limit[j] = js->max_pos_limit;
+        s->min_ferror[j] = js->min_ferror;
+        s->max_ferror[j] = js->max_ferror;
+    }
+    if (changed & MOT_STATUS_CHG_AXIS) {
+        for (int a = 0; a < EMCMOT_MAX_AXIS; a++) {
+            s->axis_min_pos_limit[a] = st->axis_status[a].min_pos_limit;
+            s->axis_max_pos_limit[a] = st->axis_status[a].max_pos_limit;
+        }
+    }
+
+    s->gen++;
+    for (int g = 0; g < MOT_STATUS_GROUPS; g++) {
+        if (changed & (1u << g))
+            s->changed[g] = s->gen;
+    }
+}
+
+void motStatusPublish(const emcmot_status_t * status, int numJoints,
+    unsigned int changed)
+{
+    static motion_state_t lastState;
+    static int lastFlag;
+    static int first = 1;
+
+    /* the first call stamps every group, so generation 0 gets them all */
+    if (first || status->motion_state != lastState || status->motionFlag != lastFlag) {
+        first = 0;
+        lastState = status->motion_state;
+        lastFlag = status->motionFlag;
+        changed |= MOT_STATUS_CHG_MOTION;
+    }
+
+    /* fill the buffer readers are not pointed at */
+    FAST_BUF *b = &fastBuf[fastCurrent.load(std::memory_order_relaxed) ^ 1];
+    writeBegin(&b->seq);
+    copyFast(&b->data, status, numJoints);
+    writeEnd(&b->seq);
+    fastCurrent.store((int)(b - fastBuf), std::memory_order_release);
+
+    if (changed) {
+        copySlow(&slowWork, status, numJoints, changed);
+        writeBegin(&slowSeq);
+        slowBuf = slowWork;
+        writeEnd(&slowSeq);
+    }
+}
+
+int motStatusReadFast(MOT_STATUS_FAST * fast)
+{
+    for (int i = 0; i < READ_RETRIES; i++) {
+        FAST_BUF *b = &fastBuf[fastCurrent.load(std::memory_order_acquire)];
+        if (0 == readBlock(&b->seq, fast, &b->data, sizeof(*fast)))
+            return 0;
+    }
+    return -1;
+}
+
+int motStatusReadSlow(MOT_STATUS_SLOW * slow)
+{
+    return readBlock(&slowSeq, slow, &slowBuf, sizeof(*slow));
+}
+
+unsigned int motStatusChanges(unsigned int *gen)
+{
+    unsigned int changed[MOT_STATUS_GROUPS];
+    unsigned int now;
+    unsigned int mask = 0;
+
+    if (0 != readBlock(&slowSeq, changed, slowBuf.changed, sizeof(changed))) {
+        return 0;
+    }
+    now = changed[0];
+    for (int g = 1; g < MOT_STATUS_GROUPS; g++) {
+        if ((int)(changed[g] - now) > 0)
+            now = changed[g];
+    }
+
+    for (int g = 0; g < MOT_STATUS_GROUPS; g++) {
+        if ((int)(changed[g] - *gen) > 0)
+            mask |= 1u << g;
+    }
+    *gen = now;
+
+    return mask;
+}
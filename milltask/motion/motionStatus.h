@@ -0,0 +1,93 @@
+/********************************************************************
+* Description: motionStatus.h
+*   Status snapshots published by the motion controller for readers
+*   on other threads (MotionTask getters, the GUI).
+*
+*   Fast fields (positions, velocities, planner state) are published
+*   every servo cycle into one of two buffers, each guarded by its own
+*   sequence counter. The writer always fills the buffer readers are
+*   not pointed at, so a reader only retries when it is more than a
+*   whole cycle late.
+*
+*   Slow fields (joint flags, homing, limits, ferror limits, axis
+*   limits) go into a separate block that is only written when one of
+*   them changed. Every change bumps a generation counter and stamps
+*   the changed group, readers ask for the groups changed since the
+*   generation they last saw.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_STATUS_H
+#define MOTION_STATUS_H
+
+#include <atomic>
+#include "motion.h"
+
+/* change groups, bit j is joint j */
+#define MOT_STATUS_CHG_JOINT(j)	(1u << (j))
+#define MOT_STATUS_CHG_AXIS	(1u << EMCMOT_MAX_JOINTS)
+#define MOT_STATUS_CHG_MOTION	(1u << (EMCMOT_MAX_JOINTS + 1))	/* state, flags */
+#define MOT_STATUS_GROUPS	(EMCMOT_MAX_JOINTS + 2)
+
+typedef struct {
+    unsigned long heartbeat;
+    int numJoints;
+    motion_state_t motion_state;
+    int motionFlag;
+    int on_soft_limit;
+    int jogging_active;
+    int carte_pos_cmd_ok;
+    int carte_pos_fb_ok;
+    double rapid_scale;
+    double feed_scale;
+    double current_vel;
+    double requested_vel;
+    double distance_to_go;
+    EmcPose carte_pos_cmd;
+    EmcPose carte_pos_fb;
+    state_tag_t tag;
+    int id;
+    int depth;
+    int activeDepth;
+    int tcqlen;
+    int queueFull;
+
+    double pos_cmd[EMCMOT_MAX_JOINTS];
+    double pos_fb[EMCMOT_MAX_JOINTS];
+    double vel_cmd[EMCMOT_MAX_JOINTS];
+    double acc_cmd[EMCMOT_MAX_JOINTS];
+    double ferror[EMCMOT_MAX_JOINTS];
+} MOT_STATUS_FAST;
+
+typedef struct {
+    unsigned int gen;			/* generation of the last change */
+    unsigned int changed[MOT_STATUS_GROUPS];	/* generation per group */
+
+    int flag[EMCMOT_MAX_JOINTS];
+    int homing[EMCMOT_MAX_JOINTS];
+    int homed[EMCMOT_MAX_JOINTS];
+    double ferror_high_mark[EMCMOT_MAX_JOINTS];
+    double backlash[EMCMOT_MAX_JOINTS];
+    double min_pos_limit[EMCMOT_MAX_JOINTS];
+    double max_pos_limit[EMCMOT_MAX_JOINTS];
+    double min_ferror[EMCMOT_MAX_JOINTS];
+    double max_ferror[EMCMOT_MAX_JOINTS];
+    double axis_min_pos_limit[EMCMOT_MAX_AXIS];
+    double axis_max_pos_limit[EMCMOT_MAX_AXIS];
+} MOT_STATUS_SLOW;
+
+/* motion thread only */
+extern void motStatusInit(void);
+/* status has been updated by update_status(), changed holds the
+   MOT_STATUS_CHG_ groups whose slow fields differ from the last call */
+extern void motStatusPublish(const emcmot_status_t * status, int numJoints,
+    unsigned int changed);
+
+/* any thread, a consistent copy, 0 on success */
+extern int motStatusReadFast(MOT_STATUS_FAST * fast);
+extern int motStatusReadSlow(MOT_STATUS_SLOW * slow);
+/* groups changed after *gen, *gen is set to the current generation */
+extern unsigned int motStatusChanges(unsigned int *gen);
+
+#endif
@@ -0,0 +1,287 @@
+/********************************************************************
+* Description: motionTelemetry.cpp
+*   Writer side of the telemetry ring, see motionTelemetry.h
+*
+*   A sample is filled in place in its slot between the two stores of
+*   its seq, then head is moved on. Publishing costs the copy of the
+*   status fields, there is no lock, system call or allocation on the
+*   motion thread.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#include "motionTelemetry.h"
+#include "motion.h"
+#include "rtapi.h"
+#include <atomic>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static_assert(EMCMOT_MAX_JOINTS <= MOT_TELEM_JOINTS, "MOT_TELEM_JOINTS too small");
+
+typedef struct {
+    std::string name;
+    void *base;
+    size_t size;
+    mot_telem_header_t *hdr;
+    mot_telem_sample_t *slots;
+    uint64_t mask;
+    uint64_t head;		/* motion thread, samples published */
+    long servoPeriod;
+} TELEM_RING;
+
+/* set up off the motion thread, handed over through current */
+static TELEM_RING ring;
+static std::atomic<TELEM_RING *> current;
+
+static inline int64_t clockNs(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* tell readers of an existing ring that it is gone */
+static void retire(const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    struct stat st;
+
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(mot_telem_header_t)) {
+        void *p = mmap(NULL, sizeof(mot_telem_header_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            std::atomic_ref<uint32_t>(((mot_telem_header_t *)p)->magic)
+                .store(0, std::memory_order_release);
+            munmap(p, sizeof(mot_telem_header_t));
+        }
+    }
+    close(fd);
+}
+
+/* fill in the header of a fresh ring and hand it to the motion thread */
+static int setup(const char *name, void *base, size_t size, uint32_t n,
+    long servo_period_ns)
+{
+    /* the mapping is zeroed, every seq is 0: nothing published */
+    ring.name = name;
+    ring.base = base;
+    ring.size = size;
+    ring.hdr = (mot_telem_header_t *)base;
+    ring.slots = (mot_telem_sample_t *)((char *)base + sizeof(mot_telem_header_t));
+    ring.mask = n - 1;
+    ring.head = 0;
+    ring.servoPeriod = servo_period_ns;
+
+    mot_telem_header_t *hdr = ring.hdr;
+    hdr->version = MOT_TELEM_VERSION;
+    hdr->header_size = sizeof(mot_telem_header_t);
+    hdr->sample_size = sizeof(mot_telem_sample_t);
+    hdr->slots = n;
+    hdr->max_joints = MOT_TELEM_JOINTS;
+    hdr->servo_period_ns = servo_period_ns;
+    hdr->epoch = clockNs(CLOCK_REALTIME);
+    hdr->writer_pid = getpid();
+    std::atomic_ref<uint32_t>(hdr->magic).store(MOT_TELEM_MAGIC,
+                                                std::memory_order_release);
+
+    current.store(&ring, std::memory_order_release);
+    rtapi_print_msg(RTAPI_MSG_INFO, "MOTION: telemetry %s, %u slots\n",
+                    name[0] ? name : "(private)", n);
+    return 0;
+}
+
+int motTelemOpen(const char *name, int slots, long servo_period_ns)
+{
+    uint32_t n = 2;
+    size_t size;
+    int fd;
+    void *base;
+
+    if ((name && (name[0] != '/' || strchr(name + 1, '/'))) || slots <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    motTelemClose();
+    while (n < (uint32_t)slots && n < (1u << 20)) {
+        n <<= 1;
+    }
+    size = sizeof(mot_telem_header_t) + (size_t)n * sizeof(mot_telem_sample_t);
+
+    if (!name) {
+        /* private, only for motTelemAttachLocal() */
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            return -1;
+        }
+        return setup("", base, size, n, servo_period_ns);
+    }
+
+    /* a new object, readers still on an old one keep their mapping */
+    retire(name);
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = err;
+        return -1;
+    }
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        int err = errno;
+        shm_unlink(name);
+        errno = err;
+        return -1;
+    }
+
+    return setup(name, base, size, n, servo_period_ns);
+}
+
+void motTelemClose(void)
+{
+    TELEM_RING *r = current.exchange(nullptr, std::memory_order_acq_rel);
+
+    if (!r) {
+        return;
+    }
+    /* the motion thread may be in motTelemPublish() still, it is only
+       closed with the thread stopped or at exit */
+    std::atomic_ref<uint32_t>(r->hdr->magic).store(0, std::memory_order_release);
+    munmap(r->base, r->size);
+    if (!r->name.empty()) {
+        shm_unlink(r->name.c_str());
+    }
+    r->base = NULL;
+    r->hdr = NULL;
+    r->slots = NULL;
+}
+
+static void fillSample(mot_telem_sample_t * s, const emcmot_status_t * st,
+    int numJoints, int numSpindles, long servoPeriod)
+{
+    const double *cmd = &st->carte_pos_cmd.tran.x;
+    const double *fb = &st->carte_pos_fb.tran.x;
+    uint32_t homed = 0;
+
+    s->cycle = st->heartbeat;
+    s->sim_time_ns = (int64_t)st->heartbeat * servoPeriod;
+    s->mono_time_ns = clockNs(CLOCK_MONOTONIC);
+
+    s->motion_state = st->motion_state;
+    s->motion_flag = st->motionFlag;
+    s->num_joints = numJoints;
+    s->num_spindles = numSpindles;
+    s->on_soft_limit = st->on_soft_limit;
+    s->jogging_active = st->jogging_active;
+    s->id = st->id;
+    s->line = st->tag.fields[GM_FIELD_LINE_NUMBER];
+    s->motion_mode = st->tag.fields[GM_FIELD_MOTION_MODE];
+    s->tcq_len = st->tcqlen;
+    s->queue_full = st->queueFull;
+
+    s->current_vel = st->current_vel;
+    s->requested_vel = st->requested_vel;
+    s->distance_to_go = st->distance_to_go;
+    s->feed_scale = st->feed_scale;
+    s->rapid_scale = st->rapid_scale;
+    s->feed = st->tag.fields_float[GM_FIELD_FLOAT_FEED];
+    s->speed = st->tag.fields_float[GM_FIELD_FLOAT_SPEED];
+
+    /* EmcPose is tran x y z, then a b c u v w */
+    for (int n = 0; n < MOT_TELEM_POSE; n++) {
+        s->carte_pos_cmd[n] = cmd[n];
+        s->carte_pos_fb[n] = fb[n];
+    }
+
+    for (int j = 0; j < numJoints; j++) {
+        const emcmot_joint_status_t *js = &st->joint_status[j];
+        s->joint_pos_cmd[j] = js->pos_cmd;
+        s->joint_pos_fb[j] = js->pos_fb;
+        s->joint_vel_cmd[j] = js->vel_cmd;
+        s->joint_acc_cmd[j] = js->acc_cmd;
+        s->joint_ferror[j] = js->ferror;
+        s->joint_flag[j] = js->flag;
+        if (js->homed) {
+            homed |= 1u << j;
+        }
+    }
+    s->homed_mask = homed;
+
+    for (int n = 0; n < numSpindles && n < MOT_TELEM_SPINDLES; n++) {
+        s->spindle_speed[n] = st->spindle_status[n].speed;
+        s->spindle_at_speed[n] = st->spindle_status[n].at_speed;
+    }
+}
+
+void motTelemPublish(const emcmot_status_t * status, int numJoints,
+    int numSpindles)
+{
+    TELEM_RING *r = current.load(std::memory_order_acquire);
+
+    if (!r) {
+        return;
+    }
+    uint64_t n = r->head;
+    mot_telem_sample_t *s = &r->slots[n & r->mask];
+    std::atomic_ref<uint64_t> seq(s->seq);
+
+    seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    fillSample(s, status, numJoints, numSpindles, r->servoPeriod);
+    seq.store(2 * n + 2, std::memory_order_release);
+
+    r->head = n + 1;
+    std::atomic_ref<uint64_t>(r->hdr->head).store(n + 1, std::memory_order_release);
+}
+
+int motTelemInfo(const char **name, int *slots, unsigned long long *published)
+{
+    TELEM_RING *r = current.load(std::memory_order_acquire);
+
+    if (!r) {
+        return -1;
+    }
+    *name = r->name.c_str();
+    *slots = (int)(r->mask + 1);
+    *published = std::atomic_ref<uint64_t>(r->hdr->head).load(std::memory_order_relaxed);
+    return 0;
+}
+
+int motTelemAttachLocal(mot_telem_reader_t * r)
+{
+    TELEM_RING *ring = current.load(std::memory_order_acquire);
+
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    if (!ring) {
+        errno = ENOENT;
+        return -1;
+    }
+    /* base stays NULL, motTelemDetach() leaves the mapping alone */
+    r->hdr = ring->hdr;
+    r->slots = ring->slots;
+    r->mask = ring->mask;
+    r->epoch = std::atomic_ref<int64_t>(ring->hdr->epoch).load(std::memory_order_acquire);
+    r->next = std::atomic_ref<uint64_t>(ring->hdr->head).load(std::memory_order_acquire);
+    if (r->next > 0) {
+        r->next--;
+    }
+    return 0;
+}
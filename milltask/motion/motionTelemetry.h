@@ -0,0 +1,240 @@
+/********************************************************************
+* Description: motionTelemetry.h
+*   Motion status telemetry in POSIX shared memory, for tools outside
+*   the simulator (dashboards, scripts, notebooks).
+*
+*   With [EMCMOT]TELEMETRY = /name the motion thread publishes one
+*   mot_telem_sample_t per servo cycle into a ring in the shared memory
+*   object /name (/dev/shm/name). The writer never waits: a reader that
+*   falls a whole ring behind loses samples and is told how many.
+*
+*   Layout, fixed and native byte order:
+*
+*     mot_telem_header_t                  header_size bytes
+*     mot_telem_sample_t[slots]           sample_size bytes each
+*
+*   Sample n lives in slot n % slots. Its seq is 2n+1 while it is
+*   written and 2n+2 once it is complete, header.head is the number of
+*   samples published. A reader copies (or reads in place) a sample
+*   and keeps what it read only if seq still holds 2n+2 afterwards.
+*   The writer sets magic last when it (re)creates the ring, a new
+*   epoch tells readers of the old one to attach again.
+*
+*   This header is plain C and, with motionTelemetryReader.c, all a
+*   reader needs, it does not link the simulator:
+*
+*     cc -o dash dash.c motionTelemetryReader.c -lrt
+*
+*     mot_telem_reader_t r;
+*     mot_telem_sample_t s;
+*     if (motTelemAttach(&r, "/cncsim-telemetry") == 0) {
+*         for (;;) {
+*             int res = motTelemNext(&r, &s);
+*             if (res > 0)
+*                 use(&s);
+*             else if (res == 0)
+*                 usleep(1000);
+*             else
+*                 break;          (the simulator restarted, attach again)
+*         }
+*         motTelemDetach(&r);
+*     }
+*
+*   Readers map the ring read only, any number of them may attach.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#ifndef MOTION_TELEMETRY_H
+#define MOTION_TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOT_TELEM_MAGIC		0x4d544c4dU	/* "MLTM" */
+#define MOT_TELEM_VERSION	1
+#define MOT_TELEM_JOINTS	16
+#define MOT_TELEM_SPINDLES	4
+#define MOT_TELEM_POSE		9	/* x y z a b c u v w */
+#define MOT_TELEM_DEFAULT_SLOTS	4096
+
+typedef struct {
+    uint32_t magic;		/* MOT_TELEM_MAGIC once the ring is set up */
+    uint32_t version;		/* MOT_TELEM_VERSION */
+    uint32_t header_size;	/* offset of slot 0 */
+    uint32_t sample_size;
+    uint32_t slots;		/* a power of two */
+    uint32_t max_joints;	/* MOT_TELEM_JOINTS */
+    int64_t servo_period_ns;
+    int64_t epoch;		/* CLOCK_REALTIME ns the writer set up the ring */
+    int32_t writer_pid;
+    uint32_t reserved0;
+    uint8_t pad0[16];
+    uint64_t head;		/* samples published, in its own cache line */
+    uint8_t pad1[56];
+} mot_telem_header_t;
+
+typedef struct {
+    uint64_t seq;		/* 2n+1 while sample n is written, then 2n+2 */
+    uint64_t cycle;		/* servo cycles, emcmotStatus->heartbeat */
+    int64_t sim_time_ns;	/* cycle * servo period, the simulated time */
+    int64_t mono_time_ns;	/* CLOCK_MONOTONIC when published */
+
+    int32_t motion_state;	/* motion_state_t, 1 free 2 coord 3 teleop */
+    int32_t motion_flag;	/* EMCMOT_MOTION_ bits */
+    int32_t num_joints;
+    int32_t num_spindles;
+    int32_t on_soft_limit;
+    int32_t jogging_active;
+    uint32_t homed_mask;	/* bit j joint j homed */
+    int32_t id;			/* motion id being executed */
+    int32_t line;		/* program line of that motion */
+    int32_t motion_mode;	/* G code * 10 */
+    int32_t tcq_len;		/* planner queue depth */
+    int32_t queue_full;
+
+    double current_vel;
+    double requested_vel;
+    double distance_to_go;
+    double feed_scale;
+    double rapid_scale;
+    double feed;		/* programmed F */
+    double speed;		/* programmed S */
+
+    double carte_pos_cmd[MOT_TELEM_POSE];
+    double carte_pos_fb[MOT_TELEM_POSE];
+
+    double joint_pos_cmd[MOT_TELEM_JOINTS];
+    double joint_pos_fb[MOT_TELEM_JOINTS];
+    double joint_vel_cmd[MOT_TELEM_JOINTS];
+    double joint_acc_cmd[MOT_TELEM_JOINTS];
+    double joint_ferror[MOT_TELEM_JOINTS];
+    int32_t joint_flag[MOT_TELEM_JOINTS];	/* EMCMOT_JOINT_ bits */
+
+    double spindle_speed[MOT_TELEM_SPINDLES];	/* commanded rpm */
+    int32_t spindle_at_speed[MOT_TELEM_SPINDLES];
+
+    uint8_t reserved[56];	/* zero, keeps the sample 64 byte sized */
+} mot_telem_sample_t;
+
+#ifdef __cplusplus
+static_assert(sizeof(mot_telem_header_t) == 128, "telemetry header layout");
+static_assert(sizeof(mot_telem_sample_t) % 64 == 0, "telemetry sample layout");
+#else
+_Static_assert(sizeof(mot_telem_header_t) == 128, "telemetry header layout");
+_Static_assert(sizeof(mot_telem_sample_t) % 64 == 0, "telemetry sample layout");
+#endif
+
+/*
+  UNIX socket stream, [EMCMOT]TELEMETRY_SOCKET = path (see TelemTask)
+
+  Every message is a mot_telem_frame_t and len payload bytes, native
+  byte order. The server sends HELLO on connect. A client sends
+  SUBSCRIBE with the channels it wants and the decimation, one sample
+  every that many servo cycles (0 stops). A new SUBSCRIBE replaces the
+  old one. Every DATA payload is a mot_telem_data_t followed by the
+  subscribed channels in bit order, each packed as listed below, with
+  num_joints values for a joint channel. lost counts the samples the
+  client missed since its last DATA, the ring lapped the server or
+  the client did not keep up and its backlog was full.
+*/
+#define MOT_TELEM_FRAME_HELLO		1	/* server, mot_telem_hello_t */
+#define MOT_TELEM_FRAME_SUBSCRIBE	2	/* client, mot_telem_subscribe_t */
+#define MOT_TELEM_FRAME_DATA		3	/* server, mot_telem_data_t ... */
+
+#define MOT_TELEM_CH_JOINT_POS	0x001	/* double[num_joints] pos_cmd */
+#define MOT_TELEM_CH_JOINT_VEL	0x002	/* double[num_joints] vel_cmd */
+#define MOT_TELEM_CH_JOINT_ACC	0x004	/* double[num_joints] acc_cmd */
+#define MOT_TELEM_CH_JOINT_FB	0x008	/* double[num_joints] pos_fb */
+#define MOT_TELEM_CH_FERROR	0x010	/* double[num_joints] ferror */
+#define MOT_TELEM_CH_TCP	0x020	/* double[9] carte_pos_cmd */
+#define MOT_TELEM_CH_LINE	0x040	/* int32 line, int32 id */
+#define MOT_TELEM_CH_FEED	0x080	/* double feed_scale, rapid_scale,
+					   current_vel, requested_vel */
+#define MOT_TELEM_CH_QUEUE	0x100	/* int32 tcq_len, int32 queue_full */
+#define MOT_TELEM_CH_STATE	0x200	/* int32 motion_state, motion_flag */
+#define MOT_TELEM_CH_ALL	0x3ff
+
+typedef struct {
+    uint16_t type;		/* MOT_TELEM_FRAME_ */
+    uint16_t reserved;
+    uint32_t len;		/* payload bytes after the frame */
+} mot_telem_frame_t;
+
+typedef struct {
+    uint32_t version;		/* MOT_TELEM_VERSION */
+    uint32_t channels;		/* MOT_TELEM_CH_ the server has */
+    int64_t servo_period_ns;
+    uint32_t max_joints;	/* MOT_TELEM_JOINTS */
+    uint32_t reserved;
+} mot_telem_hello_t;
+
+typedef struct {
+    uint32_t channels;
+    uint32_t decimation;
+} mot_telem_subscribe_t;
+
+typedef struct {
+    uint64_t cycle;
+    int64_t sim_time_ns;
+    uint32_t channels;
+    uint16_t num_joints;
+    uint16_t lost;		/* saturates at 65535 */
+} mot_telem_data_t;
+
+typedef struct {
+    int fd;
+    void *base;
+    size_t size;
+    const mot_telem_header_t *hdr;
+    const mot_telem_sample_t *slots;
+    uint64_t mask;
+    int64_t epoch;
+    uint64_t next;		/* next sample to read */
+    uint64_t seq;		/* seq of the sample motTelemPeek() handed out */
+    uint64_t lost;		/* samples overwritten before they were read */
+} mot_telem_reader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* reader side, see motionTelemetryReader.c. Attach maps the ring and
+   starts at the newest sample, 0 on success, -1 with errno */
+extern int motTelemAttach(mot_telem_reader_t * r, const char *name);
+extern void motTelemDetach(mot_telem_reader_t * r);
+/* copy the next sample. 1 a sample, 0 none yet, -1 the ring was set up
+   again by a new writer, detach and attach */
+extern int motTelemNext(mot_telem_reader_t * r, mot_telem_sample_t * s);
+/* zero copy, *s points into the ring. Read what is needed, then
+   motTelemDone() says whether it still holds (0) or the writer
+   overwrote the sample meanwhile (-1, counted in lost). Peek returns
+   like motTelemNext() */
+extern int motTelemPeek(mot_telem_reader_t * r, const mot_telem_sample_t ** s);
+extern int motTelemDone(mot_telem_reader_t * r);
+/* copy of the newest sample, does not move next. 0 or -1 */
+extern int motTelemLatest(mot_telem_reader_t * r, mot_telem_sample_t * s);
+
+/* writer side, the simulator */
+struct emcmot_status_t;
+/* create or reuse the shared memory object, slots is rounded up to a
+   power of two. name NULL keeps the ring private to the process. Not
+   on the motion thread, it may publish meanwhile */
+extern int motTelemOpen(const char *name, int slots, long servo_period_ns);
+/* in process reader of the open ring, shared or private */
+extern int motTelemAttachLocal(mot_telem_reader_t * r);
+/* marks the ring dead for its readers and unlinks it */
+extern void motTelemClose(void);
+/* motion thread only, once per servo cycle after update_status() */
+extern void motTelemPublish(const struct emcmot_status_t *status,
+    int numJoints, int numSpindles);
+/* name ("" if private), slots and samples published, 0 if a ring is
+   open */
+extern int motTelemInfo(const char **name, int *slots,
+    unsigned long long *published);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
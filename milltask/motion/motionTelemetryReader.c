@@ -0,0 +1,198 @@
+/********************************************************************
+* Description: motionTelemetryReader.c
+*   Reader side of the telemetry ring, see motionTelemetry.h
+*
+*   Plain C with the GCC atomic builtins, so a tool can compile it on
+*   its own. The ring is mapped read only, a reader never writes to
+*   the shared memory and the writer does not know about it.
+*
+* License: GPL Version 2
+* System: Linux
+********************************************************************/
+#define _POSIX_C_SOURCE 200809L	/* pread, shm_open */
+#include "motionTelemetry.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline uint64_t loadAcquire(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline uint64_t loadRelaxed(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline int64_t loadEpoch(const mot_telem_reader_t * r)
+{
+    return __atomic_load_n(&r->hdr->epoch, __ATOMIC_ACQUIRE);
+}
+
+/* the writer set the ring up again, or took it down */
+static inline int restarted(const mot_telem_reader_t * r)
+{
+    return __atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != MOT_TELEM_MAGIC ||
+        loadEpoch(r) != r->epoch;
+}
+
+int motTelemAttach(mot_telem_reader_t * r, const char *name)
+{
+    mot_telem_header_t hdr;
+    struct stat st;
+    size_t size;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = shm_open(name, O_RDONLY, 0);
+    if (r->fd < 0) {
+        return -1;
+    }
+    if (fstat(r->fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr) ||
+        pread(r->fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        goto bad;
+    }
+    if (hdr.magic != MOT_TELEM_MAGIC || hdr.version != MOT_TELEM_VERSION ||
+        hdr.sample_size != sizeof(mot_telem_sample_t) ||
+        hdr.header_size < sizeof(hdr) || hdr.slots == 0 ||
+        (hdr.slots & (hdr.slots - 1))) {
+        errno = EPROTO;
+        goto bad;
+    }
+    size = hdr.header_size + (size_t)hdr.slots * hdr.sample_size;
+    if ((size_t)st.st_size < size) {
+        errno = EPROTO;
+        goto bad;
+    }
+    r->base = mmap(NULL, size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (r->base == MAP_FAILED) {
+        r->base = NULL;
+        goto bad;
+    }
+    r->size = size;
+    r->hdr = (const mot_telem_header_t *)r->base;
+    r->slots = (const mot_telem_sample_t *)((const char *)r->base +
+                                            hdr.header_size);
+    r->mask = hdr.slots - 1;
+    r->epoch = loadEpoch(r);
+    r->next = loadAcquire(&r->hdr->head);
+    if (r->next > 0) {
+        r->next--;
+    }
+    return 0;
+
+  bad:
+    {
+        int err = errno;
+        close(r->fd);
+        r->fd = -1;
+        errno = err;
+    }
+    return -1;
+}
+
+void motTelemDetach(mot_telem_reader_t * r)
+{
+    if (r->base) {
+        munmap(r->base, r->size);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    r->base = NULL;
+    r->hdr = NULL;
+    r->slots = NULL;
+    r->fd = -1;
+}
+
+int motTelemPeek(mot_telem_reader_t * r, const mot_telem_sample_t ** s)
+{
+    uint64_t head, seq;
+    const mot_telem_sample_t *slot;
+
+    if (restarted(r)) {
+        return -1;
+    }
+    for (;;) {
+        head = loadAcquire(&r->hdr->head);
+        if (r->next >= head) {
+            return 0;
+        }
+        if (head - r->next > r->mask) {
+            /* lapped, go on from the newest sample */
+            r->lost += head - 1 - r->next;
+            r->next = head - 1;
+        }
+        slot = &r->slots[r->next & r->mask];
+        seq = loadAcquire(&slot->seq);
+        if (seq == 2 * r->next + 2) {
+            break;
+        }
+        /* overwritten between the two loads, look at head again */
+        r->lost++;
+        r->next++;
+    }
+    r->seq = seq;
+    *s = slot;
+    return 1;
+}
+
+int motTelemDone(mot_telem_reader_t * r)
+{
+    const mot_telem_sample_t *slot = &r->slots[r->next & r->mask];
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    r->next++;
+    if (loadRelaxed(&slot->seq) != r->seq) {
+        r->lost++;
+        return -1;
+    }
+    return 0;
+}
+
+int motTelemNext(mot_telem_reader_t * r, mot_telem_sample_t * s)
+{
+    const mot_telem_sample_t *slot;
+    int res;
+
+    for (;;) {
+        res = motTelemPeek(r, &slot);
+        if (res <= 0) {
+            return res;
+        }
+        memcpy(s, slot, sizeof(*s));
+        if (motTelemDone(r) == 0) {
+            return 1;
+        }
+    }
+}
+
+int motTelemLatest(mot_telem_reader_t * r, mot_telem_sample_t * s)
+{
+    for (int i = 0; i < 1000; i++) {
+        uint64_t head, seq;
+        const mot_telem_sample_t *slot;
+
+        if (restarted(r)) {
+            return -1;
+        }
+        head = loadAcquire(&r->hdr->head);
+        if (head == 0) {
+            return -1;
+        }
+        slot = &r->slots[(head - 1) & r->mask];
+        seq = loadAcquire(&slot->seq);
+        if (seq != 2 * (head - 1) + 2) {
+            continue;
+        }
+        memcpy(s, slot, sizeof(*s));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (loadRelaxed(&slot->seq) == seq) {
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -1,3 +1,56 @@
 #include "motionhalctrl.h"
+#include <sstream>
 
+std::mutex MotHalCtrl::servoMutex_;
+SERVO_PARAMS MotHalCtrl::servoStaged_[EMCMOT_MAX_JOINTS];
+unsigned int MotHalCtrl::servoStagedMask_ = 0;
+std::atomic<bool> MotHalCtrl::servoPending_{false};
+std::atomic<bool> MotHalCtrl::servoClear_{false};
+std::mutex MotHalCtrl::spindleMutex_;
+SPINDLE_PARAMS MotHalCtrl::spindleStaged_[EMCMOT_MAX_SPINDLES];
+unsigned int MotHalCtrl::spindleStagedMask_ = 0;
+std::atomic<bool> MotHalCtrl::spindlePending_{false};
+std::atomic<bool> MotHalCtrl::spindleClear_{false};
 
+std::string MotHalCtrl::show_servo(int joint)
+{
+    std::stringstream ss;
+    SERVO_PARAMS params;
+
+    if (joint < 0 || joint >= servoModel.numJoints ||
+        servoModelGetParams(&servoModel, joint, &params))
+        return "";
+
+    ss << "Servo" << joint << (params.model == SERVO_MODEL_PID ? " PID" : " IDEAL") << std::endl;
+    ss << "P " << params.p << " I " << params.i << " D " << params.d << std::endl;
+    ss << "FF0 " << params.ff0 << " FF1 " << params.ff1 << " FF2 " << params.ff2 << std::endl;
+    ss << "MaxOutput " << params.maxOutput << " Inertia " << params.inertia
+       << " Damping " << params.damping << std::endl;
+    ss << "Output " << servoModel.output[joint] << (servoModel.saturated[joint] ? " saturated" : "") << std::endl;
+    ss << "Ferror " << servoModel.ferror[joint] << " MaxFerror " << servoModel.maxFerror[joint] << std::endl;
+    ss << "SatCycles " << servoModel.satCycles[joint];
+
+    return ss.str();
+}
+
+std::string MotHalCtrl::show_spindle(int spindle)
+{
+    std::stringstream ss;
+    SPINDLE_PARAMS params;
+
+    if (spindle < 0 || spindle >= spindleModel.numSpindles ||
+        spindleModelGetParams(&spindleModel, spindle, &params))
+        return "";
+
+    ss << "Spindle" << spindle << (params.model == SPINDLE_MODEL_DYNAMIC ? " DYNAMIC" : " IDEAL") << std::endl;
+    ss << "Accel " << params.accel * 60.0 << " rpm/s Droop " << params.droop
+       << " Load " << params.load << std::endl;
+    ss << "AtSpeedTol " << params.atSpeedTol << " AtSpeedMin " << params.atSpeedMin * 60.0
+       << " rpm EncoderCounts " << params.encoderCounts << std::endl;
+    ss << "Speed " << spindleModel.speed[spindle] * 60.0 << " rpm"
+       << (spindleModel.atSpeed[spindle] ? " at speed" : "") << std::endl;
+    ss << "AtSpeedWait " << spindleModel.atSpeedWait[spindle] << " s Index "
+       << spindleModel.indexCount[spindle];
+
+    return ss.str();
+}
@@ -2,6 +2,11 @@
 #define _MOTION_HAL_CTRL_
 
 #include "mot_priv.h"
+#include "motionServo.h"
+#include "motionSpindle.h"
+#include <atomic>
+#include <mutex>
+#include <string>
 /* pointer to emcmot_hal_data_t struct in HAL shmem, with all HAL data */
 extern emcmot_hal_data_t *emcmot_hal_data;
 extern emcmot_struct_t *emcmotStruct;
@@ -11,6 +16,8 @@ extern struct emcmot_status_t *emcmotStatus;
 extern struct emcmot_config_t *emcmotConfig;
 extern struct emcmot_internal_t *emcmotInternal;
 extern struct emcmot_error_t *emcmotError;	/* unused for RT_FIFO */
+/* resync carte_pos_cmd and the planner to the joints, motionControl.cpp */
+extern void SyncCartePosCmd(void);
 
 class MotHalCtrl {
     //ShareMemory ctrl based, for emcmot direct control
@@ -34,36 +41,108 @@ public:
         *emcmot_hal_data->jog_inhibit = 0;
     }
 
+    //The spindle model stands in for the drive and the encoder,
+    //speed-in is in rps like a real encoder's velocity output
     static void spindle_hal_update(void) {
-        /* read spindle angle (for threading, etc) */
-        int joint_num, spindle_num;
-        double abs_ferror, scale;
-        joint_hal_t *joint_data;
-        emcmot_joint_t *joint;
-        unsigned char enables;
+        int spindle_num;
+        const int num = spindleModel.numSpindles;
+
+        if (spindlePending_.load(std::memory_order_acquire))
+            take_spindle_params();
+        if (spindleClear_.exchange(false, std::memory_order_acq_rel))
+            spindleModelClearStats(&spindleModel);
+
+        //the load only applies while a feed move is cutting
+        int feeding = emcmotStatus->motion_state == EMCMOT_MOTION_COORD &&
+                emcmotStatus->motionType != EMC_MOTION_TYPE_TRAVERSE &&
+                emcmotStatus->current_vel > 0.0;
 
         for (spindle_num = 0; spindle_num < emcmotConfig->numSpindles; spindle_num++){
-            *emcmot_hal_data->spindle[spindle_num].spindle_revs =
-                    *emcmot_hal_data->spindle[spindle_num].spindle_speed_out;
-            *emcmot_hal_data->spindle[spindle_num].spindle_speed_in =
-                    *emcmot_hal_data->spindle[spindle_num].spindle_speed_out;
-            *emcmot_hal_data->spindle[spindle_num].spindle_is_atspeed = 1;
-            *emcmot_hal_data->spindle[spindle_num].spindle_amp_fault = 0;
-
-            *emcmot_hal_data->spindle[spindle_num].spindle_inhibit = 0;
-            *emcmot_hal_data->spindle[spindle_num].spindle_amp_fault = 0;
-            *emcmot_hal_data->spindle[spindle_num].spindle_orient_fault = 0;
+            spindle_hal_t *spindle = &emcmot_hal_data->spindle[spindle_num];
+            int index = *spindle->spindle_index_enable;
+            double revs, speed;
+            int atSpeed;
+
+            if (spindle_num < num &&
+                0 == spindleModelUpdate(&spindleModel, spindle_num,
+                                        *spindle->spindle_speed_out_rps,
+                                        *spindle->spindle_on, feeding,
+                                        &index, &revs, &speed, &atSpeed)) {
+                *spindle->spindle_revs = revs;
+                *spindle->spindle_speed_in = speed;
+                *spindle->spindle_is_atspeed = atSpeed;
+                *spindle->spindle_index_enable = index;
+            }
+            else {
+                *spindle->spindle_speed_in = *spindle->spindle_speed_out_rps;
+                *spindle->spindle_is_atspeed = 1;
+            }
+
+            *spindle->spindle_inhibit = 0;
+            *spindle->spindle_amp_fault = 0;
+            *spindle->spindle_orient_fault = 0;
         }
     }
 
+    //Staged like the servo parameters below
+    static int set_spindle_params(int spindle, const SPINDLE_PARAMS &params) {
+        if (spindle < 0 || spindle >= EMCMOT_MAX_SPINDLES)
+            return -1;
+        std::lock_guard<std::mutex> lock(spindleMutex_);
+        spindleStaged_[spindle] = params;
+        spindleStagedMask_ |= 1u << spindle;
+        spindlePending_.store(true, std::memory_order_release);
+        return 0;
+    }
+
+    static void clear_spindle_stats(void) {
+        spindleClear_.store(true, std::memory_order_release);
+    }
+
+    static std::string show_spindle(int spindle);
+
+    //Servo parameters are staged here by the ini loader and taken over
+    //by the motion thread at the start of its next cycle
+    static int set_servo_params(int joint, const SERVO_PARAMS &params) {
+        if (joint < 0 || joint >= EMCMOT_MAX_JOINTS)
+            return -1;
+        std::lock_guard<std::mutex> lock(servoMutex_);
+        servoStaged_[joint] = params;
+        servoStagedMask_ |= 1u << joint;
+        servoPending_.store(true, std::memory_order_release);
+        return 0;
+    }
+
+    static void clear_servo_stats(void) {
+        servoClear_.store(true, std::memory_order_release);
+    }
+
+    static std::string show_servo(int joint);
+
     static void joint_hal_update(void) {
         int joint_num;
         joint_hal_t *joint_data;
-        emcmot_joint_t *joints;
+        double cmd[EMCMOT_MAX_JOINTS];
+        double fb[EMCMOT_MAX_JOINTS];
+        unsigned char enable[EMCMOT_MAX_JOINTS];
+        const int num = servoModel.numJoints;
+
+        if (servoPending_.load(std::memory_order_acquire))
+            take_servo_params();
+        if (servoClear_.exchange(false, std::memory_order_acq_rel))
+            servoModelClearStats(&servoModel);
+
+        for (joint_num = 0; joint_num < num; joint_num++) {
+            joint_data = &(emcmot_hal_data->joint[joint_num]);
+            cmd[joint_num] = *joint_data->motor_pos_cmd;
+            enable[joint_num] = *joint_data->amp_enable;
+        }
+        servoModelUpdate(&servoModel, cmd, enable, fb);
+
         for (joint_num = 0; joint_num < emcmotConfig->numJoints ; joint_num++) {
 
             joint_data = &(emcmot_hal_data->joint[joint_num]);
-            *joint_data->motor_pos_fb = *joint_data->motor_pos_cmd;
+            *joint_data->motor_pos_fb = joint_num < num ? fb[joint_num] : *joint_data->motor_pos_cmd;
             *joint_data->active = 1;
             *joint_data->in_position = 1;
             *joint_data->pos_lim_sw = 0;
@@ -72,6 +151,42 @@ public:
             *joint_data->error = 0;
         }
     }
+
+private:
+    static void take_servo_params(void) {
+        std::unique_lock<std::mutex> lock(servoMutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;     //loader busy, next cycle
+        for (int joint = 0; joint < EMCMOT_MAX_JOINTS; joint++) {
+            if (servoStagedMask_ & (1u << joint))
+                servoModelSetParams(&servoModel, joint, &servoStaged_[joint]);
+        }
+        servoStagedMask_ = 0;
+        servoPending_.store(false, std::memory_order_release);
+    }
+
+    static void take_spindle_params(void) {
+        std::unique_lock<std::mutex> lock(spindleMutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        for (int spindle = 0; spindle < EMCMOT_MAX_SPINDLES; spindle++) {
+            if (spindleStagedMask_ & (1u << spindle))
+                spindleModelSetParams(&spindleModel, spindle, &spindleStaged_[spindle]);
+        }
+        spindleStagedMask_ = 0;
+        spindlePending_.store(false, std::memory_order_release);
+    }
+
+    static std::mutex servoMutex_;
+    static SERVO_PARAMS servoStaged_[EMCMOT_MAX_JOINTS];
+    static unsigned int servoStagedMask_;
+    static std::atomic<bool> servoPending_;
+    static std::atomic<bool> servoClear_;
+    static std::mutex spindleMutex_;
+    static SPINDLE_PARAMS spindleStaged_[EMCMOT_MAX_SPINDLES];
+    static unsigned int spindleStagedMask_;
+    static std::atomic<bool> spindlePending_;
+    static std::atomic<bool> spindleClear_;
 };
 
 #endif
@@ -1,6 +1,8 @@
 #include "emcChannel.h"
 #include "emcParas.h"
 #include "emcLog.h"
+#include "emcMetrics.h"
+#include <sstream>
 
 // Initialize static members
 EMC_TRAJ_SET_SCALE emcTrajSetScaleMsgEntry;
@@ -27,29 +29,72 @@ EMC_TRAJ_SET_SPINDLESYNC* EMCChannel::emcTrajSetSpindlesyncMsg = &emcTrajSetSpin
 
 state_tag_t EMCChannel::localEmcTrajTag;
 
-emcmot_command_t EMCChannel::emcmotCommand = {};
-int EMCChannel::commandNum = 0;
-MessageQueue<emcmot_command_t> EMCChannel::mill2MotQueue;
-MessageQueue<EMCChannel::MILLCmd> EMCChannel::millCmdQueue;
-MessageQueue<emcmot_command_t> EMCChannel::cmd2MotQueue;
-std::mutex EMCChannel::mutex_cmd;
-MessageQueue<EMCChannel::MotCmd> EMCChannel::motCmdQueue;
+std::atomic<int> EMCChannel::commandSeq{0};
+CommandLane<emcmot_command_t> EMCChannel::mill2MotLane(1024);
+CommandLane<emcmot_command_t> EMCChannel::cmd2MotLane(256);
+//Control commands come one at a time from the UI, a few slots do
+BoundedQueue<EMCChannel::MILLCmd> EMCChannel::millCmdQueue(64);
+BoundedQueue<EMCChannel::MotCmd> EMCChannel::motCmdQueue(64);
 std::string EMCChannel::millMotFileName;
 
+emcmot_command_t &EMCChannel::scratchCommand()
+{
+    thread_local emcmot_command_t cmd = {};
+    cmd = emcmot_command_t();
+    return cmd;
+}
+
+//Commands posted per lane, the depths are read when shown
+static EMCMetrics::Counter &millPosted =
+    EMCMetrics::GetCounter("cncsim_motion_commands_total{lane=\"mill\"}",
+                           "commands posted to the motion lanes");
+static EMCMetrics::Counter &cmdPosted =
+    EMCMetrics::GetCounter("cncsim_motion_commands_total{lane=\"cmd\"}",
+                           "commands posted to the motion lanes");
+
+[[maybe_unused]] static const bool laneMetrics = [] {
+    EMCMetrics::AddGauge("cncsim_motion_lane_depth{lane=\"mill\"}",
+                         "commands waiting in a motion lane",
+                         [] { return (double)EMCChannel::laneDepth(EMCChannel::kMillChanel); });
+    EMCMetrics::AddGauge("cncsim_motion_lane_depth{lane=\"cmd\"}",
+                         "commands waiting in a motion lane",
+                         [] { return (double)EMCChannel::laneDepth(EMCChannel::kCmdChannel); });
+    return true;
+}();
+
+void EMCChannel::post(emcmot_command_t &cmd, enum MOTChannel channel)
+{
+    cmd.commandNum = nextCommandNum();
+    if (channel == kMillChanel) {
+        mill2MotLane.push(cmd);
+        millPosted.Add();
+    }
+    else if (channel == kCmdChannel) {
+        cmd2MotLane.push(cmd);
+        cmdPosted.Add();
+    }
+}
+
+size_t EMCChannel::laneDepth(enum MOTChannel channel)
+{
+    return channel == kMillChanel ? mill2MotLane.size() : cmd2MotLane.size();
+}
+
+int EMCChannel::nextCommandNum()
+{
+    return commandSeq.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
 int EMCChannel::emcTrajSetScale(double scale, enum MOTChannel channel)
 {
     if (scale < 0.0) {
        scale = 0.0;
     }
 
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_FEED_SCALE;
     emcmotCommand.scale = scale;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -60,14 +105,10 @@ int EMCChannel::emcTrajSetRapidScale(double scale, enum MOTChannel channel)
     scale = 0.0;
     }
 
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_RAPID_SCALE;
     emcmotCommand.scale = scale;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -80,133 +121,97 @@ int EMCChannel::emcTrajSetMaxVelocity(double vel, enum MOTChannel channel)
 
     EMCParas::set_traj_maxvel(vel);
 
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_VEL_LIMIT;
     emcmotCommand.vel = vel;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcTrajSetSpindles(int spindles, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_NUM_SPINDLES;
     emcmotCommand.spindle = spindles;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcTrajSetJoints(int joints, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_NUM_JOINTS;
     emcmotCommand.joint = joints;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcTrajSetVelocity(double vel, double ini_maxvel, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_VEL;
     emcmotCommand.vel = vel;
     emcmotCommand.ini_maxvel = ini_maxvel;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcTrajSetAcceleration(double acc, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_ACC;
     emcmotCommand.acc = acc;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcSetupArcBlends(int arcBlendEnable, int arcBlendFallbackEnable, int arcBlendOptDepth, int arcBlendGapCycles, double arcBlendRampFreq, double arcBlendTangentKinkRatio, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
-    EMCChannel::emcmotCommand.command = EMCMOT_SETUP_ARC_BLENDS;
-    EMCChannel::emcmotCommand.arcBlendEnable = arcBlendEnable;
-    EMCChannel::emcmotCommand.arcBlendFallbackEnable = arcBlendFallbackEnable;
-    EMCChannel::emcmotCommand.arcBlendOptDepth = arcBlendOptDepth;
-    EMCChannel::emcmotCommand.arcBlendGapCycles = arcBlendGapCycles;
-    EMCChannel::emcmotCommand.arcBlendRampFreq = arcBlendRampFreq;
-    EMCChannel::emcmotCommand.arcBlendTangentKinkRatio = arcBlendTangentKinkRatio;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    emcmot_command_t &emcmotCommand = scratchCommand();
+    emcmotCommand.command = EMCMOT_SETUP_ARC_BLENDS;
+    emcmotCommand.arcBlendEnable = arcBlendEnable;
+    emcmotCommand.arcBlendFallbackEnable = arcBlendFallbackEnable;
+    emcmotCommand.arcBlendOptDepth = arcBlendOptDepth;
+    emcmotCommand.arcBlendGapCycles = arcBlendGapCycles;
+    emcmotCommand.arcBlendRampFreq = arcBlendRampFreq;
+    emcmotCommand.arcBlendTangentKinkRatio = arcBlendTangentKinkRatio;
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcSetMaxFeedOverride(double maxFeedScale, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_MAX_FEED_OVERRIDE;
     emcmotCommand.maxFeedScale = maxFeedScale;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcSetProbeErrorInhibit(int j_inhibit, int h_inhibit, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_PROBE_ERR_INHIBIT;
     emcmotCommand.probe_jog_err_inhibit = j_inhibit;
     emcmotCommand.probe_home_err_inhibit = h_inhibit;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcTrajSetHome(const EmcPose &home, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_WORLD_HOME;
     emcmotCommand.pos = home;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -216,15 +221,11 @@ int EMCChannel::emcJointSetBacklash(int joint, double backlash, enum MOTChannel
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_BACKLASH;
     emcmotCommand.joint = joint;
     emcmotCommand.backlash = backlash;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -234,15 +235,11 @@ int EMCChannel::emcJointSetMinPositionLimit(int joint, double limit, enum MOTCha
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_POSITION_LIMITS;
     emcmotCommand.joint = joint;
     emcmotCommand.minLimit = limit;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -252,15 +249,11 @@ int EMCChannel::emcJointSetMaxPositionLimit(int joint, double limit, enum MOTCha
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_POSITION_LIMITS;
     emcmotCommand.joint = joint;
     emcmotCommand.maxLimit = limit;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -270,15 +263,11 @@ int EMCChannel::emcJointSetFerror(int joint, double ferror, enum MOTChannel chan
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_MAX_FERROR;
     emcmotCommand.joint = joint;
     emcmotCommand.maxFerror = ferror;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -288,15 +277,11 @@ int EMCChannel::emcJointSetMinFerror(int joint, double ferror, enum MOTChannel c
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_MIN_FERROR;
     emcmotCommand.joint = joint;
     emcmotCommand.minFerror = ferror;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -307,7 +292,7 @@ int EMCChannel::emcJointSetHomingParams(int joint, double home, double offset, d
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_HOMING_PARAMS;
     emcmotCommand.joint = joint;
     emcmotCommand.home = home;
@@ -352,11 +337,7 @@ int EMCChannel::emcJointSetHomingParams(int joint, double home, double offset, d
         }
     }
 
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -366,15 +347,11 @@ int EMCChannel::emcJointSetMaxVelocity(int joint, double vel, enum MOTChannel ch
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_VEL_LIMIT;
     emcmotCommand.joint = joint;
     emcmotCommand.vel = vel;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -384,15 +361,11 @@ int EMCChannel::emcJointSetMaxAcceleration(int joint, double acc, enum MOTChanne
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_ACC_LIMIT;
     emcmotCommand.joint = joint;
     emcmotCommand.acc = acc;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -402,14 +375,10 @@ int EMCChannel::emcJointActivate(int joint, enum MOTChannel channel)
     if (joint < 0 || joint >= EMCMOT_MAX_JOINTS) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_JOINT_ACTIVATE;
     emcmotCommand.joint = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -418,15 +387,11 @@ int EMCChannel::emcAxisSetMinPositionLimit(int axis, double limit, enum MOTChann
 {
     if (axis < 0 || axis >= EMCMOT_MAX_AXIS)
             return 0;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_AXIS_POSITION_LIMITS;
     emcmotCommand.axis = axis;
     emcmotCommand.minLimit = limit;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -435,15 +400,11 @@ int EMCChannel::emcAxisSetMaxPositionLimit(int axis, double limit, enum MOTChann
 {
     if (axis < 0 || axis >= EMCMOT_MAX_AXIS)
             return 0;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_AXIS_POSITION_LIMITS;
     emcmotCommand.axis = axis;
     emcmotCommand.maxLimit = limit;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -452,16 +413,12 @@ int EMCChannel::emcAxisSetMaxVelocity(int axis, double vel, double ext_offset_ve
 {
     if (axis < 0 || axis >= EMCMOT_MAX_AXIS)
             return 0;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_AXIS_VEL_LIMIT;
     emcmotCommand.axis = axis;
     emcmotCommand.vel = vel;
     emcmotCommand.ext_offset_vel = ext_offset_vel;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -470,16 +427,12 @@ int EMCChannel::emcAxisSetMaxAcceleration(int axis, double acc, double ext_offse
 {
     if (axis < 0 || axis >= EMCMOT_MAX_AXIS)
             return 0;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_AXIS_ACC_LIMIT;
     emcmotCommand.axis = axis;
     emcmotCommand.acc = acc;
     emcmotCommand.ext_offset_acc = ext_offset_acc;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -488,15 +441,11 @@ int EMCChannel::emcAxisSetLockingJoint(int axis, int joint, enum MOTChannel chan
 {
     if (axis < 0 || axis >= EMCMOT_MAX_AXIS)
             return 0;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_AXIS_LOCKING_JOINT;
     emcmotCommand.axis    = axis;
     emcmotCommand.joint   = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -506,7 +455,7 @@ int EMCChannel::emcSpindleSetParams(int spindle, double max_pos, double min_pos,
     if (spindle < 0 || spindle >= EMCMOT_MAX_SPINDLES) {
     return 0;
     }
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_SPINDLE_PARAMS;
     emcmotCommand.spindle = spindle;
     emcmotCommand.maxLimit = max_pos;
@@ -517,25 +466,16 @@ int EMCChannel::emcSpindleSetParams(int spindle, double max_pos, double min_pos,
     emcmotCommand.search_vel = search_vel;
     emcmotCommand.home_sequence = sequence;
     emcmotCommand.offset = increment;
-    emcmotCommand.commandNum = ++commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotAbort(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_ABORT;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -546,73 +486,48 @@ int EMCChannel::emcJogAbort(int axis, int joint, enum MOTChannel channel)
         return 1;
     if (joint < 0 || joint > EMCMOT_MAX_JOINTS)
         return 2;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.axis = axis;
     emcmotCommand.joint = joint;
     emcmotCommand.command = EMCMOT_JOG_ABORT;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotFree(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_FREE;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotCoord(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_COORD;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotTeleop(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_TELEOP;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotSetWorldHome(EmcPose pose, MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_WORLD_HOME;
     emcmotCommand.pos = pose;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -622,18 +537,13 @@ int EMCChannel::emcMotUpdateJointHomingParas
 {
     if (joint < 0 || joint > EMCMOT_MAX_JOINTS)
         return 1;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_UPDATE_JOINT_HOMING_PARAMS;
     emcmotCommand.joint = joint;
     emcmotCommand.offset = offset;
     emcmotCommand.home = home;
     emcmotCommand.home_sequence = home_sequence;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -642,15 +552,10 @@ int EMCChannel::emcMotOverridLimit(int joint, enum MOTChannel channel)
 {
     if (joint < 0 || joint > EMCMOT_MAX_JOINTS)
         return 1;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_OVERRIDE_LIMITS;
     emcmotCommand.joint = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -659,40 +564,30 @@ int EMCChannel::emcMotSetJointMotorOffset(int joint, double offset, enum MOTChan
 {
     if (joint < 0 || joint > EMCMOT_MAX_JOINTS)
         return 1;
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_JOINT_MOTOR_OFFSET;
     emcmotCommand.joint = joint;
     emcmotCommand.offset = offset;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJogCont(int joint, int axis, double vel, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_JOG_CONT;
     emcmotCommand.joint = joint;
     emcmotCommand.axis = axis;
     emcmotCommand.vel = vel;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJogInc(int joint, int axis, double vel, double offset, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
 
     if (joint == -1) {
     //axis home mode
@@ -724,19 +619,14 @@ int EMCChannel::emcMotJogInc(int joint, int axis, double vel, double offset, enu
     emcmotCommand.axis = axis;
     emcmotCommand.vel = vel;
     emcmotCommand.offset = offset;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJogAbs(int joint, int axis, double vel, double offset, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
 
     if (joint == -1) {
     //axis home mode
@@ -768,45 +658,30 @@ int EMCChannel::emcMotJogAbs(int joint, int axis, double vel, double offset, enu
     emcmotCommand.axis = axis;
     emcmotCommand.vel = vel;
     emcmotCommand.offset = offset;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotSetTermCond(int termCond, double tolerance, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_TERM_COND;
     emcmotCommand.termCond = termCond;
     emcmotCommand.tolerance = tolerance;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotSetSpindleSync(int spindle, int spindlesync, int flags, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_SPINDLESYNC;
     emcmotCommand.spindle = spindle;
     emcmotCommand.spindlesync = spindlesync;
     emcmotCommand.flags = flags;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -816,7 +691,7 @@ int EMCChannel::emcMotSetLine
  double ini_maxvel, double acc,
  int turn, state_tag_t tag, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_LINE;
     emcmotCommand.pos = pos;
     emcmotCommand.id = id;
@@ -827,12 +702,7 @@ int EMCChannel::emcMotSetLine
     emcmotCommand.turn = turn;
     emcmotCommand.tag = tag;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -842,7 +712,7 @@ int EMCChannel::emcMotSetCircle
 int turn, int motion_type, double vel, double ini_maxvel,
  double acc, state_tag_t tag, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SET_CIRCLE;
     emcmotCommand.pos = pos;
     emcmotCommand.id = id;
@@ -855,258 +725,173 @@ int turn, int motion_type, double vel, double ini_maxvel,
     emcmotCommand.acc = acc;
     emcmotCommand.tag = tag;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotPause(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_PAUSE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotReverse(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_REVERSE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotForward(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_FORWARD;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotResume(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_RESUME;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotStep(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_STEP;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotFSEna(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_FS_ENABLE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotFHEna(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_FH_ENABLE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcSpindleScale(double scale, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SPINDLE_SCALE;
 
     emcmotCommand.scale = scale;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotSSEna(int mode, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_SS_ENABLE;
 
     emcmotCommand.mode = mode;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotAFEna(int flags, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_AF_ENABLE;
 
     emcmotCommand.flags = flags;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotDisable(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_DISABLE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotEna(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_ENABLE;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJointDeActive(int joint, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_JOINT_DEACTIVATE;
 
     emcmotCommand.joint = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJointHome(int joint, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_JOINT_HOME;
 
     emcmotCommand.joint = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotJointUnhome(int joint, enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_JOINT_UNHOME;
 
     emcmotCommand.joint = joint;
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
 
 int EMCChannel::emcMotClearProbe(enum MOTChannel channel)
 {
-    std::lock_guard<std::mutex> lock(mutex_cmd);
+    emcmot_command_t &emcmotCommand = scratchCommand();
     emcmotCommand.command = EMCMOT_CLEAR_PROBE_FLAGS;
 
-    emcmotCommand.commandNum = ++commandNum;
-    emcmotCommand.commandNum = commandNum;
-    if (channel == kMillChanel)
-        mill2MotQueue.push(emcmotCommand);
-    else if (channel == kCmdChannel)
-        cmd2MotQueue.push(emcmotCommand);
+    post(emcmotCommand, channel);
 
     return 0;
 }
@@ -1118,30 +903,47 @@ int EMCChannel::emcMotProbe(enum MOTChannel channel)
 }
 
 
-int EMCChannel::getMotCmdFromMill(emcmot_command_t &cmd)
+//M6, the tool number is carried in id
+int EMCChannel::emcMotToolChange(int toolno, enum MOTChannel channel)
 {
-    if (mill2MotQueue.empty())
-        return 1;
+    emcmot_command_t &emcmotCommand = scratchCommand();
+    emcmotCommand.command = (cmd_code_t)kSimToolChange;
+    emcmotCommand.id = toolno;
+    post(emcmotCommand, channel);
 
-    cmd = mill2MotQueue.pop();
     return 0;
 }
 
+int EMCChannel::getMotCmdFromMill(emcmot_command_t &cmd)
+{
+    return mill2MotLane.try_pop(cmd) ? 0 : 1;
+}
+
 void EMCChannel::clearMill2MotQueue()
 {
-    mill2MotQueue.clear();
+    mill2MotLane.clear();
+}
+
+bool EMCChannel::isMill2MotQueueEmpty()
+{
+    return mill2MotLane.empty();
 }
 
-void EMCChannel::emitMillCmd(MILLCmd cmd)
+int EMCChannel::emitMillCmd(MILLCmd cmd)
 {
-    millCmdQueue.push(cmd);
+    if (!millCmdQueue.push(cmd, kCmdPushTimeout)) {
+        EMCLog::SetLog("mill cmd queue full", 1);
+        return -1;
+    }
+    return 0;
 }
 
 int EMCChannel::getMillCmd(MILLCmd &cmd)
 {
-    if (millCmdQueue.empty())
+    std::optional<MILLCmd> next = millCmdQueue.try_pop();
+    if (!next)
         return 1;
-    cmd = millCmdQueue.pop();
+    cmd = *next;
     return 0;
 }
 
@@ -1150,16 +952,31 @@ void EMCChannel::clearMillCmd()
     millCmdQueue.clear();
 }
 
-void EMCChannel::emitMotCmd(MotCmd cmd)
+void EMCChannel::waitMillCmd()
+{
+    millCmdQueue.wait();
+}
+
+void EMCChannel::wakeMillCmd()
+{
+    millCmdQueue.wake();
+}
+
+int EMCChannel::emitMotCmd(MotCmd cmd)
 {
-    motCmdQueue.push(cmd);
+    if (!motCmdQueue.push(cmd, kCmdPushTimeout)) {
+        EMCLog::SetLog("mot cmd queue full", 1);
+        return -1;
+    }
+    return 0;
 }
 
 int EMCChannel::getMotCmd(MotCmd &cmd)
 {
-    if (motCmdQueue.empty())
+    std::optional<MotCmd> next = motCmdQueue.try_pop();
+    if (!next)
         return 1;
-    cmd = motCmdQueue.pop();
+    cmd = *next;
     return 0;
 }
 
@@ -1168,11 +985,20 @@ void EMCChannel::clearMotCmd()
     motCmdQueue.clear();
 }
 
-int EMCChannel::getMotCmdFromCmd(emcmot_command_t &cmd)
+std::string EMCChannel::showQueues()
 {
-    if (cmd2MotQueue.empty())
-        return 1;
+    std::stringstream ss;
 
-    cmd = cmd2MotQueue.pop();
-    return 0;
+    ss << "Mill " << millCmdQueue.size() << "/" << millCmdQueue.capacity()
+       << " high " << millCmdQueue.high_water()
+       << " dropped " << millCmdQueue.dropped() << std::endl;
+    ss << "Mot " << motCmdQueue.size() << "/" << motCmdQueue.capacity()
+       << " high " << motCmdQueue.high_water()
+       << " dropped " << motCmdQueue.dropped();
+    return ss.str();
+}
+
+int EMCChannel::getMotCmdFromCmd(emcmot_command_t &cmd)
+{
+    return cmd2MotLane.try_pop(cmd) ? 0 : 1;
 }
@@ -8,6 +8,9 @@
 #include "interpl.hh"
 #include "motion.h"
 #include "emcMsgQueue.h"
+#include "emcCmdRing.h"
+#include <atomic>
+#include <chrono>
 
 //This class is just a function encapsulator
 //You can think this is a channel between milltask and emcmot
@@ -26,6 +29,10 @@ public:
         kMotNone,
         kMotStart,
         kMotRest,
+        kMotRecord,         //EMCRecord, [EMCMOT]RECORD_FILE
+        kMotRecordStop,
+        kMotReplay,
+        kMotReplayStop,
         kMotCmdNum,
     };
 
@@ -34,6 +41,12 @@ public:
         kCmdChannel,
     };
 
+    //Simulator commands carried in the mill stream so they keep the
+    //program order, MotTask handles them and never passes them to motion
+    enum SimCmd {
+        kSimToolChange = 0x10000,
+    };
+
     static EMC_TRAJ_SET_SCALE *emcTrajSetScaleMsg;
     static EMC_TRAJ_SET_RAPID_SCALE *emcTrajSetRapidScaleMsg;
     static EMC_TRAJ_SET_MAX_VELOCITY *emcTrajSetMaxVelocityMsg;
@@ -143,34 +156,58 @@ public:
     static int emcMotSetJointComp();
 
 
+    static int emcMotToolChange(int toolno, enum MOTChannel = kMillChanel);
+
     static int getMotCmdFromMill(emcmot_command_t &cmd);
     static void clearMill2MotQueue();
+    static bool isMill2MotQueueEmpty();
+
+    //Control commands are not dropped: a full queue is waited on for
+    //kCmdPushTimeout, -1 only if the consumer did not take one by then
+    static constexpr std::chrono::milliseconds kCmdPushTimeout{1000};
 
     //Thse used to control milltask
-    static void emitMillCmd(MILLCmd cmd);
+    static int emitMillCmd(MILLCmd cmd);
     static int getMillCmd(MILLCmd& cmd);
     static void clearMillCmd();
+    //Block until a mill command is pending or wakeMillCmd() is called
+    static void waitMillCmd();
+    static void wakeMillCmd();
 
     //Thse used to control mottaks
-    static void emitMotCmd(MotCmd cmd);
+    static int emitMotCmd(MotCmd cmd);
     static int getMotCmd(MotCmd& cmd);
     static void clearMotCmd();
 
+    //depth, high water mark and drops of the mill and mot cmd queues
+    static std::string showQueues();
+    //commands waiting in a motion lane, any thread
+    static size_t laneDepth(enum MOTChannel channel);
+
     //These used to control mottask
     //Mot mod direct cmd
     //cmdtask is speical, it directly controlled by UI
     static int getMotCmdFromCmd(emcmot_command_t &cmd);
 
+    //A command number the lanes never hand out, for commands that reach
+    //the controller another way (EMCRecord replay)
+    static int nextCommandNum();
+
     static std::string millMotFileName;
 
 private:
-    static int commandNum;
-    static emcmot_command_t emcmotCommand;
-    static MessageQueue<emcmot_command_t> mill2MotQueue;
-    static MessageQueue<MILLCmd> millCmdQueue;
-    static MessageQueue<emcmot_command_t> cmd2MotQueue;
-    static MessageQueue<MotCmd> motCmdQueue;
-    static std::mutex mutex_cmd;
+    //Every producer thread fills its own command copy, zeroed on every
+    //call so a command never carries fields of the one before
+    static emcmot_command_t &scratchCommand();
+    //Stamp the sequence number (commandNum) and append to the lane
+    static void post(emcmot_command_t &cmd, enum MOTChannel channel);
+
+    static std::atomic<int> commandSeq;
+    //Two lanes into the motion thread, cmd is drained before mill
+    static CommandLane<emcmot_command_t> mill2MotLane;
+    static CommandLane<emcmot_command_t> cmd2MotLane;
+    static BoundedQueue<MILLCmd> millCmdQueue;
+    static BoundedQueue<MotCmd> motCmdQueue;
     EMCChannel() = delete;
 };
 
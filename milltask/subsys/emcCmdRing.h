@@ -0,0 +1,202 @@
+#ifndef _EMC_CMD_RING_H_
+#define _EMC_CMD_RING_H_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//Bounded lock free multi producer single consumer ring.
+//Slots are preallocated, every slot carries a sequence number that
+//tells producers and the consumer whose turn it is (Vyukov's bounded
+//queue), so neither side ever takes a lock.
+template<typename T>
+class MpscRing {
+public:
+    //capacity is rounded up to a power of two
+    explicit MpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        slots_.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++)
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    //Any thread, false if the ring is full
+    bool try_push(const T& msg) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &slots_[pos & mask_];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = msg;
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Consumer only, false if nothing is published
+    bool try_pop(T& msg) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot *slot = &slots_[pos & mask_];
+        if (slot->seq.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        msg = slot->value;
+        slot->seq.store(pos + mask_ + 1, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //Consumer only, the next message without taking it, null if none
+    const T *front() const {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        const Slot *slot = &slots_[pos & mask_];
+        if (slot->seq.load(std::memory_order_acquire) != pos + 1)
+            return nullptr;
+        return &slot->value;
+    }
+
+    //Consumer only
+    bool empty() const {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        return slots_[pos & mask_].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+    //Any thread, a snapshot that may be off by the pushes in flight
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_relaxed);
+        return head > tail ? head - tail : 0;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+//One priority lane into the motion thread.
+//Commands go through the ring. A producer that finds the ring full
+//(a whole program emitted at once) appends to a spill list instead and
+//keeps appending there until the consumer has moved the spill back
+//into the ring, so each producer stays in order. The consumer only
+//ever try_locks the spill, it never waits for a producer.
+//
+//Every command carries the clear epoch it was pushed in. clear() starts
+//a new epoch and the consumer drops whatever carries an older one,
+//wherever it is, so a clear covers exactly the pushes made before it.
+template<typename T>
+class CommandLane {
+public:
+    explicit CommandLane(size_t capacity) : ring_(capacity) {}
+
+    void push(const T& msg) {
+        Entry e{msg, epoch_.load(std::memory_order_acquire)};
+        if (spillCount_.load(std::memory_order_acquire) == 0 && ring_.try_push(e))
+            return;
+        std::lock_guard<std::mutex> lock(spillMutex_);
+        if (spill_.empty() && ring_.try_push(e))
+            return;
+        spill_.push_back(e);
+        spillCount_.fetch_add(1, std::memory_order_release);
+    }
+
+    //Consumer only, never blocks
+    bool try_pop(T& msg) {
+        Entry e;
+        for (;;) {
+            if (!ring_.try_pop(e)) {
+                if (spillCount_.load(std::memory_order_acquire) == 0)
+                    return false;
+                refill();
+                if (!ring_.try_pop(e))
+                    return false;
+            }
+            if (e.epoch >= cleared_) {
+                msg = e.msg;
+                return true;
+            }
+        }
+    }
+
+    //Consumer only
+    bool empty() const {
+        return ring_.empty() && spillCount_.load(std::memory_order_acquire) == 0;
+    }
+
+    //Consumer only. The cleared commands at the head of the ring go
+    //now, the rest when the consumer reaches them
+    void clear() {
+        cleared_ = epoch_.fetch_add(1, std::memory_order_acq_rel) + 1;
+        Entry e;
+        const Entry *next;
+        while ((next = ring_.front()) && next->epoch < cleared_)
+            ring_.try_pop(e);
+        refill();
+    }
+
+    size_t capacity() const { return ring_.capacity(); }
+
+    //Any thread, the ring and the spill, a snapshot
+    size_t size() const {
+        return ring_.size() + spillCount_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Entry {
+        T msg;
+        uint64_t epoch;
+    };
+
+    void refill() {
+        std::unique_lock<std::mutex> lock(spillMutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        while (!spill_.empty()) {
+            if (spill_.front().epoch < cleared_) {
+                spill_.pop_front();
+            }
+            else if (!ring_.try_push(spill_.front())) {
+                break;
+            }
+            else {
+                spill_.pop_front();
+            }
+            spillCount_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    MpscRing<Entry> ring_;
+    std::mutex spillMutex_;
+    std::deque<Entry> spill_;
+    std::atomic<size_t> spillCount_{0};
+    std::atomic<uint64_t> epoch_{0};
+    uint64_t cleared_ = 0;          //consumer only, older epochs are dropped
+};
+#endif
@@ -1,26 +1,458 @@
 #include "emcLog.h"
+#include "emcMetrics.h"
+#include <chrono>
+#include <mutex>
+#include <stdarg.h>
+#include <time.h>
 
-MessageQueue<EMCLog::Msg>  EMCLog::logMsgQueue;
+//Records waiting for the reader, about 2.5 MB
+#define LOG_RING_SIZE 4096
 
+static const char binaryMagic[8] = {'E', 'M', 'C', 'L', 'O', 'G', 0, 1};
 
-int EMCLog::GetLog(std::string &log, int &level)
+MpscRing<EMCLog::Record> EMCLog::ring(LOG_RING_SIZE);
+
+namespace {
+
+struct Rate {
+    constexpr Rate(unsigned perSecond) : limit(perSecond) {}
+    std::atomic<unsigned> limit;
+    std::atomic<int64_t> second{0};
+    std::atomic<unsigned> count{0};
+    std::atomic<unsigned long> windowSuppressed{0};
+    std::atomic<unsigned long> suppressed{0};
+};
+
+//warnings are limited by default, a burst of motion warnings then
+//costs a few hundred lines. Errors and cmd output have no limit
+Rate rates[EMCLog::kRateLevels] = {0, 200};
+
+std::atomic<uint32_t> threadCount{0};
+std::atomic<unsigned long> droppedFull{0};
+std::atomic<size_t> highWater{0};
+
+std::mutex binaryMutex;
+FILE *binaryFile = nullptr;
+std::string binaryPath;
+
+inline void count(std::atomic<unsigned long> *c)
+{
+    c->fetch_add(1, std::memory_order_relaxed);
+}
+
+int clampLevel(int level)
+{
+    return level < 0 ? 0 : level >= EMCLog::kLevels ? EMCLog::kLevels - 1 : level;
+}
+
+void appendf(std::string &out, const char *fmt, ...)
+{
+    char buf[128];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n < sizeof(buf)) {
+        out.append(buf, n);
+        return;
+    }
+    size_t at = out.size();
+    out.resize(at + n + 1);
+    va_start(ap, fmt);
+    vsnprintf(&out[at], n + 1, fmt, ap);
+    va_end(ap);
+    out.resize(at + n);
+}
+
+const char *argStr(const EMCLog::Record &rec, const EMCLog::Arg &a)
+{
+    return a.type == EMCLog::kArgHeapStr ? a.heap->c_str() : rec.text + a.off;
+}
+
+//one conversion, spec holds '%' and the flags, width and precision
+void formatArg(std::string &out, std::string &spec, char conv,
+               const EMCLog::Record &rec, const EMCLog::Arg &a)
+{
+    bool isStr = a.type == EMCLog::kArgStr || a.type == EMCLog::kArgHeapStr;
+    long long i = a.type == EMCLog::kArgDouble ? (long long)a.d : a.i;
+    double d = a.type == EMCLog::kArgInt ? (double)a.i :
+               a.type == EMCLog::kArgUInt ? (double)a.u : a.d;
+
+    switch (conv) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+        if (isStr)
+            break;
+        if (conv == 'c') {
+            appendf(out, (spec + 'c').c_str(), (int)i);
+        } else if (conv == 'd' || conv == 'i') {
+            appendf(out, (spec + "lld").c_str(), i);
+        } else {
+            appendf(out, (spec + "ll" + conv).c_str(),
+                    a.type == EMCLog::kArgUInt ? a.u : (unsigned long long)i);
+        }
+        return;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        if (isStr)
+            break;
+        appendf(out, (spec + conv).c_str(), d);
+        return;
+    case 'p':
+        appendf(out, "0x%llx", a.u);
+        return;
+    default:
+        break;
+    }
+    //%s, or a string where a number was expected
+    if (isStr) {
+        appendf(out, (spec + 's').c_str(), argStr(rec, a));
+    } else if (a.type == EMCLog::kArgDouble) {
+        appendf(out, "%g", a.d);
+    } else if (a.type == EMCLog::kArgUInt) {
+        appendf(out, "%llu", a.u);
+    } else {
+        appendf(out, "%lld", a.i);
+    }
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+int EMCLog::begin(Record &rec, int level, const char *fmt)
+{
+    static thread_local uint32_t thread =
+        threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    level = clampLevel(level);
+    rec.timeNs = nowNs();
+    rec.thread = thread;
+    rec.level = level;
+    rec.nargs = 0;
+    rec.textLen = 0;
+    rec.fmt = fmt ? fmt : "";
+
+    if (level >= kRateLevels)
+        return 0;
+    Rate &r = rates[level];
+    unsigned limit = r.limit.load(std::memory_order_relaxed);
+    if (limit == 0)
+        return 0;
+    int64_t second = rec.timeNs / 1000000000;
+    int64_t last = r.second.load(std::memory_order_relaxed);
+    if (second != last &&
+        r.second.compare_exchange_strong(last, second, std::memory_order_relaxed)) {
+        //first line of a new second, report what the last one dropped
+        r.count.store(0, std::memory_order_relaxed);
+        unsigned long n = r.windowSuppressed.exchange(0, std::memory_order_relaxed);
+        if (n) {
+            Record note = rec;
+            note.fmt = "%lu lines suppressed by the rate limit";
+            note.args[0].type = kArgUInt;
+            note.args[0].u = n;
+            note.nargs = 1;
+            post(note);
+        }
+    }
+    if (r.count.fetch_add(1, std::memory_order_relaxed) < limit)
+        return 0;
+    count(&r.windowSuppressed);
+    count(&r.suppressed);
+    return 1;
+}
+
+void EMCLog::addStr(Record &rec, const char *s, size_t len)
+{
+    Arg &a = rec.args[rec.nargs++];
+
+    a.len = len;
+    if (rec.textLen + len + 1 <= kTextBytes) {
+        a.type = kArgStr;
+        a.off = rec.textLen;
+        memcpy(rec.text + rec.textLen, s, len);
+        rec.text[rec.textLen + len] = '\0';
+        rec.textLen += len + 1;
+    } else {
+        a.type = kArgHeapStr;
+        a.heap = new std::string(s, len);
+    }
+}
+
+void EMCLog::release(Record &rec)
+{
+    for (int n = 0; n < rec.nargs; n++) {
+        if (rec.args[n].type == kArgHeapStr) {
+            delete rec.args[n].heap;
+            rec.args[n].type = kArgStr;
+        }
+    }
+}
+
+int EMCLog::post(Record &rec)
+{
+    if (ring.try_push(rec))
+        return 0;
+    //the reader is behind, never wait for it
+    release(rec);
+    count(&droppedFull);
+    return 1;
+}
+
+void EMCLog::Format(const Record &rec, std::string &out)
+{
+    std::string spec;
+    const char *p = rec.fmt;
+    int arg = 0;
+
+    out.clear();
+    while (*p) {
+        const char *pct = strchr(p, '%');
+        if (!pct) {
+            out.append(p);
+            break;
+        }
+        out.append(p, pct - p);
+        if (pct[1] == '%') {
+            out += '%';
+            p = pct + 2;
+            continue;
+        }
+        const char *q = pct + 1;
+        while (*q && strchr("-+ #0123456789.", *q))
+            q++;
+        spec.assign(pct, q - pct);
+        while (*q && strchr("hlLqjzt", *q))
+            q++;
+        if (!*q) {
+            out.append(pct);
+            break;
+        }
+        if (arg < rec.nargs)
+            formatArg(out, spec, *q, rec, rec.args[arg++]);
+        else
+            out.append(pct, q + 1 - pct);
+        p = q + 1;
+    }
+}
+
+/*
+  Binary log, native byte order:
+
+  "EMCLOG\0\1"
+  per record:
+    int64 timeNs, uint32 thread, int16 level, uint8 nargs,
+    uint16 fmt length, fmt,
+    per arg: uint8 type, int/uint/double 8 bytes,
+             string uint32 length and the bytes (no NUL)
+*/
+
+void EMCLog::writeBinary(const Record &rec)
+{
+    std::lock_guard<std::mutex> lock(binaryMutex);
+    if (!binaryFile)
+        return;
+
+    uint16_t fmtLen = (uint16_t)strnlen(rec.fmt, 0xffff);
+    fwrite(&rec.timeNs, sizeof(rec.timeNs), 1, binaryFile);
+    fwrite(&rec.thread, sizeof(rec.thread), 1, binaryFile);
+    fwrite(&rec.level, sizeof(rec.level), 1, binaryFile);
+    fwrite(&rec.nargs, sizeof(rec.nargs), 1, binaryFile);
+    fwrite(&fmtLen, sizeof(fmtLen), 1, binaryFile);
+    fwrite(rec.fmt, 1, fmtLen, binaryFile);
+    for (int n = 0; n < rec.nargs; n++) {
+        const Arg &a = rec.args[n];
+        uint8_t type = a.type == kArgHeapStr ? (uint8_t)kArgStr : a.type;
+        fwrite(&type, sizeof(type), 1, binaryFile);
+        if (type == kArgStr) {
+            uint32_t len = a.len;
+            fwrite(&len, sizeof(len), 1, binaryFile);
+            fwrite(argStr(rec, a), 1, len, binaryFile);
+        } else {
+            fwrite(&a.u, sizeof(a.u), 1, binaryFile);
+        }
+    }
+}
+
+int EMCLog::OpenBinary(const char *path)
+{
+    FILE *fp = fopen(path, "ab");
+    if (!fp)
+        return -1;
+    if (ftell(fp) == 0)
+        fwrite(binaryMagic, 1, sizeof(binaryMagic), fp);
+
+    std::lock_guard<std::mutex> lock(binaryMutex);
+    if (binaryFile)
+        fclose(binaryFile);
+    binaryFile = fp;
+    binaryPath = path;
+    return 0;
+}
+
+void EMCLog::CloseBinary()
+{
+    std::lock_guard<std::mutex> lock(binaryMutex);
+    if (binaryFile)
+        fclose(binaryFile);
+    binaryFile = nullptr;
+}
+
+std::string EMCLog::BinaryPath()
+{
+    std::lock_guard<std::mutex> lock(binaryMutex);
+    return binaryPath;
+}
+
+int EMCLog::DecodeBinary(const char *path, FILE *out)
+{
+    FILE *fp = fopen(path, "rb");
+    char magic[sizeof(binaryMagic)];
+    int records = 0;
+
+    if (!fp)
+        return -1;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+        memcmp(magic, binaryMagic, sizeof(magic))) {
+        fclose(fp);
+        return -1;
+    }
+    {
+        //the file may be open for writing, flush what it has
+        std::lock_guard<std::mutex> lock(binaryMutex);
+        if (binaryFile)
+            fflush(binaryFile);
+    }
+
+    std::string fmt, line, strings[kMaxArgs];
+    for (;;) {
+        Record rec;
+        uint16_t fmtLen;
+        if (fread(&rec.timeNs, sizeof(rec.timeNs), 1, fp) != 1)
+            break;
+        if (fread(&rec.thread, sizeof(rec.thread), 1, fp) != 1 ||
+            fread(&rec.level, sizeof(rec.level), 1, fp) != 1 ||
+            fread(&rec.nargs, sizeof(rec.nargs), 1, fp) != 1 ||
+            fread(&fmtLen, sizeof(fmtLen), 1, fp) != 1 ||
+            rec.nargs > kMaxArgs)
+            break;
+        fmt.resize(fmtLen);
+        if (fread(&fmt[0], 1, fmtLen, fp) != fmtLen)
+            break;
+        rec.fmt = fmt.c_str();
+        rec.textLen = 0;
+        int n;
+        for (n = 0; n < rec.nargs; n++) {
+            Arg &a = rec.args[n];
+            if (fread(&a.type, sizeof(a.type), 1, fp) != 1)
+                break;
+            if (a.type == kArgStr) {
+                uint32_t len;
+                if (fread(&len, sizeof(len), 1, fp) != 1)
+                    break;
+                strings[n].resize(len);
+                if (len && fread(&strings[n][0], 1, len, fp) != len)
+                    break;
+                a.type = kArgHeapStr;
+                a.len = len;
+                a.heap = &strings[n];
+            } else if (fread(&a.u, sizeof(a.u), 1, fp) != 1) {
+                break;
+            }
+        }
+        if (n < rec.nargs)
+            break;
+
+        char stamp[32];
+        time_t sec = rec.timeNs / 1000000000;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        Format(rec, line);
+        fprintf(out, "%s.%06ld T%u L%d %s\n", stamp,
+                (long)(rec.timeNs % 1000000000 / 1000), rec.thread, rec.level,
+                line.c_str());
+        records++;
+    }
+    fclose(fp);
+    return records;
+}
+
+int EMCLog::GetLog(std::string &log, int &level, int64_t &timeNs)
 {
-    if (logMsgQueue.empty())
+    Record rec;
+    size_t depth = ring.size();
+
+    if (depth > highWater.load(std::memory_order_relaxed))
+        highWater.store(depth, std::memory_order_relaxed);
+    if (!ring.try_pop(rec))
         return 1;
-    auto msg = logMsgQueue.pop();
-    level = msg.level;
-    log = std::move(msg.log);
+    writeBinary(rec);
+    level = rec.level;
+    timeNs = rec.timeNs;
+    Format(rec, log);
+    release(rec);
 
     return 0;
 }
 
-int EMCLog::SetLog(std::string log, int level)
+int EMCLog::GetLog(std::string &log, int &level)
 {
-    Msg msg;
-    msg.level = level;
-    msg.log = std::move(log);
+    int64_t timeNs;
+    return GetLog(log, level, timeNs);
+}
 
-    logMsgQueue.push(std::move(msg));
+int EMCLog::SetLog(std::string log, int level)
+{
+    return Log(level, "%s", log);
+}
 
+int EMCLog::SetRateLimit(int level, unsigned perSecond)
+{
+    if (level < 0 || level >= kRateLevels)
+        return -1;
+    rates[level].limit.store(perSecond, std::memory_order_relaxed);
     return 0;
 }
+
+unsigned EMCLog::GetRateLimit(int level)
+{
+    if (level < 0 || level >= kRateLevels)
+        return 0;
+    return rates[level].limit.load(std::memory_order_relaxed);
+}
+
+unsigned long EMCLog::GetSuppressed(int level)
+{
+    if (level < 0 || level >= kRateLevels)
+        return 0;
+    return rates[level].suppressed.load(std::memory_order_relaxed);
+}
+
+void EMCLog::GetStats(size_t &high, unsigned long &dropped)
+{
+    high = highWater.load(std::memory_order_relaxed);
+    dropped = droppedFull.load(std::memory_order_relaxed);
+}
+
+[[maybe_unused]] static const bool logMetrics = [] {
+    static const char *levels[EMCLog::kRateLevels] = {"log", "warning"};
+    EMCMetrics::AddCounter("cncsim_log_dropped_total",
+                           "log lines dropped, the ring was full",
+                           [] { return (double)droppedFull.load(std::memory_order_relaxed); });
+    for (int level = 0; level < EMCLog::kRateLevels; level++) {
+        EMCMetrics::AddCounter(std::string("cncsim_log_suppressed_total{level=\"") +
+                               levels[level] + "\"}",
+                               "log lines over the rate limit of their level",
+                               [level] { return (double)EMCLog::GetSuppressed(level); });
+    }
+    EMCMetrics::AddGauge("cncsim_log_ring_high_water",
+                         "most log records waiting for the reader",
+                         [] { return (double)highWater.load(std::memory_order_relaxed); });
+    return true;
+}();
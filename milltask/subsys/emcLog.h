@@ -1,24 +1,134 @@
 #ifndef _EMC_LOG_H_
 #define _EMC_LOG_H_
 #include <string>
-#include "emcMsgQueue.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
+#include "emcCmdRing.h"
 #include "cstdio"
 
 //Just a log encapsulator
+//Log() keeps a printf format and the typed args. The call site stamps
+//the wall clock time and the thread, copies the args into a record
+//and pushes it on a preallocated lock free ring, the text is only
+//formatted when GetLog() reads it. So logging takes no lock and, as
+//long as the strings fit the record, allocates nothing: the motion
+//loop may log. The format must be a string literal, only the pointer
+//is kept.
+//Log and warning lines have a rate limit per second, lines over it are
+//dropped and counted, the next line after the second tells how many.
+//Errors and cmd output are never dropped by the limit.
+//With [EMC]LOG_BINARY the reader also appends every record to a
+//binary file, DecodeBinary() turns it back into text.
 class EMCLog {
 public:
-    struct Msg {
-        int level;
-        std::string log;
-    };
     //level 0: Log
     //level 1: warning
     //level 2: error
     //level 3: cmd
+    enum { kLevels = 4 };
+    //levels below this one can be rate limited
+    enum { kRateLevels = 2 };
+
+    enum ArgType : uint8_t {
+        kArgInt,
+        kArgUInt,
+        kArgDouble,
+        kArgStr,        //in Record::text
+        kArgHeapStr,    //did not fit, owned by the record
+    };
+
+    struct Arg {
+        uint8_t type;
+        uint32_t len;   //strings
+        union {
+            long long i;
+            unsigned long long u;
+            double d;
+            uint32_t off;
+            std::string *heap;
+        };
+    };
+
+    static constexpr int kMaxArgs = 8;
+    static constexpr size_t kTextBytes = 384;
+
+    struct Record {
+        int64_t timeNs;         //wall clock at the call, ns since the epoch
+        uint32_t thread;        //1, 2, ... in the order threads first log
+        int16_t level;
+        uint8_t nargs;
+        uint16_t textLen;
+        const char *fmt;
+        Arg args[kMaxArgs];
+        char text[kTextBytes];  //string args, NUL terminated
+    };
+
+    template<typename... Args>
+    static int Log(int level, const char *fmt, const Args&... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "too many log args");
+        Record rec;
+        if (begin(rec, level, fmt))
+            return 1;
+        (addArg(rec, args), ...);
+        return post(rec);
+    }
+
+    //GetLog() has one consumer, the UI
     static int GetLog(std::string &log, int &level);
+    static int GetLog(std::string &log, int &level, int64_t &timeNs);
     static int SetLog(std::string log, int level = 0);
+
+    //lines per second of a level below kRateLevels, 0 no limit
+    static int SetRateLimit(int level, unsigned perSecond);
+    static unsigned GetRateLimit(int level);
+    static unsigned long GetSuppressed(int level);
+    //deepest the ring has been seen by the reader and lines dropped
+    //because it was full
+    static void GetStats(size_t &highWater, unsigned long &dropped);
+
+    static int OpenBinary(const char *path);
+    static void CloseBinary();
+    static std::string BinaryPath();
+    //one text line per record, returns the number of records or -1
+    static int DecodeBinary(const char *path, FILE *out);
+
+    static void Format(const Record &rec, std::string &out);
+
 private:
-    static MessageQueue<Msg> logMsgQueue;
+    static int begin(Record &rec, int level, const char *fmt);
+    static int post(Record &rec);
+    static void addStr(Record &rec, const char *s, size_t len);
+    static void release(Record &rec);
+    static void writeBinary(const Record &rec);
+
+    template<typename T>
+    static void addArg(Record &rec, const T &v) {
+        if constexpr (std::is_convertible_v<const T&, const char*>) {
+            const char *s = v;
+            addStr(rec, s ? s : "(null)", s ? strlen(s) : 6);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            addStr(rec, v.data(), v.size());
+        } else {
+            Arg &a = rec.args[rec.nargs++];
+            if constexpr (std::is_floating_point_v<T>) {
+                a.type = kArgDouble;
+                a.d = v;
+            } else if constexpr (std::is_pointer_v<T>) {
+                a.type = kArgUInt;
+                a.u = (unsigned long long)(uintptr_t)v;
+            } else if constexpr (std::is_unsigned_v<T> && !std::is_same_v<T, bool>) {
+                a.type = kArgUInt;
+                a.u = v;
+            } else {
+                a.type = kArgInt;
+                a.i = (long long)v;
+            }
+        }
+    }
+
+    static MpscRing<Record> ring;
 };
 
 #endif
@@ -0,0 +1,404 @@
+#include "emcMetrics.h"
+#include "emcLog.h"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+std::atomic<int> EMCMetrics::nextShard{0};
+
+namespace {
+
+enum Type {
+    kCounter,
+    kGauge,
+    kHistogram,
+};
+
+const char *typeNames[] = {"counter", "gauge", "histogram"};
+
+struct Metric {
+    std::string name;           //with the labels
+    std::string base;           //without
+    std::string labels;         //between the braces
+    std::string help;
+    Type type;
+    std::unique_ptr<EMCMetrics::Counter> counter;
+    std::unique_ptr<EMCMetrics::Gauge> gauge;
+    std::unique_ptr<EMCMetrics::Histogram> histogram;
+    std::function<double()> read;
+    double last = 0.0;          //value at the last Report()
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Metric>> metrics;
+    std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+//Registered under the registry mutex, the same name gives the same
+//metric. A name registered again with another type gets a metric of
+//its own that is not shown, the caller still has something to use
+Metric *find(Registry &r, const std::string &name, Type type, bool &created)
+{
+    created = false;
+    for (auto &m : r.metrics) {
+        if (m->name == name) {
+            if (m->type == type)
+                return m.get();
+            EMCLog::SetLog("metric " + name + " registered with another type", 2);
+            static std::vector<std::unique_ptr<Metric>> orphans;
+            orphans.push_back(std::make_unique<Metric>());
+            orphans.back()->type = type;
+            created = true;
+            return orphans.back().get();
+        }
+    }
+    auto m = std::make_unique<Metric>();
+    m->name = name;
+    size_t brace = name.find('{');
+    m->base = name.substr(0, brace);
+    if (brace != std::string::npos && name.back() == '}')
+        m->labels = name.substr(brace + 1, name.size() - brace - 2);
+    m->type = type;
+    r.metrics.push_back(std::move(m));
+    created = true;
+    return r.metrics.back().get();
+}
+
+double value(const Metric &m)
+{
+    if (m.read)
+        return m.read();
+    if (m.counter)
+        return (double)m.counter->Value();
+    if (m.gauge)
+        return m.gauge->Value();
+    return 0.0;
+}
+
+std::string number(double v)
+{
+    if (std::isnan(v))
+        return "NaN";
+    if (std::isinf(v))
+        return v > 0 ? "+Inf" : "-Inf";
+    std::ostringstream ss;
+    ss << std::setprecision(12) << v;
+    return ss.str();
+}
+
+std::string series(const Metric &m, const std::string &suffix, const std::string &extra)
+{
+    std::string s = m.base + suffix;
+    if (m.labels.empty() && extra.empty())
+        return s;
+    s += "{" + m.labels;
+    if (!m.labels.empty() && !extra.empty())
+        s += ",";
+    return s + extra + "}";
+}
+
+struct Exporter {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread thread;
+    bool stop = false;
+    std::string path;
+
+    ~Exporter() {
+        Stop();
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+//after the registry, so it is stopped before the registry goes
+Exporter &exporter()
+{
+    registry();
+    static Exporter e;
+    return e;
+}
+
+int writeFile(const std::string &path)
+{
+    std::string tmp = path + ".tmp";
+    std::string text = EMCMetrics::Prometheus();
+    FILE *fp = fopen(tmp.c_str(), "w");
+    if (!fp)
+        return -1;
+    bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+    if (fclose(fp) || !ok || rename(tmp.c_str(), path.c_str())) {
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+} // namespace
+
+uint64_t EMCMetrics::Counter::Value() const
+{
+    uint64_t sum = 0;
+    for (const Slot &s : shards_)
+        sum += s.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+EMCMetrics::Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)),
+      buckets_(new std::atomic<uint64_t>[bounds_.size() + 1])
+{
+    for (size_t n = 0; n <= bounds_.size(); n++)
+        buckets_[n].store(0, std::memory_order_relaxed);
+}
+
+void EMCMetrics::Histogram::Observe(double v)
+{
+    size_t n = 0;
+    while (n < bounds_.size() && v > bounds_[n])
+        n++;
+    buckets_[n].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+}
+
+void EMCMetrics::Histogram::Read(std::vector<uint64_t> &counts, double &sum) const
+{
+    counts.resize(bounds_.size() + 1);
+    for (size_t n = 0; n <= bounds_.size(); n++)
+        counts[n] = buckets_[n].load(std::memory_order_relaxed);
+    sum = sum_.load(std::memory_order_relaxed);
+}
+
+EMCMetrics::Counter &EMCMetrics::GetCounter(const std::string &name, const std::string &help)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool created;
+    Metric *m = find(r, name, kCounter, created);
+    if (created) {
+        m->help = help;
+        m->counter = std::make_unique<Counter>();
+    }
+    if (!m->counter) {
+        //was added as a function, hand out a counter nobody shows
+        static std::vector<std::unique_ptr<Counter>> spare;
+        spare.push_back(std::make_unique<Counter>());
+        return *spare.back();
+    }
+    return *m->counter;
+}
+
+EMCMetrics::Gauge &EMCMetrics::GetGauge(const std::string &name, const std::string &help)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool created;
+    Metric *m = find(r, name, kGauge, created);
+    if (created) {
+        m->help = help;
+        m->gauge = std::make_unique<Gauge>();
+    }
+    if (!m->gauge) {
+        static std::vector<std::unique_ptr<Gauge>> spare;
+        spare.push_back(std::make_unique<Gauge>());
+        return *spare.back();
+    }
+    return *m->gauge;
+}
+
+EMCMetrics::Histogram &EMCMetrics::GetHistogram(const std::string &name,
+                                               const std::string &help,
+                                               const std::vector<double> &bounds)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool created;
+    Metric *m = find(r, name, kHistogram, created);
+    if (created) {
+        m->help = help;
+        m->histogram = std::make_unique<Histogram>(bounds);
+    }
+    return *m->histogram;
+}
+
+void EMCMetrics::AddCounter(const std::string &name, const std::string &help,
+                            std::function<double()> read)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool created;
+    Metric *m = find(r, name, kCounter, created);
+    if (created) {
+        m->help = help;
+        m->read = std::move(read);
+    }
+}
+
+void EMCMetrics::AddGauge(const std::string &name, const std::string &help,
+                          std::function<double()> read)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    bool created;
+    Metric *m = find(r, name, kGauge, created);
+    if (created) {
+        m->help = help;
+        m->read = std::move(read);
+    }
+}
+
+std::string EMCMetrics::Report()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - r.lastReport).count();
+    r.lastReport = now;
+
+    std::ostringstream ss;
+    ss << std::fixed;
+    for (auto &m : r.metrics) {
+        if (m->type == kHistogram) {
+            std::vector<uint64_t> counts;
+            double sum;
+            m->histogram->Read(counts, sum);
+            uint64_t total = 0;
+            for (uint64_t c : counts)
+                total += c;
+            ss << m->name << " = " << total;
+            if (total) {
+                //the bound the n-th observation is under
+                auto quantile = [&](double q) {
+                    uint64_t rank = (uint64_t)std::ceil(q * total), seen = 0;
+                    for (size_t n = 0; n < counts.size(); n++) {
+                        seen += counts[n];
+                        if (seen >= rank)
+                            return n < m->histogram->Bounds().size() ?
+                                number(m->histogram->Bounds()[n]) : std::string("+Inf");
+                    }
+                    return std::string("+Inf");
+                };
+                ss << std::setprecision(6) << ", mean " << sum / total <<
+                      ", p50 <= " << quantile(0.5) << ", p99 <= " << quantile(0.99);
+            }
+            ss << "\n";
+            continue;
+        }
+        double v = value(*m);
+        ss << m->name << " = " << number(v);
+        if (m->type == kCounter && dt > 0)
+            ss << std::setprecision(1) << ", " << (v - m->last) / dt << "/s";
+        m->last = v;
+        ss << "\n";
+    }
+    ss << "Export = " << (ExportPath().empty() ? "off" : ExportPath());
+    return ss.str();
+}
+
+std::string EMCMetrics::Prometheus()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::ostringstream ss;
+    std::vector<bool> done(r.metrics.size(), false);
+
+    //the series of a name together, under one HELP and TYPE
+    for (size_t i = 0; i < r.metrics.size(); i++) {
+        if (done[i])
+            continue;
+        const Metric &first = *r.metrics[i];
+        ss << "# HELP " << first.base << " " << first.help << "\n";
+        ss << "# TYPE " << first.base << " " << typeNames[first.type] << "\n";
+        for (size_t j = i; j < r.metrics.size(); j++) {
+            const Metric &m = *r.metrics[j];
+            if (done[j] || m.base != first.base || m.type != first.type)
+                continue;
+            done[j] = true;
+            if (m.type != kHistogram) {
+                ss << m.name << " " << number(value(m)) << "\n";
+                continue;
+            }
+            std::vector<uint64_t> counts;
+            double sum;
+            uint64_t cumulative = 0;
+            m.histogram->Read(counts, sum);
+            const std::vector<double> &bounds = m.histogram->Bounds();
+            for (size_t n = 0; n < counts.size(); n++) {
+                cumulative += counts[n];
+                std::string le = n < bounds.size() ? number(bounds[n]) : "+Inf";
+                ss << series(m, "_bucket", "le=\"" + le + "\"") << " " << cumulative << "\n";
+            }
+            ss << series(m, "_sum", "") << " " << number(sum) << "\n";
+            ss << series(m, "_count", "") << " " << cumulative << "\n";
+        }
+    }
+    return ss.str();
+}
+
+int EMCMetrics::StartExport(const std::string &path, double period)
+{
+    Exporter &e = exporter();
+
+    if (path.empty() || period <= 0)
+        return -1;
+    e.Stop();
+    if (writeFile(path)) {
+        EMCLog::SetLog("metrics: can't write " + path, 2);
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(e.mutex);
+        e.stop = false;
+        e.path = path;
+    }
+    e.thread = std::thread([&e, path, period]() {
+        bool failed = false;
+        std::unique_lock<std::mutex> lock(e.mutex);
+        while (!e.cv.wait_for(lock, std::chrono::duration<double>(period),
+                              [&e] { return e.stop; })) {
+            lock.unlock();
+            int res = writeFile(path);
+            //once per failure, not every period
+            if (res && !failed)
+                EMCLog::SetLog("metrics: can't write " + path, 2);
+            failed = res != 0;
+            lock.lock();
+        }
+    });
+    return 0;
+}
+
+void EMCMetrics::StopExport()
+{
+    Exporter &e = exporter();
+    e.Stop();
+    std::lock_guard<std::mutex> lock(e.mutex);
+    e.path.clear();
+}
+
+std::string EMCMetrics::ExportPath()
+{
+    Exporter &e = exporter();
+    std::lock_guard<std::mutex> lock(e.mutex);
+    return e.path;
+}
@@ -0,0 +1,105 @@
+#ifndef _EMC_METRICS_H_
+#define _EMC_METRICS_H_
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+//Counters, gauges and histograms of the throughput signals: queue
+//depths, planner length, NC lines and segments per second, dropped log
+//lines. STATS shows them with their rates, with [EMC]METRICS_FILE a
+//thread writes them every METRICS_PERIOD seconds in the Prometheus
+//text format, to a temporary file renamed over the old one, as the
+//node exporter textfile collector wants it.
+//
+//A counter is sharded: a thread adds to its own cache line with a
+//relaxed add, the motion thread and the interpreter never share one.
+//The reader sums the shards. A value that is kept elsewhere already
+//is registered as a function and only read when it is shown.
+//
+//Metrics are registered once and live as long as the process, keep
+//the reference:
+//
+//    static EMCMetrics::Counter &lines =
+//        EMCMetrics::GetCounter("cncsim_interp_lines_total", "NC lines executed");
+//    lines.Add();
+//
+//A name may carry labels, cncsim_x{lane="mill"}. The series of one
+//name share its help and its type.
+class EMCMetrics {
+public:
+    static constexpr int kShards = 16;
+
+    class Counter {
+    public:
+        void Add(uint64_t n = 1) {
+            shards_[Shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+        uint64_t Value() const;
+
+    private:
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> value{0};
+        };
+        Slot shards_[kShards];
+    };
+
+    class Gauge {
+    public:
+        void Set(double v) { value_.store(v, std::memory_order_relaxed); }
+        void Add(double d) { value_.fetch_add(d, std::memory_order_relaxed); }
+        double Value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value_{0.0};
+    };
+
+    //Fixed upper bounds, one writer at a time is the usual case but
+    //any number may observe
+    class Histogram {
+    public:
+        explicit Histogram(std::vector<double> bounds);
+        void Observe(double v);
+        //per bucket counts, the last one is +Inf
+        void Read(std::vector<uint64_t> &counts, double &sum) const;
+        const std::vector<double> &Bounds() const { return bounds_; }
+
+    private:
+        std::vector<double> bounds_;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+        std::atomic<double> sum_{0.0};
+    };
+
+    static Counter &GetCounter(const std::string &name, const std::string &help);
+    static Gauge &GetGauge(const std::string &name, const std::string &help);
+    static Histogram &GetHistogram(const std::string &name, const std::string &help,
+                                   const std::vector<double> &bounds);
+    //Read when shown, a counter must not go down
+    static void AddCounter(const std::string &name, const std::string &help,
+                           std::function<double()> read);
+    static void AddGauge(const std::string &name, const std::string &help,
+                         std::function<double()> read);
+
+    //"name = value" lines, counters with their rate since the last call
+    static std::string Report();
+    //Prometheus text format
+    static std::string Prometheus();
+
+    //Write Prometheus() to path every period seconds from a thread
+    static int StartExport(const std::string &path, double period);
+    static void StopExport();
+    static std::string ExportPath();
+
+private:
+    static int Shard() {
+        thread_local int shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return shard;
+    }
+    static std::atomic<int> nextShard;
+
+    EMCMetrics() = delete;
+};
+
+#endif
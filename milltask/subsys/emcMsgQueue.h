@@ -4,6 +4,12 @@
 #include <mutex>
 #include <condition_variable>
 #include <optional>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 //A thread safe Queue template
 template<typename T>
@@ -38,6 +44,25 @@ public:
         return msg;
     }
 
+    // Block until a message is queued or wake() is called, does not
+    // remove anything. Returns true if the queue holds a message
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]{ return !queue_.empty() || woken_; });
+        woken_ = false;
+        return !queue_.empty();
+    }
+
+    // Release wait() without a message, e.g. to stop the consumer. A
+    // wake() before the consumer gets to wait() is not lost
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            woken_ = true;
+        }
+        cond_.notify_all();
+    }
+
     // Check if the queue is empty
     bool empty() const {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -55,5 +80,322 @@ private:
     mutable std::mutex mutex_;
     std::queue<T> queue_;
     std::condition_variable cond_;
+    bool woken_ = false;
+};
+
+//How a BoundedQueue is shared
+//  Mutex  any number of producers and consumers
+//  Spsc   one producer thread and one consumer thread, lock free
+enum class QueueSync {
+    Mutex,
+    Spsc,
+};
+
+//A thread safe bounded queue
+//The slots are allocated once, try_push() fails when capacity messages
+//are queued instead of growing, push() waits for a free slot up to a
+//timeout. drain() moves a whole batch out under
+//a single lock, so a burst costs the consumer one lock, not one per
+//message. The deepest the queue has been (high_water()) and the pushes
+//turned away (dropped()) are counted to size the capacity.
+template<typename T, QueueSync S = QueueSync::Mutex>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : slots_(capacity ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Add a message, false if the queue is full
+    bool try_push(const T& msg) {
+        return emplace(msg);
+    }
+
+    bool try_push(T&& msg) {
+        return emplace(std::move(msg));
+    }
+
+    // Add a message, waiting while the queue is full. false if no slot
+    // came free within timeout
+    template<typename Rep, typename Period>
+    bool push(const T& msg, const std::chrono::duration<Rep, Period>& timeout) {
+        bool notify;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pushing_++;
+            bool room = space_.wait_for(lock, timeout,
+                                        [this]{ return count_ != slots_.size(); });
+            pushing_--;
+            if (!room) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                return false;
+            }
+            notify = put(msg);
+        }
+        if (notify) {
+            cond_.notify_one();
+        }
+        return true;
+    }
+
+    std::optional<T> try_pop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (count_ == 0) {
+            return std::nullopt;
+        }
+        T msg = std::move(slots_[head_]);
+        head_ = next(head_);
+        count_--;
+        freed();
+        return msg;
+    }
+
+    // Move up to max messages to out, oldest first. Returns how many
+    template<typename OutputIt>
+    size_t drain(OutputIt out, size_t max = SIZE_MAX) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = count_ < max ? count_ : max;
+        for (size_t i = 0; i < n; i++) {
+            *out++ = std::move(slots_[head_]);
+            head_ = next(head_);
+        }
+        count_ -= n;
+        if (n) {
+            freed();
+        }
+        return n;
+    }
+
+    // Block until a message is queued or wake() is called, see
+    // MessageQueue::wait()
+    bool wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_++;
+        cond_.wait(lock, [this]{ return count_ != 0 || woken_; });
+        waiting_--;
+        woken_ = false;
+        return count_ != 0;
+    }
+
+    void wake() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            woken_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    bool empty() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_ == 0;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        head_ = 0;
+        count_ = 0;
+        freed();
+    }
+
+    size_t capacity() const { return slots_.size(); }
+    size_t high_water() const { return highWater_.load(std::memory_order_relaxed); }
+    unsigned long dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    template<typename U>
+    bool emplace(U&& msg) {
+        bool notify;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (count_ == slots_.size()) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                return false;
+            }
+            notify = put(std::forward<U>(msg));
+        }
+        if (notify) {
+            cond_.notify_one();
+        }
+        return true;
+    }
+
+    // Under mutex_ with a free slot, true if a consumer waits
+    template<typename U>
+    bool put(U&& msg) {
+        size_t tail = head_ + count_;
+        if (tail >= slots_.size()) {
+            tail -= slots_.size();
+        }
+        slots_[tail] = std::forward<U>(msg);
+        count_++;
+        if (count_ > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(count_, std::memory_order_relaxed);
+        }
+        return waiting_ != 0;
+    }
+
+    // Under mutex_, slots were taken out
+    void freed() {
+        if (pushing_ != 0) {
+            space_.notify_all();
+        }
+    }
+
+    size_t next(size_t i) const {
+        return i + 1 == slots_.size() ? 0 : i + 1;
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable space_;
+    std::vector<T> slots_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    int waiting_ = 0;
+    int pushing_ = 0;
+    bool woken_ = false;
+    std::atomic<size_t> highWater_{0};
+    std::atomic<unsigned long> dropped_{0};
+};
+
+//Single producer single consumer version, no lock on either side
+//The producer owns head_, the consumer tail_, a slot is handed over by
+//the release store of the index. drain() publishes the whole batch
+//with one store. wait() sleeps on event_, which the producer only
+//notifies while the consumer is asleep.
+template<typename T>
+class BoundedQueue<T, QueueSync::Spsc> {
+public:
+    //capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        mask_ = size - 1;
+        slots_.reset(new T[size]);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Producer only, false if the queue is full
+    bool try_push(const T& msg) {
+        return emplace(msg);
+    }
+
+    bool try_push(T&& msg) {
+        return emplace(std::move(msg));
+    }
+
+    // Consumer only
+    std::optional<T> try_pop() {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        T msg = std::move(slots_[tail & mask_]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return msg;
+    }
+
+    // Consumer only
+    template<typename OutputIt>
+    size_t drain(OutputIt out, size_t max = SIZE_MAX) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t n = head_.load(std::memory_order_acquire) - tail;
+        if (n > max) {
+            n = max;
+        }
+        for (size_t i = 0; i < n; i++) {
+            *out++ = std::move(slots_[(tail + i) & mask_]);
+        }
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer only
+    bool wait() {
+        for (;;) {
+            if (woken_.exchange(false, std::memory_order_acq_rel)) {
+                return !empty();
+            }
+            sleeping_.store(true, std::memory_order_seq_cst);
+            uint32_t event = event_.load(std::memory_order_seq_cst);
+            if (!empty() || woken_.load(std::memory_order_acquire)) {
+                sleeping_.store(false, std::memory_order_relaxed);
+                if (!empty()) {
+                    return true;
+                }
+                continue;
+            }
+            event_.wait(event, std::memory_order_seq_cst);
+            sleeping_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread
+    void wake() {
+        woken_.store(true, std::memory_order_release);
+        event_.fetch_add(1, std::memory_order_seq_cst);
+        event_.notify_one();
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return head_.load(std::memory_order_acquire) - tail;
+    }
+
+    // Consumer only
+    void clear() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    size_t high_water() const { return highWater_.load(std::memory_order_relaxed); }
+    unsigned long dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    template<typename U>
+    bool emplace(U&& msg) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t used = head - tail_.load(std::memory_order_acquire);
+        if (used > mask_) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & mask_] = std::forward<U>(msg);
+        head_.store(head + 1, std::memory_order_release);
+        if (used + 1 > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(used + 1, std::memory_order_relaxed);
+        }
+        event_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_seq_cst)) {
+            event_.notify_one();
+        }
+        return true;
+    }
+
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<uint32_t> event_{0};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> woken_{false};
+    std::atomic<size_t> highWater_{0};
+    std::atomic<unsigned long> dropped_{0};
 };
 #endif
@@ -5,14 +5,23 @@
 #include "emcglb.h"
 //#include "interpl.hh"
 #include <iostream>
+#include <strings.h>
 #include "emcIniFile.hh"
 //#include "mot_priv.h"
 #include "motion.h"
 #include "emcChannel.h"
+#include "emcMetrics.h"
+#include "emcTrace.h"
 #include "emccfg.h"
 //#include "usrmotintf.h"
 #include "homing.h"
 #include "emcLog.h"
+#include "kines/kineIf.h"
+#include "kines/kineVolComp.h"
+#include "motionhalctrl.h"
+#include "motionHomeSim.h"
+#include "motionComp.h"
+#include "motionJerkTp.h"
 
 /* define this to catch isnan errors, for rtlinux FPU register
    problem testing */
@@ -38,6 +47,7 @@
 
 std::string EMCParas::inifileName;
 EMCParas::MotTrajConfig EMCParas::trajconfig;
+EMCParas::MotPeriodConfig EMCParas::periodconfig;
 EMCParas::MotJointConfig EMCParas::jointconfig[EMCMOT_MAX_JOINTS];
 EMCParas::MotAxisConfig EMCParas::axisconfig[EMCMOT_MAX_AXIS];
 
@@ -136,6 +146,9 @@ void EMCParas::init_emc_paras()
         if (!infile.Open(inifileName.c_str())) {
             return;
         }
+        loadLog(&infile);
+        loadMetrics(&infile);
+        loadTrace(&infile);
         iniTraj(inifileName.c_str());
         for (int joint = 0; joint < GetTrajConfig()->Joints; joint++) {
             iniJoint(joint, inifileName.c_str());
@@ -164,6 +177,254 @@ void EMCParas::set_traj_maxvel(double vel)
     GetTrajConfig()->MaxVel = vel;
 }
 
+/*
+  loadLog()
+
+  LOG_BINARY <file>             also write every log record to file,
+                                see EMCLog::DecodeBinary()
+  LOG_RATE_LOG <int>            lines per second of a level, 0 no limit,
+  LOG_RATE_WARNING <int>        the rest of the second is dropped and
+                                counted. Defaults 0, 200
+
+  All in [EMC], errors and cmd output are never limited.
+*/
+
+int EMCParas::loadLog(EmcIniFile *logInifile)
+{
+    static const char *rateKeys[] = {
+        "LOG_RATE_LOG", "LOG_RATE_WARNING",
+    };
+    const char *inistring;
+
+    logInifile->EnableExceptions(EmcIniFile::ERR_CONVERSION);
+
+    try {
+        for (int level = 0; level < EMCLog::kRateLevels; level++) {
+            int rate = EMCLog::GetRateLimit(level);
+            logInifile->Find(&rate, rateKeys[level], "EMC");
+            if (rate < 0) {
+                EMCLog::SetLog(std::string("bad [EMC]") + rateKeys[level], 1);
+                return -1;
+            }
+            EMCLog::SetRateLimit(level, rate);
+        }
+        if (NULL != logInifile->Find("LOG_RATE_ERROR", "EMC"))
+            EMCLog::SetLog("[EMC]LOG_RATE_ERROR ignored, errors are never limited", 1);
+
+        if (NULL != (inistring = logInifile->Find("LOG_BINARY", "EMC"))) {
+            if (EMCLog::OpenBinary(inistring)) {
+                EMCLog::Log(1, "can't open [EMC]LOG_BINARY %s", inistring);
+                return -1;
+            }
+        }
+    }
+
+    catch (EmcIniFile::Exception &e) {
+        e.Print();
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+  loadMetrics()
+
+  METRICS_FILE <file>           write the metrics (STATS) in the
+                                Prometheus text format to file, a
+                                temporary file is renamed over it
+  METRICS_PERIOD <float>        seconds between two writes, default 5
+
+  All in [EMC], see EMCMetrics.
+*/
+
+int EMCParas::loadMetrics(EmcIniFile *metricsInifile)
+{
+    const char *inistring;
+    double period = 5.0;
+
+    metricsInifile->EnableExceptions(EmcIniFile::ERR_CONVERSION);
+
+    try {
+        metricsInifile->Find(&period, "METRICS_PERIOD", "EMC");
+        if (period <= 0) {
+            EMCLog::SetLog("bad [EMC]METRICS_PERIOD", 1);
+            return -1;
+        }
+
+        if (NULL != (inistring = metricsInifile->Find("METRICS_FILE", "EMC"))) {
+            if (EMCMetrics::StartExport(inistring, period)) {
+                EMCLog::Log(1, "can't write [EMC]METRICS_FILE %s", inistring);
+                return -1;
+            }
+        }
+    }
+
+    catch (EmcIniFile::Exception &e) {
+        e.Print();
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+  loadTrace()
+
+  TRACE_FILE <file>             the Chrome trace TRACE STOP writes,
+                                default cncsim-trace.json
+  TRACE_EVENTS <int>            events each thread keeps, default 262144,
+                                32 bytes each
+
+  All in [EMC], see EMCTrace.
+*/
+
+int EMCParas::loadTrace(EmcIniFile *traceInifile)
+{
+    const char *inistring;
+    int events = 0;
+
+    traceInifile->EnableExceptions(EmcIniFile::ERR_CONVERSION);
+
+    try {
+        if (NULL != (inistring = traceInifile->Find("TRACE_FILE", "EMC"))) {
+            EMCTrace::SetFile(inistring);
+        }
+        traceInifile->Find(&events, "TRACE_EVENTS", "EMC");
+        if (events < 0) {
+            EMCLog::SetLog("bad [EMC]TRACE_EVENTS", 1);
+            return -1;
+        }
+        EMCTrace::SetCapacity(events);
+    }
+
+    catch (EmcIniFile::Exception &e) {
+        e.Print();
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+  loadEmcmot()
+
+  SERVO_PERIOD <int>            servo period, nsec
+  TRAJ_PERIOD <int>             planner period, nsec, a multiple of the
+                                servo period, defaults to SERVO_PERIOD
+  SAMPLE_RATE <SERVO|TRAJ>      simulation output rate
+  HOME_SIM <OFF|STEP|WARP|VIRTUAL>  simulated homing, see motionHomeSim.h
+  TELEMETRY </name>             publish a status sample every servo cycle
+                                to the shared memory ring /name, see
+                                motionTelemetry.h
+  TELEMETRY_SLOTS <int>         samples the ring holds, default 4096
+  TELEMETRY_SOCKET <path>       stream the ring to subscribers on a UNIX
+                                socket, see TelemTask. Without TELEMETRY
+                                the ring is kept private
+  RECORD_FILE <path>            the file RECORD writes the command stream
+                                to and REPLAY plays back, see EMCRecord,
+                                default motrecord.bin
+  ADMIT_MAX <int>               most mill commands taken into the planner
+                                in one servo cycle, default 16, 1 takes
+                                one per cycle
+  ADMIT_BUDGET <fraction>       share of the servo period the controller
+                                and the mill commands together may take,
+                                default 0.5, the first command of a cycle
+                                is always taken
+
+  The periods are handed to the motion module when it starts, see
+  MotionTask::InitMotion().
+*/
+
+int EMCParas::loadEmcmot(EmcIniFile *motInifile)
+{
+    MotPeriodConfig cfg;
+    const char *inistring;
+
+    motInifile->EnableExceptions(EmcIniFile::ERR_CONVERSION);
+
+    try {
+        int servo = 0;
+        int traj = 0;
+        motInifile->Find(&servo, "SERVO_PERIOD", "EMCMOT");
+        motInifile->Find(&traj, "TRAJ_PERIOD", "EMCMOT");
+
+        if (servo > 0)
+            cfg.servo_period_nsec = servo;
+        else if (servo < 0) {
+            EMCLog::SetLog("bad [EMCMOT]SERVO_PERIOD", 1);
+            return -1;
+        }
+        cfg.traj_period_nsec = traj > 0 ? traj : cfg.servo_period_nsec;
+        if (cfg.traj_period_nsec < cfg.servo_period_nsec) {
+            EMCLog::SetLog("bad [EMCMOT]TRAJ_PERIOD, shorter than SERVO_PERIOD", 1);
+            return -1;
+        }
+        long ratio = (cfg.traj_period_nsec + cfg.servo_period_nsec / 2) /
+            cfg.servo_period_nsec;
+        if (ratio * cfg.servo_period_nsec != cfg.traj_period_nsec) {
+            cfg.traj_period_nsec = ratio * cfg.servo_period_nsec;
+            EMCLog::SetLog("[EMCMOT]TRAJ_PERIOD rounded to " +
+                           std::to_string(cfg.traj_period_nsec) + " nsec", 2);
+        }
+
+        if (NULL != (inistring = motInifile->Find("SAMPLE_RATE", "EMCMOT"))) {
+            if (!strcasecmp(inistring, "TRAJ")) {
+                cfg.sample_traj_rate = true;
+            } else if (strcasecmp(inistring, "SERVO")) {
+                EMCLog::SetLog("bad [EMCMOT]SAMPLE_RATE, use SERVO or TRAJ", 1);
+                return -1;
+            }
+        }
+
+        if (NULL != (inistring = motInifile->Find("HOME_SIM", "EMCMOT"))) {
+            cfg.home_sim = homeSimModeFromName(inistring);
+            if (cfg.home_sim < 0) {
+                EMCLog::SetLog("bad [EMCMOT]HOME_SIM, use OFF, STEP, WARP or VIRTUAL", 1);
+                return -1;
+            }
+        }
+
+        if (NULL != (inistring = motInifile->Find("TELEMETRY", "EMCMOT"))) {
+            if (inistring[0] != '/' || strchr(inistring + 1, '/')) {
+                EMCLog::SetLog("bad [EMCMOT]TELEMETRY, use /name", 1);
+                return -1;
+            }
+            cfg.telemetry = inistring;
+        }
+        if (NULL != (inistring = motInifile->Find("TELEMETRY_SOCKET", "EMCMOT"))) {
+            cfg.telemetry_socket = inistring;
+        }
+        if (NULL != (inistring = motInifile->Find("RECORD_FILE", "EMCMOT"))) {
+            cfg.record_file = inistring;
+        }
+        motInifile->Find(&cfg.telemetry_slots, "TELEMETRY_SLOTS", "EMCMOT");
+        if (cfg.telemetry_slots <= 0) {
+            EMCLog::SetLog("bad [EMCMOT]TELEMETRY_SLOTS", 1);
+            return -1;
+        }
+        motInifile->Find(&cfg.admit_max, "ADMIT_MAX", "EMCMOT");
+        if (cfg.admit_max < 1) {
+            EMCLog::SetLog("bad [EMCMOT]ADMIT_MAX", 1);
+            return -1;
+        }
+        motInifile->Find(&cfg.admit_budget, "ADMIT_BUDGET", "EMCMOT");
+        if (cfg.admit_budget <= 0.0 || cfg.admit_budget > 1.0) {
+            EMCLog::SetLog("bad [EMCMOT]ADMIT_BUDGET, use 0 < fraction <= 1", 1);
+            return -1;
+        }
+    }
+
+    catch (EmcIniFile::Exception &e) {
+        e.Print();
+        return -1;
+    }
+
+    periodconfig = cfg;
+
+    return 0;
+}
+
 /*
   loadKins()
 
@@ -195,6 +456,136 @@ int EMCParas::loadKins(EmcIniFile *trajInifile)
     return 0;
 }
 
+/*
+  loadKinsGeometry()
+
+  Loads the machine geometry used by the simulator kinematics.
+  Every key is optional, a missing key keeps the built-in default.
+
+  TOOL_OFFSET_Z <float>           XYZABTRT spindle to tool length
+  TOOL_OFFSET <float>             XYZACTRT spindle to tool length
+  X_OFFSET, Y_OFFSET, Z_OFFSET <float>        offset between rotary axes
+  X_ROT_POINT, Y_ROT_POINT, Z_ROT_POINT <float> rotary centre
+  FIVEAXIS_TYPE <int>             1 table, 2 spindle, 3 table+spindle
+  FIVEAXIS_AXIS1, FIVEAXIS_AXIS2 <char>       A, B or C
+  FIVEAXIS_SIGN1, FIVEAXIS_SIGN2 <int>        +1 or -1
+  PRIMARY_CENTER_X/Y/Z <float>    first rotary centre in world
+  SECONDARY_OFFSET_X/Y/Z <float>  second rotary centre from the first
+  SPINDLE_SWING_X/Y/Z <float>     swing head offset
+  VOLCOMP_FILE <string>           volumetric error map, see kineVolComp.h
+
+  calls:
+
+  Kines::LoadGeometry(name, geometry);
+  VolComp::Load(file);
+*/
+
+int EMCParas::loadKinsGeometry(EmcIniFile *kinsInifile, const char *name)
+{
+    Kines::Geometry geo;
+    fiveaxis::Config &cfg = geo.fiveaxis;
+
+    kinsInifile->EnableExceptions(EmcIniFile::ERR_CONVERSION);
+
+    try {
+        kinsInifile->Find(&geo.tool_offset_z, "TOOL_OFFSET_Z", "KINS");
+        kinsInifile->Find(&geo.tool_offset, "TOOL_OFFSET", "KINS");
+        kinsInifile->Find(&geo.x_offset, "X_OFFSET", "KINS");
+        kinsInifile->Find(&geo.y_offset, "Y_OFFSET", "KINS");
+        kinsInifile->Find(&geo.z_offset, "Z_OFFSET", "KINS");
+        kinsInifile->Find(&geo.x_rot_point, "X_ROT_POINT", "KINS");
+        kinsInifile->Find(&geo.y_rot_point, "Y_ROT_POINT", "KINS");
+        kinsInifile->Find(&geo.z_rot_point, "Z_ROT_POINT", "KINS");
+
+        int type = (int)cfg.mtype;
+        kinsInifile->Find(&type, "FIVEAXIS_TYPE", "KINS");
+        if (type < (int)fiveaxis::MachineType::TABLE_TILTING ||
+            type > (int)fiveaxis::MachineType::TABLE_SPINDLE_TILTING) {
+            EMCLog::SetLog("bad [KINS]FIVEAXIS_TYPE", 1);
+            return -1;
+        }
+        cfg.mtype = (fiveaxis::MachineType)type;
+
+        const char *axisNames[2] = {"FIVEAXIS_AXIS1", "FIVEAXIS_AXIS2"};
+        fiveaxis::RotaryAxis *axes[2] = {&cfg.axis1, &cfg.axis2};
+        for (int i = 0; i < 2; i++) {
+            const char *axis = kinsInifile->Find(axisNames[i], "KINS");
+            if (!axis)
+                continue;
+            switch (toupper(axis[0])) {
+            case 'A': *axes[i] = fiveaxis::RotaryAxis::A; break;
+            case 'B': *axes[i] = fiveaxis::RotaryAxis::B; break;
+            case 'C': *axes[i] = fiveaxis::RotaryAxis::C; break;
+            default:
+                EMCLog::SetLog("bad [KINS]FIVEAXIS_AXIS, use A, B or C", 1);
+                return -1;
+            }
+        }
+
+        kinsInifile->Find(&cfg.sign_axis1, "FIVEAXIS_SIGN1", "KINS");
+        kinsInifile->Find(&cfg.sign_axis2, "FIVEAXIS_SIGN2", "KINS");
+
+        kinsInifile->Find(&cfg.primary_center_world.x, "PRIMARY_CENTER_X", "KINS");
+        kinsInifile->Find(&cfg.primary_center_world.y, "PRIMARY_CENTER_Y", "KINS");
+        kinsInifile->Find(&cfg.primary_center_world.z, "PRIMARY_CENTER_Z", "KINS");
+        kinsInifile->Find(&cfg.secondary_offset_world.x, "SECONDARY_OFFSET_X", "KINS");
+        kinsInifile->Find(&cfg.secondary_offset_world.y, "SECONDARY_OFFSET_Y", "KINS");
+        kinsInifile->Find(&cfg.secondary_offset_world.z, "SECONDARY_OFFSET_Z", "KINS");
+        kinsInifile->Find(&cfg.spindle_swing_world.x, "SPINDLE_SWING_X", "KINS");
+        kinsInifile->Find(&cfg.spindle_swing_world.y, "SPINDLE_SWING_Y", "KINS");
+        kinsInifile->Find(&cfg.spindle_swing_world.z, "SPINDLE_SWING_Z", "KINS");
+    }
+
+    catch (EmcIniFile::Exception &e) {
+        e.Print();
+        return -1;
+    }
+
+    if (0 != Kines::GetInstance().LoadGeometry(name, geo)) {
+        return -1;
+    }
+
+    // the map belongs to the machine, no file means no compensation
+    const char *volcomp = kinsInifile->Find("VOLCOMP_FILE", "KINS");
+    if (!volcomp) {
+        VolComp::GetInstance().Unload();
+    }
+    else if (0 != VolComp::GetInstance().Load(volcomp)) {
+        EMCLog::SetLog("bad [KINS]VOLCOMP_FILE", 1);
+        return -1;
+    }
+    VolComp::GetInstance().Bind(name);
+
+    return 0;
+}
+
+/*
+  iniKins(const char *filename, bool reload)
+
+  Loads the [KINS] geometry of filename and makes it the active one.
+  Can be called while running to swap machines between simulations.
+  The file name is the key of the cached geometry, a file loaded
+  before is only reselected unless reload is set, together with the
+  VOLCOMP map it was loaded with.
+ */
+int EMCParas::iniKins(const char *filename, bool reload)
+{
+    if (!reload && 0 == Kines::GetInstance().SelectGeometry(filename)) {
+        if (0 != VolComp::GetInstance().Select(filename)) {
+            VolComp::GetInstance().Unload();
+        }
+        return 0;
+    }
+
+    EmcIniFile kinsInifile;
+
+    if (kinsInifile.Open(filename) == false) {
+    return -1;
+    }
+
+    return loadKinsGeometry(&kinsInifile, filename);
+}
+
 std::string EMCParas::showTrajParas()
 {
     std::stringstream ss;
@@ -505,10 +896,18 @@ int EMCParas::iniTraj(const char *filename)
     if (trajInifile.Open(filename) == false) {
     return -1;
     }
+    // load motion module periods
+    if (0 != loadEmcmot(&trajInifile)) {
+    return -1;
+    }
     // load trajectory values
     if (0 != loadKins(&trajInifile)) {
     return -1;
     }
+    // load kinematics geometry
+    if (0 != loadKinsGeometry(&trajInifile, filename)) {
+    return -1;
+    }
     // load trajectory values
     if (0 != loadTraj(&trajInifile)) {
     return -1;
@@ -727,6 +1126,7 @@ int EMCParas::iniJoint(int joint, const char *filename)
   TYPE <LINEAR ANGULAR>        type of joint
   MAX_VELOCITY <float>         max vel for joint
   MAX_ACCELERATION <float>     max accel for joint
+  MAX_JERK <float>             jerk limit of jogs and homing moves, 0 trapezoidal
   BACKLASH <float>             backlash
   MIN_LIMIT <float>            minimum soft position limit
   MAX_LIMIT <float>            maximum soft position limit
@@ -739,7 +1139,15 @@ int EMCParas::iniJoint(int joint, const char *filename)
   HOME_LATCH_VEL <float>       homing speed, latch phase
   HOME_USE_INDEX <bool>        use index pulse when homing
   HOME_IGNORE_LIMITS <bool>    ignore limit switches when homing
-  COMP_FILE <filename>         file of joint compensation points
+  COMP_FILE <filename>         file of joint compensation points, any number
+                               up to MOT_COMP_MAX_ENTRIES, see motionComp.h
+  COMP_JERK <float>            jerk limit of the backlash / comp ramp, 0 trapezoidal
+  SERVO_MODEL <IDEAL PID>      simulated servo loop, IDEAL feeds back the command
+  P, I, D <float>              PID gains of the simulated servo loop
+  FF0, FF1, FF2 <float>        position, velocity and acceleration feedforward
+  MAX_OUTPUT <float>           servo output (torque) limit, 0 no limit
+  SERVO_INERTIA <float>        plant inertia, output per unit/s^2
+  SERVO_DAMPING <float>        plant viscous damping, output per unit/s
 
   calls:
 
@@ -757,7 +1165,10 @@ int EMCParas::iniJoint(int joint, const char *filename)
   emcJointActivate(int joint);
   emcJointSetMaxVelocity(int joint, double vel);
   emcJointSetMaxAcceleration(int joint, double acc);
-  emcJointLoadComp(int joint, const char * file, int comp_file_type);
+  jerkTpSetJerk(int lane, double jerk);
+  motCompLoad(int joint, const char * file, int comp_file_type);
+  motCompSetJerk(int joint, double jerk);
+  MotHalCtrl::set_servo_params(int joint, const SERVO_PARAMS &params);
   */
 
 int EMCParas::loadJoint(int joint, EmcIniFile *jointIniFile)
@@ -782,9 +1193,12 @@ int EMCParas::loadJoint(int joint, EmcIniFile *jointIniFile)
     int locking_indexer;
     int absolute_encoder;
     int comp_file_type; //type for the compensation file. type==0 means nom, forw, rev.
+    double comp_jerk;
     double maxVelocity;
     double maxAcceleration;
+    double maxJerk;
     double ferror;
+    SERVO_PARAMS servo;
 
     // compose string to match, joint = 0 -> JOINT_0, etc.
     snprintf(jointString, sizeof(jointString), "JOINT_%d", joint);
@@ -914,12 +1328,59 @@ int EMCParas::loadJoint(int joint, EmcIniFile *jointIniFile)
         }
         jointconfig[joint].joint_max_acceleration = maxAcceleration;
 
+        maxJerk = 0.0;                  // default, trapezoidal
+        jointIniFile->Find(&maxJerk, "MAX_JERK", jointString);
+        if (0 != jerkTpSetJerk(JERK_TP_JOINT(joint), maxJerk)) {
+            EMCLog::SetLog("bad MAX_JERK", 1);
+            return -1;
+        }
+
+        // simulated servo loop
+        servoModelDefaultParams(&servo);
+        if (NULL != (inistring = jointIniFile->Find("SERVO_MODEL", jointString))) {
+            if (!strcasecmp(inistring, "PID")) {
+                servo.model = SERVO_MODEL_PID;
+            } else if (strcasecmp(inistring, "IDEAL")) {
+                EMCLog::SetLog("bad SERVO_MODEL, use IDEAL or PID", 1);
+                return -1;
+            }
+        }
+        jointIniFile->Find(&servo.p, "P", jointString);
+        jointIniFile->Find(&servo.i, "I", jointString);
+        jointIniFile->Find(&servo.d, "D", jointString);
+        jointIniFile->Find(&servo.ff0, "FF0", jointString);
+        jointIniFile->Find(&servo.ff1, "FF1", jointString);
+        jointIniFile->Find(&servo.ff2, "FF2", jointString);
+        jointIniFile->Find(&servo.maxOutput, "MAX_OUTPUT", jointString);
+        jointIniFile->Find(&servo.inertia, "SERVO_INERTIA", jointString);
+        jointIniFile->Find(&servo.damping, "SERVO_DAMPING", jointString);
+        if (servo.inertia <= 0.0 || servo.maxOutput < 0.0) {
+            EMCLog::SetLog("bad SERVO_INERTIA or MAX_OUTPUT", 1);
+            return -1;
+        }
+        if (0 != MotHalCtrl::set_servo_params(joint, servo)) {
+            return -1;
+        }
+
         comp_file_type = 0;             // default
         jointIniFile->Find(&comp_file_type, "COMP_FILE_TYPE", jointString);
         if (NULL != (inistring = jointIniFile->Find("COMP_FILE", jointString))) {
-            if (0 != emcJointLoadComp(joint, inistring, comp_file_type)) {
+            int entries = motCompLoad(joint, inistring, comp_file_type);
+            if (entries < 0) {
+                EMCLog::SetLog(std::string("bad COMP_FILE ") + inistring, 1);
                 return -1;
             }
+            EMCLog::SetLog(std::string(inistring) + " " + std::to_string(entries) +
+                           " comp points, joint " + std::to_string(joint));
+        } else {
+            motCompUnload(joint);
+        }
+
+        comp_jerk = 0.0;                // default, trapezoidal ramp
+        jointIniFile->Find(&comp_jerk, "COMP_JERK", jointString);
+        if (0 != motCompSetJerk(joint, comp_jerk)) {
+            EMCLog::SetLog("bad COMP_JERK", 1);
+            return -1;
         }
     }
 
@@ -1204,6 +1665,8 @@ extern double ext_offset_a_or_v_ratio[EMCMOT_MAX_AXIS]; // all zero
   TYPE <LINEAR ANGULAR>        type of axis (hardcoded: X,Y,Z,U,V,W: LINEAR, A,B,C: ANGULAR)
   MAX_VELOCITY <float>         max vel for axis
   MAX_ACCELERATION <float>     max accel for axis
+  MAX_JERK <float>             jerk limit of teleop jogs and external offsets,
+                               0 trapezoidal
   MIN_LIMIT <float>            minimum soft position limit
   MAX_LIMIT <float>            maximum soft position limit
 
@@ -1213,6 +1676,7 @@ extern double ext_offset_a_or_v_ratio[EMCMOT_MAX_AXIS]; // all zero
   emcAxisSetMaxPositionLimit(int axis, double limit);
   emcAxisSetMaxVelocity(int axis, double vel, double ext_offset_vel);
   emcAxisSetMaxAcceleration(int axis, double acc, double ext_offset_acc);
+  jerkTpSetJerk(int lane, double jerk);
   */
 
 int EMCParas::loadAxis(int axis, EmcIniFile *axisIniFile)
@@ -1221,6 +1685,7 @@ int EMCParas::loadAxis(int axis, EmcIniFile *axisIniFile)
     double limit;
     double maxVelocity;
     double maxAcceleration;
+    double maxJerk;
     int    lockingjnum = -1; // -1 ==> locking joint not used
 
     // compose string to match, axis = 0 -> AXIS_X etc.
@@ -1296,6 +1761,15 @@ int EMCParas::loadAxis(int axis, EmcIniFile *axisIniFile)
         }
         axisconfig[axis].axis_max_acceleration = maxAcceleration;
 
+        // jerk limit, the same for the jog and the external offset planner
+        maxJerk = 0.0;                  // default, trapezoidal
+        axisIniFile->Find(&maxJerk, "MAX_JERK", axisString);
+        if (0 != jerkTpSetJerk(JERK_TP_AXIS(axis), maxJerk)
+            || 0 != jerkTpSetJerk(JERK_TP_EOFFSET(axis), maxJerk)) {
+                EMCLog::SetLog("bad MAX_JERK", 1);
+            return -1;
+        }
+
         axisIniFile->Find(&lockingjnum, "LOCKING_INDEXER_JOINT", axisString);
         if (0 != emcAxisSetLockingJoint_(axis, lockingjnum)) {
                 EMCLog::SetLog("bad return from emcAxisSetLockingJoint", 1);
@@ -1505,6 +1979,38 @@ int EMCParas::loadSpindle(int spindle, EmcIniFile *spindleIniFile)
         fastest_neg, search_vel, home_angle, home_sequence, increment)) {
         return -1;
     }
+
+    // simulated drive and encoder, see motionSpindle.h, speeds in rpm
+    SPINDLE_PARAMS model;
+    const char *inistring;
+    spindleModelDefaultParams(&model);
+    if (NULL != (inistring = spindleIniFile->Find("SPINDLE_MODEL", spindleString))) {
+        if (!strcasecmp(inistring, "DYNAMIC")) {
+            model.model = SPINDLE_MODEL_DYNAMIC;
+        } else if (strcasecmp(inistring, "IDEAL")) {
+            EMCLog::SetLog("bad SPINDLE_MODEL, use IDEAL or DYNAMIC", 1);
+            return -1;
+        }
+    }
+    if (spindleIniFile->Find(&limit, "SPINDLE_ACCEL", spindleString) == 0) {
+        model.accel = limit / 60.0;
+    }
+    spindleIniFile->Find(&model.droop, "SPINDLE_DROOP", spindleString);
+    spindleIniFile->Find(&model.load, "SPINDLE_LOAD", spindleString);
+    spindleIniFile->Find(&model.atSpeedTol, "AT_SPEED_TOL", spindleString);
+    if (spindleIniFile->Find(&limit, "AT_SPEED_MIN", spindleString) == 0) {
+        model.atSpeedMin = limit / 60.0;
+    }
+    spindleIniFile->Find(&model.encoderCounts, "ENCODER_SCALE", spindleString);
+    if (model.accel <= 0.0 || model.droop < 0.0 || model.droop > 1.0 ||
+        model.load < 0.0 || model.load > 1.0 || model.atSpeedTol < 0.0 ||
+        model.atSpeedMin < 0.0 || model.encoderCounts < 0) {
+        EMCLog::SetLog("bad SPINDLE_ACCEL, SPINDLE_DROOP, SPINDLE_LOAD, AT_SPEED or ENCODER_SCALE", 1);
+        return -1;
+    }
+    if (0 != MotHalCtrl::set_spindle_params(spindle, model)) {
+        return -1;
+    }
     return 0;
 }
 
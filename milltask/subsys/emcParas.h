@@ -40,6 +40,19 @@ public:
         int joint_home_sequence;
     };
 
+    struct MotPeriodConfig {
+        long servo_period_nsec = 1000000;
+        long traj_period_nsec = 1000000;
+        bool sample_traj_rate = false;  // simulation output once per traj period
+        int home_sim = 0;               // HOME_SIM_ mode, see motionHomeSim.h
+        std::string telemetry;          // shared memory ring, see motionTelemetry.h
+        int telemetry_slots = 4096;
+        std::string telemetry_socket;   // UNIX socket stream, see telemtask.h
+        std::string record_file = "motrecord.bin";  // RECORD and REPLAY, see emcRecord.h
+        int admit_max = 16;             // mill commands per servo cycle, see MotTask::admitMill()
+        double admit_budget = 0.5;      // of the servo period, controller and admission
+    };
+
     struct MotAxisConfig {
         double axis_min_limit;
         double axis_max_limit;
@@ -60,12 +73,19 @@ public:
     static void set_traj_maxvel(double vel);
 
     static MotTrajConfig trajconfig;
+    static MotPeriodConfig periodconfig;
     static MotJointConfig jointconfig[EMCMOT_MAX_JOINTS];
     static MotAxisConfig axisconfig[EMCMOT_MAX_AXIS];
 
+    static int loadLog(EmcIniFile *logInifile);
+    static int loadMetrics(EmcIniFile *metricsInifile);
+    static int loadTrace(EmcIniFile *traceInifile);
     static int iniTraj(const char *filename);
+    static int loadEmcmot(EmcIniFile *motInifile);
     static int loadTraj(EmcIniFile *trajInifile);
     static int loadKins(EmcIniFile *trajInifile);
+    static int iniKins(const char *filename, bool reload = false);
+    static int loadKinsGeometry(EmcIniFile *kinsInifile, const char *name);
 
     static std::string showTrajParas();
 
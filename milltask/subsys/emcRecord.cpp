@@ -0,0 +1,429 @@
+#include "emcRecord.h"
+#include "emcChannel.h"
+#include "emcLog.h"
+#include "kines/kineIf.h"
+#include "kines/kineVolComp.h"
+#include "motionComp.h"
+#include "motionHomeSim.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+//stdio buffer of the recording. A command is a few hundred bytes, so
+//the motion thread writes one page every few dozen commands
+#define RECORD_BUFFER_SIZE (1 << 16)
+
+namespace {
+
+enum Mode {
+    kOff,
+    kRecording,
+    kReplaying,
+};
+
+const uint64_t fnvBasis = 0xcbf29ce484222325ULL;
+const uint64_t fnvPrime = 0x100000001b3ULL;
+
+//motion thread
+uint64_t cycle = 0;
+uint64_t digest = fnvBasis;
+uint64_t commands = 0;
+
+FILE *recordFile = nullptr;
+std::vector<char> recordBuffer;
+
+//closes a finished recording off the motion thread
+std::thread closer;
+std::atomic<bool> closing{false};
+
+std::vector<char> replayData;
+size_t replayPos = 0;
+size_t replayEnd = 0;
+uint64_t replayCycles = 0;
+EMCRecord::Trailer replayTrailer;
+std::chrono::steady_clock::time_point replayStart;
+
+//read by Status()
+std::atomic<int> mode{kOff};
+std::atomic<uint64_t> statCycles{0};
+std::atomic<uint64_t> statCommands{0};
+std::mutex statusMutex;
+std::string path;
+std::string lastReplay{"off"};
+
+inline uint64_t fnv(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *c = (const unsigned char *)p;
+    for (size_t i = 0; i < n; i++) {
+        h ^= c[i];
+        h *= fnvPrime;
+    }
+    return h;
+}
+
+void setPath(const std::string &p)
+{
+    std::lock_guard<std::mutex> lock(statusMutex);
+    path = p;
+}
+
+void fillHeader(EMCRecord::Header &h, const emcmot_status_t *st, int numJoints,
+                long servoPeriod, long trajPeriod)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memset(&h, 0, sizeof(h));
+    h.magic = EMCRecord::kMagic;
+    h.version = EMCRecord::kVersion;
+    h.commandSize = sizeof(emcmot_command_t);
+    h.numJoints = numJoints;
+    h.servoPeriodNs = servoPeriod;
+    h.trajPeriodNs = trajPeriod;
+    h.timeNs = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    h.motionState = st->motion_state;
+    for (int j = 0; j < numJoints && j < EMCMOT_MAX_JOINTS; j++) {
+        h.posCmd[j] = st->joint_status[j].pos_cmd;
+        if (st->joint_status[j].homed)
+            h.homedMask |= 1u << j;
+    }
+    h.homeSim = homeSimGetMode();
+    h.kinType = Kines::GetInstance().GetKineType();
+    h.kinsDigest = Kines::GetInstance().GeometryDigest();
+    h.volCompDigest = VolComp::GetInstance().Digest();
+    h.compDigest = motCompDigest();
+}
+
+//fclose() writes what is left of the buffer
+void closeRecord(FILE *f, std::vector<char> buffer, std::string summary, bool failed)
+{
+    if (fclose(f))
+        failed = true;
+    buffer.clear();
+    buffer.shrink_to_fit();
+    std::string res = "record " + std::string(failed ? "write failed, " : "") + summary;
+    EMCLog::SetLog(res, failed ? 2 : 0);
+    closing.store(false, std::memory_order_release);
+}
+
+//true while the last recording is being closed, joins a closer that is done
+bool closerBusy(const char *what)
+{
+    if (closing.load(std::memory_order_acquire)) {
+        EMCLog::SetLog(std::string(what) + ": the last recording is still being written", 1);
+        return true;
+    }
+    if (closer.joinable())
+        closer.join();
+    return false;
+}
+
+} // namespace
+
+int EMCRecord::StartRecord(const std::string &file, const emcmot_status_t *st,
+                           int numJoints, long servoPeriod, long trajPeriod)
+{
+    Header h;
+
+    if (mode.load(std::memory_order_relaxed) != kOff) {
+        EMCLog::SetLog("record: a recording or a replay is running", 1);
+        return -1;
+    }
+    if (closerBusy("record"))
+        return -1;
+    recordFile = fopen(file.c_str(), "wb");
+    if (!recordFile) {
+        EMCLog::SetLog("record: can't open " + file, 2);
+        return -1;
+    }
+    recordBuffer.resize(RECORD_BUFFER_SIZE);
+    setvbuf(recordFile, recordBuffer.data(), _IOFBF, recordBuffer.size());
+
+    fillHeader(h, st, numJoints, servoPeriod, trajPeriod);
+    if (fwrite(&h, sizeof(h), 1, recordFile) != 1) {
+        EMCLog::SetLog("record: can't write " + file, 2);
+        fclose(recordFile);
+        recordFile = nullptr;
+        return -1;
+    }
+
+    cycle = 0;
+    digest = fnvBasis;
+    commands = 0;
+    statCycles.store(0, std::memory_order_relaxed);
+    statCommands.store(0, std::memory_order_relaxed);
+    setPath(file);
+    mode.store(kRecording, std::memory_order_relaxed);
+    EMCLog::SetLog("record " + file + " started");
+    return 0;
+}
+
+void EMCRecord::Record(Lane lane, const emcmot_command_t &cmd)
+{
+    if (!recordFile)
+        return;
+
+    Entry e{cycle, lane, (uint32_t)sizeof(cmd)};
+    if (fwrite(&e, sizeof(e), 1, recordFile) != 1 ||
+        fwrite(&cmd, sizeof(cmd), 1, recordFile) != 1) {
+        EMCLog::Log(2, "record: write failed at command %llu, stopped",
+                    (unsigned long long)commands);
+        fclose(recordFile);
+        recordFile = nullptr;
+        mode.store(kOff, std::memory_order_relaxed);
+        return;
+    }
+    commands++;
+    statCommands.store(commands, std::memory_order_relaxed);
+}
+
+int EMCRecord::StopRecord()
+{
+    if (!recordFile)
+        return -1;
+
+    Entry e{cycle, kEndLane, (uint32_t)sizeof(Trailer)};
+    Trailer t{commands, digest};
+    int res = 0;
+    if (fwrite(&e, sizeof(e), 1, recordFile) != 1 ||
+        fwrite(&t, sizeof(t), 1, recordFile) != 1)
+        res = -1;
+
+    std::ostringstream ss;
+    ss << commands << " commands, " << cycle << " cycles, digest " << std::hex << digest;
+
+    //the buffer goes with the file, it must outlive the fclose()
+    if (closer.joinable())
+        closer.join();
+    closing.store(true, std::memory_order_relaxed);
+    closer = std::thread(closeRecord, recordFile, std::move(recordBuffer), ss.str(), res != 0);
+    recordFile = nullptr;
+    recordBuffer = std::vector<char>();
+    mode.store(kOff, std::memory_order_relaxed);
+    return res;
+}
+
+void EMCRecord::WaitClosed()
+{
+    if (closer.joinable())
+        closer.join();
+}
+
+bool EMCRecord::IsRecording()
+{
+    return recordFile != nullptr;
+}
+
+int EMCRecord::StartReplay(const std::string &file, const emcmot_status_t *st,
+                           int numJoints, long servoPeriod, long trajPeriod)
+{
+    if (mode.load(std::memory_order_relaxed) != kOff) {
+        EMCLog::SetLog("replay: a recording or a replay is running", 1);
+        return -1;
+    }
+    if (closerBusy("replay"))
+        return -1;
+
+    FILE *f = fopen(file.c_str(), "rb");
+    if (!f) {
+        EMCLog::SetLog("replay: can't open " + file, 2);
+        return -1;
+    }
+    std::vector<char> data;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    //the header, then whole entries up to the end entry and its trailer
+    Header h;
+    if (data.size() < sizeof(h)) {
+        EMCLog::SetLog("replay: " + file + " is not a recording", 2);
+        return -1;
+    }
+    memcpy(&h, data.data(), sizeof(h));
+    if (h.magic != kMagic || h.version != kVersion) {
+        EMCLog::SetLog("replay: " + file + " is not a recording", 2);
+        return -1;
+    }
+    if (h.commandSize != sizeof(emcmot_command_t)) {
+        EMCLog::SetLog("replay: " + file + " was recorded by another build", 2);
+        return -1;
+    }
+
+    size_t pos = sizeof(h);
+    size_t end = 0;
+    Entry e;
+    while (pos + sizeof(e) <= data.size()) {
+        memcpy(&e, data.data() + pos, sizeof(e));
+        if (e.lane == kEndLane) {
+            if (e.size == sizeof(Trailer) && pos + sizeof(e) + e.size <= data.size()) {
+                end = pos;
+                memcpy(&replayTrailer, data.data() + pos + sizeof(e), sizeof(Trailer));
+                replayCycles = e.cycle;
+            }
+            break;
+        }
+        if ((e.lane != kCmdLane && e.lane != kMillLane) || e.size != h.commandSize)
+            break;
+        pos += sizeof(e) + e.size;
+    }
+    if (!end) {
+        EMCLog::SetLog("replay: " + file + " is cut off, stop the recording first", 2);
+        return -1;
+    }
+
+    //a replay only repeats the recording from the same state
+    bool same = (int)h.numJoints == numJoints && h.servoPeriodNs == servoPeriod &&
+        h.trajPeriodNs == trajPeriod && h.motionState == (int32_t)st->motion_state;
+    for (int j = 0; same && j < numJoints && j < EMCMOT_MAX_JOINTS; j++) {
+        if (std::fabs(h.posCmd[j] - st->joint_status[j].pos_cmd) > 1e-9 ||
+            !(h.homedMask & (1u << j)) != !st->joint_status[j].homed)
+            same = false;
+    }
+    if (!same)
+        EMCLog::SetLog("replay: " + file + " was recorded from another state "
+                       "or with other periods, the digest will differ", 1);
+
+    //and with the same setup
+    std::string setup;
+    if (h.homeSim != homeSimGetMode())
+        setup += " HOME_SIM";
+    if (h.kinType != Kines::GetInstance().GetKineType() ||
+        h.kinsDigest != Kines::GetInstance().GeometryDigest())
+        setup += " kinematics";
+    if (h.volCompDigest != VolComp::GetInstance().Digest())
+        setup += " VOLCOMP";
+    if (h.compDigest != motCompDigest())
+        setup += " COMP_FILE";
+    if (!setup.empty())
+        EMCLog::SetLog("replay: " + file + " was recorded with another" + setup +
+                       ", the digest will differ", 1);
+
+    replayData.swap(data);
+    replayPos = sizeof(h);
+    replayEnd = end;
+    cycle = 0;
+    digest = fnvBasis;
+    commands = 0;
+    statCycles.store(0, std::memory_order_relaxed);
+    statCommands.store(0, std::memory_order_relaxed);
+    setPath(file);
+    mode.store(kReplaying, std::memory_order_relaxed);
+    EMCLog::SetLog("replay " + file + " started, " +
+                   std::to_string(replayTrailer.commands) + " commands, " +
+                   std::to_string(replayCycles) + " cycles");
+    replayStart = std::chrono::steady_clock::now();
+    return 0;
+}
+
+int EMCRecord::NextReplay(Lane lane, emcmot_command_t &cmd)
+{
+    Entry e;
+
+    if (replayPos >= replayEnd)
+        return 1;
+    memcpy(&e, replayData.data() + replayPos, sizeof(e));
+    if (e.cycle > cycle || (e.cycle == cycle && e.lane != lane))
+        return 1;
+
+    memcpy(&cmd, replayData.data() + replayPos + sizeof(e), sizeof(cmd));
+    replayPos += sizeof(e) + e.size;
+    //the controller only runs a number it has not echoed yet, the
+    //recorded ones may be anything by now
+    cmd.commandNum = EMCChannel::nextCommandNum();
+    commands++;
+    statCommands.store(commands, std::memory_order_relaxed);
+    return 0;
+}
+
+bool EMCRecord::ReplayDone()
+{
+    return cycle >= replayCycles && replayPos >= replayEnd;
+}
+
+void EMCRecord::StopReplay(bool finished)
+{
+    if (mode.load(std::memory_order_relaxed) != kReplaying)
+        return;
+
+    double wall = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - replayStart).count();
+    Header h;
+    memcpy(&h, replayData.data(), sizeof(h));
+
+    std::ostringstream ss;
+    ss << path << (finished ? ", " : " stopped, ") << commands << " commands, " <<
+          cycle << " cycles in " << std::fixed;
+    ss.precision(3);
+    ss << wall << " s";
+    if (wall > 0) {
+        ss.precision(0);
+        ss << ", " << cycle / wall << " cycles/s, ";
+        ss.precision(1);
+        ss << cycle * (double)h.servoPeriodNs * 1e-9 / wall << "x real time";
+    }
+    if (finished) {
+        ss << ", digest " << std::hex << digest;
+        if (digest == replayTrailer.digest)
+            ss << " matches";
+        else
+            ss << " differs from " << replayTrailer.digest;
+    }
+
+    std::string res = ss.str();
+    {
+        std::lock_guard<std::mutex> lock(statusMutex);
+        lastReplay = res;
+    }
+    EMCLog::SetLog("replay " + res, finished && digest != replayTrailer.digest ? 1 : 0);
+
+    replayData.clear();
+    replayData.shrink_to_fit();
+    replayPos = replayEnd = 0;
+    mode.store(kOff, std::memory_order_relaxed);
+}
+
+bool EMCRecord::IsReplaying()
+{
+    return mode.load(std::memory_order_relaxed) == kReplaying;
+}
+
+void EMCRecord::Cycle(const emcmot_status_t *st, int numJoints)
+{
+    if (mode.load(std::memory_order_relaxed) == kOff)
+        return;
+
+    for (int j = 0; j < numJoints && j < EMCMOT_MAX_JOINTS; j++)
+        digest = fnv(digest, &st->joint_status[j].pos_cmd, sizeof(double));
+    cycle++;
+    statCycles.store(cycle, std::memory_order_relaxed);
+}
+
+std::string EMCRecord::Status()
+{
+    int m = mode.load(std::memory_order_relaxed);
+    std::ostringstream ss;
+    std::lock_guard<std::mutex> lock(statusMutex);
+
+    ss << "Record = ";
+    if (m == kRecording)
+        ss << path << ", " << statCommands.load(std::memory_order_relaxed) <<
+              " commands, " << statCycles.load(std::memory_order_relaxed) << " cycles";
+    else
+        ss << "off";
+    ss << "\nReplay = ";
+    if (m == kReplaying)
+        ss << path << ", " << statCommands.load(std::memory_order_relaxed) <<
+              " commands, cycle " << statCycles.load(std::memory_order_relaxed);
+    else
+        ss << lastReplay;
+    return ss.str();
+}
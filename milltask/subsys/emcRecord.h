@@ -0,0 +1,98 @@
+#ifndef _EMC_RECORD_H_
+#define _EMC_RECORD_H_
+#include <string>
+#include <cstdint>
+#include "motion.h"
+
+//Records the emcmot_command_t stream MotTask hands to the motion
+//controller, from the cmd and the mill lanes, with the servo cycle
+//each command ran in, and plays a recording back into the controller
+//with nothing but the motion thread involved. A replay runs free, so
+//it is a reproducible benchmark of the planner and the controller, and
+//the digest of every cycle's joint positions tells whether a change
+//moved the path at all.
+//
+//File, native byte order, only read by the build that wrote it:
+//
+//  Header
+//  Entry + emcmot_command_t        one per command
+//  Entry with lane kEndLane        cycle = cycles recorded
+//  Trailer
+//
+//The motion thread calls everything but Status(), MotTask starts and
+//stops a recording or a replay on EMCChannel::MotCmd.
+class EMCRecord {
+public:
+    static constexpr uint32_t kMagic = 0x52434d45;     //"EMCR"
+    static constexpr uint32_t kVersion = 2;
+
+    enum Lane : uint32_t {
+        kCmdLane,
+        kMillLane,
+        kEndLane = 0xffffffff,
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t commandSize;       //sizeof(emcmot_command_t)
+        uint32_t numJoints;
+        int64_t servoPeriodNs;
+        int64_t trajPeriodNs;
+        int64_t timeNs;             //wall clock the recording started
+        int32_t motionState;        //the state a replay should start from
+        uint32_t homedMask;
+        double posCmd[EMCMOT_MAX_JOINTS];
+        //the setup that shapes the path besides the commands
+        int32_t homeSim;            //HOME_SIM_ mode
+        int32_t kinType;
+        uint64_t kinsDigest;        //Kines::GeometryDigest()
+        uint64_t volCompDigest;     //VolComp::Digest(), 0 off
+        uint64_t compDigest;        //motCompDigest()
+    };
+
+    struct Entry {
+        uint64_t cycle;             //servo cycles since the start
+        uint32_t lane;
+        uint32_t size;              //bytes following, commandSize
+    };
+
+    struct Trailer {
+        uint64_t commands;
+        uint64_t digest;            //FNV-1a of the joint pos_cmd, every cycle
+    };
+
+    //Recording. The motion thread writes into a small stdio buffer,
+    //StopRecord() hands the file to a thread of its own to close
+    static int StartRecord(const std::string &path, const emcmot_status_t *st,
+                           int numJoints, long servoPeriod, long trajPeriod);
+    static void Record(Lane lane, const emcmot_command_t &cmd);
+    static int StopRecord();
+    static bool IsRecording();
+    //Blocks until the file StopRecord() handed off is closed, any thread
+    //once the motion thread is gone
+    static void WaitClosed();
+
+    //Replay, the whole file is read before the first cycle
+    static int StartReplay(const std::string &path, const emcmot_status_t *st,
+                           int numJoints, long servoPeriod, long trajPeriod);
+    //Next command due where MotTask took it from lane, 0 when there is
+    //one. A command that is late goes wherever the replay asks next
+    static int NextReplay(Lane lane, emcmot_command_t &cmd);
+    //A replay runs as many cycles as were recorded
+    static bool ReplayDone();
+    static void StopReplay(bool finished);
+    static bool IsReplaying();
+
+    //Once per servo cycle after the controller ran, while recording or
+    //replaying
+    static void Cycle(const emcmot_status_t *st, int numJoints);
+
+    //"Record = ..." and "Replay = ..." lines for the console
+    static std::string Status();
+
+private:
+    EMCRecord() = delete;
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "emcTrace.h"
+#include "emcLog.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+
+std::atomic<bool> EMCTrace::on_{false};
+
+namespace {
+
+struct Event {
+    const char *name;
+    int64_t ts;                 //ns since Start()
+    union {
+        uint64_t id;            //flows
+        double value;           //counters
+    };
+    char phase;
+};
+
+//Only the owner thread appends, count is published after the event is
+//written so Stop() reads what is complete. A buffer is emptied by its
+//owner on the first event of a new trace
+struct Buffer {
+    std::unique_ptr<Event[]> events;
+    uint32_t capacity;
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint64_t> dropped{0};
+    const char *name = nullptr;     //under the registry mutex
+    int tid;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::string path = "cncsim-trace.json";
+    uint32_t capacity = 262144;
+    std::atomic<uint32_t> generation{0};
+    std::atomic<int64_t> origin{0};
+    std::string last = "off";
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+thread_local Buffer *threadBuffer = nullptr;
+thread_local const char *threadName = nullptr;
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Buffer *buffer()
+{
+    if (threadBuffer)
+        return threadBuffer;
+
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    auto b = std::make_unique<Buffer>();
+    b->capacity = r.capacity;
+    b->events.reset(new (std::nothrow) Event[r.capacity]);
+    if (!b->events)
+        b->capacity = 0;
+    b->name = threadName;
+    b->tid = (int)r.buffers.size() + 1;
+    r.buffers.push_back(std::move(b));
+    threadBuffer = r.buffers.back().get();
+    return threadBuffer;
+}
+
+} // namespace
+
+void EMCTrace::add(char phase, const char *name, uint64_t id, double value)
+{
+    Registry &r = registry();
+    Buffer *b = buffer();
+    uint32_t gen = r.generation.load(std::memory_order_acquire);
+
+    if (b->generation.load(std::memory_order_relaxed) != gen) {
+        b->count.store(0, std::memory_order_relaxed);
+        b->dropped.store(0, std::memory_order_relaxed);
+        b->generation.store(gen, std::memory_order_release);
+    }
+    uint32_t n = b->count.load(std::memory_order_relaxed);
+    if (n >= b->capacity) {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event &e = b->events[n];
+    e.name = name;
+    e.ts = nowNs() - r.origin.load(std::memory_order_relaxed);
+    if (phase == 'C')
+        e.value = value;
+    else
+        e.id = id;
+    e.phase = phase;
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+void EMCTrace::SetFile(const std::string &path)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.path = path;
+}
+
+void EMCTrace::SetCapacity(uint32_t events)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    if (events > 0)
+        r.capacity = events;
+}
+
+void EMCTrace::ThreadName(const char *name)
+{
+    threadName = name;
+    if (threadBuffer) {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        threadBuffer->name = name;
+    }
+}
+
+int EMCTrace::Start()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    if (on_.load(std::memory_order_relaxed))
+        return -1;
+    //a new generation empties every buffer on its next event
+    r.origin.store(nowNs(), std::memory_order_relaxed);
+    r.generation.fetch_add(1, std::memory_order_release);
+    on_.store(true, std::memory_order_release);
+    return 0;
+}
+
+int EMCTrace::Stop(std::string &res)
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    if (!on_.load(std::memory_order_relaxed)) {
+        res = "Trace not running";
+        return -1;
+    }
+    on_.store(false, std::memory_order_relaxed);
+
+    FILE *fp = fopen(r.path.c_str(), "w");
+    if (!fp) {
+        res = "Trace can't write " + r.path;
+        r.last = res;
+        EMCLog::SetLog(res, 2);
+        return -1;
+    }
+    std::vector<char> out(1 << 20);
+    setvbuf(fp, out.data(), _IOFBF, out.size());
+
+    const uint32_t gen = r.generation.load(std::memory_order_relaxed);
+    const int pid = (int)getpid();
+    uint64_t events = 0, dropped = 0;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CNCSim\"}}",
+            pid);
+    for (auto &b : r.buffers) {
+        if (b->name)
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", pid, b->tid, b->name);
+        if (b->generation.load(std::memory_order_acquire) != gen)
+            continue;
+        uint32_t n = b->count.load(std::memory_order_acquire);
+        dropped += b->dropped.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; i++) {
+            const Event &e = b->events[i];
+            //Chrome traces count in us
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03d,\"pid\":%d,\"tid\":%d",
+                    e.name, e.phase, (long long)(e.ts / 1000), (int)(e.ts % 1000), pid, b->tid);
+            switch (e.phase) {
+            case 'C':
+                fprintf(fp, ",\"args\":{\"value\":%.17g}}", e.value);
+                break;
+            case 's':
+            case 't':
+                fprintf(fp, ",\"cat\":\"flow\",\"id\":%llu}", (unsigned long long)e.id);
+                break;
+            case 'f':
+                //to the slice it is in, not the next one
+                fprintf(fp, ",\"cat\":\"flow\",\"id\":%llu,\"bp\":\"e\"}",
+                        (unsigned long long)e.id);
+                break;
+            default:
+                fputc('}', fp);
+                break;
+            }
+        }
+        events += n;
+    }
+    fprintf(fp, "\n]}\n");
+
+    bool failed = ferror(fp) != 0;
+    if (fclose(fp) || failed) {
+        res = "Trace write failed " + r.path;
+        r.last = res;
+        EMCLog::SetLog(res, 2);
+        return -1;
+    }
+
+    std::ostringstream ss;
+    ss << r.path << ", " << events << " events";
+    if (dropped)
+        ss << ", " << dropped << " dropped, raise [EMC]TRACE_EVENTS";
+    r.last = ss.str();
+    res = "Trace " + r.last;
+    EMCLog::SetLog(res);
+    return 0;
+}
+
+std::string EMCTrace::Status()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::ostringstream ss;
+
+    if (!on_.load(std::memory_order_relaxed)) {
+        ss << "Trace = " << r.last;
+        return ss.str();
+    }
+    const uint32_t gen = r.generation.load(std::memory_order_relaxed);
+    uint64_t events = 0, dropped = 0;
+    for (auto &b : r.buffers) {
+        if (b->generation.load(std::memory_order_acquire) != gen)
+            continue;
+        events += b->count.load(std::memory_order_relaxed);
+        dropped += b->dropped.load(std::memory_order_relaxed);
+    }
+    ss << "Trace = on, " << events << " events, " << dropped << " dropped\n";
+    ss << "File = " << r.path;
+    return ss.str();
+}
@@ -0,0 +1,96 @@
+#ifndef _EMC_TRACE_H_
+#define _EMC_TRACE_H_
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+//Trace events of the threads, written as a Chrome trace JSON file that
+//Perfetto (ui.perfetto.dev) and chrome://tracing load. TRACE START on
+//the console starts it, TRACE STOP writes [EMC]TRACE_FILE.
+//
+//Every thread appends to a buffer of its own, TRACE_EVENTS events,
+//taken the first time the thread traces something. A full buffer drops
+//what comes after, TRACE shows how many. While tracing is off a call
+//is one relaxed load.
+//
+//    EMCTrace::Scope scope("controller");     //begin here, end at the }
+//    EMCTrace::Count("tcqlen", tcqlen);
+//
+//An NC line is followed as a flow with its line number as the id: it
+//starts where the interpreter executed the line, steps where the move
+//was posted to the mill lane and ends in the servo cycle that took it
+//into the planner. A line run again by a loop or a subroutine shares
+//the id with its first run.
+//
+//Names are kept as pointers until the file is written, use literals.
+class EMCTrace {
+public:
+    static bool On() {
+        return on_.load(std::memory_order_relaxed);
+    }
+
+    //[EMC]TRACE_FILE and TRACE_EVENTS, before the threads trace
+    static void SetFile(const std::string &path);
+    static void SetCapacity(uint32_t events);
+
+    static int Start();
+    //Writes the file, res is the console answer
+    static int Stop(std::string &res);
+    //"Trace = ..." for the console
+    static std::string Status();
+
+    //The name of the calling thread in the trace
+    static void ThreadName(const char *name);
+
+    static void Begin(const char *name) {
+        if (On())
+            add('B', name, 0);
+    }
+    static void End(const char *name) {
+        if (On())
+            add('E', name, 0);
+    }
+    static void Count(const char *name, double value) {
+        if (On())
+            add('C', name, 0, value);
+    }
+    static void FlowStart(const char *name, uint64_t id) {
+        if (On())
+            add('s', name, id);
+    }
+    static void FlowStep(const char *name, uint64_t id) {
+        if (On())
+            add('t', name, id);
+    }
+    static void FlowEnd(const char *name, uint64_t id) {
+        if (On())
+            add('f', name, id);
+    }
+
+    //Begin and end of a block. A scope that began before Start() is
+    //not in the trace, one that ends after Stop() stays open there
+    class Scope {
+    public:
+        explicit Scope(const char *name) : name_(On() ? name : nullptr) {
+            if (name_)
+                add('B', name_, 0);
+        }
+        ~Scope() {
+            if (name_)
+                add('E', name_, 0);
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        const char *name_;
+    };
+
+private:
+    static void add(char phase, const char *name, uint64_t id, double value = 0.0);
+    static std::atomic<bool> on_;
+
+    EMCTrace() = delete;
+};
+
+#endif
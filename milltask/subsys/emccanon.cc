@@ -27,7 +27,9 @@
   -------------------
   The interpreter does not subtract off tool length offsets. It calls
   USE_TOOL_LENGTH_OFFSETS(length), which we record here and apply to
-  all appropriate values subsequently.
+  all appropriate values subsequently. The five axis kinematics apply
+  the length of the tool in the spindle themselves, with those the Z
+  of the offset is dropped here.
 
   NURBS
   -----
@@ -63,6 +65,7 @@
 #include <rtapi_string.h>
 #include "modal_state.hh"
 #include "tooldata.hh"
+#include "kines/kineIf.h"	// AppliesToolLength()
 #include <algorithm>
 
 //#define EMCCANON_DEBUG
@@ -2839,6 +2842,13 @@ void USE_TOOL_LENGTH_OFFSET(const EmcPose& offset)
     canon.toolOffset.v = FROM_PROG_LEN(offset.v);
     canon.toolOffset.w = FROM_PROG_LEN(offset.w);
 
+    /* the tool kinematics already add the length of the tool in the
+       spindle along its axis (M6), adding it again along Z here would
+       count it twice */
+    if (Kines::GetInstance().AppliesToolLength()) {
+        canon.toolOffset.tran.z = 0.0;
+    }
+
     /* append it to interp list so it gets updated at the right time, not at
        read-ahead time */
     set_offset_msg->offset.tran.x = TO_EXT_LEN(canon.toolOffset.tran.x);
@@ -1,12 +1,14 @@
 #include "cmdtask.h"
 #include <chrono>
 #include <iostream>
+#include <iterator>
 #include <libintl.h>
 #include <rtapi_string.h>
 #include "emcLog.h"
 #include "Version.h"
 #include "emcParas.h"
 #include "emcChannel.h"
+#include "motionTask.h"
 #include "iomanip"
 
 CmdTask::CmdTask() : running(false) {
@@ -24,13 +26,14 @@ void CmdTask::doWork() {
     running = true;
     workerThread = std::thread([this]() {
         EMCLog::SetLog("CmdTask start work");
+        EMCTrace::ThreadName("CmdTask");
 
         while (running) {
             // Process work
             process();
 
-            // Small delay to prevent busy waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // Sleep until the next command, stopWork() wakes us as well
+            cmdQueue.wait();
         }
 
         // Notify that we're finished
@@ -44,7 +47,7 @@ void CmdTask::stopWork() {
     if (!running) return;
 
     running = false;
-    cv.notify_all(); // Notify any waiting threads
+    cmdQueue.wake(); // Release the worker waiting for a command
 
     if (workerThread.joinable()) {
         workerThread.join();
@@ -55,14 +58,26 @@ void CmdTask::process() {
 
     // Emit result through callback
 
-    while (!cmdQueue.empty()) {
-        auto cmdStr = cmdQueue.pop();
-
-        if (cmdStr != "") {
-            ExecuteCommand(cmdStr);
+    std::vector<std::string> batch;
+    while (cmdQueue.drain(std::back_inserter(batch), kCmdQueueSize)) {
+        for (const auto &cmdStr : batch) {
+            if (cmdStr != "") {
+                ExecuteCommand(cmdStr);
+            }
         }
+        batch.clear();
     }
 
+    std::unique_ptr<Script> script;
+    {
+        std::lock_guard<std::mutex> lock(mutex_script);
+        script = std::move(pendingScript_);
+        if (script)
+            scriptBusy_ = true;
+    }
+    if (script)
+        ExecuteScript(*script);
+
     if (resultCallback) {
         std::string result;
         resultCallback(result);
@@ -207,6 +222,19 @@ std::string getModesDetialStr(struct state_tag_t &tag)
 }
 
 #include "motionhalctrl.h"
+#include "kines/kineIf.h"
+#include "kines/kineVolComp.h"
+#include "motionProfile.h"
+#include "motionHomeSim.h"
+#include "motionComp.h"
+#include "motionTelemetry.h"
+#include "telemtask.h"
+#include "emcRecord.h"
+#include "emcMetrics.h"
+#include "emcTrace.h"
+#include "motionStatus.h"
+#include <fstream>
+#include <cstring>
 
 void CmdTask::init()
 {
@@ -223,7 +251,55 @@ void CmdTask::init()
             ss << "Set KineType";
         }
         else {
-            ss << "Wrong KIN";
+            return Fail("Wrong KIN");
+        }
+
+        return ss.str();
+
+        });
+
+    RegisterCommand("KINGEO", [this](const std::vector<std::string>& args) -> std::string {
+        return Kines::GetInstance().showGeometry();
+        });
+
+    RegisterCommand("VOLCOMP", [this](const std::vector<std::string>& args) -> std::string {
+        // VOLCOMP [0|1|BENCH [samples]], the map itself comes from [KINS]VOLCOMP_FILE
+        if (args.size() >= 1 && args[0] == "BENCH") {
+            int samples = args.size() >= 2 ? std::stoi(args[1]) : 1000000;
+            double ns = VolComp::GetInstance().Bench(samples);
+            if (ns < 0)
+                return Fail("Wrong VOLCOMP BENCH");
+            std::stringstream ss;
+            ss << "Lookup = " << ns << " ns";
+            return ss.str();
+        }
+        if (args.size() >= 1) {
+            if (args[0] != "0" && args[0] != "1")
+                return Fail("Wrong VOLCOMP");
+            // switching steps every joint by the map error, only at rest
+            MOT_STATUS_FAST st;
+            if (motStatusReadFast(&st) != 0 || st.tcqlen != 0 || st.jogging_active ||
+                !(st.motionFlag & EMCMOT_MOTION_INPOS_BIT))
+                return Fail("VOLCOMP needs the machine in position");
+            VolComp::GetInstance().SetEnable(args[0] == "1");
+        }
+        return VolComp::GetInstance().showVolComp();
+        });
+
+    RegisterCommand("INTERP", [this](const std::vector<std::string>& args) -> std::string {
+        std::stringstream ss;
+        if (args.size() == 0) {
+            ss << "InterpMode = " << MotionTask::getInterpMode();
+        }
+        else if (args.size() == 1) {
+            int mode = std::stoi(args[0]);
+            if (MotionTask::setInterpMode(mode))
+                return Fail("Wrong INTERP mode, 0:cubic 1:quintic");
+            else
+                ss << "Set InterpMode";
+        }
+        else {
+            return Fail("Wrong INTERP");
         }
 
         return ss.str();
@@ -247,7 +323,7 @@ void CmdTask::init()
             vel = std::stof(args[2]);
         }
         else {
-            return "wrong";
+            return Fail("wrong");
         }
 
         EMCChannel::emcMotJogInc(joint, axis, vel, offset);
@@ -272,7 +348,7 @@ void CmdTask::init()
             vel = std::stof(args[2]);
         }
         else {
-            return "wrong";
+            return Fail("wrong");
         }
 
         EMCChannel::emcMotJogAbs(joint, axis, vel, offset);
@@ -297,7 +373,7 @@ void CmdTask::init()
             vel = std::stof(args[2]);
         }
         else {
-            return "wrong";
+            return Fail("wrong");
         }
 
         EMCChannel::emcMotJogInc(joint, axis, vel, offset);
@@ -322,7 +398,7 @@ void CmdTask::init()
             vel = std::stof(args[2]);
         }
         else {
-            return "wrong";
+            return Fail("wrong");
         }
 
         EMCChannel::emcMotJogAbs(joint, axis, vel, offset);
@@ -355,9 +431,15 @@ void CmdTask::init()
         });
 
     RegisterCommand("MOTSTS", [this](const std::vector<std::string>& args) -> std::string {
+        // MOTSTS reads the published snapshots, the motion status
+        // itself is being written by the motion thread
         std::stringstream ss;
         std::string motionStateStr;
-        switch (emcmotStatus->motion_state) {
+        MOT_STATUS_FAST st;
+        MOT_STATUS_SLOW slow;
+        if (motStatusReadFast(&st) != 0 || motStatusReadSlow(&slow) != 0)
+            return Fail("MOTSTS busy, try again");
+        switch (st.motion_state) {
         case EMCMOT_MOTION_DISABLED:
             motionStateStr = "EMCMOT_MOTION_DISABLED";
             break;
@@ -376,30 +458,33 @@ void CmdTask::init()
         }
 
         std::string motionStsStr = "MotionSts:";
-        if (emcmotStatus->motionFlag & EMCMOT_MOTION_ENABLE_BIT)
+        if (st.motionFlag & EMCMOT_MOTION_ENABLE_BIT)
             motionStsStr += " enable ";
-        if (emcmotStatus->motionFlag & EMCMOT_MOTION_INPOS_BIT)
+        if (st.motionFlag & EMCMOT_MOTION_INPOS_BIT)
             motionStsStr += " inpos ";
-        if (emcmotStatus->motionFlag & EMCMOT_MOTION_COORD_BIT)
+        if (st.motionFlag & EMCMOT_MOTION_COORD_BIT)
             motionStsStr += " coord ";
-        if (emcmotStatus->motionFlag & EMCMOT_MOTION_ERROR_BIT)
+        if (st.motionFlag & EMCMOT_MOTION_ERROR_BIT)
             motionStsStr += " error ";
-        if (emcmotStatus->motionFlag & EMCMOT_MOTION_TELEOP_BIT)
+        if (st.motionFlag & EMCMOT_MOTION_TELEOP_BIT)
             motionStsStr += " teleop ";
 
         std::string softLimitStr;
-        if (emcmotStatus->on_soft_limit)
+        if (st.on_soft_limit)
             softLimitStr = "on_soft_limit";
         else
             softLimitStr = "no_soft_limit";
 
 
         ss << "emcmot_status_t\n" <<
-              "feed_scale " << emcmotStatus->feed_scale << "\n" <<
-              "rapid_scale " << emcmotStatus->rapid_scale << "\n" <<
+              "feed_scale " << st.feed_scale << "\n" <<
+              "rapid_scale " << st.rapid_scale << "\n" <<
               "motion_state " << motionStateStr << "\n" <<
               "motionFlag " << motionStsStr << "\n" <<
-              "soft_limit " << softLimitStr;
+              "soft_limit " << softLimitStr << "\n" <<
+              "homed";
+        for (int joint = 0; joint < st.numJoints; joint++)
+            ss << " " << slow.homed[joint];
 
 
         return ss.str();
@@ -410,7 +495,8 @@ void CmdTask::init()
         std::string res;
         std::stringstream ss;
 
-        EMCChannel::emitMillCmd(EMCChannel::kMillAuto);
+        if (0 != EMCChannel::emitMillCmd(EMCChannel::kMillAuto))
+            return Fail("RUN failed, mill cmd queue full");
 
         return res;
         });
@@ -500,6 +586,34 @@ void CmdTask::init()
         return res;
         });
 
+    RegisterCommand("SERVO", [this](const std::vector<std::string>& args) -> std::string {
+        // SERVO joint, SERVO CLEAR resets the max ferror and saturation counts
+        if (args.size() == 1 && args[0] == "CLEAR") {
+            MotHalCtrl::clear_servo_stats();
+            return "Servo stats cleared";
+        }
+        if (args.size() == 1) {
+            return MotHalCtrl::show_servo(std::stoi(args[0]));
+        }
+        return Fail("Wrong SERVO");
+        });
+
+    RegisterCommand("MOTPROF", [this](const std::vector<std::string>& args) -> std::string {
+        // MOTPROF shows the controller stage timing, MOTPROF CLEAR|ON|OFF
+        if (args.empty()) {
+            return motProfReport();
+        }
+        if (args.size() == 1 && args[0] == "CLEAR") {
+            motProfReset();
+            return "Motion profile cleared";
+        }
+        if (args.size() == 1 && (args[0] == "ON" || args[0] == "OFF")) {
+            motProfSetEnable(args[0] == "ON");
+            return "Motion profile " + args[0];
+        }
+        return Fail("Wrong MOTPROF");
+        });
+
     RegisterCommand("AXIS", [this](const std::vector<std::string>& args) -> std::string {
         std::string res;
         std::stringstream ss;
@@ -509,11 +623,96 @@ void CmdTask::init()
             return res;
         });
 
+    RegisterCommand("COMP", [this](const std::vector<std::string>& args) -> std::string {
+        // COMP n shows the joint comp table and lookups, COMP CLEAR
+        if (args.size() == 1 && args[0] == "CLEAR") {
+            motCompClearStats();
+            return "Comp stats cleared";
+        }
+        if (args.size() != 1)
+            return Fail("Wrong COMP");
+        int joint = std::stoi(args[0]);
+        if (joint < 0 || joint >= EMCMOT_MAX_JOINTS)
+            return Fail("Wrong COMP");
+        MOT_COMP_STATS stats;
+        motCompGetStats(joint, &stats);
+        std::stringstream ss;
+        ss << "Entries = " << stats.entries <<
+              "\nJerk = " << stats.jerk <<
+              "\nLookups = " << stats.lookups <<
+              "\nNeighbour = " << stats.neighbour <<
+              "\nSearches = " << stats.searches;
+        return ss.str();
+        });
+
+    RegisterCommand("QUEUES", [this](const std::vector<std::string>& args) -> std::string {
+        // QUEUES shows depth, high water mark and drops of the cmd queues
+        size_t logHigh;
+        unsigned long logDropped;
+        EMCLog::GetStats(logHigh, logDropped);
+        std::stringstream ss;
+        ss << "Cmd " << cmdQueue.size() << "/" << cmdQueue.capacity() <<
+              " high " << cmdQueue.high_water() <<
+              " dropped " << cmdQueue.dropped() << std::endl;
+        ss << EMCChannel::showQueues() << std::endl;
+        ss << "Log high " << logHigh << " dropped " << logDropped;
+        return ss.str();
+        });
+
+    RegisterCommand("LOG", [this](const std::vector<std::string>& args) -> std::string {
+        // LOG shows the rate limits, LOG RATE level n sets one,
+        // LOG DECODE turns the [EMC]LOG_BINARY file into text
+        static const char *names[EMCLog::kLevels] = {"Log", "Warning", "Error", "Cmd"};
+        std::stringstream ss;
+        std::string path = EMCLog::BinaryPath();
+        if (args.size() == 0) {
+            for (int level = 0; level < EMCLog::kRateLevels; level++) {
+                ss << names[level] << " rate " << EMCLog::GetRateLimit(level) <<
+                      "/s suppressed " << EMCLog::GetSuppressed(level) << std::endl;
+            }
+            ss << "Binary " << (path.empty() ? "off" : path);
+        }
+        else if (args.size() == 3 && args[0] == "RATE") {
+            int level = std::stoi(args[1]);
+            int rate = std::stoi(args[2]);
+            if (rate < 0 || EMCLog::SetRateLimit(level, rate))
+                return Fail("Wrong LOG RATE, level 0..1 and lines per second");
+            else
+                ss << "Set " << names[level] << " rate " << rate << "/s";
+        }
+        else if (args.size() == 1 && args[0] == "DECODE") {
+            if (path.empty())
+                return Fail("No [EMC]LOG_BINARY");
+            std::string text = path + ".txt";
+            FILE *fp = fopen(text.c_str(), "w");
+            if (!fp)
+                return Fail("Can't write " + text);
+            int records = EMCLog::DecodeBinary(path.c_str(), fp);
+            fclose(fp);
+            if (records < 0)
+                return Fail("Bad log file " + path);
+            else
+                ss << "Decoded " << records << " records to " << text;
+        }
+        else {
+            return Fail("Wrong LOG");
+        }
+        return ss.str();
+        });
+
     RegisterCommand("SPINDLE", [this](const std::vector<std::string>& args) -> std::string {
+        // SPINDLE n, SPINDLE CLEAR resets the at-speed wait and index counts
         std::string res;
         std::stringstream ss;
+        if (args.size() == 1 && args[0] == "CLEAR") {
+            MotHalCtrl::clear_spindle_stats();
+            return "Spindle stats cleared";
+        }
         if (args.size() == 1) {
            res = EMCParas::showSpindle(std::stoi(args[0]));
+           std::string model = MotHalCtrl::show_spindle(std::stoi(args[0]));
+           if (!model.empty())
+               res += "\n" + model;
         }
         return res;
         });
@@ -666,18 +865,152 @@ void CmdTask::init()
         return res;
         });
 
+    RegisterCommand("HOMESIM", [this](const std::vector<std::string>& args) -> std::string {
+        // HOMESIM shows the simulated homing mode and counts,
+        // HOMESIM OFF|STEP|WARP|VIRTUAL|CLEAR
+        if (args.size() == 1 && args[0] == "CLEAR") {
+            homeSimClearStats();
+            return "Home sim stats cleared";
+        }
+        if (args.size() == 1) {
+            if (0 != homeSimSetMode(homeSimModeFromName(args[0].c_str())))
+                return Fail("Wrong HOMESIM");
+            return "Home sim " + args[0] + ", used from the next home";
+        }
+        HOME_SIM_STATS stats;
+        homeSimGetStats(&stats);
+        std::stringstream ss;
+        ss << "HomeSim = " << homeSimModeName(homeSimGetMode()) <<
+              "\nCycles = " << stats.cycles <<
+              "\nWarps = " << stats.warps <<
+              "\nWarpedCycles = " << stats.warpedCycles <<
+              "\nVirtualHomes = " << stats.virtualHomes;
+        return ss.str();
+        });
+
+    RegisterCommand("TELEMETRY", [this](const std::vector<std::string>& args) -> std::string {
+        // TELEMETRY shows the [EMCMOT]TELEMETRY ring, reads its newest
+        // sample back through the reader API and shows the socket stream
+        const char *name;
+        int slots;
+        unsigned long long published;
+        if (motTelemInfo(&name, &slots, &published))
+            return "Telemetry off, set [EMCMOT]TELEMETRY";
+        std::stringstream ss;
+        ss << "Telemetry = " << (name[0] ? name : "(private)") <<
+              "\nSlots = " << slots << " x " << sizeof(mot_telem_sample_t) << " bytes" <<
+              "\nPublished = " << published;
+        mot_telem_reader_t reader;
+        mot_telem_sample_t sample;
+        if (motTelemAttachLocal(&reader) == 0) {
+            if (motTelemLatest(&reader, &sample) == 0)
+                ss << "\nLatest cycle = " << sample.cycle <<
+                      " line " << sample.line <<
+                      " vel " << sample.current_vel;
+            motTelemDetach(&reader);
+        }
+        ss << "\n" << TelemTask::showStats();
+        return ss.str();
+        });
+
+    RegisterCommand("RECORD", [this](const std::vector<std::string>& args) -> std::string {
+        // RECORD START writes every command the motion controller gets
+        // to [EMCMOT]RECORD_FILE, RECORD STOP closes it, RECORD shows it
+        if (args.size() == 0)
+            return EMCRecord::Status();
+        if (args.size() == 1 && args[0] == "START") {
+            if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotRecord))
+                return Fail("RECORD failed, mot cmd queue full");
+            return "Record " + EMCParas::periodconfig.record_file;
+        }
+        if (args.size() == 1 && args[0] == "STOP") {
+            if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotRecordStop))
+                return Fail("RECORD failed, mot cmd queue full");
+            return "Record stop";
+        }
+        return Fail("Wrong RECORD, START or STOP");
+        });
+
+    RegisterCommand("REPLAY", [this](const std::vector<std::string>& args) -> std::string {
+        // REPLAY feeds [EMCMOT]RECORD_FILE to the motion controller as
+        // fast as it runs, REPLAY STOP ends it, the result is logged and
+        // shown by RECORD
+        if (args.size() == 0) {
+            if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotReplay))
+                return Fail("REPLAY failed, mot cmd queue full");
+            return "Replay " + EMCParas::periodconfig.record_file;
+        }
+        if (args.size() == 1 && args[0] == "STOP") {
+            if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotReplayStop))
+                return Fail("REPLAY failed, mot cmd queue full");
+            return "Replay stop";
+        }
+        return Fail("Wrong REPLAY");
+        });
+
+    RegisterCommand("STATS", [this](const std::vector<std::string>& args) -> std::string {
+        // STATS shows the metrics, counters with their rate since the
+        // last STATS, STATS PROM the Prometheus text [EMC]METRICS_FILE has
+        if (args.size() == 0)
+            return EMCMetrics::Report();
+        if (args.size() == 1 && args[0] == "PROM")
+            return EMCMetrics::Prometheus();
+        return Fail("Wrong STATS");
+        });
+
+    RegisterCommand("TRACE", [this](const std::vector<std::string>& args) -> std::string {
+        // TRACE START records the thread activity, TRACE STOP writes it
+        // to [EMC]TRACE_FILE for ui.perfetto.dev, TRACE shows it
+        if (args.size() == 0)
+            return EMCTrace::Status();
+        if (args.size() == 1 && args[0] == "START") {
+            if (EMCTrace::Start())
+                return Fail("Trace already running");
+            return "Trace start";
+        }
+        if (args.size() == 1 && args[0] == "STOP") {
+            std::string res;
+            if (EMCTrace::Stop(res))
+                return Fail(res);
+            return res;
+        }
+        return Fail("Wrong TRACE, START or STOP");
+        });
+
+    RegisterCommand("SCRIPT", [this](const std::vector<std::string>& args) -> std::string {
+        // SCRIPT shows the running or the last script, SCRIPT STOP stops
+        // it, scripts are started through IMillTaskInterface::runScript()
+        if (args.size() == 0)
+            return ScriptStatusText();
+        if (args.size() == 1 && args[0] == "STOP") {
+            if (!scriptBusy_)
+                return Fail("No script running");
+            scriptStop_ = true;
+            return "Script stop";
+        }
+        return Fail("Wrong SCRIPT");
+        });
+
     RegisterCommand("RST", [this](const std::vector<std::string>& args) -> std::string {
         std::string res;
         std::stringstream ss;
 
-        EMCChannel::emitMillCmd(EMCChannel::kMillRest);
-        EMCChannel::emitMotCmd(EMCChannel::kMotRest);
+        if (0 != EMCChannel::emitMillCmd(EMCChannel::kMillRest))
+            return Fail("RST failed, mill cmd queue full");
+        if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotRest))
+            return Fail("RST failed, mot cmd queue full");
 
         return res;
         });
 
 }
 
+std::string CmdTask::Fail(const std::string &reason)
+{
+    cmdFailed_ = true;
+    return reason;
+}
+
 void CmdTask::RegisterCommand(const std::string &name, CommandFunc func)
 {
     std::lock_guard<std::mutex> lock(mutex_reg);
@@ -705,6 +1038,13 @@ std::pair<std::string, std::vector<std::string>> CmdTask::ParseCommand(std::stri
 }
 
 
+static EMCMetrics::Counter &consoleCommands =
+    EMCMetrics::GetCounter("cncsim_console_commands_total{source=\"console\"}",
+                           "console commands run");
+static EMCMetrics::Counter &scriptCommands =
+    EMCMetrics::GetCounter("cncsim_console_commands_total{source=\"script\"}",
+                           "console commands run");
+
 std::string CmdTask::ExecuteCommand(const std::string &rawCmd)
 {
     typedef std::unordered_map<std::string, std::function<std::string(const std::vector<std::string>&)>> CommandTable;
@@ -716,10 +1056,13 @@ std::string CmdTask::ExecuteCommand(const std::string &rawCmd)
     std::string result{"Cmd Not Found!"};
 
     EMCLog::SetLog("Do Cmd: " + cmd);
+    consoleCommands.Add();
+    EMCTrace::Scope scope("command");
 
     // 执行注册函数
     CommandTable::const_iterator it = _commandTable.find(cmd);//Best match
     if (it != _commandTable.end()) {
+        cmdFailed_ = false;
         result = it->second(args);  // 调用注册的函数
     }
 
@@ -732,5 +1075,414 @@ std::string CmdTask::ExecuteCommand(const std::string &rawCmd)
 void CmdTask::SetCmd(const std::string &str)
 {
     std::lock_guard<std::mutex> lock(mutex_cmd);
-    cmdQueue.push(str);
+    if (!cmdQueue.try_push(str))
+        EMCLog::SetLog("Cmd queue full, dropped: " + str, 1);
+}
+
+/*
+  RunScript()
+
+  A script is a text file of console commands, one per line, compiled
+  once before it runs: upper cased like the console, split, and looked
+  up, so running a step is a call of its handler. An unknown command or
+  a bad wait fails the whole file with its line. # starts a comment.
+  Besides the commands:
+
+  UNTIL <var> <op> <value> [TIMEOUT <s>]
+                                wait for the motion status, var is
+                                TCQLEN, LINE, ID, STATE or JOGGING, op
+                                == != < <= > >=, UNTIL TCQLEN==0 works
+                                as well
+  UNTIL LINE <n>                the program reached line n
+  UNTIL INPOS                   in position
+  UNTIL IDLE                    planner empty and in position
+  SLEEP <s>
+
+  The commands between two waits go out back to back, nothing waits for
+  the motion thread to take them. A wait first lets two servo cycles
+  pass, by then the controller has run every command posted before it.
+  A wait that times out, default 60 s, stops the script. A command that
+  fails, its handler returned Fail() or threw, is recorded and the
+  script goes on. Console commands typed meanwhile run during every
+  wait and after every SCRIPT_PENDING_STEPS commands, so SCRIPT STOP
+  stops even a long run of commands within that many steps.
+  Commands of a script are not logged one by one, the script logs a
+  summary when it ends.
+*/
+
+#define SCRIPT_TIMEOUT 60.0     //default UNTIL timeout, s
+#define SCRIPT_POLL_MS 1        //UNTIL polls the status this often
+#define SCRIPT_PENDING_STEPS 64 //console commands run between this many steps
+
+static const char scriptMagic[8] = {'C', 'M', 'D', 'R', 'E', 'S', 0, 1};
+
+int CmdTask::RunScript(const std::string &path, const std::string &resultPath,
+                       std::string &err)
+{
+    std::ifstream ifs(path);
+    if (!ifs) {
+        err = "can't open " + path;
+        return -1;
+    }
+
+    std::unique_ptr<Script> script = std::make_unique<Script>();
+    script->path = path;
+    script->resultPath = resultPath;
+    if (CompileScript(ifs, *script, err)) {
+        err = path + ":" + err;
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_script);
+        if (pendingScript_ || scriptBusy_) {
+            err = "a script is running";
+            return -1;
+        }
+        pendingScript_ = std::move(script);
+    }
+    cmdQueue.wake();
+    return 0;
+}
+
+int CmdTask::CompileScript(std::istream &in, Script &script, std::string &err)
+{
+    std::string text;
+    uint32_t line = 0;
+
+    while (std::getline(in, text)) {
+        line++;
+        size_t hash = text.find('#');
+        if (hash != std::string::npos)
+            text.resize(hash);
+
+        std::pair<std::string, std::vector<std::string>> parsed = ParseCommand(text);
+        if (parsed.first.empty())
+            continue;
+
+        ScriptStep step;
+        step.line = line;
+        if (parsed.first == "UNTIL") {
+            step.kind = ScriptStep::kUntil;
+            if (CompileUntil(parsed.second, step)) {
+                err = std::to_string(line) + ": wrong UNTIL";
+                return -1;
+            }
+        }
+        else if (parsed.first == "SLEEP") {
+            step.kind = ScriptStep::kSleep;
+            char *end = nullptr;
+            if (parsed.second.size() == 1)
+                step.value = strtod(parsed.second[0].c_str(), &end);
+            if (!end || *end || step.value < 0) {
+                err = std::to_string(line) + ": wrong SLEEP";
+                return -1;
+            }
+        }
+        else {
+            auto it = _commandTable.find(parsed.first);
+            if (it == _commandTable.end()) {
+                err = std::to_string(line) + ": unknown command " + parsed.first;
+                return -1;
+            }
+            step.func = &it->second;
+            step.args = std::move(parsed.second);
+        }
+        script.steps.push_back(std::move(step));
+    }
+    return 0;
+}
+
+int CmdTask::CompileUntil(const std::vector<std::string> &args, ScriptStep &step)
+{
+    static const struct {
+        const char *name;
+        ScriptStep::Var var;
+    } vars[] = {
+        {"TCQLEN", ScriptStep::kTcqLen},
+        {"LINE", ScriptStep::kLine},
+        {"ID", ScriptStep::kId},
+        {"STATE", ScriptStep::kState},
+        {"JOGGING", ScriptStep::kJogging},
+        {"INPOS", ScriptStep::kInpos},
+        {"IDLE", ScriptStep::kIdle},
+    };
+    static const struct {
+        const char *text;
+        ScriptStep::Op op;
+    } ops[] = {
+        {"==", ScriptStep::kEq}, {"!=", ScriptStep::kNe},
+        {"<=", ScriptStep::kLe}, {">=", ScriptStep::kGe},
+        {"<", ScriptStep::kLt}, {">", ScriptStep::kGt},
+        {"=", ScriptStep::kEq},
+    };
+
+    //the condition may be split by blanks or not, TIMEOUT ends it
+    std::string cond;
+    size_t n = 0;
+    step.timeout = SCRIPT_TIMEOUT;
+    for (; n < args.size() && args[n] != "TIMEOUT"; n++)
+        cond += args[n];
+    if (n < args.size()) {
+        char *end = nullptr;
+        if (n + 2 != args.size())
+            return -1;
+        step.timeout = strtod(args[n + 1].c_str(), &end);
+        if (*end || step.timeout <= 0)
+            return -1;
+    }
+
+    size_t nameLen = 0;
+    for (const auto &v : vars) {
+        size_t len = strlen(v.name);
+        if (cond.compare(0, len, v.name) == 0 && len > nameLen) {
+            step.var = v.var;
+            nameLen = len;
+        }
+    }
+    if (!nameLen)
+        return -1;
+    std::string rest = cond.substr(nameLen);
+
+    if (step.var == ScriptStep::kInpos || step.var == ScriptStep::kIdle) {
+        step.op = ScriptStep::kEq;
+        step.value = 1;
+        return rest.empty() ? 0 : -1;
+    }
+
+    //LINE n is LINE >= n, the others need an op
+    step.op = ScriptStep::kGe;
+    bool hasOp = false;
+    for (const auto &o : ops) {
+        size_t len = strlen(o.text);
+        if (rest.compare(0, len, o.text) == 0) {
+            step.op = o.op;
+            rest.erase(0, len);
+            hasOp = true;
+            break;
+        }
+    }
+    if (!hasOp && step.var != ScriptStep::kLine)
+        return -1;
+
+    char *end = nullptr;
+    step.value = strtod(rest.c_str(), &end);
+    if (rest.empty() || *end)
+        return -1;
+    return 0;
+}
+
+void CmdTask::ExecutePending()
+{
+    if (cmdQueue.empty())
+        return;
+
+    std::vector<std::string> batch;
+    cmdQueue.drain(std::back_inserter(batch), kCmdQueueSize);
+    for (const auto &cmdStr : batch) {
+        if (cmdStr != "")
+            ExecuteCommand(cmdStr);
+    }
+}
+
+CmdTask::ScriptStatus CmdTask::RunStep(const ScriptStep &step, std::string &text)
+{
+    switch (step.kind) {
+    case ScriptStep::kCommand:
+        cmdFailed_ = false;
+        try {
+            text = (*step.func)(step.args);
+        }
+        catch (const std::exception &e) {
+            text = e.what();
+            return kScriptFailed;
+        }
+        return cmdFailed_ ? kScriptFailed : kScriptOk;
+
+    case ScriptStep::kUntil: {
+        auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration<double>(step.timeout);
+        auto holds = [&step](const MOT_STATUS_FAST &st) {
+            bool inpos = st.motionFlag & EMCMOT_MOTION_INPOS_BIT;
+            double v = 0;
+            switch (step.var) {
+            case ScriptStep::kTcqLen: v = st.tcqlen; break;
+            case ScriptStep::kLine: v = st.tag.fields[GM_FIELD_LINE_NUMBER]; break;
+            case ScriptStep::kId: v = st.id; break;
+            case ScriptStep::kState: v = st.motion_state; break;
+            case ScriptStep::kJogging: v = st.jogging_active; break;
+            case ScriptStep::kInpos: v = inpos; break;
+            case ScriptStep::kIdle: v = st.tcqlen == 0 && inpos; break;
+            }
+            switch (step.op) {
+            case ScriptStep::kEq: return v == step.value;
+            case ScriptStep::kNe: return v != step.value;
+            case ScriptStep::kLt: return v < step.value;
+            case ScriptStep::kLe: return v <= step.value;
+            case ScriptStep::kGt: return v > step.value;
+            case ScriptStep::kGe: return v >= step.value;
+            }
+            return false;
+        };
+        MOT_STATUS_FAST st;
+        unsigned long start = 0;
+        bool started = false;
+        for (;;) {
+            if (!running || scriptStop_)
+                return kScriptStopped;
+            if (motStatusReadFast(&st) == 0) {
+                if (!started) {
+                    start = st.heartbeat;
+                    started = true;
+                }
+                if (st.heartbeat - start >= 2 && holds(st))
+                    return kScriptOk;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                text = "timeout";
+                return kScriptTimeout;
+            }
+            ExecutePending();
+            std::this_thread::sleep_for(std::chrono::milliseconds(SCRIPT_POLL_MS));
+        }
+    }
+
+    case ScriptStep::kSleep: {
+        auto until = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(step.value));
+        while (std::chrono::steady_clock::now() < until) {
+            if (!running || scriptStop_)
+                return kScriptStopped;
+            ExecutePending();
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                until - std::chrono::steady_clock::now(), std::chrono::milliseconds(10)));
+        }
+        return kScriptOk;
+    }
+    }
+    return kScriptFailed;
+}
+
+void CmdTask::ExecuteScript(Script &script)
+{
+    EMCTrace::Scope scope("script");
+    FILE *res = nullptr;
+    std::vector<char> resBuffer;
+    unsigned long failed = 0;
+    unsigned long commands = 0;
+    ScriptStatus last = kScriptOk;
+    std::string text;
+
+    if (!script.resultPath.empty()) {
+        res = fopen(script.resultPath.c_str(), "wb");
+        if (!res) {
+            EMCLog::SetLog("script: can't write " + script.resultPath, 2);
+        }
+        else {
+            resBuffer.resize(1 << 20);
+            setvbuf(res, resBuffer.data(), _IOFBF, resBuffer.size());
+            ScriptFileHeader hdr = {};
+            memcpy(hdr.magic, scriptMagic, sizeof(hdr.magic));
+            hdr.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            hdr.steps = script.steps.size();
+            fwrite(&hdr, sizeof(hdr), 1, res);
+        }
+    }
+
+    scriptPath_ = script.path;
+    scriptStop_ = false;
+    scriptStep_ = 0;
+    scriptSteps_ = script.steps.size();
+    scriptStart_ = std::chrono::steady_clock::now();
+    EMCLog::SetLog("script " + script.path + " started, " +
+                   std::to_string(script.steps.size()) + " steps");
+
+    for (size_t n = 0; n < script.steps.size(); n++) {
+        const ScriptStep &step = script.steps[n];
+        if (!running || scriptStop_) {
+            last = kScriptStopped;
+            EMCLog::SetLog("script " + script.path + ":" + std::to_string(step.line) +
+                           " stopped", 1);
+            break;
+        }
+        scriptStep_.store(n + 1, std::memory_order_relaxed);
+        auto t0 = std::chrono::steady_clock::now();
+
+        text.clear();
+        {
+            EMCTrace::Scope stepScope(step.kind == ScriptStep::kCommand ?
+                                      "script step" : "script wait");
+            last = RunStep(step, text);
+        }
+        if (step.kind == ScriptStep::kCommand) {
+            commands++;
+            scriptCommands.Add();
+        }
+        if (last == kScriptFailed)
+            failed++;
+
+        if (res) {
+            auto t1 = std::chrono::steady_clock::now();
+            ScriptRecord rec = {};
+            rec.line = step.line;
+            rec.kind = step.kind;
+            rec.status = last;
+            rec.startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                t0 - scriptStart_).count();
+            rec.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                t1 - t0).count();
+            rec.textLen = text.size();
+            fwrite(&rec, sizeof(rec), 1, res);
+            fwrite(text.data(), 1, text.size(), res);
+        }
+
+        if (last == kScriptTimeout || last == kScriptStopped) {
+            EMCLog::SetLog("script " + script.path + ":" + std::to_string(step.line) +
+                           (last == kScriptTimeout ? " UNTIL timed out" : " stopped"), 1);
+            break;
+        }
+        if (step.kind != ScriptStep::kCommand || commands % SCRIPT_PENDING_STEPS == 0)
+            ExecutePending();
+    }
+
+    if (res && fclose(res))
+        EMCLog::SetLog("script: write " + script.resultPath + " failed", 2);
+
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - scriptStart_).count();
+    std::stringstream ss;
+    ss << script.path << ", " << scriptStep_ << "/" << scriptSteps_ << " steps, " <<
+          commands << " commands, " << failed << " failed, " <<
+          std::fixed << std::setprecision(3) << elapsed << " s";
+    if (elapsed > 0)
+        ss << ", " << std::setprecision(0) << commands / elapsed << " commands/s";
+    if (last == kScriptTimeout)
+        ss << ", timed out";
+    else if (last == kScriptStopped)
+        ss << ", stopped";
+    {
+        std::lock_guard<std::mutex> lock(mutex_script);
+        scriptResult_ = ss.str();
+        scriptBusy_ = false;
+    }
+    EMCLog::SetLog("script " + ss.str(), failed || last != kScriptOk ? 1 : 0);
+}
+
+std::string CmdTask::ScriptStatusText()
+{
+    std::stringstream ss;
+    ss << "Script = ";
+    if (scriptBusy_) {
+        double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - scriptStart_).count();
+        ss << scriptPath_ << ", step " << scriptStep_ << "/" << scriptSteps_ <<
+              ", " << std::fixed << std::setprecision(3) << elapsed << " s";
+    }
+    else {
+        std::lock_guard<std::mutex> lock(mutex_script);
+        ss << scriptResult_;
+    }
+    return ss.str();
 }
@@ -7,12 +7,43 @@
 #include <condition_variable>
 #include <string>
 #include <functional>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstdint>
 #include "emcMsgQueue.h"
 
 //This should be asis worker, and can manage the simultion task
 class CmdTask {
 public:
     using CommandFunc = std::function<std::string(const std::vector<std::string>&)>;
+
+    //SCRIPT result file, native byte order: ScriptFileHeader, then a
+    //ScriptRecord and its textLen bytes of text for every step run
+    struct ScriptFileHeader {
+        char magic[8];          //"CMDRES\0\1"
+        int64_t timeNs;         //wall clock the script started
+        uint32_t steps;         //steps in the script
+        uint32_t reserved;
+    };
+
+    enum ScriptStatus : uint16_t {
+        kScriptOk,
+        kScriptFailed,          //the command failed or threw, text is the reason
+        kScriptTimeout,         //an UNTIL timed out, the script stopped
+        kScriptStopped,         //SCRIPT STOP or the task stopped
+    };
+
+    struct ScriptRecord {
+        uint32_t line;          //line in the script
+        uint16_t kind;          //0 command, 1 UNTIL, 2 SLEEP
+        uint16_t status;        //ScriptStatus
+        int64_t startNs;        //since the script started
+        int64_t durationNs;
+        uint32_t textLen;       //the command result
+        uint32_t reserved;
+    };
+
     CmdTask();
     ~CmdTask();
 
@@ -32,7 +63,16 @@ public:
 
     void SetCmd(const std::string &str);
 
+    //Compile a file of console commands and run it on the worker
+    //thread, see the syntax at its definition. resultPath, if not
+    //empty, gets the ScriptRecords. Errors in the file are reported
+    //here, with their line, and nothing is run
+    int RunScript(const std::string &path, const std::string &resultPath,
+                  std::string &err);
+
 private:
+    friend struct CmdTaskTest;  //tests/testScript.cpp
+
     void init(); // Once prepaing main process function
     void process();  // Main processing function
 
@@ -41,7 +81,6 @@ private:
     std::mutex mutex;
     std::mutex mutex_reg;
     std::mutex mutex_cmd;
-    std::condition_variable cv;
 
     // Callbacks to replace Qt signals
     std::function<void(const std::string&)> resultCallback;
@@ -50,11 +89,77 @@ private:
     std::unordered_map<std::string, CommandFunc> _commandTable;
     std::pair<std::string, std::vector<std::string>> ParseCommand(std::string s);
 
-    MessageQueue <std::string> cmdQueue;
+    //Mutex fed: SetCmd() runs on any thread and pushes under mutex_cmd,
+    //which is what makes it the one producer the Spsc queue needs. The
+    //worker thread is the only consumer
+    static constexpr size_t kCmdQueueSize = 1024;
+    BoundedQueue <std::string, QueueSync::Spsc> cmdQueue{kCmdQueueSize};
     MessageQueue <std::string> resQueue;
 
     void RegisterCommand(const std::string& name, CommandFunc func);
     std::string ExecuteCommand(const std::string &rawCmd);
+    //A handler returns Fail(reason) when the command did not do what it
+    //was asked, a script records the step as failed
+    std::string Fail(const std::string &reason);
+    bool cmdFailed_ = false;    //worker thread, set by Fail()
+
+    //A script is compiled once: commands resolved to their handler with
+    //their args split, waits to a condition on the motion status
+    struct ScriptStep {
+        enum Kind : uint16_t {
+            kCommand,
+            kUntil,
+            kSleep,
+        };
+        enum Var : uint8_t {
+            kTcqLen,
+            kLine,
+            kId,
+            kState,
+            kJogging,
+            kInpos,
+            kIdle,
+        };
+        enum Op : uint8_t {
+            kEq,
+            kNe,
+            kLt,
+            kLe,
+            kGt,
+            kGe,
+        };
+        Kind kind = kCommand;
+        Var var = kTcqLen;
+        Op op = kEq;
+        uint32_t line = 0;
+        double value = 0.0;     //UNTIL operand, SLEEP seconds
+        double timeout = 0.0;   //UNTIL seconds
+        const CommandFunc *func = nullptr;
+        std::vector<std::string> args;
+    };
+
+    struct Script {
+        std::string path;
+        std::string resultPath;
+        std::vector<ScriptStep> steps;
+    };
+
+    int CompileScript(std::istream &in, Script &script, std::string &err);
+    static int CompileUntil(const std::vector<std::string> &args, ScriptStep &step);
+    void ExecuteScript(Script &script);
+    ScriptStatus RunStep(const ScriptStep &step, std::string &text);
+    void ExecutePending();      //console commands that came meanwhile
+    std::string ScriptStatusText();
+
+    std::mutex mutex_script;
+    std::unique_ptr<Script> pendingScript_;
+    std::atomic<bool> scriptBusy_{false};
+    std::atomic<bool> scriptStop_{false};
+    std::atomic<uint32_t> scriptStep_{0};
+    std::atomic<uint32_t> scriptSteps_{0};
+    std::string scriptPath_;    //worker thread
+    std::string scriptResult_{"off"};   //mutex_script
+    std::chrono::steady_clock::time_point scriptStart_;
 };
 
 #endif // _CMD_TASK_
@@ -20,6 +20,27 @@
 
 #include "emcLog.h"
 #include "emcChannel.h"
+#include "emcMetrics.h"
+#include "emcTrace.h"
+#include <chrono>
+
+//NC lines through the interpreter, every reader of a file counts
+static EMCMetrics::Counter &interpLines =
+    EMCMetrics::GetCounter("cncsim_interp_lines_total", "NC lines the interpreter executed");
+static EMCMetrics::Histogram &interpLineTime =
+    EMCMetrics::GetHistogram("cncsim_interp_line_seconds",
+                             "time to read and execute one NC line",
+                             {1e-6, 4e-6, 16e-6, 64e-6, 256e-6, 1e-3, 4e-3, 16e-3});
+
+//Counts the line read and executed since start, returns the start of
+//the next one
+static std::chrono::steady_clock::time_point lineDone(std::chrono::steady_clock::time_point start)
+{
+    auto now = std::chrono::steady_clock::now();
+    interpLines.Add();
+    interpLineTime.Observe(std::chrono::duration<double>(now - start).count());
+    return now;
+}
 
 EMCTask::EMCTask(std::string iniFileName)
     :emcFileName_(iniFileName)
@@ -66,6 +87,7 @@ EMCTask::EMCTask(std::string iniFileName)
 
 int EMCTask::load_file(std::string filename, std::vector<IMillTaskInterface::ToolPath>* toolPath, std::string &err)
 {
+    EMCTrace::Scope scope("preview");
     if (!pinterp)//Wrong
         return 1;
 
@@ -89,8 +111,10 @@ int EMCTask::load_file(std::string filename, std::vector<IMillTaskInterface::Too
     int code = 0;
     char errText[256];
     memset(errText, 0, 256);
+    auto lineStart = std::chrono::steady_clock::now();
     while (!pinterp->read()) {
         code = pinterp->execute();
+        lineStart = lineDone(lineStart);
         if (code > INTERP_ENDFILE) {
             std::ostringstream oss;
             oss << std::fixed << std::setprecision(6); // 保证6位小数且非科学计数法
@@ -189,8 +213,15 @@ int EMCTask::load_file(std::string filename, std::string &err)
     int code = 0;
     char errText[256];
     memset(errText, 0, 256);
+    auto lineStart = std::chrono::steady_clock::now();
     while (!pinterp->read()) {
-        code = pinterp->execute();
+        {
+            //the flow of the line starts in its slice, see EMCTrace
+            EMCTrace::Scope scope("execute");
+            code = pinterp->execute();
+            EMCTrace::FlowStart("nc line", (uint32_t)pinterp->sequence_number());
+        }
+        lineStart = lineDone(lineStart);
         if (code > INTERP_ENDFILE) {
             std::ostringstream oss;
             oss << std::fixed << std::setprecision(6); // 保证6位小数且非科学计数法
@@ -211,12 +242,181 @@ int EMCTask::load_file(std::string filename, std::string &err)
     emitAllCmd();
 
     EMCChannel::millMotFileName = filename + ".ngc";
-    EMCChannel::emitMotCmd(EMCChannel::kMotStart);
+    if (0 != EMCChannel::emitMotCmd(EMCChannel::kMotStart)) {
+        err = "mot cmd queue full, file not started";
+        return -1;
+    }
 
     return 0;
 }
 
 #include "motionTask.h"
+#include "kines/kineIf.h"
+#include "kines/kinePathCheck.h"
+int EMCTask::check_file(std::string filename, std::string &res, std::string &err)
+{
+    EMCTrace::Scope scope("check_file");
+    if (!pinterp)//Wrong
+        return 1;
+
+    pinterp->reset();
+    pinterp->close();
+
+    if (interp_list.len() > 0) {
+        //Clear the useless msg first
+        interp_list.clear();
+        return 2;
+    }
+
+    if (pinterp->open(filename.c_str())) {
+        EMCLog::SetLog(filename + " Wrong file");
+        return 3;
+    }
+
+    //the program starts where the machine is now, with its tool
+    PathCheck::Program program;
+    IMillTaskInterface::ToolPath pos = MotionTask::getCarteCmdPos();
+    program.start.tran.x = pos.x;
+    program.start.tran.y = pos.y;
+    program.start.tran.z = pos.z;
+    program.start.a = pos.a;
+    program.start.b = pos.b;
+    program.start.c = pos.c;
+    program.start.u = pos.u;
+    program.start.v = pos.v;
+    program.start.w = pos.w;
+    program.tools = toolLengths();
+    int tool = Kines::GetInstance().GetActiveTool();
+    int prepped = 0;
+
+    //moves are taken off the list after every line, the list never
+    //holds more than one line's messages
+    auto take = [&]() {
+        while (interp_list.len() > 0) {
+            auto msg = interp_list.get();
+            if (msg->_type == EMC_TRAJ_LINEAR_MOVE_TYPE) {
+                auto lmmsg = (EMC_TRAJ_LINEAR_MOVE*)msg.get();
+                PathCheck::Segment seg;
+                seg.end = lmmsg->end;
+                seg.line = lmmsg->tag.get_state_tag().fields[GM_FIELD_LINE_NUMBER];
+                seg.arc = -1;
+                seg.tool = tool;
+                program.segments.push_back(seg);
+            }
+            else if (msg->_type == EMC_TRAJ_CIRCULAR_MOVE_TYPE) {
+                auto cmmsg = (EMC_TRAJ_CIRCULAR_MOVE*)msg.get();
+                PathCheck::Arc arc;
+                arc.center.x = cmmsg->center.x;
+                arc.center.y = cmmsg->center.y;
+                arc.center.z = cmmsg->center.z;
+                arc.normal.x = cmmsg->normal.x;
+                arc.normal.y = cmmsg->normal.y;
+                arc.normal.z = cmmsg->normal.z;
+                arc.turn = cmmsg->turn;
+                PathCheck::Segment seg;
+                seg.end = cmmsg->end;
+                seg.line = cmmsg->tag.get_state_tag().fields[GM_FIELD_LINE_NUMBER];
+                seg.arc = (int)program.arcs.size();
+                seg.tool = tool;
+                program.arcs.push_back(arc);
+                program.segments.push_back(seg);
+            }
+            //a rigid tap goes down to pos and back out to where it
+            //started, the message carries no tag
+            else if (msg->_type == EMC_TRAJ_RIGID_TAP_TYPE) {
+                auto rtmsg = (EMC_TRAJ_RIGID_TAP*)msg.get();
+                PathCheck::Segment seg;
+                seg.end = rtmsg->pos;
+                seg.line = interp_list.get_line_number();
+                seg.arc = -1;
+                seg.tool = tool;
+                PathCheck::Segment back = seg;
+                back.end = program.segments.empty() ? program.start :
+                                                      program.segments.back().end;
+                program.segments.push_back(seg);
+                program.segments.push_back(back);
+            }
+            //a probe is checked over its whole travel, it may not trip
+            else if (msg->_type == EMC_TRAJ_PROBE_TYPE) {
+                auto prmsg = (EMC_TRAJ_PROBE*)msg.get();
+                PathCheck::Segment seg;
+                seg.end = prmsg->pos;
+                seg.line = interp_list.get_line_number();
+                seg.arc = -1;
+                seg.tool = tool;
+                program.segments.push_back(seg);
+            }
+            //T and M6, the same way run_file hands them to motion
+            else if (msg->_type == EMC_TOOL_PREPARE_TYPE) {
+                prepped = ((EMC_TOOL_PREPARE*)msg.get())->tool;
+            }
+            else if (msg->_type == EMC_TOOL_LOAD_TYPE) {
+                tool = prepped;
+            }
+        }
+    };
+
+    int code = 0;
+    char errText[256];
+    memset(errText, 0, 256);
+    auto lineStart = std::chrono::steady_clock::now();
+    while (!pinterp->read()) {
+        code = pinterp->execute();
+        lineStart = lineDone(lineStart);
+        if (code > INTERP_ENDFILE) {
+            std::ostringstream oss;
+            oss << "file:" << pinterp->file_name(errText, 256);
+            oss << " line:" << pinterp->line() << " " << pinterp->line_text(errText, 256);
+            oss << " err:" << pinterp->error_text(code, errText, 256);
+            err = oss.str();
+            EMCLog::SetLog(err);
+            interp_list.clear();
+            return 4;
+        }
+        take();
+    }
+    take();
+
+    PathCheck::Limits limits;
+    limits.joints = std::min(EMCParas::GetTrajConfig()->Joints, EMCMOT_MAX_JOINTS);
+    for (int joint = 0; joint < limits.joints; joint++) {
+        limits.jointMin[joint] = EMCParas::jointconfig[joint].joint_min_limit;
+        limits.jointMax[joint] = EMCParas::jointconfig[joint].joint_max_limit;
+    }
+    limits.axisMask = EMCParas::GetTrajConfig()->AxisMask & 0x1ff;
+    for (int axis = 0; axis < 9; axis++) {
+        limits.axisMin[axis] = EMCParas::axisconfig[axis].axis_min_limit;
+        limits.axisMax[axis] = EMCParas::axisconfig[axis].axis_max_limit;
+    }
+
+    PathCheck::Report report = PathCheck::Run(program, limits, PathCheck::Options());
+    res = PathCheck::ToText(report);
+    EMCLog::SetLog(filename + " " + res, report.first.found ? 2 : 0);
+
+    return report.first.found ? 6 : 0;
+}
+
+std::map<int, double> EMCTask::toolLengths()
+{
+    std::map<int, double> lengths;
+    CANON_TOOL_TABLE tdata;
+
+    for (int idx = 0; idx < CANON_POCKETS_MAX; idx++) {
+        if (tooldata_get(&tdata, idx) != IDX_OK)
+            continue;
+        if (tdata.toolno <= 0)
+            continue;
+        lengths[tdata.toolno] = tdata.offset.tran.z;
+    }
+
+    return lengths;
+}
+
+void EMCTask::publishToolTable()
+{
+    Kines::GetInstance().SetToolTable(toolLengths());
+}
+
 void EMCTask::init_all()
 {
     //init milltask moudle
@@ -257,6 +457,7 @@ void EMCTask::init_all()
     if (0 != tooldata_load(tooltable_filename)) {
         printf("can't load tool table.\n");
     }
+    publishToolTable();
 
     if (random_toolchanger) {
         CANON_TOOL_TABLE tdata;
@@ -895,10 +1096,12 @@ int EMCTask::emcTaskIssueTrajCmd(NMLmsg *cmd)
     case EMC_TOOL_PREPARE_TYPE:
 //    tool_prepare_msg = (EMC_TOOL_PREPARE *) cmd;
 //    retval = emcToolPrepare(tool_prepare_msg->tool);
+    tool_prepped = ((EMC_TOOL_PREPARE *) cmd)->tool;
     break;
 
     case EMC_TOOL_LOAD_TYPE:
 //    retval = emcToolLoad();
+    retval = EMCChannel::emcMotToolChange(tool_prepped);
     break;
 
     case EMC_TOOL_UNLOAD_TYPE:
@@ -908,6 +1111,11 @@ int EMCTask::emcTaskIssueTrajCmd(NMLmsg *cmd)
     case EMC_TOOL_LOAD_TOOL_TABLE_TYPE:
 //    load_tool_table_msg = (EMC_TOOL_LOAD_TOOL_TABLE *) cmd;
 //    retval = emcToolLoadToolTable(load_tool_table_msg->file);
+    {
+        const char *file = ((EMC_TOOL_LOAD_TOOL_TABLE *) cmd)->file;
+        retval = tooldata_load(file[0] ? file : tooltable_filename);
+        publishToolTable();
+    }
     break;
 
     case EMC_TOOL_SET_OFFSET_TYPE:
@@ -1266,9 +1474,16 @@ int EMCTask::emcTaskIssueTrajCmd(NMLmsg *cmd)
 
 void EMCTask::emitAllCmd()
 {
+    EMCTrace::Scope scope("emitAllCmd");
     while (interp_list.len() > 0) {
         auto cmd = interp_list.get();
+        EMCTrace::Scope issue("issue");
         emcTaskIssueTrajCmd(cmd.get());
+        //a move carries the line number in its tag to the motion thread
+        if (EMCTrace::On() && (cmd->_type == EMC_TRAJ_LINEAR_MOVE_TYPE ||
+                               cmd->_type == EMC_TRAJ_CIRCULAR_MOVE_TYPE))
+            EMCTrace::FlowStep("nc line",
+                (uint32_t)EMCChannel::localEmcTrajTag.fields[GM_FIELD_LINE_NUMBER]);
     }
 }
 
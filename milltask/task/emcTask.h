@@ -11,6 +11,7 @@
 #include "motion.h"
 #include "motion_struct.h"      /* emcmot_struct_t */
 #include <deque>
+#include <map>
 
 //This is a nc simulation interface
 class EMCTask {
@@ -26,10 +27,13 @@ public:
     int random_toolchanger {0};
     const char *tooltable_filename {};
     int tool_status;
+    int tool_prepped {0};     // T word, loaded by the next M6
 
     int load_file(std::string filename, std::vector<IMillTaskInterface::ToolPath>* toolPath, std::string &err);
     int load_file(std::string filename, std::string &err);
     int simulate(std::string filename, std::string &res, std::string &err);
+    //interpret the file and check the swept path against the soft limits
+    int check_file(std::string filename, std::string &res, std::string &err);
     void init_all(void);
     InterpBase *pinterp=0;
 
@@ -62,6 +66,11 @@ private:
 
     void emitAllCmd();
 
+    //Tool lengths of the loaded tool table by tool number
+    std::map<int, double> toolLengths();
+    //Publish tool lengths of the loaded tool table to the kinematics
+    void publishToolTable();
+
 };
 
 
@@ -5,6 +5,7 @@
 #include "emcglb.h"
 #include <rtapi_string.h>
 #include "emcLog.h"
+#include "emcTrace.h"
 
 
 MillTask::MillTask(const char* emcFile) : running(false) {
@@ -23,13 +24,17 @@ void MillTask::doWork() {
     running = true;
     EMCLog::SetLog("MillTask start work");
     workerThread = std::thread([this]() {
+        EMCTrace::ThreadName("MillTask");
 
         while (running) {
             // Process work
             process();
 
-            // Small delay to prevent busy waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // Sleep until the next command, unless a state has work left
+            // or stopWork() wakes us
+            if (state_ == kIDLE || state_ == kHandle || state_ == kMDI) {
+                EMCChannel::waitMillCmd();
+            }
         }
 
         // Notify that we're finished
@@ -43,7 +48,7 @@ void MillTask::stopWork() {
     if (!running) return;
 
     running = false;
-    cv.notify_all(); // Notify any waiting threads
+    EMCChannel::wakeMillCmd(); // Release the worker waiting for a command
 
     if (workerThread.joinable()) {
         workerThread.join();
@@ -119,6 +124,11 @@ int MillTask::load_file(std::string filename, std::vector<IMillTaskInterface::To
     return retval;
 }
 
+int MillTask::check_file(std::string filename, std::string &res, std::string &err)
+{
+    return taskMethods->check_file(filename, res, err);
+}
+
 void MillTask::init()
 {
     taskMethods = new EMCTask(emcFile_);
@@ -37,6 +37,9 @@ public:
     //load the file and get the previe date
     int load_file(std::string filename, std::vector<IMillTaskInterface::ToolPath>* toolPath, std::string &err);
 
+    //check the swept path of the file against the soft limits
+    int check_file(std::string filename, std::string &res, std::string &err);
+
     void active_gcodes(int active_gcodes[ACTIVE_G_CODES]) {
         return taskMethods->pinterp->active_g_codes(active_gcodes);
     }
@@ -56,7 +59,6 @@ private:
     std::thread workerThread;
     std::atomic<bool> running{false};
     std::mutex mutex;
-    std::condition_variable cv;
 
     // Callbacks to replace Qt signals
     std::function<void(const std::string&)> resultCallback;
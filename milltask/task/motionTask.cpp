@@ -11,26 +11,74 @@
 #include "tp.h"
 #include "motion.h"
 #include "mot_priv.h"
+#include "kines/kineInterp.h"
+#include "motionStatus.h"
+#include "motionHomeSim.h"
+#include "motionTelemetry.h"
+#include "emcLog.h"
+#include "emcMetrics.h"
+#include <string.h>
+#include <errno.h>
+#include <mutex>
 
 
 extern int rtapi_app_main_kines(void);
 extern int rtapi_app_main_motion(void);
+extern void emcmotSetPeriods(long servo_nsec, long traj_nsec);
+
+//Periods come from [EMCMOT], see EMCParas::loadEmcmot()
+static long servo_period = 1000000;
+static long traj_period = 1000000;
 void MotionTask::InitMotion()
 {
+    servo_period = EMCParas::periodconfig.servo_period_nsec;
+    traj_period = EMCParas::periodconfig.traj_period_nsec;
+    emcmotSetPeriods(servo_period, traj_period);
 //    rtapi_app_main_kines();
     rtapi_app_main_motion();
+    homeSimSetMode(EMCParas::periodconfig.home_sim);
+    //TELEMETRY_SOCKET alone reads a ring nobody else sees
+    const EMCParas::MotPeriodConfig &cfg = EMCParas::periodconfig;
+    if (!cfg.telemetry.empty() || !cfg.telemetry_socket.empty()) {
+        const char *name = cfg.telemetry.empty() ? NULL : cfg.telemetry.c_str();
+        if (motTelemOpen(name, cfg.telemetry_slots, servo_period))
+            EMCLog::Log(1, "can't open [EMCMOT]TELEMETRY %s: %s",
+                        name ? name : "(private)", strerror(errno));
+        else if (name)
+            EMCLog::Log(0, "telemetry %s", name);
+    }
 }
 
-static long servo_period = 1000000;
 extern void emcmotCommandHandler(void *arg, long servo_period);
 void MotionTask::CmdHandler()
 {
     emcmotCommandHandler(NULL, servo_period);
 }
 
-void MotionTask::MotionCtrl()
+//One servo cycle. The joint interpolator and the servo models run
+//every cycle, the planner only when the interpolator has used up its
+//segment, that is once every getTrajRatio() cycles in coord mode.
+//Returns true on the cycles the planner ran.
+bool MotionTask::MotionCtrl()
 {
+    bool trajTick = jointInterpNeedNextPoint(&jointInterp);
     emcmotController(NULL, servo_period);
+    return trajTick;
+}
+
+long MotionTask::getServoPeriod()
+{
+    return servo_period;
+}
+
+long MotionTask::getTrajPeriod()
+{
+    return traj_period;
+}
+
+int MotionTask::getTrajRatio()
+{
+    return (int)(traj_period / servo_period);
 }
 
 //These struct is crated by motion module, and these
@@ -43,63 +91,128 @@ extern struct emcmot_status_t *emcmotStatus;
 extern struct emcmot_config_t *emcmotConfig;
 extern struct emcmot_internal_t *emcmotInternal;
 extern struct emcmot_error_t *emcmotError;	/* unused for RT_FIFO */
+//The getters run on other threads, they read the snapshot published
+//at the end of every controller cycle, see motionStatus.h. A read that
+//loses every retry to the writer returns the last good copy this
+//thread saw, zeros only before the first one
+static MOT_STATUS_FAST fastStatus()
+{
+    thread_local MOT_STATUS_FAST last = {};
+    MOT_STATUS_FAST fast;
+    if (0 != motStatusReadFast(&fast))
+        return last;
+    last = fast;
+    return fast;
+}
+
+//A counter must not go back. Only a read that got a snapshot moves it,
+//and a heartbeat that went back means the motion module was started
+//again, its cycles are added on top
+static double servoCycles()
+{
+    static std::mutex mutex;
+    static unsigned long last = 0;
+    static double total = 0.0;
+    MOT_STATUS_FAST fast;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (0 == motStatusReadFast(&fast)) {
+        total += fast.heartbeat >= last ? fast.heartbeat - last : fast.heartbeat;
+        last = fast.heartbeat;
+    }
+    return total;
+}
+
+//The motion thread is not touched, the metrics read the snapshot
+[[maybe_unused]] static const bool motionMetrics = [] {
+    EMCMetrics::AddCounter("cncsim_servo_cycles_total", "servo cycles run",
+                           servoCycles);
+    EMCMetrics::AddGauge("cncsim_tcq_length", "segments in the planner queue",
+                         [] { return (double)fastStatus().tcqlen; });
+    EMCMetrics::AddGauge("cncsim_tcq_full", "the planner queue is full",
+                         [] { return (double)fastStatus().queueFull; });
+    EMCMetrics::AddGauge("cncsim_current_velocity", "current velocity, units/s",
+                         [] { return fastStatus().current_vel; });
+    return true;
+}();
+
 IMillTaskInterface::ToolPath MotionTask::getCarteCmdPos()
 {
-    return {emcmotStatus->carte_pos_cmd.tran.x,
-                emcmotStatus->carte_pos_cmd.tran.y,
-                emcmotStatus->carte_pos_cmd.tran.z,
-                emcmotStatus->carte_pos_cmd.a,
-                emcmotStatus->carte_pos_cmd.b,
-                emcmotStatus->carte_pos_cmd.c,
-                emcmotStatus->carte_pos_cmd.u,
-                emcmotStatus->carte_pos_cmd.v,
-                emcmotStatus->carte_pos_cmd.w};
+    MOT_STATUS_FAST st = fastStatus();
+    return {st.carte_pos_cmd.tran.x,
+                st.carte_pos_cmd.tran.y,
+                st.carte_pos_cmd.tran.z,
+                st.carte_pos_cmd.a,
+                st.carte_pos_cmd.b,
+                st.carte_pos_cmd.c,
+                st.carte_pos_cmd.u,
+                st.carte_pos_cmd.v,
+                st.carte_pos_cmd.w};
 }
 
 void MotionTask::getFeedrateSacle(double &rapid, double &feed)
 {
-    rapid = emcmotStatus->rapid_scale;
-    feed = emcmotStatus->feed_scale;
+    MOT_STATUS_FAST st = fastStatus();
+    rapid = st.rapid_scale;
+    feed = st.feed_scale;
 }
 
 void MotionTask::getMotionState(int &state)
 {
-    state = emcmotStatus->motion_state;
+    state = fastStatus().motion_state;
 }
 
 void MotionTask::getMotionFlag(int &flag)
 {
-    flag = emcmotStatus->motionFlag;
+    flag = fastStatus().motionFlag;
 }
 
 void MotionTask::getMotCmdFb(int &cmd, int &fb)
 {
-    cmd = emcmotStatus->carte_pos_cmd_ok;
-    fb = emcmotStatus->carte_pos_fb_ok;
+    MOT_STATUS_FAST st = fastStatus();
+    cmd = st.carte_pos_cmd_ok;
+    fb = st.carte_pos_fb_ok;
 }
 
 int MotionTask::isSoftLimit()
 {
-    return emcmotStatus->on_soft_limit;
+    return fastStatus().on_soft_limit;
 }
 
 double MotionTask::getMotDtg()
 {
-    return emcmotStatus->distance_to_go;
+    return fastStatus().distance_to_go;
 }
 
 void MotionTask::getRunInfo(double &vel, double &req_vel)
 {
-    vel = emcmotStatus->current_vel;
-    req_vel = emcmotStatus->requested_vel;
+    MOT_STATUS_FAST st = fastStatus();
+    vel = st.current_vel;
+    req_vel = st.requested_vel;
 }
 
 int MotionTask::isJogging()
 {
-    return emcmotStatus->jogging_active;
+    return fastStatus().jogging_active;
 }
 
 void MotionTask::getStateTag(state_tag_t &tag)
 {
-    tag = emcmotStatus->tag;
+    tag = fastStatus().tag;
+}
+
+unsigned int MotionTask::getStatusChanges(unsigned int &gen)
+{
+    return motStatusChanges(&gen);
+}
+
+//The new mode is used from the next interpolator drain,
+//that is the next enable or coord/teleop mode switch
+int MotionTask::setInterpMode(int mode)
+{
+    return jointInterpSetMode(&jointInterp, mode);
+}
+
+int MotionTask::getInterpMode()
+{
+    return jointInterpGetMode(&jointInterp);
 }
@@ -15,7 +15,10 @@ public:
 
     static void InitMotion();
     static void CmdHandler();
-    static void MotionCtrl();
+    static bool MotionCtrl();
+    static long getServoPeriod();
+    static long getTrajPeriod();
+    static int getTrajRatio();
 
     static struct IMillTaskInterface::ToolPath getCarteCmdPos();
     static void getFeedrateSacle(double &rapid, double &feed);
@@ -27,6 +30,9 @@ public:
     static void getRunInfo(double &vel, double &req_vel);
     static int isJogging();
     static void getStateTag(state_tag_t &tag);
+    static unsigned int getStatusChanges(unsigned int &gen);
+    static int setInterpMode(int mode);
+    static int getInterpMode();
 
     MotionTask() = delete;
 };
@@ -8,6 +8,11 @@
 #include "usrmotintf.h"
 #include <array>
 #include "kines/kineIf.h"
+#include "motionTelemetry.h"
+#include "emcRecord.h"
+#include "emcMetrics.h"
+#include "emcTrace.h"
+#include "motionProfile.h"
 
 MotTask::MotTask() : running(false) {
     emcFile_ = emc_inifile;
@@ -17,6 +22,10 @@ MotTask::MotTask() : running(false) {
 
 MotTask::~MotTask() {
     stopWork(); // Ensure thread is stopped on destruction
+    EMCRecord::StopRecord();
+    EMCRecord::WaitClosed();
+    //the TelemTask reader is stopped by now, see ~MillTaskImplementation
+    motTelemClose();
 }
 
 void MotTask::doWork() {
@@ -28,13 +37,20 @@ void MotTask::doWork() {
 
 
         EMCLog::SetLog("MotTask start work");
+        EMCTrace::ThreadName("MotTask");
+        const auto period = std::chrono::nanoseconds(MotionTask::getServoPeriod());
+        auto next = std::chrono::steady_clock::now();
         while (running) {
             // Process work
             process();
 
-            // Small delay to prevent busy waiting
-            if (needWait_)
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            // Paced at the servo period, a gather runs free since its
+            // samples carry the simulated time, not the wall clock
+            next += period;
+            if (needWait_ && next > std::chrono::steady_clock::now())
+                std::this_thread::sleep_until(next);
+            else
+                next = std::chrono::steady_clock::now();
         }
 
 
@@ -58,6 +74,7 @@ void MotTask::stopWork() {
 
 #include "motionTask.h"
 #include "emcChannel.h"
+#include "emcParas.h"
 
 //These struct is crated by motion module, and these
 //point is used to drive motion module
@@ -71,6 +88,8 @@ extern struct emcmot_internal_t *emcmotInternal;
 extern struct emcmot_error_t *emcmotError;	/* unused for RT_FIFO */
 
 #include "motionhalctrl.h"
+#include "homing.h"
+#include "motionHomeSim.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -79,6 +98,135 @@ extern struct emcmot_error_t *emcmotError;	/* unused for RT_FIFO */
 #include "stashf.h"
 
 
+//Returns true when emcmotCommand is a simulator command
+bool MotTask::handleSimCmd()
+{
+    switch ((int)emcmotCommand->command) {
+    case EMCChannel::kSimToolChange:
+        toolChangePending_ = true;
+        pendingTool_ = emcmotCommand->id;
+        doToolChange();
+        return true;
+    default:
+        return false;
+    }
+}
+
+//Hands emcmotCommand to the controller, or to MotTask for a simulator
+//command
+void MotTask::runCmd()
+{
+    if (!handleSimCmd())
+        MotionTask::CmdHandler();
+}
+
+//Why a batch of mill commands ended with commands still waiting
+static EMCMetrics::Counter &admitStopPlanner =
+    EMCMetrics::GetCounter("cncsim_admit_stops_total{reason=\"planner\"}",
+                           "cycles that left mill commands waiting");
+static EMCMetrics::Counter &admitStopMax =
+    EMCMetrics::GetCounter("cncsim_admit_stops_total{reason=\"max\"}",
+                           "cycles that left mill commands waiting");
+static EMCMetrics::Counter &admitStopBudget =
+    EMCMetrics::GetCounter("cncsim_admit_stops_total{reason=\"budget\"}",
+                           "cycles that left mill commands waiting");
+static EMCMetrics::Histogram &admitBatch =
+    EMCMetrics::GetHistogram("cncsim_admit_batch", "mill commands taken in one cycle",
+                             {0, 1, 2, 4, 8, 16, 32, 64});
+
+//Takes mill commands into the controller after this cycle's controller
+//run. The planner is kept below 80% of its queue as before, a batch
+//ends at ADMIT_MAX commands or when the next one is expected to take
+//the cycle over its budget: the controller time of this cycle, the
+//time spent here and the average cost of a mill command. The cycle
+//profiler gives the controller time, with the profiler off process()
+//measures MotionCtrl() on the steady clock. The first command is
+//always taken, so the lane moves at least as fast as one per cycle.
+//
+//The cmd lane is drained before every mill command, a jog or an abort
+//posted during a batch waits for one mill command, not for the batch.
+void MotTask::admitMill()
+{
+    EMCTrace::Scope scope("admit");
+    const uint64_t start = motProfTicks();
+    EMCMetrics::Counter *stop = nullptr;
+    int n = 0;
+
+    if (--calibrate_ <= 0) {
+        //the tick rate is known better the longer the profiler runs
+        nsPerTick_ = motProfNsPerTick();
+        budgetTicks_ = nsPerTick_ > 0.0 ?
+            (uint64_t)(admitBudget_ * MotionTask::getServoPeriod() / nsPerTick_) : 0;
+        calibrate_ = 1000;
+    }
+
+    //the controller ran from motProf.start to motProf.last
+    uint64_t used = motProf.last - motProf.start;
+    if (!motProf.enable.load(std::memory_order_relaxed))
+        used = nsPerTick_ > 0.0 ? (uint64_t)(controllerNs_ / nsPerTick_) : 0;
+
+    //an M6 holds the rest of the lane back
+    while (!toolChangePending_) {
+        //tcqlen is only updated by the controller, count what is added here
+        if (emcmotStatus->tcqlen + n > 0.8 * DEFAULT_TC_QUEUE_SIZE) {
+            stop = &admitStopPlanner;
+            break;
+        }
+        if (n >= admitMax_) {
+            stop = &admitStopMax;
+            break;
+        }
+        uint64_t now = motProfTicks();
+        if (n > 0 && used + (now - start) + admitCost_ > budgetTicks_) {
+            stop = &admitStopBudget;
+            break;
+        }
+
+        while (!EMCChannel::getMotCmdFromCmd(*emcmotCommand)) {//High priority
+            EMCRecord::Record(EMCRecord::kCmdLane, *emcmotCommand);
+            runCmd();
+        }
+        if (EMCChannel::getMotCmdFromMill(*emcmotCommand))
+            break;
+        EMCRecord::Record(EMCRecord::kMillLane, *emcmotCommand);
+        runCmd();
+        //the end of the flow of the NC line, see EMCTrace
+        if (EMCTrace::On() && (emcmotCommand->command == EMCMOT_SET_LINE ||
+                               emcmotCommand->command == EMCMOT_SET_CIRCLE ||
+                               emcmotCommand->command == EMCMOT_RIGID_TAP))
+            EMCTrace::FlowEnd("nc line",
+                (uint32_t)emcmotCommand->tag.fields[GM_FIELD_LINE_NUMBER]);
+        admitCost_ += ((double)(motProfTicks() - now) - admitCost_) / 16;
+        n++;
+        if (emcmotStatus->commandStatus != EMCMOT_COMMAND_OK)
+            break;
+    }
+
+    if (stop && !EMCChannel::isMill2MotQueueEmpty())
+        stop->Add();
+    if (n || stop)
+        admitBatch.Observe(n);
+}
+
+//Like a real M6 the change waits for the queued moves to finish,
+//so the new length is used from the first move after it. The joints
+//stay where they are, the tool tip position is taken again from them
+//with the new length
+void MotTask::doToolChange()
+{
+    if (emcmotStatus->tcqlen != 0 ||
+        !(emcmotStatus->motionFlag & EMCMOT_MOTION_INPOS_BIT))
+        return;
+
+    if (Kines::GetInstance().ChangeTool(pendingTool_)) {
+        EMCLog::SetLog("M6 tool " + std::to_string(pendingTool_) +
+                       " not in tool table, length 0 used", 2);
+        Kines::GetInstance().ChangeTool(0);
+    }
+    SyncCartePosCmd();
+    toolChangePending_ = false;
+}
+
 /* copies error to s */
 int MotTask::usrmotReadEmcmotError(char *e)
 {
@@ -109,32 +257,72 @@ void MotTask::process() {
     //    counter++;
     //    std::string result = "Processed: " + std::to_string(counter);
 
+    EMCTrace::Scope scope("servo cycle");
     MotHalCtrl::emcmot_hal_update();
     MotHalCtrl::spindle_hal_update();
     MotHalCtrl::joint_hal_update();
 
 
-    while (!EMCChannel::getMotCmdFromCmd(*emcmotCommand))//High priority
-        MotionTask::CmdHandler();
+    if (motTaskSts_ == kReplay) {
+        //Only the recording drives the controller, the UI waits
+        while (!EMCChannel::getMotCmdFromCmd(*emcmotCommand))
+            replayIgnored_++;
+        while (!EMCRecord::NextReplay(EMCRecord::kCmdLane, *emcmotCommand))
+            runCmd();
+    }
+    else {
+        while (!EMCChannel::getMotCmdFromCmd(*emcmotCommand)) {//High priority
+            EMCRecord::Record(EMCRecord::kCmdLane, *emcmotCommand);
+            runCmd();
+        }
+    }
 
-    MotionTask::MotionCtrl();
+    {
+        EMCTrace::Scope controller("controller");
+        //admitMill() needs the controller time, the profiler has it
+        //when it is on
+        if (motProf.enable.load(std::memory_order_relaxed)) {
+            trajTick_ = MotionTask::MotionCtrl();
+        }
+        else {
+            auto t0 = std::chrono::steady_clock::now();
+            trajTick_ = MotionTask::MotionCtrl();
+            controllerNs_ = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - t0).count();
+        }
+    }
+    EMCRecord::Cycle(emcmotStatus, emcmotConfig->numJoints);
+    if (EMCTrace::On() && emcmotStatus->tcqlen != tracedTcqlen_) {
+        tracedTcqlen_ = emcmotStatus->tcqlen;
+        EMCTrace::Count("tcqlen", tracedTcqlen_);
+    }
 
     //if the msg send by milltask crated, msg will be get
 
-    if (emcmotStatus->tcqlen > 0.8 * DEFAULT_TC_QUEUE_SIZE) {
+    if (toolChangePending_) {
+        //Stop feeding the planner until the tool is changed
+        doToolChange();
+    }
+    else if (motTaskSts_ == kReplay) {
+        //the recording already waited for the planner, a batch may have
+        //taken cmd lane commands between its mill commands
+        while (!EMCRecord::NextReplay(EMCRecord::kMillLane, *emcmotCommand) ||
+               !EMCRecord::NextReplay(EMCRecord::kCmdLane, *emcmotCommand))
+            runCmd();
     }
     else {
-        if (!EMCChannel::getMotCmdFromMill(*emcmotCommand))//Low priority
-            MotionTask::CmdHandler();
+        admitMill();
     }
 
     execCmd();
 
     char errMsg[EMCMOT_ERROR_LEN];
 
-    // read the emcmot error
+    // read the emcmot error, Log() keeps the text without a lock or an
+    // allocation. Errors are never dropped, only levels 0..1 are rate
+    // limited
     while (!usrmotReadEmcmotError(errMsg)) {
-        EMCLog::SetLog(errMsg, 2);
+        EMCLog::Log(2, "%s", errMsg);
     }
 
     std::stringstream ss;
@@ -145,6 +333,13 @@ void MotTask::process() {
     case kIdle:
         needWait_ = true;
         if (start_) {
+            sampleTrajRate_ = EMCParas::periodconfig.sample_traj_rate;
+            //HOME_SIM VIRTUAL, home what is not homed before the run
+            if (homeSimGetMode() == HOME_SIM_VIRTUAL && !get_allhomed()) {
+                int homed = homeSimHomeAll();
+                if (homed >= 0)
+                    EMCLog::SetLog("virtual home, " + std::to_string(homed) + " joints");
+            }
             motTaskSts_ = kStart;
             start_ = false;
         }
@@ -182,24 +377,29 @@ void MotTask::process() {
         break;
     case kStartGather:
         needWait_ = false;
-        tad = Kines::GetInstance().GetTad();
-        ss << std::fixed << std::setprecision(6);
-        ss << "X " <<  emcmotStatus->joint_status[0].pos_cmd <<
-              " Y " << emcmotStatus->joint_status[1].pos_cmd <<
-              " Z " << " " << emcmotStatus->joint_status[2].pos_cmd <<
-              " A " << emcmotStatus->joint_status[3].pos_cmd <<
-              " B " << emcmotStatus->joint_status[4].pos_cmd <<
-              " C " << emcmotStatus->joint_status[5].pos_cmd <<
-              " TCP " << emcmotStatus->carte_pos_cmd.tran.x << " " <<
-                    emcmotStatus->carte_pos_cmd.tran.y << " " <<
-                    emcmotStatus->carte_pos_cmd.tran.z << " " <<
-              " TAD " << tad[0] << " " << tad[1] << " " << tad[2] <<
-              " N " << emcmotStatus->tag.fields[GM_FIELD_LINE_NUMBER] <<
-              " M " << emcmotStatus->tag.fields[GM_FIELD_MOTION_MODE] / 10 <<
-              " S " << emcmotStatus->tag.fields_float[GM_FIELD_FLOAT_SPEED] << std::endl;
-
-        ofs_ << ss.str();
-        if (emcmotStatus->tcqlen == 0)
+        //SAMPLE_RATE TRAJ keeps one sample per planner period
+        if (!sampleTrajRate_ || trajTick_) {
+            tad = Kines::GetInstance().GetTad();
+            ss << std::fixed << std::setprecision(6);
+            ss << "X " <<  emcmotStatus->joint_status[0].pos_cmd <<
+                  " Y " << emcmotStatus->joint_status[1].pos_cmd <<
+                  " Z " << " " << emcmotStatus->joint_status[2].pos_cmd <<
+                  " A " << emcmotStatus->joint_status[3].pos_cmd <<
+                  " B " << emcmotStatus->joint_status[4].pos_cmd <<
+                  " C " << emcmotStatus->joint_status[5].pos_cmd <<
+                  " TCP " << emcmotStatus->carte_pos_cmd.tran.x << " " <<
+                        emcmotStatus->carte_pos_cmd.tran.y << " " <<
+                        emcmotStatus->carte_pos_cmd.tran.z << " " <<
+                  " TAD " << tad[0] << " " << tad[1] << " " << tad[2] <<
+                  " N " << emcmotStatus->tag.fields[GM_FIELD_LINE_NUMBER] <<
+                  " M " << emcmotStatus->tag.fields[GM_FIELD_MOTION_MODE] / 10 <<
+                  " S " << emcmotStatus->tag.fields_float[GM_FIELD_FLOAT_SPEED] << std::endl;
+
+            ofs_ << ss.str();
+        }
+        //An M6 empties the planner in the middle of the program
+        if (emcmotStatus->tcqlen == 0 && !toolChangePending_ &&
+            EMCChannel::isMill2MotQueueEmpty())
             motTaskSts_ = kEndGather;
 
         if (emcmotStatus->commandStatus != EMCMOT_COMMAND_OK) {
@@ -222,6 +422,17 @@ void MotTask::process() {
             motTaskSts_ = kError;
         }
         break;
+    case kReplay:
+        //runs free, the replay reports the wall time it took
+        needWait_ = false;
+        if (EMCRecord::ReplayDone()) {
+            EMCRecord::StopReplay(true);
+            if (replayIgnored_)
+                EMCLog::SetLog(std::to_string(replayIgnored_) +
+                               " commands ignored during the replay", 1);
+            motTaskSts_ = kIdle;
+        }
+        break;
     case kError:
     default:
         EMCLog::SetLog(EMCChannel::millMotFileName + " simu error");
@@ -247,8 +458,41 @@ void MotTask::execCmd()
         break;
     case EMCChannel::kMotRest:
         start_ = false;
+        toolChangePending_ = false;
+        if (motTaskSts_ == kReplay)
+            EMCRecord::StopReplay(false);
         motTaskSts_ = kIdle;
         break;
+    case EMCChannel::kMotRecord:
+        EMCRecord::StartRecord(EMCParas::periodconfig.record_file, emcmotStatus,
+                               emcmotConfig->numJoints,
+                               MotionTask::getServoPeriod(),
+                               MotionTask::getTrajPeriod());
+        break;
+    case EMCChannel::kMotRecordStop:
+        EMCRecord::StopRecord();
+        break;
+    case EMCChannel::kMotReplay:
+        //from a quiet controller, the way a recording starts
+        if (motTaskSts_ != kIdle || start_ || toolChangePending_ ||
+            emcmotStatus->tcqlen != 0 || !EMCChannel::isMill2MotQueueEmpty()) {
+            EMCLog::SetLog("replay: wait for the simulation to finish", 1);
+            break;
+        }
+        if (!EMCRecord::StartReplay(EMCParas::periodconfig.record_file, emcmotStatus,
+                                    emcmotConfig->numJoints,
+                                    MotionTask::getServoPeriod(),
+                                    MotionTask::getTrajPeriod())) {
+            replayIgnored_ = 0;
+            motTaskSts_ = kReplay;
+        }
+        break;
+    case EMCChannel::kMotReplayStop:
+        if (motTaskSts_ == kReplay) {
+            EMCRecord::StopReplay(false);
+            motTaskSts_ = kIdle;
+        }
+        break;
     default:
         break;
     }
@@ -269,4 +513,6 @@ void MotTask::loadfile(std::string filename)
 
 void MotTask::init()
 {
+    admitMax_ = EMCParas::periodconfig.admit_max;
+    admitBudget_ = EMCParas::periodconfig.admit_budget;
 }
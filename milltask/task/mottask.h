@@ -6,6 +6,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <string>
+#include <cstdint>
 #include <functional>
 #include <interp_base.hh>
 #include "emcTask.h"
@@ -20,6 +21,7 @@ public:
         kOpenFile,
         kStartGather,
         kEndGather,
+        kReplay,
         kError,
     };
     MotTask();
@@ -60,8 +62,33 @@ private:
     bool needWait_ = true;
     enum MotTaskSts motTaskSts_ = kIdle;
     bool start_= false;
+    bool trajTick_ = false;         //the planner period started this cycle
+    bool sampleTrajRate_ = false;   //[EMCMOT]SAMPLE_RATE TRAJ
     void execCmd();
 
+    //M6 read from the mill stream, held until the moves before it are done
+    bool toolChangePending_ = false;
+    int pendingTool_ = 0;
+    bool handleSimCmd();
+    void doToolChange();
+
+    //A replay feeds the controller from the EMCRecord file instead of
+    //the lanes, see kReplay
+    void runCmd();
+    unsigned long replayIgnored_ = 0;
+
+    //Mill commands taken per cycle, up to [EMCMOT]ADMIT_MAX while the
+    //cycle stays within ADMIT_BUDGET of the servo period
+    void admitMill();
+    int admitMax_ = 1;
+    double admitBudget_ = 0.5;      //of the servo period
+    uint64_t budgetTicks_ = 0;      //motProfTicks(), recalibrated
+    double nsPerTick_ = 0.0;        //motProfNsPerTick() at the calibration
+    double controllerNs_ = 0.0;     //MotionCtrl() this cycle, profiler off
+    int calibrate_ = 0;             //cycles to the next calibration
+    double admitCost_ = 0.0;        //ticks one mill command takes, average
+    int tracedTcqlen_ = -1;         //planner length in the trace, on change
+
     int usrmotReadEmcmotError(char *e);
 };
 
@@ -0,0 +1,457 @@
+#include "telemtask.h"
+#include "emcLog.h"
+#include "emcTrace.h"
+#include "emcParas.h"
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//How often the ring is looked at while somebody is subscribed, it
+//holds seconds of samples so this only sets the latency
+#define TELEM_POLL_MS 5
+#define TELEM_EVENTS 64
+
+namespace {
+
+std::mutex statsMutex;
+std::string statsPath;
+std::atomic<int> statsClients{0};
+std::atomic<unsigned long> statsFrames{0};
+std::atomic<unsigned long> statsDropped{0};
+
+inline void count(std::atomic<unsigned long> &c, unsigned long n = 1)
+{
+    c.fetch_add(n, std::memory_order_relaxed);
+}
+
+//payload bytes of the channels of a sample
+size_t channelBytes(uint32_t channels, int joints)
+{
+    size_t n = 0;
+    for (uint32_t ch : {MOT_TELEM_CH_JOINT_POS, MOT_TELEM_CH_JOINT_VEL,
+                        MOT_TELEM_CH_JOINT_ACC, MOT_TELEM_CH_JOINT_FB,
+                        MOT_TELEM_CH_FERROR})
+        if (channels & ch)
+            n += joints * sizeof(double);
+    if (channels & MOT_TELEM_CH_TCP)
+        n += MOT_TELEM_POSE * sizeof(double);
+    if (channels & MOT_TELEM_CH_LINE)
+        n += 2 * sizeof(int32_t);
+    if (channels & MOT_TELEM_CH_FEED)
+        n += 4 * sizeof(double);
+    if (channels & MOT_TELEM_CH_QUEUE)
+        n += 2 * sizeof(int32_t);
+    if (channels & MOT_TELEM_CH_STATE)
+        n += 2 * sizeof(int32_t);
+    return n;
+}
+
+inline char *put(char *p, const void *v, size_t len)
+{
+    memcpy(p, v, len);
+    return p + len;
+}
+
+} // namespace
+
+TelemTask::TelemTask() : running(false) {
+    path_ = EMCParas::periodconfig.telemetry_socket;
+}
+
+TelemTask::~TelemTask() {
+    stopWork(); // Ensure thread is stopped on destruction
+}
+
+void TelemTask::doWork() {
+    if (running || path_.empty()) return;
+    if (openSocket()) {
+        closeSocket();
+        return;
+    }
+
+    running = true;
+    workerThread = std::thread([this]() {
+        EMCLog::Log(0, "TelemTask serving %s", path_);
+        EMCTrace::ThreadName("TelemTask");
+        while (running) {
+            process();
+        }
+    });
+}
+
+void TelemTask::stopWork() {
+    if (!running) return;
+
+    running = false;
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) < 0) {
+        // the counter can't be full, nothing to do
+    }
+
+    if (workerThread.joinable()) {
+        workerThread.join();
+    }
+    closeSocket();
+}
+
+int TelemTask::openSocket()
+{
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+        EMCLog::SetLog("[EMCMOT]TELEMETRY_SOCKET path too long", 1);
+        return -1;
+    }
+    strcpy(addr.sun_path, path_.c_str());
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listenFd_ < 0 || epollFd_ < 0 || wakeFd_ < 0) {
+        EMCLog::Log(1, "TelemTask: %s", strerror(errno));
+        return -1;
+    }
+    //a socket left by an earlier run
+    unlink(path_.c_str());
+    if (bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenFd_, kMaxClients) < 0) {
+        EMCLog::Log(1, "TelemTask: can't listen on %s: %s", path_, strerror(errno));
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsPath = path_;
+    return 0;
+}
+
+void TelemTask::closeSocket()
+{
+    for (auto &c : clients_)
+        close(c.fd);
+    clients_.clear();
+    statsClients.store(0, std::memory_order_relaxed);
+    if (listenFd_ >= 0) {
+        close(listenFd_);
+        unlink(path_.c_str());
+    }
+    if (epollFd_ >= 0)
+        close(epollFd_);
+    if (wakeFd_ >= 0)
+        close(wakeFd_);
+    listenFd_ = epollFd_ = wakeFd_ = -1;
+    if (attached_)
+        motTelemDetach(&reader_);
+    attached_ = false;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    statsPath.clear();
+}
+
+void TelemTask::process()
+{
+    struct epoll_event events[TELEM_EVENTS];
+    bool subscribed = std::any_of(clients_.begin(), clients_.end(),
+                                  [](const Client &c) { return c.decimation != 0; });
+
+    //sleep until a client talks unless somebody waits for samples
+    int n = epoll_wait(epollFd_, events, TELEM_EVENTS, subscribed ? TELEM_POLL_MS : -1);
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wakeFd_) {
+            uint64_t v;
+            if (read(wakeFd_, &v, sizeof(v)) < 0) {
+                // already drained
+            }
+            continue;
+        }
+        if (fd == listenFd_) {
+            accept();
+            continue;
+        }
+        auto it = std::find_if(clients_.begin(), clients_.end(),
+                               [fd](const Client &c) { return c.fd == fd; });
+        if (it == clients_.end())
+            continue;
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+            drop(*it);
+            continue;
+        }
+        if (events[i].events & EPOLLIN)
+            readClient(*it);
+        if (it->fd >= 0 && (events[i].events & EPOLLOUT))
+            flush(*it);
+    }
+
+    pump();
+
+    for (auto &c : clients_)
+        if (c.fd >= 0 && c.outPos < c.out.size() && !c.waitOut)
+            flush(c);
+    clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                  [](const Client &c) { return c.fd < 0; }),
+                   clients_.end());
+    statsClients.store((int)clients_.size(), std::memory_order_relaxed);
+}
+
+void TelemTask::accept()
+{
+    for (;;) {
+        int fd = accept4(listenFd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        if ((int)clients_.size() >= kMaxClients) {
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            continue;
+        }
+        clients_.emplace_back();
+        Client &c = clients_.back();
+        c.fd = fd;
+
+        mot_telem_hello_t hello;
+        memset(&hello, 0, sizeof(hello));
+        hello.version = MOT_TELEM_VERSION;
+        hello.channels = MOT_TELEM_CH_ALL;
+        hello.servo_period_ns = EMCParas::periodconfig.servo_period_nsec;
+        hello.max_joints = MOT_TELEM_JOINTS;
+        send(c, MOT_TELEM_FRAME_HELLO, &hello, sizeof(hello));
+        flush(c);
+    }
+}
+
+void TelemTask::readClient(Client &c)
+{
+    char buf[512];
+
+    for (;;) {
+        ssize_t n = read(c.fd, buf, sizeof(buf));
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            drop(c);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        c.in.insert(c.in.end(), buf, buf + n);
+    }
+
+    size_t pos = 0;
+    while (c.in.size() - pos >= sizeof(mot_telem_frame_t)) {
+        mot_telem_frame_t frame;
+        memcpy(&frame, &c.in[pos], sizeof(frame));
+        if (frame.len > 4096) {
+            //not our protocol
+            drop(c);
+            return;
+        }
+        if (c.in.size() - pos < sizeof(frame) + frame.len)
+            break;
+        if (frame.type == MOT_TELEM_FRAME_SUBSCRIBE &&
+            frame.len >= sizeof(mot_telem_subscribe_t)) {
+            mot_telem_subscribe_t sub;
+            memcpy(&sub, &c.in[pos + sizeof(frame)], sizeof(sub));
+            c.channels = sub.channels & MOT_TELEM_CH_ALL;
+            c.decimation = c.channels ? sub.decimation : 0;
+            c.next = 0;
+            c.since = 0;
+            c.lost = 0;
+            //samples published before the subscribe are not the client's
+            mot_telem_sample_t latest;
+            if (attached_ && 0 == motTelemLatest(&reader_, &latest))
+                c.next = c.since = latest.cycle + 1;
+        }
+        pos += sizeof(frame) + frame.len;
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + pos);
+}
+
+void TelemTask::flush(Client &c)
+{
+    while (c.outPos < c.out.size()) {
+        ssize_t n = ::send(c.fd, &c.out[c.outPos], c.out.size() - c.outPos,
+                           MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN) {
+                drop(c);
+                return;
+            }
+            break;
+        }
+        c.outPos += n;
+    }
+    if (c.outPos == c.out.size()) {
+        c.out.clear();
+        c.outPos = 0;
+    }
+
+    //only wait for the socket to drain while something is pending
+    bool waitOut = c.outPos < c.out.size();
+    if (waitOut != c.waitOut) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (waitOut ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.fd = c.fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, c.fd, &ev);
+        c.waitOut = waitOut;
+    }
+}
+
+void TelemTask::drop(Client &c)
+{
+    close(c.fd);
+    c.fd = -1;
+}
+
+void TelemTask::send(Client &c, uint16_t type, const void *payload, size_t len)
+{
+    mot_telem_frame_t frame;
+    frame.type = type;
+    frame.reserved = 0;
+    frame.len = len;
+    const char *p = (const char *)payload;
+    c.out.insert(c.out.end(), (const char *)&frame, (const char *)&frame + sizeof(frame));
+    c.out.insert(c.out.end(), p, p + len);
+}
+
+void TelemTask::sendSample(Client &c, const mot_telem_sample_t &s)
+{
+    int joints = std::min(std::max(s.num_joints, 0), MOT_TELEM_JOINTS);
+    size_t len = sizeof(mot_telem_data_t) + channelBytes(c.channels, joints);
+
+    if (c.out.size() - c.outPos + sizeof(mot_telem_frame_t) + len > kMaxBacklog) {
+        c.lost++;
+        count(statsDropped);
+        return;
+    }
+
+    mot_telem_frame_t frame = {MOT_TELEM_FRAME_DATA, 0, (uint32_t)len};
+    mot_telem_data_t data;
+    data.cycle = s.cycle;
+    data.sim_time_ns = s.sim_time_ns;
+    data.channels = c.channels;
+    data.num_joints = joints;
+    data.lost = c.lost > 0xffff ? 0xffff : c.lost;
+    c.lost = 0;
+
+    size_t at = c.out.size();
+    c.out.resize(at + sizeof(frame) + len);
+    char *p = &c.out[at];
+    p = put(p, &frame, sizeof(frame));
+    p = put(p, &data, sizeof(data));
+    size_t jointBytes = joints * sizeof(double);
+    if (c.channels & MOT_TELEM_CH_JOINT_POS)
+        p = put(p, s.joint_pos_cmd, jointBytes);
+    if (c.channels & MOT_TELEM_CH_JOINT_VEL)
+        p = put(p, s.joint_vel_cmd, jointBytes);
+    if (c.channels & MOT_TELEM_CH_JOINT_ACC)
+        p = put(p, s.joint_acc_cmd, jointBytes);
+    if (c.channels & MOT_TELEM_CH_JOINT_FB)
+        p = put(p, s.joint_pos_fb, jointBytes);
+    if (c.channels & MOT_TELEM_CH_FERROR)
+        p = put(p, s.joint_ferror, jointBytes);
+    if (c.channels & MOT_TELEM_CH_TCP)
+        p = put(p, s.carte_pos_cmd, sizeof(s.carte_pos_cmd));
+    if (c.channels & MOT_TELEM_CH_LINE) {
+        p = put(p, &s.line, sizeof(s.line));
+        p = put(p, &s.id, sizeof(s.id));
+    }
+    if (c.channels & MOT_TELEM_CH_FEED) {
+        p = put(p, &s.feed_scale, sizeof(double));
+        p = put(p, &s.rapid_scale, sizeof(double));
+        p = put(p, &s.current_vel, sizeof(double));
+        p = put(p, &s.requested_vel, sizeof(double));
+    }
+    if (c.channels & MOT_TELEM_CH_QUEUE) {
+        p = put(p, &s.tcq_len, sizeof(s.tcq_len));
+        p = put(p, &s.queue_full, sizeof(s.queue_full));
+    }
+    if (c.channels & MOT_TELEM_CH_STATE) {
+        p = put(p, &s.motion_state, sizeof(s.motion_state));
+        p = put(p, &s.motion_flag, sizeof(s.motion_flag));
+    }
+    count(statsFrames);
+}
+
+//Hand every new sample of the ring to the clients that want it
+void TelemTask::pump()
+{
+    mot_telem_sample_t s;
+    int res;
+
+    if (!attached_) {
+        //the ring is opened by MotionTask::InitMotion()
+        if (motTelemAttachLocal(&reader_))
+            return;
+        attached_ = true;
+        ringLost_ = reader_.lost;
+    }
+
+    while ((res = motTelemNext(&reader_, &s)) > 0) {
+        unsigned long lost = reader_.lost - ringLost_;
+        ringLost_ = reader_.lost;
+        for (auto &c : clients_) {
+            if (c.fd < 0 || c.decimation == 0)
+                continue;
+            //samples the ring took away before we got to them, cycles
+            //s.cycle - lost up to s.cycle, as far as they are after the
+            //subscribe
+            if (lost) {
+                uint64_t from = s.cycle > lost ? s.cycle - lost : 0;
+                if (from < c.since)
+                    from = c.since;
+                if (s.cycle > from)
+                    c.lost += (s.cycle - from) / c.decimation;
+            }
+            if (s.cycle < c.next)
+                continue;
+            c.next = s.cycle + c.decimation;
+            sendSample(c, s);
+        }
+    }
+    if (res < 0) {
+        //set up again, look for the new ring next time
+        motTelemDetach(&reader_);
+        attached_ = false;
+    }
+}
+
+std::string TelemTask::showStats()
+{
+    std::stringstream ss;
+    std::lock_guard<std::mutex> lock(statsMutex);
+
+    if (statsPath.empty())
+        return "Socket off, set [EMCMOT]TELEMETRY_SOCKET";
+    ss << "Socket = " << statsPath <<
+          "\nClients = " << statsClients.load(std::memory_order_relaxed) <<
+          "\nFrames = " << statsFrames.load(std::memory_order_relaxed) <<
+          "\nDropped = " << statsDropped.load(std::memory_order_relaxed);
+    return ss.str();
+}
@@ -0,0 +1,73 @@
+#ifndef _TELEM_TASK_
+#define _TELEM_TASK_
+
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "motionTelemetry.h"
+
+//Streams motion telemetry to local clients over a UNIX socket
+//[EMCMOT]TELEMETRY_SOCKET names the socket, the frames and channels
+//are in motionTelemetry.h. One thread serves every client from one
+//epoll loop. It reads the telemetry ring in process, the motion thread
+//does not know about it. Every client has a bounded backlog, a client
+//that does not keep up loses samples (counted in its DATA frames)
+//instead of holding the others or the simulation up.
+class TelemTask {
+public:
+    TelemTask();
+    ~TelemTask();
+
+    // Start the worker thread, nothing without TELEMETRY_SOCKET
+    void doWork();
+
+    // Stop the worker thread gracefully
+    void stopWork();
+
+    // Socket, clients, frames sent and samples dropped
+    static std::string showStats();
+
+private:
+    struct Client {
+        int fd = -1;
+        std::vector<char> in;       //partial frame read
+        std::vector<char> out;      //frames not written yet
+        size_t outPos = 0;
+        bool waitOut = false;       //EPOLLOUT armed
+        uint32_t channels = 0;
+        uint32_t decimation = 0;
+        uint64_t next = 0;          //next cycle to send
+        uint64_t since = 0;         //first cycle after the subscribe
+        unsigned long lost = 0;
+    };
+
+    static constexpr int kMaxClients = 32;
+    static constexpr size_t kMaxBacklog = 1 << 20;  //bytes per client
+
+    int openSocket();
+    void closeSocket();
+    void process();  // Main processing function
+    void accept();
+    void readClient(Client &c);
+    void flush(Client &c);
+    void drop(Client &c);
+    void pump();
+    void send(Client &c, uint16_t type, const void *payload, size_t len);
+    void sendSample(Client &c, const mot_telem_sample_t &s);
+
+    std::thread workerThread;
+    std::atomic<bool> running{false};
+
+    std::string path_;
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::vector<Client> clients_;
+    bool attached_ = false;
+    mot_telem_reader_t reader_;
+    unsigned long ringLost_ = 0;
+};
+
+#endif // _TELEM_TASK_
@@ -0,0 +1,173 @@
+// Compensation table lookup, see motion/motionComp.h
+#include "testMain.h"
+#include "motionComp.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static std::string writeTable(const std::string &name, const std::string &text)
+{
+    std::string path = TestMain::TempPath(name);
+    FILE *fp = fopen(path.c_str(), "w");
+    fputs(text.c_str(), fp);
+    fclose(fp);
+    return path;
+}
+
+static double lookup(int joint, double pos, double vel)
+{
+    double corr = 12345.0;
+    CHECK_EQ(motCompCorrection(joint, pos, vel, &corr), 1);
+    return corr;
+}
+
+TEST(comp_interpolation)
+{
+    std::string path = writeTable("comp1.txt",
+                                  "# nominal fwd_trim rev_trim\n"
+                                  "0 0.01 -0.01\n"
+                                  "\n"
+                                  "10 0.02 -0.02\n"
+                                  "20 0.0 0.0\n");
+    motCompInit();
+    CHECK_EQ(motCompLoad(0, path.c_str(), 1), 3);
+
+    CHECK_NEAR(lookup(0, 5.0, 1.0), 0.015, 1e-12);
+    CHECK_NEAR(lookup(0, 5.0, -1.0), -0.015, 1e-12);
+    CHECK_NEAR(lookup(0, 15.0, 1.0), 0.01, 1e-12);
+    CHECK_NEAR(lookup(0, 10.0, 1.0), 0.02, 1e-12);
+    //outside the table the trim of the end holds
+    CHECK_NEAR(lookup(0, -100.0, 1.0), 0.01, 1e-12);
+    CHECK_NEAR(lookup(0, 100.0, -1.0), 0.0, 1e-12);
+
+    //standing still keeps the correction
+    double corr = 0.5;
+    CHECK_EQ(motCompCorrection(0, 5.0, 0.0, &corr), 1);
+    CHECK_EQ(corr, 0.5);
+
+    //no table, nothing to do
+    corr = 0.5;
+    CHECK_EQ(motCompCorrection(1, 5.0, 1.0, &corr), 0);
+    CHECK_EQ(corr, 0.5);
+
+    motCompUnload(0);
+    CHECK_EQ(motCompCorrection(0, 5.0, 1.0, &corr), 0);
+    motCompCycleDone();
+}
+
+TEST(comp_type0)
+{
+    //nominal forward reverse, the trims are nominal - measured
+    std::string path = writeTable("comp0.txt", "0 0.1 -0.1\n10 9.8 10.2\n");
+    motCompInit();
+    CHECK_EQ(motCompLoad(0, path.c_str(), 0), 2);
+    CHECK_NEAR(lookup(0, 0.0, 1.0), -0.1, 1e-12);
+    CHECK_NEAR(lookup(0, 0.0, -1.0), 0.1, 1e-12);
+    CHECK_NEAR(lookup(0, 10.0, 1.0), 0.2, 1e-12);
+    CHECK_NEAR(lookup(0, 10.0, -1.0), -0.2, 1e-12);
+    motCompUnload(0);
+    motCompCycleDone();
+}
+
+TEST(comp_bad_files)
+{
+    std::string down = writeTable("down.txt", "0 0 0\n10 0 0\n5 0 0\n");
+    std::string bad = writeTable("bad.txt", "0 0 0\n10 0\n");
+    std::string empty = writeTable("empty.txt", "# nothing\n\n");
+
+    CHECK_EQ(motCompLoad(0, down.c_str(), 1), -1);
+    CHECK_EQ(motCompLoad(0, bad.c_str(), 1), -1);
+    CHECK_EQ(motCompLoad(0, empty.c_str(), 1), -1);
+    CHECK_EQ(motCompLoad(0, TestMain::TempPath("none.txt").c_str(), 1), -1);
+    CHECK_EQ(motCompLoad(-1, down.c_str(), 1), -1);
+    CHECK_EQ(motCompLoad(EMCMOT_MAX_JOINTS, down.c_str(), 1), -1);
+}
+
+//A laser table with uneven spacing against a linear scan, walked slowly
+//and with jumps
+TEST(comp_large_table)
+{
+    const int n = 20000;
+    std::mt19937 rng(39);
+    std::uniform_real_distribution<double> step(0.01, 0.1);
+    std::uniform_real_distribution<double> trim(-0.05, 0.05);
+    std::vector<double> nom(n), fwd(n), rev(n);
+    std::string text;
+    double x = -500.0;
+    char line[96];
+
+    for (int i = 0; i < n; i++) {
+        x += step(rng);
+        nom[i] = x;
+        fwd[i] = trim(rng);
+        rev[i] = trim(rng);
+        snprintf(line, sizeof(line), "%.17g %.17g %.17g\n", nom[i], fwd[i], rev[i]);
+        text += line;
+    }
+    std::string path = writeTable("large.txt", text);
+
+    motCompInit();
+    motCompClearStats();
+    CHECK_EQ(motCompLoad(2, path.c_str(), 1), n);
+
+    auto expected = [&](double pos, bool up) {
+        const std::vector<double> &t = up ? fwd : rev;
+        if (pos < nom[0])
+            return t[0];
+        int i = 0;
+        while (i + 1 < n && nom[i + 1] <= pos)
+            i++;
+        if (i + 1 == n)
+            return t[n - 1];
+        return t[i] + (t[i + 1] - t[i]) / (nom[i + 1] - nom[i]) * (pos - nom[i]);
+    };
+
+    int checked = 0;
+    for (double pos = nom[0] - 1.0; pos < nom[n - 1] + 1.0; pos += 0.009) {
+        if (checked++ % 97 == 0)
+            CHECK_NEAR(lookup(2, pos, 1.0), expected(pos, true), 1e-9);
+        else
+            lookup(2, pos, 1.0);
+    }
+    std::uniform_real_distribution<double> anywhere(nom[0] - 1.0, nom[n - 1] + 1.0);
+    for (int i = 0; i < 2000; i++) {
+        double pos = anywhere(rng);
+        CHECK_NEAR(lookup(2, pos, -1.0), expected(pos, false), 1e-9);
+    }
+
+    //a walk in steps below the spacing finds the segment next to the
+    //last one, only jumps search
+    MOT_COMP_STATS st;
+    motCompGetStats(2, &st);
+    CHECK_EQ(st.entries, n);
+    CHECK_EQ(st.lookups, (unsigned long)checked + 2000);
+    CHECK(st.searches <= 2000 + 2);
+    CHECK(st.neighbour > 0);
+
+    motCompUnload(2);
+    motCompCycleDone();
+}
+
+//A table replaced while the motion side keeps looking up
+TEST(comp_reload)
+{
+    std::string a = writeTable("a.txt", "0 1 1\n10 1 1\n");
+    std::string b = writeTable("b.txt", "0 2 2\n10 2 2\n20 2 2\n");
+
+    motCompInit();
+    CHECK_EQ(motCompLoad(3, b.c_str(), 1), 3);
+    CHECK_NEAR(lookup(3, 15.0, 1.0), 2.0, 1e-12);
+    motCompCycleDone();
+    //the cached segment is past the end of the smaller table
+    CHECK_EQ(motCompLoad(3, a.c_str(), 1), 2);
+    CHECK_NEAR(lookup(3, 15.0, 1.0), 1.0, 1e-12);
+    CHECK_NEAR(lookup(3, 5.0, 1.0), 1.0, 1e-12);
+    motCompCycleDone();
+
+    unsigned long long one = motCompDigest();
+    CHECK_EQ(motCompLoad(3, a.c_str(), 1), 2);
+    CHECK_EQ(motCompDigest(), one);
+    motCompUnload(3);
+    CHECK(motCompDigest() != one);
+    motCompCycleDone();
+}
@@ -0,0 +1,135 @@
+// Jerk limited lanes, see motion/motionJerkTp.h
+#include "testMain.h"
+#include "motionJerkTp.h"
+#include <cmath>
+
+namespace {
+
+const double kPeriod = 0.001;
+const double kJerk = 20000.0;
+const int kLane = JERK_TP_JOINT(0);
+
+simple_tp_t lane(double vmax, double amax)
+{
+    simple_tp_t tp = {};
+    tp.max_vel = vmax;
+    tp.max_acc = amax;
+    tp.enable = 1;
+    return tp;
+}
+
+//one update, false if it broke a limit
+bool update(simple_tp_t &tp)
+{
+    double acc = jerkTpGetAcc(kLane);
+    jerkTpUpdate(&tp, kLane, kPeriod);
+    double a = jerkTpGetAcc(kLane);
+    return std::fabs(a - acc) <= kJerk * kPeriod * (1 + 1e-9) &&
+           std::fabs(a) <= tp.max_acc * (1 + 1e-9);
+}
+
+} // namespace
+
+TEST(jerk_point_to_point)
+{
+    jerkTpInit();
+    jerkTpSetJerk(kLane, kJerk);
+    simple_tp_t tp = lane(50.0, 500.0);
+    tp.pos_cmd = 10.0;
+
+    bool limits = true;
+    double top = 0.0;
+    int n = 0;
+    for (; n < 10000 && (n == 0 || tp.active); n++) {
+        limits = update(tp) && limits;
+        top = std::fmax(top, tp.curr_vel);
+    }
+    CHECK(limits);
+    CHECK(n < 10000);
+    CHECK_EQ(tp.curr_pos, 10.0);
+    CHECK_EQ(tp.curr_vel, 0.0);
+    CHECK(top <= 50.0);
+    CHECK(top > 49.0);
+}
+
+//the feed override or a slower JOG_CONT lowers max_vel mid move
+TEST(jerk_lower_vmax)
+{
+    jerkTpInit();
+    jerkTpSetJerk(kLane, kJerk);
+    simple_tp_t tp = lane(50.0, 500.0);
+    tp.pos_cmd = 1e6;
+
+    for (int n = 0; n < 1000; n++)
+        update(tp);
+    CHECK_EQ(tp.curr_vel, 50.0);
+
+    tp.max_vel = 10.0;
+    bool limits = true;
+    double low = 50.0;
+    int reached = -1;
+    for (int n = 0; n < 2000; n++) {
+        limits = update(tp) && limits;
+        low = std::fmin(low, tp.curr_vel);
+        if (reached < 0 && tp.curr_vel <= 10.0)
+            reached = n;
+    }
+    CHECK(limits);
+    CHECK_EQ(tp.curr_vel, 10.0);
+    CHECK_EQ(jerkTpGetAcc(kLane), 0.0);
+    //no undershoot, down at full deceleration: 40 / 500 + 500 / 20000
+    CHECK(low >= 10.0 - 1e-9);
+    CHECK(reached > 0 && reached <= 110);
+
+    //and back up
+    tp.max_vel = 30.0;
+    for (int n = 0; n < 1000; n++)
+        limits = update(tp) && limits;
+    CHECK(limits);
+    CHECK_EQ(tp.curr_vel, 30.0);
+}
+
+TEST(jerk_time_to_stop)
+{
+    jerkTpInit();
+    jerkTpSetJerk(kLane, kJerk);
+    simple_tp_t tp = lane(50.0, 500.0);
+    tp.pos_cmd = 1e6;
+
+    //at rest nothing to do
+    CHECK_EQ(jerkTpTimeToStop(&tp, kLane), 0.0);
+    CHECK_EQ(jerkTpStopDist(&tp, kLane), 0.0);
+
+    //stop while still accelerating
+    for (int n = 0; n < 60; n++)
+        update(tp);
+    CHECK(jerkTpGetAcc(kLane) > 0.0);
+    double t = jerkTpTimeToStop(&tp, kLane);
+    double d = jerkTpStopDist(&tp, kLane);
+    double start = tp.curr_pos;
+    CHECK(t > 0.0);
+
+    //the discrete stop brakes a little harder than the closed form and
+    //settles in a few periods after it
+    tp.enable = 0;
+    int stopped = -1;
+    for (int n = 1; n <= 1000 && tp.curr_vel != 0.0; n++) {
+        update(tp);
+        if (stopped < 0 && tp.curr_vel <= 0.0)
+            stopped = n;
+    }
+    CHECK_EQ(tp.curr_vel, 0.0);
+    CHECK(stopped * kPeriod > 0.9 * t);
+    CHECK(stopped * kPeriod <= t + kPeriod);
+    CHECK_NEAR(tp.curr_pos - start, d, 5e-3);
+
+    //cruising, the closed form: (v / a) + (a / j)
+    tp = lane(50.0, 500.0);
+    tp.pos_cmd = 1e6;
+    jerkTpReset(kLane);
+    for (int k = 0; k < 1000; k++)
+        update(tp);
+    CHECK_NEAR(jerkTpTimeToStop(&tp, kLane), 50.0 / 500.0 + 500.0 / kJerk, 1e-12);
+    tp.curr_vel = -tp.curr_vel;
+    CHECK_NEAR(jerkTpTimeToStop(&tp, kLane), 50.0 / 500.0 + 500.0 / kJerk, 1e-12);
+}
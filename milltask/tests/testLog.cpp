@@ -0,0 +1,169 @@
+// EMCLog formatting, rate limits and the binary log, see subsys/emcLog.h
+#include "testMain.h"
+#include "emcLog.h"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Line {
+    int level;
+    std::string text;
+};
+
+std::vector<Line> readLog()
+{
+    std::vector<Line> lines;
+    std::string log;
+    int level;
+    while (!EMCLog::GetLog(log, level))
+        lines.push_back({level, log});
+    return lines;
+}
+
+} // namespace
+
+TEST(log_format)
+{
+    readLog();
+    EMCLog::Log(1, "joint %d pos %8.3f name %s u=%u x=%#x c=%c 100%% %s",
+                3, 1.23456, "X", 7u, 255, 'A', std::string("str"));
+    EMCLog::Log(0, "%-5s|%05.1f|%lld|%lu", "ab", 2.25, -7LL, 42ul);
+    EMCLog::SetLog("plain", 3);
+    const char *null = nullptr;
+    EMCLog::Log(2, "null %s", null);
+
+    std::vector<Line> lines = readLog();
+    CHECK_EQ(lines.size(), 4u);
+    if (lines.size() != 4)
+        return;
+    CHECK_EQ(lines[0].level, 1);
+    CHECK_EQ(lines[0].text, "joint 3 pos    1.235 name X u=7 x=0xff c=A 100% str");
+    CHECK_EQ(lines[1].text, "ab   |002.2|-7|42");
+    CHECK_EQ(lines[2].level, 3);
+    CHECK_EQ(lines[2].text, "plain");
+    CHECK_EQ(lines[3].text, "null (null)");
+}
+
+TEST(log_format_mismatch)
+{
+    readLog();
+    //a conversion without an arg is kept as text, a mismatched arg is
+    //printed as what it is
+    EMCLog::Log(0, "missing %d %s");
+    EMCLog::Log(0, "num as str %s and str as num %d", 42, "abc");
+    EMCLog::Log(5, "level %d", 5);
+    EMCLog::Log(-1, "level %d", -1);
+
+    std::vector<Line> lines = readLog();
+    CHECK_EQ(lines.size(), 4u);
+    if (lines.size() != 4)
+        return;
+    CHECK_EQ(lines[0].text, "missing %d %s");
+    CHECK_EQ(lines[1].text, "num as str 42 and str as num abc");
+    CHECK_EQ(lines[2].level, EMCLog::kLevels - 1);
+    CHECK_EQ(lines[3].level, 0);
+}
+
+TEST(log_long_strings)
+{
+    readLog();
+    //more than the record holds goes to the heap, whole
+    std::string big(1000, 'b');
+    std::string small(100, 's');
+    EMCLog::Log(0, "%s|%s|%s|%s|%s", small, small, small, small, big);
+
+    std::vector<Line> lines = readLog();
+    CHECK_EQ(lines.size(), 1u);
+    if (lines.size() == 1)
+        CHECK_EQ(lines[0].text, small + "|" + small + "|" + small + "|" + small + "|" + big);
+}
+
+//The limit counts lines per wall clock second
+static void nextSecond()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto next = std::chrono::duration_cast<std::chrono::seconds>(now) + std::chrono::seconds(1);
+    std::this_thread::sleep_for(next - now + std::chrono::milliseconds(1));
+}
+
+TEST(log_rate_limit)
+{
+    readLog();
+    unsigned old = EMCLog::GetRateLimit(1);
+    unsigned long before = EMCLog::GetSuppressed(1);
+
+    CHECK_EQ(EMCLog::SetRateLimit(1, 5), 0);
+    CHECK_EQ(EMCLog::GetRateLimit(1), 5u);
+    nextSecond();
+    for (int i = 0; i < 100; i++)
+        EMCLog::Log(1, "warning %d", i);
+
+    std::vector<Line> lines = readLog();
+    CHECK_EQ(lines.size(), 5u);
+    if (lines.size() == 5)
+        CHECK_EQ(lines[4].text, "warning 4");
+    CHECK_EQ(EMCLog::GetSuppressed(1) - before, 95ul);
+
+    //the first line of the next second tells what the last one dropped
+    nextSecond();
+    EMCLog::Log(1, "warning %d", 100);
+    lines = readLog();
+    CHECK_EQ(lines.size(), 2u);
+    if (lines.size() == 2) {
+        CHECK_EQ(lines[0].text, "95 lines suppressed by the rate limit");
+        CHECK_EQ(lines[1].text, "warning 100");
+    }
+    CHECK_EQ(EMCLog::SetRateLimit(1, old), 0);
+}
+
+TEST(log_rate_errors_not_limited)
+{
+    readLog();
+    //errors and cmd output have no limit to set
+    CHECK_EQ(EMCLog::SetRateLimit(2, 5), -1);
+    CHECK_EQ(EMCLog::SetRateLimit(3, 5), -1);
+    CHECK_EQ(EMCLog::SetRateLimit(-1, 5), -1);
+    CHECK_EQ(EMCLog::GetRateLimit(2), 0u);
+
+    for (int i = 0; i < 1000; i++)
+        EMCLog::Log(2, "error %d", i);
+    std::vector<Line> lines = readLog();
+    CHECK_EQ(lines.size(), 1000u);
+    CHECK_EQ(EMCLog::GetSuppressed(2), 0ul);
+}
+
+TEST(log_binary)
+{
+    std::string bin = TestMain::TempPath("log.bin");
+    std::string text = TestMain::TempPath("log.txt");
+
+    readLog();
+    CHECK_EQ(EMCLog::OpenBinary(bin.c_str()), 0);
+    CHECK_EQ(EMCLog::BinaryPath(), bin);
+    EMCLog::Log(2, "joint %d following error %.3f", 1, 0.25);
+    EMCLog::Log(0, "%s", std::string(600, 'x'));
+    //the reader writes the file
+    CHECK_EQ(readLog().size(), 2u);
+    EMCLog::CloseBinary();
+
+    FILE *fp = fopen(text.c_str(), "w");
+    CHECK_EQ(EMCLog::DecodeBinary(bin.c_str(), fp), 2);
+    fclose(fp);
+
+    std::vector<std::string> decoded;
+    char line[1024];
+    fp = fopen(text.c_str(), "r");
+    while (fp && fgets(line, sizeof(line), fp))
+        decoded.push_back(line);
+    if (fp)
+        fclose(fp);
+    CHECK_EQ(decoded.size(), 2u);
+    if (decoded.size() == 2) {
+        CHECK(decoded[0].find(" L2 joint 1 following error 0.250\n") != std::string::npos);
+        CHECK(decoded[1].find(" L0 " + std::string(600, 'x') + "\n") != std::string::npos);
+    }
+    CHECK_EQ(EMCLog::DecodeBinary(text.c_str(), stdout), -1);
+}
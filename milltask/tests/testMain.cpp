@@ -0,0 +1,90 @@
+// milltask_tests [prefix ...]
+//
+// Runs every TEST, or the ones whose name starts with one of the
+// prefixes, see testMain.h
+#include "testMain.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+struct Test {
+    const char *name;
+    std::function<void()> func;
+};
+
+std::vector<Test> &tests()
+{
+    static std::vector<Test> list;
+    return list;
+}
+
+int failures = 0;
+std::string tempDir;
+
+bool selected(const char *name, int argc, char **argv)
+{
+    if (argc < 2)
+        return true;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+int TestMain::Register(const char *name, std::function<void()> func)
+{
+    tests().push_back({name, std::move(func)});
+    return 0;
+}
+
+void TestMain::Fail(const char *file, int line, const std::string &what)
+{
+    fprintf(stderr, "%s:%d: FAILED %s\n", file, line, what.c_str());
+    failures++;
+}
+
+std::string TestMain::TempPath(const std::string &name)
+{
+    if (tempDir.empty()) {
+        char dir[] = "/tmp/milltask_tests.XXXXXX";
+        if (!mkdtemp(dir)) {
+            perror("mkdtemp");
+            exit(1);
+        }
+        tempDir = dir;
+    }
+    return tempDir + "/" + name;
+}
+
+int main(int argc, char **argv)
+{
+    int run = 0, failed = 0;
+
+    for (const auto &t : tests()) {
+        if (!selected(t.name, argc, argv))
+            continue;
+        int before = failures;
+        t.func();
+        run++;
+        if (failures != before) {
+            printf("FAIL %s\n", t.name);
+            failed++;
+        }
+        else {
+            printf("ok   %s\n", t.name);
+        }
+    }
+
+    if (!tempDir.empty())
+        std::filesystem::remove_all(tempDir);
+    printf("%d tests, %d failed\n", run, failed);
+    return run == 0 ? 1 : failed;
+}
@@ -0,0 +1,66 @@
+#ifndef _TEST_MAIN_H_
+#define _TEST_MAIN_H_
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <string>
+
+//A minimal test runner, no framework to install next to linuxcnc.
+//
+//    TEST(queue_order) {
+//        CHECK(q.try_push(1));
+//        CHECK_EQ(q.size(), 1u);
+//    }
+//
+//Every TEST registers itself, milltask_tests runs all of them or the
+//ones whose name starts with an argument, ctest runs one group per
+//add_test(). A failed CHECK prints file:line and the test goes on, the
+//exit code is the number of failed tests.
+namespace TestMain {
+
+int Register(const char *name, std::function<void()> func);
+void Fail(const char *file, int line, const std::string &what);
+//a directory for the files a test writes, removed at exit
+std::string TempPath(const std::string &name);
+
+template<typename A, typename B>
+std::string Values(const A &a, const B &b)
+{
+    std::ostringstream ss;
+    ss << a << " vs " << b;
+    return ss.str();
+}
+
+} // namespace TestMain
+
+#define TEST(name) \
+    static void test_##name(); \
+    [[maybe_unused]] static const int reg_##name = \
+        TestMain::Register(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+            TestMain::Fail(__FILE__, __LINE__, #cond); \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        auto va_ = (a); \
+        auto vb_ = (b); \
+        if (!(va_ == vb_)) \
+            TestMain::Fail(__FILE__, __LINE__, std::string(#a " == " #b ": ") + \
+                           TestMain::Values(va_, vb_)); \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol) \
+    do { \
+        double va_ = (a); \
+        double vb_ = (b); \
+        if (!(std::fabs(va_ - vb_) <= (tol))) \
+            TestMain::Fail(__FILE__, __LINE__, std::string(#a " ~ " #b ": ") + \
+                           TestMain::Values(va_, vb_)); \
+    } while (0)
+
+#endif
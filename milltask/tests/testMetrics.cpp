@@ -0,0 +1,138 @@
+// EMCMetrics in the Prometheus text format, see subsys/emcMetrics.h
+#include "testMain.h"
+#include "emcMetrics.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+bool has(const std::string &text, const std::string &line)
+{
+    return text.find("\n" + line + "\n") != std::string::npos ||
+           text.compare(0, line.size() + 1, line + "\n") == 0;
+}
+
+size_t count(const std::string &text, const std::string &s)
+{
+    size_t n = 0;
+    for (size_t pos = text.find(s); pos != std::string::npos; pos = text.find(s, pos + 1))
+        n++;
+    return n;
+}
+
+} // namespace
+
+TEST(metrics_counter)
+{
+    EMCMetrics::Counter &mill =
+        EMCMetrics::GetCounter("test_cmds_total{lane=\"mill\"}", "commands taken");
+    EMCMetrics::Counter &cmd =
+        EMCMetrics::GetCounter("test_cmds_total{lane=\"cmd\"}", "commands taken");
+
+    //the same name is the same counter
+    CHECK(&EMCMetrics::GetCounter("test_cmds_total{lane=\"mill\"}", "x") == &mill);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&mill] {
+            for (int i = 0; i < 100000; i++)
+                mill.Add();
+        });
+    }
+    for (auto &t : threads)
+        t.join();
+    cmd.Add(5);
+    CHECK_EQ(mill.Value(), 400000u);
+
+    std::string text = EMCMetrics::Prometheus();
+    //one HELP and TYPE for the series of a name
+    CHECK_EQ(count(text, "# HELP test_cmds_total "), 1u);
+    CHECK(has(text, "# HELP test_cmds_total commands taken"));
+    CHECK(has(text, "# TYPE test_cmds_total counter"));
+    CHECK(has(text, "test_cmds_total{lane=\"mill\"} 400000"));
+    CHECK(has(text, "test_cmds_total{lane=\"cmd\"} 5"));
+    size_t help = text.find("# HELP test_cmds_total ");
+    CHECK(text.find("# TYPE test_cmds_total counter") > help);
+    CHECK(text.find("test_cmds_total{lane=\"cmd\"}") > help);
+}
+
+TEST(metrics_gauge)
+{
+    EMCMetrics::Gauge &depth = EMCMetrics::GetGauge("test_depth", "queue depth");
+    depth.Set(2.5);
+    depth.Add(1.0);
+    EMCMetrics::AddGauge("test_read", "read when shown", [] { return 0.125; });
+    EMCMetrics::AddCounter("test_read_total", "counted elsewhere", [] { return 42.0; });
+
+    std::string text = EMCMetrics::Prometheus();
+    CHECK(has(text, "# TYPE test_depth gauge"));
+    CHECK(has(text, "test_depth 3.5"));
+    CHECK(has(text, "# TYPE test_read gauge"));
+    CHECK(has(text, "test_read 0.125"));
+    CHECK(has(text, "# TYPE test_read_total counter"));
+    CHECK(has(text, "test_read_total 42"));
+}
+
+TEST(metrics_histogram)
+{
+    EMCMetrics::Histogram &h =
+        EMCMetrics::GetHistogram("test_seconds", "time taken", {0.001, 0.01, 0.1});
+    CHECK(&EMCMetrics::GetHistogram("test_seconds", "time taken", {1.0}) == &h);
+
+    h.Observe(0.0005);
+    h.Observe(0.001);
+    h.Observe(0.05);
+    h.Observe(0.05);
+    h.Observe(7.0);
+
+    std::vector<uint64_t> counts;
+    double sum;
+    h.Read(counts, sum);
+    CHECK(counts == (std::vector<uint64_t>{2, 0, 2, 1}));
+    CHECK_NEAR(sum, 7.1015, 1e-12);
+
+    //buckets are cumulative, +Inf is the count
+    std::string text = EMCMetrics::Prometheus();
+    CHECK(has(text, "# TYPE test_seconds histogram"));
+    CHECK(has(text, "test_seconds_bucket{le=\"0.001\"} 2"));
+    CHECK(has(text, "test_seconds_bucket{le=\"0.01\"} 2"));
+    CHECK(has(text, "test_seconds_bucket{le=\"0.1\"} 4"));
+    CHECK(has(text, "test_seconds_bucket{le=\"+Inf\"} 5"));
+    CHECK(has(text, "test_seconds_sum 7.1015"));
+    CHECK(has(text, "test_seconds_count 5"));
+}
+
+TEST(metrics_labelled_histogram)
+{
+    EMCMetrics::Histogram &h =
+        EMCMetrics::GetHistogram("test_batch{lane=\"mill\"}", "batch size", {1, 4});
+    h.Observe(3);
+
+    std::string text = EMCMetrics::Prometheus();
+    CHECK(has(text, "test_batch_bucket{lane=\"mill\",le=\"1\"} 0"));
+    CHECK(has(text, "test_batch_bucket{lane=\"mill\",le=\"4\"} 1"));
+    CHECK(has(text, "test_batch_bucket{lane=\"mill\",le=\"+Inf\"} 1"));
+    CHECK(has(text, "test_batch_sum{lane=\"mill\"} 3"));
+    CHECK(has(text, "test_batch_count{lane=\"mill\"} 1"));
+}
+
+TEST(metrics_export)
+{
+    std::string path = TestMain::TempPath("metrics.prom");
+    EMCMetrics::Counter &c = EMCMetrics::GetCounter("test_export_total", "exported");
+
+    c.Add(3);
+    CHECK_EQ(EMCMetrics::StartExport(path, 3600.0), 0);
+    CHECK_EQ(EMCMetrics::ExportPath(), path);
+    //the first write is right away
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    CHECK(has(ss.str(), "test_export_total 3"));
+    EMCMetrics::StopExport();
+
+    CHECK(EMCMetrics::StartExport("", 1.0) != 0);
+    CHECK(EMCMetrics::StartExport(path, 0.0) != 0);
+}
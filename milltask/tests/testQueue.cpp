@@ -0,0 +1,102 @@
+// BoundedQueue, see subsys/emcMsgQueue.h
+#include "testMain.h"
+#include "emcMsgQueue.h"
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+TEST(queue_bounded_full)
+{
+    BoundedQueue<int> q(3);
+
+    CHECK_EQ(q.capacity(), 3u);
+    CHECK(q.empty());
+    CHECK(q.try_push(1));
+    CHECK(q.try_push(2));
+    CHECK(q.try_push(3));
+    CHECK(!q.try_push(4));
+    CHECK_EQ(q.dropped(), 1ul);
+    CHECK_EQ(q.high_water(), 3u);
+    CHECK(!q.push(4, std::chrono::milliseconds(5)));
+    CHECK_EQ(q.dropped(), 2ul);
+
+    CHECK_EQ(*q.try_pop(), 1);
+    CHECK(q.try_push(4));
+    std::vector<int> out;
+    CHECK_EQ(q.drain(std::back_inserter(out), 2), 2u);
+    CHECK(out == (std::vector<int>{2, 3}));
+    CHECK_EQ(q.drain(std::back_inserter(out)), 1u);
+    CHECK_EQ(out.back(), 4);
+    CHECK(!q.try_pop());
+    CHECK_EQ(q.high_water(), 3u);
+}
+
+TEST(queue_bounded_push_waits)
+{
+    BoundedQueue<int> q(1);
+    CHECK(q.try_push(1));
+
+    std::thread consumer([&q] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        q.try_pop();
+    });
+    CHECK(q.push(2, std::chrono::seconds(5)));
+    consumer.join();
+    CHECK_EQ(*q.try_pop(), 2);
+}
+
+template<QueueSync S>
+static void producerConsumer(int total)
+{
+    BoundedQueue<int, S> q(64);
+    std::thread producer([&q, total] {
+        for (int i = 0; i < total; i++) {
+            while (!q.try_push(i))
+                std::this_thread::yield();
+        }
+    });
+
+    int expect = 0;
+    std::vector<int> batch;
+    while (expect < total) {
+        batch.clear();
+        if (!q.drain(std::back_inserter(batch), 16)) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (int v : batch) {
+            if (v != expect) {
+                CHECK_EQ(v, expect);
+                expect = total;
+                break;
+            }
+            expect++;
+        }
+    }
+    producer.join();
+    CHECK(q.empty());
+}
+
+TEST(queue_bounded_threads)
+{
+    producerConsumer<QueueSync::Mutex>(100000);
+}
+
+TEST(queue_spsc)
+{
+    BoundedQueue<int, QueueSync::Spsc> q(5);
+
+    //rounded up to a power of two
+    CHECK_EQ(q.capacity(), 8u);
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 8; i++)
+            CHECK(q.try_push(round * 8 + i));
+        CHECK(!q.try_push(-1));
+        CHECK_EQ(q.size(), 8u);
+        for (int i = 0; i < 8; i++)
+            CHECK_EQ(*q.try_pop(), round * 8 + i);
+        CHECK(!q.try_pop());
+    }
+    producerConsumer<QueueSync::Spsc>(1000000);
+}
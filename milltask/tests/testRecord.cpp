@@ -0,0 +1,147 @@
+// EMCRecord, a recording played back gives the same commands in the
+// same cycles, see subsys/emcRecord.h
+#include "testMain.h"
+#include "emcRecord.h"
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const int kJoints = 3;
+const long kServoNs = 1000000;
+const long kTrajNs = 1000000;
+
+struct Seen {
+    uint64_t cycle;
+    uint32_t lane;
+    int command;
+};
+
+//The "controller": a cmd lane command moves joint 0 by its number
+void controller(emcmot_status_t &st, int moved)
+{
+    st.joint_status[0].pos_cmd += 0.001 * moved;
+    st.joint_status[1].pos_cmd += 0.0001;
+}
+
+} // namespace
+
+//Records 1000 cycles, returns what was recorded
+static std::vector<Seen> record(const std::string &path)
+{
+    static emcmot_status_t st;
+    std::vector<Seen> recorded;
+    emcmot_command_t cmd;
+
+    st = {};
+    CHECK_EQ(EMCRecord::StartRecord(path, &st, kJoints, kServoNs, kTrajNs), 0);
+    CHECK(EMCRecord::IsRecording());
+    for (int c = 0; c < 1000; c++) {
+        int moved = 0;
+        if (c % 7 == 0) {
+            cmd = {};
+            cmd.command = (cmd_code_t)c;
+            EMCRecord::Record(EMCRecord::kCmdLane, cmd);
+            recorded.push_back({(uint64_t)c, EMCRecord::kCmdLane, c});
+            moved = c;
+        }
+        controller(st, moved);
+        EMCRecord::Cycle(&st, kJoints);
+        if (c % 5 == 0) {
+            cmd = {};
+            cmd.command = (cmd_code_t)(c + 1);
+            EMCRecord::Record(EMCRecord::kMillLane, cmd);
+            recorded.push_back({(uint64_t)c + 1, EMCRecord::kMillLane, c + 1});
+        }
+    }
+    CHECK_EQ(EMCRecord::StopRecord(), 0);
+    EMCRecord::WaitClosed();
+    CHECK(!EMCRecord::IsRecording());
+    return recorded;
+}
+
+//Plays path back, drift moves joint 2 so the path differs
+static std::vector<Seen> replay(const std::string &path, double drift)
+{
+    static emcmot_status_t st;
+    std::vector<Seen> replayed;
+    emcmot_command_t cmd;
+    uint64_t cycle = 0;
+
+    st = {};
+    CHECK_EQ(EMCRecord::StartReplay(path, &st, kJoints, kServoNs, kTrajNs), 0);
+    CHECK(EMCRecord::IsReplaying());
+    while (!EMCRecord::ReplayDone()) {
+        int moved = 0;
+        while (!EMCRecord::NextReplay(EMCRecord::kCmdLane, cmd)) {
+            replayed.push_back({cycle, EMCRecord::kCmdLane, (int)cmd.command});
+            moved = cmd.command;
+        }
+        controller(st, moved);
+        st.joint_status[2].pos_cmd += drift;
+        EMCRecord::Cycle(&st, kJoints);
+        cycle++;
+        while (!EMCRecord::NextReplay(EMCRecord::kMillLane, cmd))
+            replayed.push_back({cycle, EMCRecord::kMillLane, (int)cmd.command});
+    }
+    EMCRecord::StopReplay(true);
+    CHECK(!EMCRecord::IsReplaying());
+    CHECK_EQ(cycle, 1000u);
+    return replayed;
+}
+
+TEST(record_round_trip)
+{
+    std::string path = TestMain::TempPath("record.bin");
+    std::vector<Seen> recorded = record(path);
+    std::vector<Seen> replayed = replay(path, 0.0);
+
+    //every command in the cycle and the lane it was taken in
+    CHECK_EQ(replayed.size(), recorded.size());
+    for (size_t i = 0; i < recorded.size() && i < replayed.size(); i++) {
+        if (replayed[i].cycle != recorded[i].cycle ||
+            replayed[i].lane != recorded[i].lane ||
+            replayed[i].command != recorded[i].command) {
+            TestMain::Fail(__FILE__, __LINE__, "command " + std::to_string(i) + " differs");
+            break;
+        }
+    }
+    CHECK(EMCRecord::Status().find(" matches") != std::string::npos);
+
+    //a path that moved shows in the digest
+    replay(path, 1e-6);
+    CHECK(EMCRecord::Status().find(" differs from ") != std::string::npos);
+}
+
+TEST(record_bad_files)
+{
+    static emcmot_status_t st;
+    std::string missing = TestMain::TempPath("missing.bin");
+    std::string junk = TestMain::TempPath("junk.bin");
+    std::string cut = TestMain::TempPath("cut.bin");
+
+    st = {};
+    CHECK(EMCRecord::StartReplay(missing, &st, kJoints, kServoNs, kTrajNs) != 0);
+
+    FILE *fp = fopen(junk.c_str(), "wb");
+    fputs("not a recording", fp);
+    fclose(fp);
+    CHECK(EMCRecord::StartReplay(junk, &st, kJoints, kServoNs, kTrajNs) != 0);
+
+    //without its end entry and trailer
+    record(cut);
+    fp = fopen(cut.c_str(), "rb");
+    std::vector<char> data;
+    char buf[4096];
+    size_t n;
+    while (fp && (n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    if (fp)
+        fclose(fp);
+    CHECK(data.size() > sizeof(EMCRecord::Trailer) + sizeof(EMCRecord::Entry));
+    fp = fopen(cut.c_str(), "wb");
+    fwrite(data.data(), 1, data.size() - sizeof(EMCRecord::Trailer), fp);
+    fclose(fp);
+    CHECK(EMCRecord::StartReplay(cut, &st, kJoints, kServoNs, kTrajNs) != 0);
+    CHECK(!EMCRecord::IsReplaying());
+}
@@ -0,0 +1,102 @@
+// MpscRing and CommandLane, see subsys/emcCmdRing.h
+#include "testMain.h"
+#include "emcCmdRing.h"
+#include <thread>
+#include <utility>
+#include <vector>
+
+TEST(ring_mpsc)
+{
+    MpscRing<int> ring(3);
+    int v;
+
+    CHECK_EQ(ring.capacity(), 4u);
+    CHECK(ring.front() == nullptr);
+    for (int i = 0; i < 4; i++)
+        CHECK(ring.try_push(i));
+    CHECK(!ring.try_push(4));
+    CHECK_EQ(ring.size(), 4u);
+    CHECK_EQ(*ring.front(), 0);
+    CHECK(ring.try_pop(v));
+    CHECK_EQ(v, 0);
+    CHECK(ring.try_push(4));
+    for (int i = 1; i <= 4; i++) {
+        CHECK(ring.try_pop(v));
+        CHECK_EQ(v, i);
+    }
+    CHECK(!ring.try_pop(v));
+    CHECK(ring.empty());
+}
+
+//every producer's commands arrive, each producer's in its order
+TEST(ring_mpsc_threads)
+{
+    const int producers = 4, each = 100000;
+    MpscRing<std::pair<int, int>> ring(256);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&ring, p] {
+            for (int i = 0; i < each; i++) {
+                while (!ring.try_push({p, i}))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<int> next(producers, 0);
+    int received = 0;
+    bool ordered = true;
+    std::pair<int, int> msg;
+    while (received < producers * each) {
+        if (!ring.try_pop(msg)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && msg.second == next[msg.first];
+        next[msg.first] = msg.second + 1;
+        received++;
+    }
+    for (auto &t : threads)
+        t.join();
+    CHECK(ordered);
+    CHECK(ring.empty());
+}
+
+TEST(ring_lane_spill)
+{
+    CommandLane<int> lane(4);
+    int v;
+
+    //more than the ring holds goes to the spill, in order
+    for (int i = 0; i < 20; i++)
+        lane.push(i);
+    CHECK_EQ(lane.size(), 20u);
+    for (int i = 0; i < 20; i++) {
+        CHECK(lane.try_pop(v));
+        CHECK_EQ(v, i);
+    }
+    CHECK(!lane.try_pop(v));
+    CHECK(lane.empty());
+}
+
+TEST(ring_lane_clear)
+{
+    CommandLane<int> lane(4);
+    int v;
+
+    for (int i = 0; i < 10; i++)
+        lane.push(i);
+    lane.clear();
+    lane.push(100);
+    CHECK(lane.try_pop(v));
+    CHECK_EQ(v, 100);
+    CHECK(!lane.try_pop(v));
+
+    //a push after the clear survives it, one before does not
+    lane.push(1);
+    lane.clear();
+    lane.push(2);
+    CHECK(lane.try_pop(v));
+    CHECK_EQ(v, 2);
+    CHECK(lane.empty());
+}
@@ -0,0 +1,90 @@
+// SCRIPT UNTIL conditions, CmdTask::CompileUntil()
+#include "testMain.h"
+#include "cmdtask.h"
+#include <sstream>
+
+struct CmdTaskTest {
+    using Step = CmdTask::ScriptStep;
+
+    static int Compile(const std::string &text, Step &step) {
+        std::istringstream in(text);
+        std::vector<std::string> args;
+        std::string arg;
+        while (in >> arg)
+            args.push_back(arg);
+        return CmdTask::CompileUntil(args, step);
+    }
+};
+
+using Step = CmdTaskTest::Step;
+
+static bool until(const std::string &text, Step::Var var, Step::Op op, double value)
+{
+    Step step;
+    if (CmdTaskTest::Compile(text, step)) {
+        TestMain::Fail(__FILE__, __LINE__, "UNTIL " + text + " not compiled");
+        return false;
+    }
+    return step.var == var && step.op == op && step.value == value;
+}
+
+TEST(script_until_ops)
+{
+    CHECK(until("TCQLEN == 0", Step::kTcqLen, Step::kEq, 0));
+    CHECK(until("TCQLEN = 0", Step::kTcqLen, Step::kEq, 0));
+    CHECK(until("TCQLEN != 3", Step::kTcqLen, Step::kNe, 3));
+    CHECK(until("TCQLEN < 10", Step::kTcqLen, Step::kLt, 10));
+    CHECK(until("TCQLEN <= 10", Step::kTcqLen, Step::kLe, 10));
+    CHECK(until("TCQLEN > 1.5", Step::kTcqLen, Step::kGt, 1.5));
+    CHECK(until("TCQLEN >= -2", Step::kTcqLen, Step::kGe, -2));
+    CHECK(until("ID>=7", Step::kId, Step::kGe, 7));
+    CHECK(until("STATE== 1", Step::kState, Step::kEq, 1));
+    CHECK(until("JOGGING =0", Step::kJogging, Step::kEq, 0));
+}
+
+TEST(script_until_flags)
+{
+    //LINE n waits for line n or later, INPOS and IDLE take no operand
+    CHECK(until("LINE 120", Step::kLine, Step::kGe, 120));
+    CHECK(until("LINE == 120", Step::kLine, Step::kEq, 120));
+    CHECK(until("INPOS", Step::kInpos, Step::kEq, 1));
+    CHECK(until("IDLE", Step::kIdle, Step::kEq, 1));
+}
+
+TEST(script_until_timeout)
+{
+    Step step;
+    CHECK_EQ(CmdTaskTest::Compile("IDLE", step), 0);
+    CHECK(step.timeout > 0);
+    CHECK_EQ(CmdTaskTest::Compile("IDLE TIMEOUT 2.5", step), 0);
+    CHECK_EQ(step.timeout, 2.5);
+    CHECK_EQ(CmdTaskTest::Compile("TCQLEN < 4 TIMEOUT 10", step), 0);
+    CHECK_EQ(step.timeout, 10.0);
+    CHECK_EQ(step.value, 4.0);
+}
+
+TEST(script_until_errors)
+{
+    const char *bad[] = {
+        "",
+        "SPEED > 1",
+        "TCQLEN",
+        "TCQLEN 3",
+        "TCQLEN ==",
+        "TCQLEN == x",
+        "TCQLEN == 3x",
+        "LINE",
+        "INPOS 1",
+        "IDLE == 1",
+        "IDLE TIMEOUT",
+        "IDLE TIMEOUT 0",
+        "IDLE TIMEOUT -1",
+        "IDLE TIMEOUT 1s",
+        "IDLE TIMEOUT 1 2",
+    };
+    for (const char *text : bad) {
+        Step step;
+        if (CmdTaskTest::Compile(text, step) == 0)
+            TestMain::Fail(__FILE__, __LINE__, std::string("UNTIL ") + text + " compiled");
+    }
+}
@@ -781,10 +781,14 @@ void MainWindow::setCmdLogDock()
 
         logTimer->start(100);
         connect (logTimer, &QTimer::timeout, this, [this] {
+            millIf_->traceBegin("logTimer");
             std::string log;
-            QString timeStr = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss ");
             int level = 0;
-            while (millIf_->getlog(log, level) == 0) {
+            long long timeNs = 0;
+            while (millIf_->getlog(log, level, timeNs) == 0) {
+                //the time the line was logged, not when it is shown
+                QString timeStr = QDateTime::fromMSecsSinceEpoch(timeNs / 1000000)
+                    .toString("yyyy-MM-dd hh:mm:ss.zzz ");
                 if (level == 0)
                     logDisplayWidget->appendLog(timeStr + QString::fromStdString(log));
                 else if (level == 1)
@@ -794,6 +798,7 @@ void MainWindow::setCmdLogDock()
                 else if (level == 3)
                     cmdTextEdit->appendOutput(QString::fromStdString(log));
             }
+            millIf_->traceEnd("logTimer");
         });
 
         // Resize the dock widget
@@ -825,6 +830,7 @@ void MainWindow::setKeyInfoDock()
         int oneThirdWidth = screenGeometry.width() / 3;
 
         connect(infoTimer, &QTimer::timeout, this, [this] {
+            millIf_->traceBegin("infoTimer");
             QVector<double> posVec;
             auto path = millIf_->getCarteCmdPos();
             posVec << path.x << path.y << path.z <<
@@ -864,19 +870,22 @@ void MainWindow::setKeyInfoDock()
             keyInfoDisplayWidget->updateJogging(
                         millIf_->isJoggingActive());
 
-            int state = 0;
-            millIf_->getMotionState(state);
-            keyInfoDisplayWidget->updateState(state);
+            //state and flags are only read again after they changed
+            if (millIf_->getStatusChanges(statusGen_) & IMillTaskInterface::kStatusChgMotion) {
+                int state = 0;
+                millIf_->getMotionState(state);
+                keyInfoDisplayWidget->updateState(state);
 
-            int flag = 0;
-            millIf_->getMotionFlag(flag);
-            keyInfoDisplayWidget->updateMotionFlag(flag);
+                int flag = 0;
+                millIf_->getMotionFlag(flag);
+                keyInfoDisplayWidget->updateMotionFlag(flag);
+            }
 
             state_tag_t tag;
             millIf_->getStateTag(tag);
             keyInfoDisplayWidget->updateTag(tag);
 
-
+            millIf_->traceEnd("infoTimer");
         });
 
         infoTimer->start(100);
@@ -147,6 +147,7 @@ private:
     QDockWidget *keyInfoDisplayDock = nullptr;
     KeyInfoDisplayWidget *keyInfoDisplayWidget = nullptr;
     QTimer *infoTimer = nullptr;
+    unsigned int statusGen_ = 0;    //motion status generation shown
     void setKeyInfoDock();
 
     bool ncPathOnly = true;